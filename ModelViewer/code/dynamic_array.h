@@ -1,5 +1,13 @@
 #pragma once
 #include <stdint.h>
+#include <string.h>
+#include <new>
+#include <type_traits>
+#include "model_viewer_memory.h"
+
+// NOTE(georgy): Entries live in Arena if it's set, otherwise on the heap. Trivially copyable entries grow with
+// realloc/memcpy, anything else is moved one by one. An array can be moved but not copied, a copy would free
+// the same entries twice.
 
 template<typename T>
 struct dynamic_array
@@ -7,6 +15,8 @@ struct dynamic_array
 	uint32_t MaxEntriesCount;
 	uint32_t EntriesCount;
 	T* Entries;
+	// NOTE(georgy): 0 for the heap. Entries in an arena are never freed, they go when the arena's temporary memory ends.
+	memory_arena* Arena;
 
     T &operator[](int32_t Index);
 
@@ -15,20 +25,33 @@ struct dynamic_array
 		InitializeDynamicArray(this);
     }
 
-	dynamic_array(uint32_t InitialMaxEntriesCount)
+	dynamic_array(uint32_t InitialMaxEntriesCount, memory_arena* Arena = 0)
 	{
-		InitializeDynamicArray(this, InitialMaxEntriesCount);
+		InitializeDynamicArray(this, InitialMaxEntriesCount, Arena);
 	}
 
-    ~dynamic_array()
+    dynamic_array(dynamic_array &&Other)
+    {
+        InitializeDynamicArray(this);
+        SwapDynamicArrays(this, &Other);
+    }
+
+    dynamic_array &operator=(dynamic_array &&Other)
     {
-        MaxEntriesCount = 0;
-        EntriesCount = 0;
-        if(Entries)
+        if(this != &Other)
         {
-            free(Entries);
-            Entries = 0;
+            FreeDynamicArray(this);
+            SwapDynamicArrays(this, &Other);
         }
+        return(*this);
+    }
+
+    dynamic_array(const dynamic_array &Other) = delete;
+    dynamic_array &operator=(const dynamic_array &Other) = delete;
+
+    ~dynamic_array()
+    {
+        FreeDynamicArray(this);
     }
 };
 
@@ -39,11 +62,33 @@ T &dynamic_array<T>::operator[](int32_t Index)
 }
 
 template<typename T>
-void InitializeDynamicArray(dynamic_array<T> *Array, uint32_t InitialMaxEntriesCount = 0)
+T *AllocateDynamicArrayEntries(dynamic_array<T> *Array, uint32_t Count)
+{
+    T *Result = Array->Arena ? PushArray(Array->Arena, Count, T) : (T *)MemoryAlloc(Count*sizeof(T));
+    return(Result);
+}
+
+template<typename T>
+void InitializeDynamicArray(dynamic_array<T> *Array, uint32_t InitialMaxEntriesCount = 0, memory_arena *Arena = 0)
 {
     Array->MaxEntriesCount = InitialMaxEntriesCount;
     Array->EntriesCount = 0;
-    Array->Entries = (Array->MaxEntriesCount > 0) ? (T *)malloc(Array->MaxEntriesCount*sizeof(T)) : 0;
+    Array->Arena = Arena;
+    Array->Entries = (Array->MaxEntriesCount > 0) ? AllocateDynamicArrayEntries(Array, Array->MaxEntriesCount) : 0;
+}
+
+template<typename T>
+void DestroyDynamicArrayEntries(T *Entries, uint32_t First, uint32_t OnePastLast)
+{
+    if(!std::is_trivially_destructible<T>::value)
+    {
+        for(uint32_t EntryIndex = First;
+            EntryIndex < OnePastLast;
+            EntryIndex++)
+        {
+            Entries[EntryIndex].~T();
+        }
+    }
 }
 
 template<typename T>
@@ -61,15 +106,46 @@ void ExpandDynamicArray(dynamic_array<T> *Array, uint32_t ExactMaxEntriesCount =
 
     if(NewMaxEntriesCount > Array->MaxEntriesCount)
     {
-        T *NewMemory = static_cast<T *>(malloc(NewMaxEntriesCount*sizeof(T)));
-        for(uint32_t EntryIndex = 0;
-            EntryIndex < Array->EntriesCount;
-            EntryIndex++)
+        // NOTE(georgy): The last push of an arena grows where it is
+        if(Array->Arena && Array->Entries &&
+           ExtendArenaBlock(Array->Arena, Array->Entries, Array->MaxEntriesCount*sizeof(T), NewMaxEntriesCount*sizeof(T)))
         {
-            NewMemory[EntryIndex] = Array->Entries[EntryIndex];
+            Array->MaxEntriesCount = NewMaxEntriesCount;
+            return;
         }
 
-        free(Array->Entries);
+        T *NewMemory;
+        if(std::is_trivially_copyable<T>::value)
+        {
+            if(!Array->Arena)
+            {
+                NewMemory = (T *)MemoryRealloc(Array->Entries, NewMaxEntriesCount*sizeof(T));
+            }
+            else
+            {
+                NewMemory = AllocateDynamicArrayEntries(Array, NewMaxEntriesCount);
+                if(Array->EntriesCount)
+                {
+                    memcpy((void *)NewMemory, Array->Entries, Array->EntriesCount*sizeof(T));
+                }
+            }
+        }
+        else
+        {
+            NewMemory = AllocateDynamicArrayEntries(Array, NewMaxEntriesCount);
+            for(uint32_t EntryIndex = 0;
+                EntryIndex < Array->EntriesCount;
+                EntryIndex++)
+            {
+                new(&NewMemory[EntryIndex]) T(static_cast<T &&>(Array->Entries[EntryIndex]));
+            }
+            DestroyDynamicArrayEntries(Array->Entries, 0, Array->EntriesCount);
+
+            if(!Array->Arena)
+            {
+                MemoryFree(Array->Entries);
+            }
+        }
         Array->MaxEntriesCount = NewMaxEntriesCount;
         Array->Entries = NewMemory;
     }
@@ -83,7 +159,53 @@ void PushEntry(dynamic_array<T> *Array, T Entry)
         ExpandDynamicArray(Array);
     }
 
-    Array->Entries[Array->EntriesCount++] = Entry;
+    new(&Array->Entries[Array->EntriesCount++]) T(static_cast<T &&>(Entry));
+}
+
+template<typename T>
+void ReserveDynamicArray(dynamic_array<T> *Array, uint32_t NewMaxEntriesCount)
+{
+    if(NewMaxEntriesCount > Array->MaxEntriesCount)
+    {
+        ExpandDynamicArray(Array, NewMaxEntriesCount);
+    }
+}
+
+// NOTE(georgy): Room for at least MinMaxEntriesCount, doubling when that's more
+template<typename T>
+void GrowDynamicArray(dynamic_array<T> *Array, uint32_t MinMaxEntriesCount)
+{
+    if(MinMaxEntriesCount > Array->MaxEntriesCount)
+    {
+        uint32_t Doubled = 2*Array->MaxEntriesCount;
+        ExpandDynamicArray(Array, (Doubled > MinMaxEntriesCount) ? Doubled : MinMaxEntriesCount);
+    }
+}
+
+// NOTE(georgy): Source can't point into Array, growing may move it
+template<typename T>
+void PushEntries(dynamic_array<T> *Array, const T *Source, uint32_t Count)
+{
+    GrowDynamicArray(Array, Array->EntriesCount + Count);
+
+    T *Dest = Array->Entries + Array->EntriesCount;
+    if(std::is_trivially_copyable<T>::value)
+    {
+        if(Count)
+        {
+            memcpy((void *)Dest, Source, Count*sizeof(T));
+        }
+    }
+    else
+    {
+        for(uint32_t EntryIndex = 0;
+            EntryIndex < Count;
+            EntryIndex++)
+        {
+            new(&Dest[EntryIndex]) T(Source[EntryIndex]);
+        }
+    }
+    Array->EntriesCount += Count;
 }
 
 template<typename T>
@@ -91,23 +213,58 @@ void ResizeDynamicArray(dynamic_array<T> *Array, uint32_t NewEntriesCount)
 {
     if(NewEntriesCount > Array->EntriesCount)
     {
-        while(NewEntriesCount > Array->EntriesCount)
+        GrowDynamicArray(Array, NewEntriesCount);
+        for(uint32_t EntryIndex = Array->EntriesCount;
+            EntryIndex < NewEntriesCount;
+            EntryIndex++)
         {
-			T Entry = {};
-            PushEntry(Array, Entry);
+            new(&Array->Entries[EntryIndex]) T();
         }
     }
-    else if(NewEntriesCount < Array->EntriesCount)
+    else
     {
-        Array->EntriesCount = NewEntriesCount;
+        DestroyDynamicArrayEntries(Array->Entries, NewEntriesCount, Array->EntriesCount);
     }
+    Array->EntriesCount = NewEntriesCount;
 }
 
+// NOTE(georgy): New entries hold whatever was in memory, the caller writes every one of them
 template<typename T>
-void ReserveDynamicArray(dynamic_array<T> *Array, uint32_t NewMaxEntriesCount)
+void ResizeDynamicArrayUninitialized(dynamic_array<T> *Array, uint32_t NewEntriesCount)
 {
-    if(NewMaxEntriesCount > Array->MaxEntriesCount)
+    static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable entries can be left uninitialized");
+
+    GrowDynamicArray(Array, NewEntriesCount);
+    Array->EntriesCount = NewEntriesCount;
+}
+
+template<typename T>
+void FreeDynamicArray(dynamic_array<T> *Array)
+{
+    DestroyDynamicArrayEntries(Array->Entries, 0, Array->EntriesCount);
+    if(!Array->Arena)
     {
-        ExpandDynamicArray(Array, NewMaxEntriesCount);
+        MemoryFree(Array->Entries);
     }
-}
\ No newline at end of file
+    Array->Entries = 0;
+    Array->MaxEntriesCount = 0;
+    Array->EntriesCount = 0;
+}
+template<typename T>
+void SwapDynamicArrays(dynamic_array<T> *A, dynamic_array<T> *B)
+{
+    uint32_t MaxEntriesCount = A->MaxEntriesCount;
+    uint32_t EntriesCount = A->EntriesCount;
+    T *Entries = A->Entries;
+    memory_arena *Arena = A->Arena;
+
+    A->MaxEntriesCount = B->MaxEntriesCount;
+    A->EntriesCount = B->EntriesCount;
+    A->Entries = B->Entries;
+    A->Arena = B->Arena;
+
+    B->MaxEntriesCount = MaxEntriesCount;
+    B->EntriesCount = EntriesCount;
+    B->Entries = Entries;
+    B->Arena = Arena;
+}
@@ -1,93 +1,177 @@
 #include <GL/glew.h>
 #include "model_viewer_platform_common.h"
+#include "model_viewer_memory.h"
 #include "model_viewer_math.h"
 #include "model_viewer_shader.h"
+#include "model_viewer_frame_constants.h"
 
+// NOTE(georgy): Decoded images are tagged with whatever scope decodes them
+#define STBI_MALLOC(Size) MemoryAlloc(Size)
+#define STBI_REALLOC(Memory, Size) MemoryRealloc(Memory, Size)
+#define STBI_FREE(Memory) MemoryFree(Memory)
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
 #include <assimp/cimport.h>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <assimp/Importer.hpp>
 
-#include <nfd.h>
+#include <atomic>
 
-#define INVALID_TEXTURE 0xFFFFFFFF
-#define MAX_PATH 260
+#include <nfd.h>
 
-static GLuint
-LoadTexture(const char* Path)
+static mat4 
+Mat4FromAssimp(const aiMatrix4x4 &AssimpMatrix)
 {
-	GLuint TextureID;
-	glGenTextures(1, &TextureID);
-
-	int Width, Height, Channels;
-	stbi_uc* Data = stbi_load(Path, &Width, &Height, &Channels, 0);
-	if (Data)
-	{
-		GLenum Format;
-		if (Channels == 1) Format = GL_RED;
-		else if (Channels == 3) Format = GL_RGB;
-		else if (Channels == 4) Format = GL_RGBA;
-
-		glBindTexture(GL_TEXTURE_2D, TextureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, Format, Width, Height, 0, Format, GL_UNSIGNED_BYTE, Data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	}
-	else
-	{
-		TextureID = INVALID_TEXTURE;
-		Assert(!"INVALID TEXTURE");
-	}
+	mat4 Result;
 
-	stbi_image_free(Data);
+	Result.a11 = AssimpMatrix.a1; Result.a21 = AssimpMatrix.b1; Result.a31 = AssimpMatrix.c1; Result.a41 = AssimpMatrix.d1;
+	Result.a12 = AssimpMatrix.a2; Result.a22 = AssimpMatrix.b2; Result.a32 = AssimpMatrix.c2; Result.a42 = AssimpMatrix.d2;
+	Result.a13 = AssimpMatrix.a3; Result.a23 = AssimpMatrix.b3; Result.a33 = AssimpMatrix.c3; Result.a43 = AssimpMatrix.d3;
+	Result.a14 = AssimpMatrix.a4; Result.a24 = AssimpMatrix.b4; Result.a34 = AssimpMatrix.c4; Result.a44 = AssimpMatrix.d4;
 
-	return(TextureID);
+	return(Result);
 }
 
 struct mesh
 {
 	uint32_t BaseVertex;
 	uint32_t BaseIndex;
+	uint32_t VertexCount;
 	uint32_t IndexCount;
 	uint32_t MaterialIndex;
+	uint32_t ShaderFeatures;
+	aabb AABB;
+
+	uint64_t ContentHash;
 };
 
 #include "dynamic_array.h"
+#include "model_viewer_profiler.h"
+#include "model_viewer_animation.h"
+#include "model_viewer_culling.h"
+#include "model_viewer_bvh.h"
+#include "model_viewer_occlusion.h"
+#include "model_viewer_crowd.h"
+#include "model_viewer_morph.h"
+#include "model_viewer_file_watcher.h"
+#include "model_viewer_render.h"
+#include "model_viewer_texture_array.h"
+#include "model_viewer_software.h"
+#include "model_viewer_load_benchmark.h"
+#include "model_viewer_math_benchmark.h"
 
 enum vbo_type
 {
 	Pos_VBO,
 	Normal_VBO,
 	TexCoord_VBO,
+	Skin_VBO,
+	Material_VBO,
 	Index_VBO,
 
 	Count_VBO
 };
+
+struct model_texture
+{
+	char Path[MAX_PATH];
+	uint32_t Watch;
+};
+
 struct model
 {
 	GLuint VAO;
 	GLuint VBOs[Count_VBO];
 
 	dynamic_array<mesh> Meshes;
-	dynamic_array<GLuint> Textures;
+	dynamic_array<material_texture> Materials;
+	dynamic_array<model_texture> TextureFiles;
+	texture_array TextureArray;
+
+	// NOTE(georgy): Mesh AABBs in the vertex space, as center/extent
+	cull_bounds MeshBounds;
+
+	// NOTE(georgy): CPU copy of the geometry for the BVH and the software renderer
+	dynamic_array<vec3> Positions;
+	dynamic_array<vec2> TexCoords;
+	dynamic_array<uint32_t> Indices;
+	scene_bvh BVH;
+
+	animation_set Animation;
+	morph_set Morph;
 
 	aabb AABB;
 	mat4 RootTransform;
+
+	char FilePath[MAX_PATH];
+	uint32_t FileWatch;
+	uint32_t VertexCount;
+	uint32_t IndexCount;
+};
+
+// NOTE(georgy): CPU side of an import, kept around only until it is uploaded
+struct model_geometry
+{
+	dynamic_array<mesh> Meshes;
+	dynamic_array<vec3> Positions;
+	dynamic_array<vec3> Normals;
+	dynamic_array<vec2> TexCoords;
+	dynamic_array<uint32_t> Indices;
+	dynamic_array<vertex_skin> Skins;
+
+	uint32_t VertexCount;
+	uint32_t IndexCount;
+};
+
+struct shader_watch
+{
+	shader* Shader;
+	uint32_t VSWatch;
+	uint32_t FSWatch;
 };
 
+// NOTE(georgy): The frame arena starts over every frame, the scratch arena is for imports. Both are in temporary storage.
+#define FRAME_ARENA_SIZE Megabytes(64)
+
 struct game_state
 {
 	bool IsInitialized;
 
-	shader DefaultShader;
+	memory_arena FrameArena;
+	memory_arena ScratchArena;
+
+	shader_permutations DefaultShaders;
+	uniform_ring FrameConstants;
+
+	gl_state_cache StateCache;
+	dynamic_array<draw_command> DrawList;
+	dynamic_array<uint8_t> MeshVisibility;
+	occlusion_buffer Occlusion;
+
+	bool UseMultiDrawIndirect;
+	GLuint IndirectBuffer;
+	dynamic_array<draw_elements_indirect_command> IndirectCommands;
 
 	model Model;
+	crowd Crowd;
+
+	bool UseSoftwareRenderer;
+	software_renderer Software;
+
+	// NOTE(georgy): Matrices of the last model frame, picking works on what was on screen
+	bool CanPick;
+	mat4 PickProjection;
+	mat4 PickView;
+	mat4 PickModel;
+	pick_result LastPick;
+
+	float CrowdTime;
+	float AnimationTime;
+
+	file_watcher FileWatcher;
+	dynamic_array<shader_watch> ShaderWatches;
 };
 
 static void
@@ -106,193 +190,1666 @@ Concatenate(char* Dest, char* SrcA, uint32_t SrcALength, char* SrcB, uint32_t Sr
 	*Dest = 0;
 }
 
-static mat4 
-Mat4FromAssimp(const aiMatrix4x4 &AssimpMatrix)
+static void
+ExtractGeometry(const aiScene* Scene, model_geometry* Geometry)
 {
-	mat4 Result;
+	PROFILE_ZONE("ExtractGeometry");
 
-	Result.a11 = AssimpMatrix.a1; Result.a21 = AssimpMatrix.b1; Result.a31 = AssimpMatrix.c1; Result.a41 = AssimpMatrix.d1;
-	Result.a12 = AssimpMatrix.a2; Result.a22 = AssimpMatrix.b2; Result.a32 = AssimpMatrix.c2; Result.a42 = AssimpMatrix.d2;
-	Result.a13 = AssimpMatrix.a3; Result.a23 = AssimpMatrix.b3; Result.a33 = AssimpMatrix.c3; Result.a43 = AssimpMatrix.d3;
-	Result.a14 = AssimpMatrix.a4; Result.a24 = AssimpMatrix.b4; Result.a34 = AssimpMatrix.c4; Result.a44 = AssimpMatrix.d4;
+	ResizeDynamicArray(&Geometry->Meshes, Scene->mNumMeshes);
 
-	return(Result);
+	uint32_t VertexCount = 0;
+	uint32_t IndexCount = 0;
+	for (uint32_t MeshIndex = 0;
+		MeshIndex < Geometry->Meshes.EntriesCount;
+		MeshIndex++)
+	{
+		Geometry->Meshes[MeshIndex].BaseVertex = VertexCount;
+		Geometry->Meshes[MeshIndex].BaseIndex = IndexCount;
+		Geometry->Meshes[MeshIndex].VertexCount = Scene->mMeshes[MeshIndex]->mNumVertices;
+		Geometry->Meshes[MeshIndex].IndexCount = 3 * Scene->mMeshes[MeshIndex]->mNumFaces;
+		Geometry->Meshes[MeshIndex].MaterialIndex = Scene->mMeshes[MeshIndex]->mMaterialIndex;
+		Geometry->Meshes[MeshIndex].ShaderFeatures =
+			(Scene->mMeshes[MeshIndex]->HasTextureCoords(0) ? ShaderFeature_TexCoords : 0) |
+			(Scene->mMeshes[MeshIndex]->HasBones() ? ShaderFeature_Skinned : 0);
+
+		VertexCount += Scene->mMeshes[MeshIndex]->mNumVertices;
+		IndexCount += Geometry->Meshes[MeshIndex].IndexCount;
+	}
+	Geometry->VertexCount = VertexCount;
+	Geometry->IndexCount = IndexCount;
+
+	// NOTE(georgy): Every entry is written below, at the offsets the meshes got above
+	ResizeDynamicArrayUninitialized(&Geometry->Positions, VertexCount);
+	ResizeDynamicArrayUninitialized(&Geometry->Normals, VertexCount);
+	ResizeDynamicArrayUninitialized(&Geometry->TexCoords, VertexCount);
+	ResizeDynamicArrayUninitialized(&Geometry->Indices, IndexCount);
+
+	for (uint32_t MeshIndex = 0;
+		MeshIndex < Geometry->Meshes.EntriesCount;
+		MeshIndex++)
+	{
+		const aiMesh* AssimpMesh = Scene->mMeshes[MeshIndex];
+		mesh* Mesh = &Geometry->Meshes[MeshIndex];
+
+		vec3* Positions = &Geometry->Positions[Mesh->BaseVertex];
+		vec3* Normals = &Geometry->Normals[Mesh->BaseVertex];
+		vec2* TexCoords = &Geometry->TexCoords[Mesh->BaseVertex];
+		for (uint32_t VertexIndex = 0;
+			VertexIndex < AssimpMesh->mNumVertices;
+			VertexIndex++)
+		{
+			const aiVector3D Pos = AssimpMesh->mVertices[VertexIndex];
+			const aiVector3D Normal = AssimpMesh->HasNormals() ? AssimpMesh->mNormals[VertexIndex] : aiVector3D(0.0f);
+			const aiVector3D TexCoord = AssimpMesh->HasTextureCoords(0) ? AssimpMesh->mTextureCoords[0][VertexIndex] : aiVector3D(0.0f);
+
+			Positions[VertexIndex] = vec3(Pos.x, Pos.y, Pos.z);
+			Normals[VertexIndex] = vec3(Normal.x, Normal.y, Normal.z);
+			TexCoords[VertexIndex] = vec2(TexCoord.x, TexCoord.y);
+		}
+		Mesh->AABB = AABBFromVertices(AssimpMesh->mNumVertices, Positions);
+
+		uint32_t* Indices = &Geometry->Indices[Mesh->BaseIndex];
+		for (uint32_t FaceIndex = 0;
+			FaceIndex < AssimpMesh->mNumFaces;
+			FaceIndex++)
+		{
+			const aiFace Face = AssimpMesh->mFaces[FaceIndex];
+			Assert(Face.mNumIndices == 3);
+
+			Indices[3*FaceIndex + 0] = Face.mIndices[0];
+			Indices[3*FaceIndex + 1] = Face.mIndices[1];
+			Indices[3*FaceIndex + 2] = Face.mIndices[2];
+		}
+	}
 }
 
-void
-UpdateAndRender(game_memory* Memory, game_input* Input, uint32_t BufferWidth, uint32_t BufferHeight)
+static void
+HashMeshContents(model_geometry* Geometry)
 {
-	Assert(sizeof(game_state) < Memory->PermanentStorageSize);
-	game_state* GameState = (game_state*)Memory->PermanentStorage;
-	if (!GameState->IsInitialized)
+	for (uint32_t MeshIndex = 0;
+		MeshIndex < Geometry->Meshes.EntriesCount;
+		MeshIndex++)
 	{
-		GameState->DefaultShader = shader("shaders\\DefaultVS.glsl", "shaders\\DefaultFS.glsl");
+		mesh* Mesh = &Geometry->Meshes[MeshIndex];
 
-		model* Model = &GameState->Model;
+		uint64_t Hash = HashBytes(&Geometry->Positions[Mesh->BaseVertex], sizeof(vec3) * Mesh->VertexCount);
+		Hash = HashBytes(&Geometry->Normals[Mesh->BaseVertex], sizeof(vec3) * Mesh->VertexCount, Hash);
+		Hash = HashBytes(&Geometry->TexCoords[Mesh->BaseVertex], sizeof(vec2) * Mesh->VertexCount, Hash);
+		Hash = HashBytes(&Geometry->Indices[Mesh->BaseIndex], sizeof(uint32_t) * Mesh->IndexCount, Hash);
+		if (Geometry->Skins.EntriesCount > 0)
+		{
+			Hash = HashBytes(&Geometry->Skins[Mesh->BaseVertex], sizeof(vertex_skin) * Mesh->VertexCount, Hash);
+		}
+		Hash = HashBytes(&Mesh->MaterialIndex, sizeof(Mesh->MaterialIndex), Hash);
+
+		Mesh->ContentHash = Hash;
+	}
+}
+
+static void
+InitializeModel(model* Model)
+{
+	glGenVertexArrays(1, &Model->VAO);
+	glGenBuffers(ArrayCount(Model->VBOs), Model->VBOs);
+	glBindVertexArray(Model->VAO);
+
+	glBindBuffer(GL_ARRAY_BUFFER, Model->VBOs[Pos_VBO]);
+	glEnableVertexAttribArray(Pos_VBO);
+	glVertexAttribPointer(Pos_VBO, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, Model->VBOs[Normal_VBO]);
+	glEnableVertexAttribArray(Normal_VBO);
+	glVertexAttribPointer(Normal_VBO, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, Model->VBOs[TexCoord_VBO]);
+	glEnableVertexAttribArray(TexCoord_VBO);
+	glVertexAttribPointer(TexCoord_VBO, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+
+	// NOTE(georgy): One entry per material, a draw selects its material through the base instance.
+	// Without base instance support the attributes stay disabled and every draw sets them as constants.
+	if (GLEW_ARB_base_instance)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, Model->VBOs[Material_VBO]);
+		glEnableVertexAttribArray(MaterialUVTransform_Attribute);
+		glVertexAttribPointer(MaterialUVTransform_Attribute, 4, GL_FLOAT, GL_FALSE, sizeof(material_texture), (void*)OffsetOf(material_texture, UVTransform));
+		glVertexAttribDivisor(MaterialUVTransform_Attribute, 1);
+		glEnableVertexAttribArray(MaterialLayer_Attribute);
+		glVertexAttribPointer(MaterialLayer_Attribute, 2, GL_FLOAT, GL_FALSE, sizeof(material_texture), (void*)OffsetOf(material_texture, Layer));
+		glVertexAttribDivisor(MaterialLayer_Attribute, 1);
+	}
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Model->VBOs[Index_VBO]);
+
+	glBindVertexArray(0);
+
+	InitializeDynamicArray(&Model->Meshes);
+	InitializeDynamicArray(&Model->Materials);
+	InitializeDynamicArray(&Model->TextureFiles);
+	Model->FileWatch = NO_FILE_WATCH;
+}
+
+static void
+UploadBufferRange(GLenum Target, GLuint Buffer, uint32_t ElementSize, uint32_t First, uint32_t Count, void* Data)
+{
+	glBindBuffer(Target, Buffer);
+	glBufferSubData(Target, (GLintptr)ElementSize * First, (GLsizeiptr)ElementSize * Count, (uint8_t*)Data + (size_t)ElementSize * First);
+}
 
-		glGenVertexArrays(1, &Model->VAO);
-		glGenBuffers(ArrayCount(Model->VBOs), Model->VBOs);
-		glBindVertexArray(Model->VAO);
+// NOTE(georgy): When the reimported model has the same mesh layout, only the vertex and index ranges of meshes
+// whose content hash changed are uploaded. Anything else is a full upload.
+static void
+UploadGeometry(model* Model, model_geometry* Geometry, bool Incremental)
+{
+	PROFILE_ZONE("UploadGeometry");
 
-		char* ModelFilePath = 0;
-		nfdresult_t result = NFD_OpenDialog(0, 0, &ModelFilePath);
+	bool SameLayout = Incremental &&
+		(Geometry->Meshes.EntriesCount == Model->Meshes.EntriesCount) &&
+		(Geometry->VertexCount == Model->VertexCount) && (Geometry->IndexCount == Model->IndexCount);
+	for (uint32_t MeshIndex = 0; SameLayout && (MeshIndex < Geometry->Meshes.EntriesCount); MeshIndex++)
+	{
+		mesh* Old = &Model->Meshes[MeshIndex];
+		mesh* New = &Geometry->Meshes[MeshIndex];
+		SameLayout = (Old->BaseVertex == New->BaseVertex) && (Old->VertexCount == New->VertexCount) &&
+					 (Old->BaseIndex == New->BaseIndex) && (Old->IndexCount == New->IndexCount);
+	}
 
-		char* LastSlash = 0;
-		for (char* C = ModelFilePath; *C != 0; C++)
+	if (SameLayout)
+	{
+		uint32_t ChangedMeshes = 0;
+		uint64_t UploadedBytes = 0;
+		for (uint32_t MeshIndex = 0;
+			MeshIndex < Geometry->Meshes.EntriesCount;
+			MeshIndex++)
 		{
-			if (*C == '\\')
+			mesh* Mesh = &Geometry->Meshes[MeshIndex];
+			if (Mesh->ContentHash == Model->Meshes[MeshIndex].ContentHash)
+			{
+				continue;
+			}
+
+			UploadBufferRange(GL_ARRAY_BUFFER, Model->VBOs[Pos_VBO], sizeof(vec3), Mesh->BaseVertex, Mesh->VertexCount, Geometry->Positions.Entries);
+			UploadBufferRange(GL_ARRAY_BUFFER, Model->VBOs[Normal_VBO], sizeof(vec3), Mesh->BaseVertex, Mesh->VertexCount, Geometry->Normals.Entries);
+			UploadBufferRange(GL_ARRAY_BUFFER, Model->VBOs[TexCoord_VBO], sizeof(vec2), Mesh->BaseVertex, Mesh->VertexCount, Geometry->TexCoords.Entries);
+			UploadBufferRange(GL_ELEMENT_ARRAY_BUFFER, Model->VBOs[Index_VBO], sizeof(uint32_t), Mesh->BaseIndex, Mesh->IndexCount, Geometry->Indices.Entries);
+			UploadedBytes += (2 * sizeof(vec3) + sizeof(vec2)) * Mesh->VertexCount + sizeof(uint32_t) * Mesh->IndexCount;
+			if (Geometry->Skins.EntriesCount > 0)
 			{
-				LastSlash = C;
+				UploadBufferRange(GL_ARRAY_BUFFER, Model->VBOs[Skin_VBO], sizeof(vertex_skin), Mesh->BaseVertex, Mesh->VertexCount, Geometry->Skins.Entries);
+				UploadedBytes += sizeof(vertex_skin) * Mesh->VertexCount;
 			}
+
+			ChangedMeshes++;
 		}
-		uint32_t ModelDirLengthWithLastSlash = (uint32_t)(LastSlash - ModelFilePath) + 1;
 
-		const aiScene* Scene = aiImportFile(ModelFilePath,
-			aiProcess_Triangulate | aiProcess_GenSmoothNormals |
-			aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices);
-		if (Scene)
+		printf("Model reloaded: %u of %u meshes changed, %.2f MB uploaded\n",
+			ChangedMeshes, Geometry->Meshes.EntriesCount, (float)UploadedBytes / (float)Megabytes(1));
+	}
+	else
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, Model->VBOs[Pos_VBO]);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(vec3) * Geometry->Positions.EntriesCount, Geometry->Positions.Entries, GL_STATIC_DRAW);
+
+		glBindBuffer(GL_ARRAY_BUFFER, Model->VBOs[Normal_VBO]);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(vec3) * Geometry->Normals.EntriesCount, Geometry->Normals.Entries, GL_STATIC_DRAW);
+
+		glBindBuffer(GL_ARRAY_BUFFER, Model->VBOs[TexCoord_VBO]);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(vec2) * Geometry->TexCoords.EntriesCount, Geometry->TexCoords.Entries, GL_STATIC_DRAW);
+
+		if (Geometry->Skins.EntriesCount > 0)
 		{
-			Model->RootTransform = Mat4FromAssimp(Scene->mRootNode->mTransformation);
+			glBindBuffer(GL_ARRAY_BUFFER, Model->VBOs[Skin_VBO]);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_skin) * Geometry->Skins.EntriesCount, Geometry->Skins.Entries, GL_STATIC_DRAW);
+		}
 
-			InitializeDynamicArray(&Model->Meshes);
-			InitializeDynamicArray(&Model->Textures);
-			ResizeDynamicArray(&Model->Meshes, Scene->mNumMeshes);
-			ResizeDynamicArray(&Model->Textures, Scene->mNumMaterials);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Model->VBOs[Index_VBO]);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * Geometry->Indices.EntriesCount, Geometry->Indices.Entries, GL_STATIC_DRAW);
 
-			uint32_t VertexCount = 0;
-			uint32_t IndexCount = 0;
-			for (uint32_t MeshIndex = 0;
-				MeshIndex < Model->Meshes.EntriesCount;
-				MeshIndex++)
-			{
-				Model->Meshes[MeshIndex].BaseVertex = VertexCount;
-				Model->Meshes[MeshIndex].BaseIndex = IndexCount;
-				Model->Meshes[MeshIndex].IndexCount = 3 * Scene->mMeshes[MeshIndex]->mNumFaces;
-				Model->Meshes[MeshIndex].MaterialIndex = Scene->mMeshes[MeshIndex]->mMaterialIndex;
+		TrackGPUObject(MemoryTag_GPUBuffers, Model->VBOs[Pos_VBO], sizeof(vec3) * Geometry->Positions.EntriesCount);
+		TrackGPUObject(MemoryTag_GPUBuffers, Model->VBOs[Normal_VBO], sizeof(vec3) * Geometry->Normals.EntriesCount);
+		TrackGPUObject(MemoryTag_GPUBuffers, Model->VBOs[TexCoord_VBO], sizeof(vec2) * Geometry->TexCoords.EntriesCount);
+		TrackGPUObject(MemoryTag_GPUBuffers, Model->VBOs[Skin_VBO], sizeof(vertex_skin) * Geometry->Skins.EntriesCount);
+		TrackGPUObject(MemoryTag_GPUBuffers, Model->VBOs[Index_VBO], sizeof(uint32_t) * Geometry->Indices.EntriesCount);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-				VertexCount += Scene->mMeshes[MeshIndex]->mNumVertices;
-				IndexCount += Model->Meshes[MeshIndex].IndexCount;
-			}
+	Model->VertexCount = Geometry->VertexCount;
+	Model->IndexCount = Geometry->IndexCount;
+	Model->Meshes.EntriesCount = 0;
+	for (uint32_t MeshIndex = 0;
+		MeshIndex < Geometry->Meshes.EntriesCount;
+		MeshIndex++)
+	{
+		PushEntry(&Model->Meshes, Geometry->Meshes[MeshIndex]);
+	}
+}
 
-			dynamic_array<vec3> Positions(VertexCount), Normals(VertexCount);
-			dynamic_array<vec2> TexCoords(VertexCount);
-			dynamic_array<uint32_t> Indices(IndexCount);
+// NOTE(georgy): Packs every material texture into the model's texture array and uploads the per-material data
+static void
+BuildMaterialTextures(model* Model, memory_arena* Scratch, load_profile* Profile = 0)
+{
+	MEMORY_TAG(MemoryTag_Textures);
 
-			for (uint32_t MeshIndex = 0;
-				MeshIndex < Model->Meshes.EntriesCount;
-				MeshIndex++)
-			{
-				const aiMesh* AssimpMesh = Scene->mMeshes[MeshIndex];
+	temporary_memory PathMemory = BeginTemporaryMemory(Scratch);
+	uint32_t MaterialCount = Model->TextureFiles.EntriesCount;
+	dynamic_array<const char*> Paths(MaterialCount, Scratch);
+	for (uint32_t MaterialIndex = 0; MaterialIndex < MaterialCount; MaterialIndex++)
+	{
+		PushEntry(&Paths, (const char*)Model->TextureFiles[MaterialIndex].Path);
+	}
 
-				for (uint32_t VertexIndex = 0;
-					VertexIndex < AssimpMesh->mNumVertices;
-					VertexIndex++)
-				{
-					const aiVector3D Pos = AssimpMesh->mVertices[VertexIndex];
-					const aiVector3D Normal = AssimpMesh->HasNormals() ? AssimpMesh->mNormals[VertexIndex] : aiVector3D(0.0f);
-					const aiVector3D TexCoord = AssimpMesh->HasTextureCoords(0) ? AssimpMesh->mTextureCoords[0][VertexIndex] : aiVector3D(0.0f);
+	SwitchLoadStage(Profile, LoadStage_Textures);
+	ResizeDynamicArray(&Model->Materials, MaterialCount);
+	uint32_t TextureCount = PackTextureArray(&Model->TextureArray, MaterialCount, Paths.Entries, Model->Materials.Entries,
+		TextureArrayMaxLayerSize(), Scratch);
+	EndTemporaryMemory(PathMemory);
 
-					PushEntry(&Positions, vec3(Pos.x, Pos.y, Pos.z));
-					PushEntry(&Normals, vec3(Normal.x, Normal.y, Normal.z));
-					PushEntry(&TexCoords, vec2(TexCoord.x, TexCoord.y));
-				}
+	SwitchLoadStage(Profile, LoadStage_Upload);
+	UploadTextureArray(&Model->TextureArray, TextureCount);
+	glBindBuffer(GL_ARRAY_BUFFER, Model->VBOs[Material_VBO]);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(material_texture) * MaterialCount, Model->Materials.Entries, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	TrackGPUObject(MemoryTag_GPUBuffers, Model->VBOs[Material_VBO], sizeof(material_texture) * MaterialCount);
+}
 
-				for (uint32_t FaceIndex = 0;
-					FaceIndex < AssimpMesh->mNumFaces;
-					FaceIndex++)
-				{
-					const aiFace Face = AssimpMesh->mFaces[FaceIndex];
-					Assert(Face.mNumIndices == 3);
+// NOTE(georgy): The diffuse texture is looked for next to the model file, whatever directory the material names.
+// FullPath is empty if the material has none.
+static void
+MaterialTexturePath(const aiMaterial* AssimpMaterial, const char* ModelFilePath, char* FullPath)
+{
+	FullPath[0] = 0;
+	if (AssimpMaterial->GetTextureCount(aiTextureType_DIFFUSE) > 0)
+	{
+		aiString TexturePath;
 
-					PushEntry(&Indices, Face.mIndices[0]);
-					PushEntry(&Indices, Face.mIndices[1]);
-					PushEntry(&Indices, Face.mIndices[2]);
-				}
-			}
+		if (AssimpMaterial->GetTexture(aiTextureType_DIFFUSE, 0, &TexturePath, 0, 0, 0, 0, 0) == AI_SUCCESS)
+		{
+			uint32_t ModelDirLengthWithLastSlash = (uint32_t)(FileNameFromPath(ModelFilePath) - ModelFilePath);
+			char* TextureName = (char*)FileNameFromPath(TexturePath.data);
+			uint32_t TextureNameLength = TexturePath.length - (uint32_t)(TextureName - TexturePath.data);
 
-			for (uint32_t MaterialIndex = 0;
-				MaterialIndex < Scene->mNumMaterials;
-				MaterialIndex++)
-			{
-				const aiMaterial* AssimpMaterial = Scene->mMaterials[MaterialIndex];
+			Concatenate(FullPath, (char*)ModelFilePath, ModelDirLengthWithLastSlash, TextureName, TextureNameLength);
+		}
+	}
+}
 
-				Model->Textures[MaterialIndex] = INVALID_TEXTURE;
-				if (AssimpMaterial->GetTextureCount(aiTextureType_DIFFUSE) > 0)
-				{
-					aiString TexturePath;
+// NOTE(georgy): Only changed texture paths get a new file watch, the old one is removed. The texture array is rebuilt
+// from scratch every time.
+static void
+LoadMaterials(model* Model, const aiScene* Scene, file_watcher* Watcher, memory_arena* Scratch, load_profile* Profile)
+{
+	char* ModelFilePath = Model->FilePath;
 
-					if (AssimpMaterial->GetTexture(aiTextureType_DIFFUSE, 0, &TexturePath, 0, 0, 0, 0, 0) == AI_SUCCESS)
-					{
-						char* TextureName = TexturePath.data;
-						for (char* C = TexturePath.data; *C != 0; C++)
-						{
-							if (*C == '\\')
-							{
-								TextureName = C + 1;
-							}
-						}
-						uint32_t TextureNameLength = TexturePath.length - (uint32_t)(TextureName - TexturePath.data);
-
-						char FullPath[MAX_PATH];
-						Concatenate(FullPath, ModelFilePath, ModelDirLengthWithLastSlash, TextureName, TextureNameLength);
-						Model->Textures[MaterialIndex] = LoadTexture(FullPath);
-					}
-				}
+	for (uint32_t MaterialIndex = Scene->mNumMaterials;
+		MaterialIndex < Model->TextureFiles.EntriesCount;
+		MaterialIndex++)
+	{
+		RemoveFileWatch(Watcher, Model->TextureFiles[MaterialIndex].Watch);
+	}
+	uint32_t OldMaterialCount = Min(Model->TextureFiles.EntriesCount, Scene->mNumMaterials);
+	ResizeDynamicArray(&Model->TextureFiles, Scene->mNumMaterials);
+
+	for (uint32_t MaterialIndex = 0;
+		MaterialIndex < Scene->mNumMaterials;
+		MaterialIndex++)
+	{
+		char FullPath[MAX_PATH];
+		MaterialTexturePath(Scene->mMaterials[MaterialIndex], ModelFilePath, FullPath);
+
+		model_texture* TextureFile = &Model->TextureFiles[MaterialIndex];
+		bool IsNewMaterial = (MaterialIndex >= OldMaterialCount);
+		if (IsNewMaterial || (strcmp(TextureFile->Path, FullPath) != 0))
+		{
+			if (!IsNewMaterial)
+			{
+				RemoveFileWatch(Watcher, TextureFile->Watch);
 			}
+			memcpy(TextureFile->Path, FullPath, sizeof(FullPath));
+			TextureFile->Watch = FullPath[0] ? AddFileWatch(Watcher, FullPath) : NO_FILE_WATCH;
+		}
+	}
+
+	BuildMaterialTextures(Model, Scratch, Profile);
+}
+
+// NOTE(georgy): Assimp allocates inside its own library, where we can't see it, so the scene is estimated from what
+// it holds. The large parts only: vertex streams, faces, bones, anim meshes, animation keys and embedded textures.
+static uint64_t
+EstimateSceneBytes(const aiScene* Scene)
+{
+	uint64_t Result = sizeof(aiScene);
+	for (uint32_t MeshIndex = 0; MeshIndex < Scene->mNumMeshes; MeshIndex++)
+	{
+		const aiMesh* Mesh = Scene->mMeshes[MeshIndex];
+		uint64_t Streams = (Mesh->HasPositions() ? 1 : 0) + (Mesh->HasNormals() ? 1 : 0) + (Mesh->HasTangentsAndBitangents() ? 2 : 0) +
+			Mesh->GetNumUVChannels();
+		Result += sizeof(aiMesh) + Streams * sizeof(aiVector3D) * Mesh->mNumVertices +
+			Mesh->GetNumColorChannels() * sizeof(aiColor4D) * Mesh->mNumVertices;
+		Result += (sizeof(aiFace) + 3 * sizeof(uint32_t)) * (uint64_t)Mesh->mNumFaces;
+		for (uint32_t BoneIndex = 0; BoneIndex < Mesh->mNumBones; BoneIndex++)
+		{
+			Result += sizeof(aiBone) + sizeof(aiVertexWeight) * (uint64_t)Mesh->mBones[BoneIndex]->mNumWeights;
+		}
+		for (uint32_t TargetIndex = 0; TargetIndex < Mesh->mNumAnimMeshes; TargetIndex++)
+		{
+			const aiAnimMesh* Target = Mesh->mAnimMeshes[TargetIndex];
+			uint64_t TargetStreams = (Target->HasPositions() ? 1 : 0) + (Target->HasNormals() ? 1 : 0);
+			Result += sizeof(aiAnimMesh) + TargetStreams * sizeof(aiVector3D) * Target->mNumVertices;
+		}
+	}
+
+	for (uint32_t AnimationIndex = 0; AnimationIndex < Scene->mNumAnimations; AnimationIndex++)
+	{
+		const aiAnimation* Animation = Scene->mAnimations[AnimationIndex];
+		for (uint32_t ChannelIndex = 0; ChannelIndex < Animation->mNumChannels; ChannelIndex++)
+		{
+			const aiNodeAnim* Channel = Animation->mChannels[ChannelIndex];
+			Result += sizeof(aiNodeAnim) + sizeof(aiVectorKey) * (uint64_t)(Channel->mNumPositionKeys + Channel->mNumScalingKeys) +
+				sizeof(aiQuatKey) * (uint64_t)Channel->mNumRotationKeys;
+		}
+	}
+
+	for (uint32_t TextureIndex = 0; TextureIndex < Scene->mNumTextures; TextureIndex++)
+	{
+		// NOTE(georgy): A compressed texture has its byte size in mWidth and a height of 0
+		const aiTexture* Texture = Scene->mTextures[TextureIndex];
+		Result += (Texture->mHeight == 0) ? Texture->mWidth : sizeof(aiTexel) * (uint64_t)Texture->mWidth * Texture->mHeight;
+	}
+
+	return(Result);
+}
+
+// NOTE(georgy): Reading and post-processing are separate calls only so that the profile can tell them apart
+static bool
+LoadModel(model* Model, const char* ModelFilePath, file_watcher* Watcher, memory_arena* Scratch, bool IsReload, load_profile* Profile = 0)
+{
+	PROFILE_ZONE("LoadModel");
+	MEMORY_TAG(MemoryTag_Geometry);
+
+	SwitchLoadStage(Profile, LoadStage_Parse);
+	const aiScene* Scene;
+	{
+		PROFILE_ZONE("aiImportFile");
+		Scene = aiImportFile(ModelFilePath, 0);
+	}
+	if (!Scene)
+	{
+		printf("Failed to import %s: %s\n", ModelFilePath, aiGetErrorString());
+		return(false);
+	}
+
+	SwitchLoadStage(Profile, LoadStage_PostProcess);
+	{
+		PROFILE_ZONE("aiApplyPostProcessing");
+		Scene = aiApplyPostProcessing(Scene,
+			aiProcess_Triangulate | aiProcess_GenSmoothNormals |
+			aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices);
+	}
+	if (!Scene)
+	{
+		printf("Failed to post-process %s: %s\n", ModelFilePath, aiGetErrorString());
+		return(false);
+	}
+	uint64_t SceneBytes = EstimateSceneBytes(Scene);
+	TrackMemory(MemoryTag_AssimpScene, (int64_t)SceneBytes);
+
+	SwitchLoadStage(Profile, LoadStage_Convert);
+
+	if (!IsReload)
+	{
+		strncpy(Model->FilePath, ModelFilePath, sizeof(Model->FilePath) - 1);
+		Model->FileWatch = AddFileWatch(Watcher, Model->FilePath);
+	}
+	Model->RootTransform = Mat4FromAssimp(Scene->mRootNode->mTransformation);
+
+	// NOTE(georgy): Positions, texture coordinates and indices stay with the model, the rest is gone after the upload
+	temporary_memory GeometryMemory = BeginTemporaryMemory(Scratch);
+	model_geometry Geometry = {};
+	InitializeDynamicArray(&Geometry.Meshes, 0, Scratch);
+	InitializeDynamicArray(&Geometry.Normals, 0, Scratch);
+	InitializeDynamicArray(&Geometry.Skins, 0, Scratch);
+	ExtractGeometry(Scene, &Geometry);
 
-			Model->AABB = AABBFromVertices(Positions.EntriesCount, Positions.Entries);
+	Model->AABB = AABBFromVertices(Geometry.Positions.EntriesCount, Geometry.Positions.Entries);
+
+	if (IsReload)
+	{
+		FreeAnimationSet(&Model->Animation);
+		FreeMorphTargets(&Model->Morph);
+	}
 
-			glBindBuffer(GL_ARRAY_BUFFER, Model->VBOs[Pos_VBO]);
-			glBufferData(GL_ARRAY_BUFFER, sizeof(vec3) * Positions.EntriesCount, &Positions[0], GL_STATIC_DRAW);
-			glEnableVertexAttribArray(Pos_VBO);
-			glVertexAttribPointer(Pos_VBO, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	animation_compression_settings CompressionSettings;
+	CompressionSettings.TranslationTolerance = 0.0001f * Length(Model->AABB.Max - Model->AABB.Min);
+	CompressionSettings.RotationTolerance = Radians(0.05f);
+	CompressionSettings.ScaleTolerance = 0.0001f;
+	LoadAnimations(&Model->Animation, Scene, CompressionSettings, Scratch);
 
-			glBindBuffer(GL_ARRAY_BUFFER, Model->VBOs[Normal_VBO]);
-			glBufferData(GL_ARRAY_BUFFER, sizeof(vec3) * Normals.EntriesCount, &Normals[0], GL_STATIC_DRAW);
-			glEnableVertexAttribArray(Normal_VBO);
-			glVertexAttribPointer(Normal_VBO, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	bool HasBones = false;
+	for (uint32_t MeshIndex = 0; MeshIndex < Scene->mNumMeshes; MeshIndex++)
+	{
+		HasBones = HasBones || Scene->mMeshes[MeshIndex]->HasBones();
+	}
+	if (HasBones)
+	{
+		ResizeDynamicArray(&Geometry.Skins, Geometry.VertexCount);
+		LoadSkin(&Model->Animation, Scene, &Geometry.Skins);
+	}
 
-			glBindBuffer(GL_ARRAY_BUFFER, Model->VBOs[TexCoord_VBO]);
-			glBufferData(GL_ARRAY_BUFFER, sizeof(vec2) * TexCoords.EntriesCount, &TexCoords[0], GL_STATIC_DRAW);
-			glEnableVertexAttribArray(TexCoord_VBO);
-			glVertexAttribPointer(TexCoord_VBO, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	HashMeshContents(&Geometry);
+	SwitchLoadStage(Profile, LoadStage_Upload);
+	UploadGeometry(Model, &Geometry, IsReload);
+	SwitchLoadStage(Profile, LoadStage_Convert);
+	SwapDynamicArrays(&Model->Positions, &Geometry.Positions);
+	SwapDynamicArrays(&Model->TexCoords, &Geometry.TexCoords);
+	SwapDynamicArrays(&Model->Indices, &Geometry.Indices);
+	EndTemporaryMemory(GeometryMemory);
 
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Model->VBOs[Index_VBO]);
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * Indices.EntriesCount, &Indices[0], GL_STATIC_DRAW);
+	// NOTE(georgy): The cull boxes also hold every morph target at full weight
+	ResizeCullBounds(&Model->MeshBounds, Model->Meshes.EntriesCount);
+	for (uint32_t MeshIndex = 0; MeshIndex < Model->Meshes.EntriesCount; MeshIndex++)
+	{
+		aabb Box = Model->Meshes[MeshIndex].AABB;
+		const aiMesh* AssimpMesh = Scene->mMeshes[MeshIndex];
+		for (uint32_t TargetIndex = 0; TargetIndex < AssimpMesh->mNumAnimMeshes; TargetIndex++)
+		{
+			const aiAnimMesh* Target = AssimpMesh->mAnimMeshes[TargetIndex];
+			for (uint32_t VertexIndex = 0; Target->HasPositions() && (VertexIndex < Target->mNumVertices); VertexIndex++)
+			{
+				vec3 P = vec3(Target->mVertices[VertexIndex].x, Target->mVertices[VertexIndex].y, Target->mVertices[VertexIndex].z);
+				Box.Min = vec3(Min(Box.Min.x, P.x), Min(Box.Min.y, P.y), Min(Box.Min.z, P.z));
+				Box.Max = vec3(Max(Box.Max.x, P.x), Max(Box.Max.y, P.y), Max(Box.Max.z, P.z));
+			}
 		}
 
-		glBindVertexArray(0);
-		GameState->IsInitialized = true;
+		SetCullBounds(&Model->MeshBounds, MeshIndex, 0.5f*(Box.Min + Box.Max), 0.5f*(Box.Max - Box.Min));
 	}
 
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	LoadMaterials(Model, Scene, Watcher, Scratch, Profile);
 
-	vec3 ModelAABBCenter = 0.5f*(GameState->Model.AABB.Min + GameState->Model.AABB.Max);
-	const float TargetHeight = 0.6f;
-	float Scale = TargetHeight / (GameState->Model.AABB.Max.y - GameState->Model.AABB.Min.y);
-
-	mat4 View = LookAt(vec3(0.0f, 0.0f, 3.0f), vec3(0.0f, 0.0f, 0.0f));
-	mat4 PerspectiveProjection = Perspective(45.0f, (float)BufferWidth / (float)BufferHeight, 0.1f, 100.0f);
-	mat4 Model = Scaling(Scale) * GameState->Model.RootTransform * Translation(-ModelAABBCenter);
-	GameState->DefaultShader.Use();
-	GameState->DefaultShader.SetMat4("View", View);
-	GameState->DefaultShader.SetMat4("Projection", PerspectiveProjection);
-	GameState->DefaultShader.SetMat4("Model", Model);
-
-	glBindVertexArray(GameState->Model.VAO);
+	// NOTE(georgy): Mostly the delta texture and the scatter shader
+	SwitchLoadStage(Profile, LoadStage_Upload);
+	LoadMorphTargets(&Model->Morph, Scene, Scratch);
+
+	SwitchLoadStage(Profile, LoadStage_Parse);
+	aiReleaseImport(Scene);
+	TrackMemory(MemoryTag_AssimpScene, -(int64_t)SceneBytes, -1);
+
+	return(true);
+}
+
+// NOTE(georgy): Every model is shown centered on the origin and MODEL_FIT_HEIGHT units high, the space game_camera is in.
+// A flat model goes by its widest side instead.
+#define MODEL_FIT_HEIGHT 0.6f
+
+inline float
+ModelFitScale(aabb AABB)
+{
+	float Extent = AABB.Max.y - AABB.Min.y;
+	if (Extent <= 0.0f)
+	{
+		Extent = Max(AABB.Max.x - AABB.Min.x, AABB.Max.z - AABB.Min.z);
+	}
+	float Result = (Extent > 0.0f) ? (MODEL_FIT_HEIGHT / Extent) : 1.0f;
+
+	return(Result);
+}
+
+inline mat4
+ModelFitTransform(aabb AABB, mat4 RootTransform)
+{
+	vec3 Center = 0.5f*(AABB.Min + AABB.Max);
+	mat4 Result = Scaling(ModelFitScale(AABB)) * RootTransform * Translation(-Center);
+
+	return(Result);
+}
+
+// NOTE(georgy): A bottom level per mesh, and a top level with one instance per mesh in the model's vertex space
+static void
+BuildModelBVH(game_memory* Memory, model* Model)
+{
+	PROFILE_ZONE("BuildModelBVH");
+	MEMORY_TAG(MemoryTag_BVH);
+
+	scene_bvh* Scene = &Model->BVH;
+	BuildMeshBVHs(Memory, Scene, Model->Meshes.EntriesCount, Model->Meshes.Entries, Model->Positions.Entries, Model->Indices.Entries);
+	Scene->Instances.EntriesCount = 0;
 	for (uint32_t MeshIndex = 0;
-		MeshIndex < GameState->Model.Meshes.EntriesCount;
+		MeshIndex < Model->Meshes.EntriesCount;
 		MeshIndex++)
 	{
-		mesh* Mesh = &GameState->Model.Meshes[MeshIndex];
+		AddBVHInstance(Scene, MeshIndex, Identity());
+	}
+	BuildTopLevelBVH(Memory, Scene);
 
-		GLuint Texture = GameState->Model.Textures[Mesh->MaterialIndex];
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, Texture);
+	// NOTE(georgy): The time is the zone's, this only says what it was spent on
+	PROFILE_COUNTER("BVH triangles built", Model->IndexCount / 3);
+}
 
-		glDrawElementsBaseVertex(GL_TRIANGLES, Mesh->IndexCount, GL_UNSIGNED_INT,
-			(void*)(sizeof(uint32_t) * Mesh->BaseIndex),
-			Mesh->BaseVertex);
+static void
+WatchShader(game_state* GameState, shader* Shader)
+{
+	for (uint32_t WatchIndex = 0;
+		WatchIndex < GameState->ShaderWatches.EntriesCount;
+		WatchIndex++)
+	{
+		if (GameState->ShaderWatches[WatchIndex].Shader == Shader)
+		{
+			return;
+		}
 	}
-	glBindVertexArray(0);
-}
\ No newline at end of file
+
+	shader_watch Watch;
+	Watch.Shader = Shader;
+	Watch.VSWatch = AddFileWatch(&GameState->FileWatcher, Shader->GetVSPath());
+	Watch.FSWatch = AddFileWatch(&GameState->FileWatcher, Shader->GetFSPath());
+	PushEntry(&GameState->ShaderWatches, Watch);
+}
+
+// NOTE(georgy): Texture and morph bits follow the materials and morph targets, the others come with the geometry.
+// A material only counts as textured if the mesh has UVs to sample it with.
+static void
+UpdateMeshShaderFeatures(model* Model)
+{
+	for (uint32_t MeshIndex = 0;
+		MeshIndex < Model->Meshes.EntriesCount;
+		MeshIndex++)
+	{
+		mesh* Mesh = &Model->Meshes[MeshIndex];
+		Mesh->ShaderFeatures &= ~(ShaderFeature_Texture | ShaderFeature_Morph);
+		if ((Mesh->ShaderFeatures & ShaderFeature_TexCoords) && (Model->Materials[Mesh->MaterialIndex].Layer >= 0.0f))
+		{
+			Mesh->ShaderFeatures |= ShaderFeature_Texture;
+		}
+		if (Model->Morph.TextureWidth > 0)
+		{
+			Mesh->ShaderFeatures |= ShaderFeature_Morph;
+		}
+	}
+}
+
+// NOTE(georgy): Builds the variants the model's meshes need that don't exist yet, and watches them for hot reload
+static void
+BuildShaderVariants(game_state* GameState, shader_permutations* Permutations)
+{
+	uint32_t NeededVariants = 0;
+	for (uint32_t MeshIndex = 0;
+		MeshIndex < GameState->Model.Meshes.EntriesCount;
+		MeshIndex++)
+	{
+		NeededVariants |= 1 << (GameState->Model.Meshes[MeshIndex].ShaderFeatures & Permutations->SupportedFeatures);
+	}
+
+	uint32_t BuiltCount = BuildShaderPermutations(Permutations, NeededVariants);
+	if (BuiltCount > 0)
+	{
+		printf("Built %u shader variants of %s, %s\n", BuiltCount, Permutations->VSPath, Permutations->FSPath);
+	}
+
+	for (uint32_t Features = 0;
+		Features < SHADER_PERMUTATION_COUNT;
+		Features++)
+	{
+		if (Permutations->Variants[Features].IsBuilt())
+		{
+			WatchShader(GameState, &Permutations->Variants[Features]);
+		}
+	}
+}
+
+// NOTE(georgy): All meshes share the model's VAO for now, so the vertex array part of the key stays 0.
+// Visible may be 0, then every mesh is drawn.
+static void
+BuildDrawList(dynamic_array<draw_command>* DrawList, model* Model, shader_permutations* Permutations, mat4 ModelView, uint8_t* Visible)
+{
+	PROFILE_ZONE("BuildDrawList");
+
+	DrawList->EntriesCount = 0;
+	for (uint32_t MeshIndex = 0;
+		MeshIndex < Model->Meshes.EntriesCount;
+		MeshIndex++)
+	{
+		if (Visible && !Visible[MeshIndex])
+		{
+			continue;
+		}
+
+		mesh* Mesh = &Model->Meshes[MeshIndex];
+
+		uint32_t Program = Mesh->ShaderFeatures & Permutations->SupportedFeatures;
+		uint32_t Texture = (Mesh->ShaderFeatures & ShaderFeature_Texture) ? 1 : 0;
+		vec3 Center = 0.5f*(Mesh->AABB.Min + Mesh->AABB.Max);
+		float Depth = -(ModelView * vec4(Center, 1.0f)).z;
+
+		draw_command Command;
+		Command.SortKey = MakeDrawKey(Program, Texture, 0, Depth);
+		Command.MeshIndex = MeshIndex;
+		PushEntry(DrawList, Command);
+	}
+
+	SortDrawCommands(DrawList);
+}
+
+static void
+BindDefaultMeshState(game_state* GameState, mesh* Mesh, mat4 Model)
+{
+	gl_state_cache* StateCache = &GameState->StateCache;
+	morph_set* Morph = &GameState->Model.Morph;
+
+	// NOTE(georgy): The list is sorted by program, so a program change is also its first use this frame
+	shader* Shader = GetShaderPermutation(&GameState->DefaultShaders, Mesh->ShaderFeatures);
+	if (CacheUseProgram(StateCache, Shader->GetID()))
+	{
+		Shader->SetMat4("Model", Model);
+		Shader->SetI32("MorphTextureWidth", Morph->TextureWidth);
+		Shader->SetI32("MorphDeltas", 2);
+	}
+
+	if (Mesh->ShaderFeatures & ShaderFeature_Texture)
+	{
+		CacheBindTexture(StateCache, 0, GL_TEXTURE_2D_ARRAY, GameState->Model.TextureArray.Texture);
+	}
+}
+
+// NOTE(georgy): For draws that can't pick their material through the base instance
+inline void
+SetMaterialAttributes(material_texture* Material)
+{
+	glVertexAttrib4fv(MaterialUVTransform_Attribute, Material->UVTransform.E);
+	glVertexAttrib2f(MaterialLayer_Attribute, Material->Layer, Material->MaxLod);
+}
+
+// NOTE(georgy): Writes the sorted draw list into the indirect buffer and issues one glMultiDrawElementsIndirect
+// per run of draws that share a program. The base instance of each command selects its material.
+static void
+DrawModelIndirect(game_state* GameState, mat4 Model)
+{
+	PROFILE_ZONE("DrawModelIndirect");
+
+	dynamic_array<draw_command>* DrawList = &GameState->DrawList;
+	dynamic_array<draw_elements_indirect_command>* Commands = &GameState->IndirectCommands;
+
+	Commands->EntriesCount = 0;
+	for (uint32_t DrawIndex = 0;
+		DrawIndex < DrawList->EntriesCount;
+		DrawIndex++)
+	{
+		mesh* Mesh = &GameState->Model.Meshes[(*DrawList)[DrawIndex].MeshIndex];
+
+		draw_elements_indirect_command Command;
+		Command.Count = Mesh->IndexCount;
+		Command.InstanceCount = 1;
+		Command.FirstIndex = Mesh->BaseIndex;
+		Command.BaseVertex = Mesh->BaseVertex;
+		Command.BaseInstance = Mesh->MaterialIndex;
+		PushEntry(Commands, Command);
+	}
+
+	// NOTE(georgy): The order changes with the camera, so the buffer is respecified every frame
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, GameState->IndirectBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(draw_elements_indirect_command) * Commands->EntriesCount, Commands->Entries, GL_STREAM_DRAW);
+	TrackGPUObject(MemoryTag_GPUBuffers, GameState->IndirectBuffer, sizeof(draw_elements_indirect_command) * Commands->EntriesCount);
+
+	uint32_t RunStart = 0;
+	for (uint32_t DrawIndex = 1;
+		DrawIndex <= DrawList->EntriesCount;
+		DrawIndex++)
+	{
+		if ((DrawIndex == DrawList->EntriesCount) ||
+			(DrawKeyState((*DrawList)[DrawIndex].SortKey) != DrawKeyState((*DrawList)[RunStart].SortKey)))
+		{
+			BindDefaultMeshState(GameState, &GameState->Model.Meshes[(*DrawList)[RunStart].MeshIndex], Model);
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+				(void*)(sizeof(draw_elements_indirect_command) * RunStart),
+				DrawIndex - RunStart, 0);
+			GameState->StateCache.Stats.DrawCalls++;
+
+			RunStart = DrawIndex;
+		}
+	}
+	GameState->StateCache.Stats.MeshDraws += DrawList->EntriesCount;
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+static void
+UpdateModelShaders(game_state* GameState)
+{
+	UpdateMeshShaderFeatures(&GameState->Model);
+	BuildShaderVariants(GameState, &GameState->DefaultShaders);
+	if (GameState->Crowd.IsBaked)
+	{
+		BuildShaderVariants(GameState, &GameState->Crowd.Shaders);
+	}
+}
+
+// NOTE(georgy): Runs at the top of the frame, so everything is swapped in between two frames
+static void
+ReloadChangedAssets(game_memory* Memory, game_state* GameState)
+{
+	PROFILE_ZONE("ReloadChangedAssets");
+
+	model* Model = &GameState->Model;
+	file_watcher* Watcher = &GameState->FileWatcher;
+
+	PollFileWatcher(Watcher);
+
+	if (FileChanged(Watcher, Model->FileWatch))
+	{
+		if (LoadModel(Model, Model->FilePath, Watcher, &GameState->ScratchArena, true))
+		{
+			BuildModelBVH(Memory, Model);
+			SelectOccluders(&GameState->Occlusion, Model->Meshes.EntriesCount, Model->Meshes.Entries);
+
+			// NOTE(georgy): Bones and clips may have changed, bake again on the next toggle
+			ReleaseCrowd(&GameState->Crowd);
+
+			if (Model->Morph.TextureWidth > 0)
+			{
+				WatchShader(GameState, &Model->Morph.ScatterShader);
+			}
+			UpdateModelShaders(GameState);
+		}
+	}
+
+	for (uint32_t MaterialIndex = 0;
+		MaterialIndex < Model->TextureFiles.EntriesCount;
+		MaterialIndex++)
+	{
+		model_texture* TextureFile = &Model->TextureFiles[MaterialIndex];
+		if (TextureFile->Path[0] && FileChanged(Watcher, TextureFile->Watch))
+		{
+			// NOTE(georgy): The file may still be half written, we get another notification when it's done.
+			// Same size as before goes straight into its old slot, anything else packs the whole array again.
+			printf("Texture changed: %s\n", TextureFile->Path);
+			if (Model->TextureArray.Texture &&
+				RepackTextureArrayImage(&Model->TextureArray, MaterialIndex, TextureFile->Path, TextureArrayMaxLayerSize()))
+			{
+				UploadTextureArrayImage(&Model->TextureArray, MaterialIndex);
+			}
+			else
+			{
+				BuildMaterialTextures(Model, &GameState->ScratchArena);
+				UpdateModelShaders(GameState);
+			}
+
+			// NOTE(georgy): Materials with the same path share the slot, it's already up to date for them
+			for (uint32_t Other = MaterialIndex + 1; Other < Model->TextureFiles.EntriesCount; Other++)
+			{
+				model_texture* OtherFile = &Model->TextureFiles[Other];
+				if (strcmp(OtherFile->Path, TextureFile->Path) == 0)
+				{
+					FileChanged(Watcher, OtherFile->Watch);
+				}
+			}
+		}
+	}
+
+	// NOTE(georgy): Changed shaders rebuild in the background, each one keeps drawing with its old program until the new one links.
+	// A reload is polled from the frame after it was issued, so the driver gets at least a frame to work on it.
+	// Without KHR_parallel_shader_compile there is no way to ask, the first poll waits for the build and can still stall a frame.
+	for (uint32_t WatchIndex = 0;
+		WatchIndex < GameState->ShaderWatches.EntriesCount;
+		WatchIndex++)
+	{
+		shader_watch* Watch = &GameState->ShaderWatches[WatchIndex];
+
+		if (Watch->Shader->UpdateReload())
+		{
+			printf("Shader reloaded: %s, %s\n", Watch->Shader->GetVSPath(), Watch->Shader->GetFSPath());
+		}
+
+		bool VSChanged = FileChanged(Watcher, Watch->VSWatch);
+		bool FSChanged = FileChanged(Watcher, Watch->FSWatch);
+		if ((VSChanged || FSChanged) && Watch->Shader->IsBuilt())
+		{
+			Watch->Shader->BeginReload();
+		}
+	}
+}
+
+// NOTE(georgy): The cursor ray goes through the pixel center into the model's vertex space, where the BVH lives.
+// Morphs aren't applied, the ray hits the bind pose.
+bool
+PickAtPixel(game_memory* Memory, int32_t X, int32_t Y, uint32_t BufferWidth, uint32_t BufferHeight, pick_result* Result)
+{
+	game_state* GameState = (game_state*)Memory->PermanentStorage;
+	*Result = {};
+	if (!GameState->IsInitialized || !GameState->CanPick)
+	{
+		return(false);
+	}
+
+	double StartTime = GetWallClockSeconds();
+
+	float NDCX = 2.0f * ((float)X + 0.5f) / (float)BufferWidth - 1.0f;
+	float NDCY = 1.0f - 2.0f * ((float)Y + 0.5f) / (float)BufferHeight;
+	mat4 Projection = GameState->PickProjection;
+	vec3 ViewDirection = vec3((NDCX + Projection.a13) / Projection.a11, (NDCY + Projection.a23) / Projection.a22, -1.0f);
+
+	mat4 ModelFromView = AffineInverse(GameState->PickView * GameState->PickModel);
+	vec3 Origin = (ModelFromView * vec4(0.0f, 0.0f, 0.0f, 1.0f)).xyz;
+	vec3 Direction = (ModelFromView * vec4(ViewDirection, 0.0f)).xyz;
+
+	model* Model = &GameState->Model;
+	bvh_ray Ray = MakeBVHRay(Origin, Direction);
+	bvh_hit Hit;
+	Hit.T = FLT_MAX;
+	if (IntersectRaySceneBVH(&Model->BVH, Model->Meshes.Entries, Model->Positions.Entries, Model->Indices.Entries, &Ray, &Hit))
+	{
+		vec3 Position = Origin + Hit.T*Direction;
+
+		Result->Hit = true;
+		Result->MeshIndex = Hit.MeshIndex;
+		Result->TriangleIndex = Hit.TriangleIndex;
+		Result->Barycentrics[0] = 1.0f - Hit.U - Hit.V;
+		Result->Barycentrics[1] = Hit.U;
+		Result->Barycentrics[2] = Hit.V;
+		Result->Position[0] = Position.x;
+		Result->Position[1] = Position.y;
+		Result->Position[2] = Position.z;
+	}
+	Result->Milliseconds = 1000.0 * (GetWallClockSeconds() - StartTime);
+
+	return(Result->Hit);
+}
+
+void
+UpdateAndRender(game_memory* Memory, game_input* Input, uint32_t BufferWidth, uint32_t BufferHeight)
+{
+	// NOTE(georgy): Set before any zone, the workers are idle between frames
+	if (GlobalProfiler != Memory->Profiler)
+	{
+		GlobalProfiler = Memory->Profiler;
+	}
+	PROFILE_ZONE("UpdateAndRender");
+	PROFILE_GPU_ZONE("UpdateAndRender");
+	MEMORY_TAG(MemoryTag_Render);
+	uint64_t FrameStartHeapAllocations = HeapAllocationCount();
+
+	Assert(sizeof(game_state) < Memory->PermanentStorageSize);
+	game_state* GameState = (game_state*)Memory->PermanentStorage;
+	if (!GameState->IsInitialized)
+	{
+		memory_arena TemporaryArena;
+		InitializeArena(&TemporaryArena, Memory->TemporaryStorageSize, Memory->TemporaryStorage);
+		SubArena(&GameState->FrameArena, &TemporaryArena, FRAME_ARENA_SIZE);
+		SubArena(&GameState->ScratchArena, &TemporaryArena, TemporaryArena.Size - TemporaryArena.Used);
+
+		if (GLEW_KHR_parallel_shader_compile)
+		{
+			glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+		}
+
+		InitializeShaderPermutations(&GameState->DefaultShaders, "shaders/DefaultVS.glsl", "shaders/DefaultFS.glsl",
+			ShaderFeature_TexCoords | ShaderFeature_Texture | ShaderFeature_Morph);
+		InitializeUniformRing(&GameState->FrameConstants);
+
+		InitializeFileWatcher(&GameState->FileWatcher);
+		InitializeDynamicArray(&GameState->ShaderWatches);
+		InitializeDynamicArray(&GameState->DrawList);
+		InitializeDynamicArray(&GameState->MeshVisibility);
+
+		// NOTE(georgy): Core 4.3, otherwise we stay with a draw call per mesh. Materials come from the base instance.
+		GameState->UseMultiDrawIndirect = GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance;
+		if (GameState->UseMultiDrawIndirect)
+		{
+			glGenBuffers(1, &GameState->IndirectBuffer);
+			InitializeDynamicArray(&GameState->IndirectCommands);
+		}
+
+		model* Model = &GameState->Model;
+		InitializeModel(Model);
+
+		char* ModelFilePath = (char*)Memory->ModelFilePath;
+		if (!ModelFilePath)
+		{
+			nfdresult_t Result = NFD_OpenDialog(0, 0, &ModelFilePath);
+			if (Result != NFD_OKAY)
+			{
+				if (Result == NFD_ERROR)
+				{
+					printf("Open dialog failed: %s\n", NFD_GetError());
+				}
+				ModelFilePath = 0;
+			}
+		}
+
+		Memory->ModelLoaded = ModelFilePath && LoadModel(Model, ModelFilePath, &GameState->FileWatcher, &GameState->ScratchArena, false);
+		BuildModelBVH(Memory, Model);
+		SelectOccluders(&GameState->Occlusion, Model->Meshes.EntriesCount, Model->Meshes.Entries);
+		if (Model->Morph.TextureWidth > 0)
+		{
+			WatchShader(GameState, &Model->Morph.ScatterShader);
+		}
+		UpdateModelShaders(GameState);
+
+		GameState->IsInitialized = true;
+	}
+	else
+	{
+		ReloadChangedAssets(Memory, GameState);
+	}
+	ResetArena(&GameState->FrameArena);
+
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	gl_state_cache* StateCache = &GameState->StateCache;
+	ResetStateCache(StateCache);
+
+	vec3 ModelAABBCenter = 0.5f*(GameState->Model.AABB.Min + GameState->Model.AABB.Max);
+	float Scale = ModelFitScale(GameState->Model.AABB);
+
+	if (WasDown(&Input->MouseLeft))
+	{
+		pick_result* Pick = &GameState->LastPick;
+		if (PickAtPixel(Memory, Input->MouseX, Input->MouseY, BufferWidth, BufferHeight, Pick))
+		{
+			printf("Picked mesh %u, triangle %u, barycentrics (%.3f, %.3f, %.3f), at (%.4f, %.4f, %.4f) in %.3f ms\n",
+				Pick->MeshIndex, Pick->TriangleIndex, Pick->Barycentrics[0], Pick->Barycentrics[1], Pick->Barycentrics[2],
+				Pick->Position[0], Pick->Position[1], Pick->Position[2], Pick->Milliseconds);
+		}
+		else if (GameState->CanPick)
+		{
+			printf("Picked nothing in %.3f ms\n", Pick->Milliseconds);
+		}
+	}
+
+	if (WasDown(&Input->B))
+	{
+		model* Model = &GameState->Model;
+		BenchmarkSceneBVH(Memory, &Model->BVH, Model->Meshes.EntriesCount, Model->Meshes.Entries, Model->Positions.Entries, Model->Indices.Entries);
+	}
+
+	if (WasDown(&Input->M))
+	{
+		PrintMemoryReport();
+	}
+
+	if (WasDown(&Input->R))
+	{
+		GameState->UseSoftwareRenderer = !GameState->UseSoftwareRenderer;
+		printf("Renderer: %s\n", GameState->UseSoftwareRenderer ? "software (crowd mode stays on GL)" : "GL");
+	}
+
+	if (WasDown(&Input->C))
+	{
+		model* Model = &GameState->Model;
+		if ((Model->Animation.Bones.EntriesCount > 0) && (Model->Animation.Clips.EntriesCount > 0))
+		{
+			if (!GameState->Crowd.IsBaked)
+			{
+				float Spacing = 1.2f * Scale * Max(Model->AABB.Max.x - Model->AABB.Min.x, Model->AABB.Max.z - Model->AABB.Min.z);
+				InitializeCrowd(&GameState->Crowd, &Model->Animation, Model->VBOs, Model->VBOs[Skin_VBO], Model->VBOs[Index_VBO], Spacing);
+				BuildShaderVariants(GameState, &GameState->Crowd.Shaders);
+			}
+			GameState->Crowd.Enabled = !GameState->Crowd.Enabled;
+		}
+		else
+		{
+			printf("Crowd mode needs a skinned model with animations\n");
+		}
+	}
+
+	game_camera* Camera = &Memory->Camera;
+	frame_constants FrameConstants;
+	FrameConstants.Projection = Perspective(Camera->Override ? Camera->FieldOfView : 45.0f, (float)BufferWidth / (float)BufferHeight, 0.1f, 100.0f);
+	if (GameState->Crowd.Enabled)
+	{
+		crowd* Crowd = &GameState->Crowd;
+		GameState->CrowdTime += Input->dt;
+
+		// NOTE(georgy): Skinned positions already include the root transform, only center and scale here
+		vec3 RootCenter = (GameState->Model.RootTransform * vec4(ModelAABBCenter, 1.0f)).xyz;
+		FrameConstants.View = LookAt(vec3(0.0f, 2.5f, 4.0f), vec3(0.0f, 0.0f, -3.0f));
+		PushFrameConstants(&GameState->FrameConstants, &FrameConstants);
+		GameState->CanPick = false;
+
+		mat4 Model = Scaling(Scale) * Translation(-RootCenter);
+		BuildDrawList(&GameState->DrawList, &GameState->Model, &Crowd->Shaders, FrameConstants.View * Model * GameState->Model.RootTransform, 0);
+
+		// NOTE(georgy): Animation moves the vertices out of the bind pose box, so the instance box gets some slack.
+		// Meshes aren't culled here for the same reason, the instances are.
+		aabb InstanceBox = TransformAABB(Model * GameState->Model.RootTransform, GameState->Model.AABB);
+		vec3 Slack = 0.25f*(InstanceBox.Max - InstanceBox.Min);
+		InstanceBox.Min -= Slack;
+		InstanceBox.Max += Slack;
+		frustum Frustum = FrustumFromMatrix(FrameConstants.Projection * FrameConstants.View);
+		CullCrowdInstances(Memory, &GameState->FrameArena, Crowd, &Frustum, InstanceBox);
+		StateCache->Stats.VisibleInstances = Crowd->VisibleInstanceCount;
+		StateCache->Stats.CulledInstances = Crowd->InstanceCount - Crowd->VisibleInstanceCount;
+
+		PROFILE_ZONE("Submit crowd draws");
+		PROFILE_GPU_ZONE("Crowd draws");
+		CacheBindTexture(StateCache, 1, GL_TEXTURE_2D, Crowd->Baked.BoneTexture);
+		CacheBindVertexArray(StateCache, Crowd->VAO);
+		for (uint32_t DrawIndex = 0;
+			DrawIndex < GameState->DrawList.EntriesCount;
+			DrawIndex++)
+		{
+			mesh* Mesh = &GameState->Model.Meshes[GameState->DrawList[DrawIndex].MeshIndex];
+
+			// NOTE(georgy): The list is sorted by program, so a program change is also its first use this frame
+			shader* Shader = GetShaderPermutation(&Crowd->Shaders, Mesh->ShaderFeatures);
+			if (CacheUseProgram(StateCache, Shader->GetID()))
+			{
+				Shader->SetMat4("Model", Model);
+				Shader->SetR32("Time", GameState->CrowdTime);
+				Shader->SetR32("FramesPerSecond", Crowd->Baked.FramesPerSecond);
+				Shader->SetI32Array("ClipFirstFrame", Crowd->Baked.ClipCount, Crowd->Baked.ClipFirstFrame);
+				Shader->SetI32Array("ClipFrameCount", Crowd->Baked.ClipCount, Crowd->Baked.ClipFrameCount);
+				Shader->SetI32("BoneTexture", 1);
+			}
+
+			// NOTE(georgy): The base instance belongs to the crowd instances here, the material goes in as constant attributes
+			if (Mesh->ShaderFeatures & ShaderFeature_Texture)
+			{
+				CacheBindTexture(StateCache, 0, GL_TEXTURE_2D_ARRAY, GameState->Model.TextureArray.Texture);
+				SetMaterialAttributes(&GameState->Model.Materials[Mesh->MaterialIndex]);
+			}
+
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, Mesh->IndexCount, GL_UNSIGNED_INT,
+				(void*)(sizeof(uint32_t) * Mesh->BaseIndex),
+				Crowd->VisibleInstanceCount, Mesh->BaseVertex);
+			StateCache->Stats.DrawCalls++;
+			StateCache->Stats.MeshDraws++;
+		}
+		CacheBindVertexArray(StateCache, 0);
+	}
+	else
+	{
+		morph_set* Morph = &GameState->Model.Morph;
+		if (Morph->TextureWidth > 0)
+		{
+			GameState->AnimationTime += Input->dt;
+			AnimateMorphWeights(Morph, GameState->AnimationTime);
+			ScatterMorphTargets(Morph);
+		}
+
+		if (Camera->Override)
+		{
+			FrameConstants.View = LookAt(vec3(Camera->Position[0], Camera->Position[1], Camera->Position[2]),
+										 vec3(Camera->Target[0], Camera->Target[1], Camera->Target[2]));
+		}
+		else
+		{
+			FrameConstants.View = LookAt(vec3(0.0f, 0.0f, 3.0f), vec3(0.0f, 0.0f, 0.0f));
+		}
+		PushFrameConstants(&GameState->FrameConstants, &FrameConstants);
+
+		mat4 Model = ModelFitTransform(GameState->Model.AABB, GameState->Model.RootTransform);
+		GameState->CanPick = true;
+		GameState->PickProjection = FrameConstants.Projection;
+		GameState->PickView = FrameConstants.View;
+		GameState->PickModel = Model;
+
+		// NOTE(georgy): With the model matrix in, the planes are in the vertex space of the mesh boxes
+		cull_bounds* MeshBounds = &GameState->Model.MeshBounds;
+		ResizeDynamicArray(&GameState->MeshVisibility, MeshBounds->Count);
+		frustum Frustum = FrustumFromMatrix(FrameConstants.Projection * FrameConstants.View * Model);
+		uint32_t VisibleMeshes = CullBounds(Memory, &GameState->FrameArena, &Frustum, MeshBounds, GameState->MeshVisibility.Entries);
+		StateCache->Stats.CulledMeshes = MeshBounds->Count - VisibleMeshes;
+
+		// NOTE(georgy): Occluders are drawn from their bind pose, with morphs they could cover more than they should
+		if (Morph->TextureWidth == 0)
+		{
+			model* LoadedModel = &GameState->Model;
+			mat4 ClipFromModel = FrameConstants.Projection * FrameConstants.View * Model;
+			RasterizeOccluders(Memory, &GameState->Occlusion, ClipFromModel, LoadedModel->Meshes.Entries,
+				LoadedModel->Positions.Entries, LoadedModel->Indices.Entries, GameState->MeshVisibility.Entries);
+			uint32_t OccludedMeshes = CullOccludedMeshes(&GameState->Occlusion, ClipFromModel, MeshBounds, GameState->MeshVisibility.Entries);
+			StateCache->Stats.OccludedMeshes = OccludedMeshes;
+			StateCache->Stats.OccluderTriangles = GameState->Occlusion.Indices.EntriesCount / 3;
+			VisibleMeshes -= OccludedMeshes;
+		}
+		StateCache->Stats.VisibleMeshes = VisibleMeshes;
+
+		BuildDrawList(&GameState->DrawList, &GameState->Model, &GameState->DefaultShaders, FrameConstants.View * Model, GameState->MeshVisibility.Entries);
+
+		if (Morph->TextureWidth > 0)
+		{
+			CacheBindTexture(StateCache, 2, GL_TEXTURE_2D, Morph->DeltaTexture);
+		}
+
+		PROFILE_ZONE("Submit draws");
+		PROFILE_GPU_ZONE("Draws");
+		if (GameState->UseSoftwareRenderer)
+		{
+			model* LoadedModel = &GameState->Model;
+			RenderSoftware(Memory, &GameState->FrameArena, &GameState->Software, BufferWidth, BufferHeight, FrameConstants.Projection * FrameConstants.View * Model,
+				LoadedModel->Meshes.Entries, GameState->DrawList.Entries, GameState->DrawList.EntriesCount,
+				LoadedModel->Positions.Entries, LoadedModel->TexCoords.Entries, LoadedModel->Positions.EntriesCount,
+				LoadedModel->Indices.Entries, LoadedModel->Materials.Entries, &LoadedModel->TextureArray);
+			PresentSoftwareFrame(&GameState->Software, StateCache);
+			ReportSoftwareStats(&GameState->Software);
+		}
+		else if (GameState->UseMultiDrawIndirect)
+		{
+			CacheBindVertexArray(StateCache, GameState->Model.VAO);
+			DrawModelIndirect(GameState, Model);
+		}
+		else
+		{
+			CacheBindVertexArray(StateCache, GameState->Model.VAO);
+			for (uint32_t DrawIndex = 0;
+				DrawIndex < GameState->DrawList.EntriesCount;
+				DrawIndex++)
+			{
+				mesh* Mesh = &GameState->Model.Meshes[GameState->DrawList[DrawIndex].MeshIndex];
+				BindDefaultMeshState(GameState, Mesh, Model);
+
+				if (GLEW_ARB_base_instance)
+				{
+					glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, Mesh->IndexCount, GL_UNSIGNED_INT,
+						(void*)(sizeof(uint32_t) * Mesh->BaseIndex),
+						1, Mesh->BaseVertex, Mesh->MaterialIndex);
+				}
+				else
+				{
+					SetMaterialAttributes(&GameState->Model.Materials[Mesh->MaterialIndex]);
+					glDrawElementsBaseVertex(GL_TRIANGLES, Mesh->IndexCount, GL_UNSIGNED_INT,
+						(void*)(sizeof(uint32_t) * Mesh->BaseIndex),
+						Mesh->BaseVertex);
+				}
+				StateCache->Stats.DrawCalls++;
+				StateCache->Stats.MeshDraws++;
+			}
+		}
+		CacheBindVertexArray(StateCache, 0);
+	}
+
+	EndFrameConstants(&GameState->FrameConstants);
+	StateCache->Stats.HeapAllocations = (uint32_t)(HeapAllocationCount() - FrameStartHeapAllocations);
+	StateCache->Stats.FrameArenaKB = (uint32_t)(GameState->FrameArena.Used / Kilobytes(1));
+	RecordRenderStats(&StateCache->Stats);
+}
+// NOTE(georgy): Model directories keep textures and the like next to the models, only what assimp imports is taken.
+// Returns how many paths were left out.
+static uint32_t
+FilterImportableModels(uint32_t PathCount, const char** Paths, dynamic_array<const char*>* Models)
+{
+	Assimp::Importer Importer;
+	for (uint32_t PathIndex = 0; PathIndex < PathCount; PathIndex++)
+	{
+		const char* Extension = strrchr(FileNameFromPath(Paths[PathIndex]), '.');
+		if (Extension && Importer.IsExtensionSupported(Extension))
+		{
+			PushEntry(Models, Paths[PathIndex]);
+		}
+	}
+	uint32_t Result = PathCount - Models->EntriesCount;
+
+	return(Result);
+}
+
+//
+// NOTE(georgy): Batch thumbnails
+//
+
+// NOTE(georgy): Each worker takes the next model, imports it, decodes its textures, draws it with the software renderer
+// and writes the image. Nothing is shared between workers but the model counter and no GL context is involved, so every
+// core stays busy until the last model is taken.
+
+#define THUMBNAIL_MAX_TEXTURE_SIZE 512
+
+enum thumbnail_stage
+{
+	ThumbnailStage_Import,
+	ThumbnailStage_Textures,
+	ThumbnailStage_Render,
+	ThumbnailStage_Write,
+
+	ThumbnailStage_Count
+};
+
+struct thumbnail_batch
+{
+	uint32_t ModelCount;
+	const char** ModelPaths;
+	const char* OutputDirectory;
+	uint32_t Width, Height;
+	game_camera Camera;
+
+	std::atomic<uint32_t> NextModel;
+};
+
+// NOTE(georgy): Everything here is reused from one model to the next
+struct thumbnail_worker
+{
+	thumbnail_batch* Batch;
+
+	model_geometry Geometry;
+	dynamic_array<model_texture> TextureFiles;
+	dynamic_array<const char*> TexturePaths;
+	dynamic_array<material_texture> Materials;
+	texture_array Textures;
+	dynamic_array<draw_command> Draws;
+	software_renderer Renderer;
+	dynamic_array<uint32_t> Image;
+	memory_arena Scratch;
+
+	uint32_t Written;
+	uint32_t Failed;
+	double StageSeconds[ThumbnailStage_Count];
+};
+
+static bool
+RenderThumbnail(thumbnail_worker* Worker, uint32_t ModelIndex)
+{
+	thumbnail_batch* Batch = Worker->Batch;
+	const char* ModelFilePath = Batch->ModelPaths[ModelIndex];
+	double StageStart = GetWallClockSeconds();
+
+	// NOTE(georgy): aiImportFile keeps its last error in a global, an importer of our own doesn't
+	Assimp::Importer Importer;
+	const aiScene* Scene = Importer.ReadFile(ModelFilePath,
+		aiProcess_Triangulate | aiProcess_GenSmoothNormals |
+		aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices);
+	if (!Scene || !Scene->mRootNode || (Scene->mNumMeshes == 0))
+	{
+		printf("Failed to import %s: %s\n", ModelFilePath, Scene ? "no meshes" : Importer.GetErrorString());
+		return(false);
+	}
+	uint64_t SceneBytes = EstimateSceneBytes(Scene);
+	TrackMemory(MemoryTag_AssimpScene, (int64_t)SceneBytes);
+
+	model_geometry* Geometry = &Worker->Geometry;
+	Geometry->Positions.EntriesCount = Geometry->Normals.EntriesCount = Geometry->TexCoords.EntriesCount = 0;
+	Geometry->Indices.EntriesCount = 0;
+	ExtractGeometry(Scene, Geometry);
+	aabb AABB = AABBFromVertices(Geometry->Positions.EntriesCount, Geometry->Positions.Entries);
+	mat4 RootTransform = Mat4FromAssimp(Scene->mRootNode->mTransformation);
+
+	uint32_t MaterialCount = Scene->mNumMaterials;
+	ResizeDynamicArray(&Worker->TextureFiles, MaterialCount);
+	Worker->TexturePaths.EntriesCount = 0;
+	for (uint32_t MaterialIndex = 0; MaterialIndex < MaterialCount; MaterialIndex++)
+	{
+		MaterialTexturePath(Scene->mMaterials[MaterialIndex], ModelFilePath, Worker->TextureFiles[MaterialIndex].Path);
+		PushEntry(&Worker->TexturePaths, (const char*)Worker->TextureFiles[MaterialIndex].Path);
+	}
+	Importer.FreeScene();
+	TrackMemory(MemoryTag_AssimpScene, -(int64_t)SceneBytes, -1);
+
+	double Now = GetWallClockSeconds();
+	Worker->StageSeconds[ThumbnailStage_Import] += Now - StageStart;
+	StageStart = Now;
+
+	ResizeDynamicArray(&Worker->Materials, MaterialCount);
+	PackTextureArray(&Worker->Textures, MaterialCount, Worker->TexturePaths.Entries, Worker->Materials.Entries, THUMBNAIL_MAX_TEXTURE_SIZE,
+		&Worker->Scratch);
+
+	Now = GetWallClockSeconds();
+	Worker->StageSeconds[ThumbnailStage_Textures] += Now - StageStart;
+	StageStart = Now;
+
+	// NOTE(georgy): Every mesh is drawn, the software renderer culls by triangle anyway
+	Worker->Draws.EntriesCount = 0;
+	for (uint32_t MeshIndex = 0; MeshIndex < Geometry->Meshes.EntriesCount; MeshIndex++)
+	{
+		mesh* Mesh = &Geometry->Meshes[MeshIndex];
+		Mesh->ShaderFeatures &= ~ShaderFeature_Texture;
+		if ((Mesh->ShaderFeatures & ShaderFeature_TexCoords) && (Worker->Materials[Mesh->MaterialIndex].Layer >= 0.0f))
+		{
+			Mesh->ShaderFeatures |= ShaderFeature_Texture;
+		}
+
+		draw_command Command = {};
+		Command.MeshIndex = MeshIndex;
+		PushEntry(&Worker->Draws, Command);
+	}
+
+	game_camera* Camera = &Batch->Camera;
+	mat4 Projection = Perspective(Camera->Override ? Camera->FieldOfView : 45.0f, (float)Batch->Width / (float)Batch->Height, 0.1f, 100.0f);
+	mat4 View = Camera->Override ?
+		LookAt(vec3(Camera->Position[0], Camera->Position[1], Camera->Position[2]), vec3(Camera->Target[0], Camera->Target[1], Camera->Target[2])) :
+		LookAt(vec3(0.0f, 0.0f, 3.0f), vec3(0.0f, 0.0f, 0.0f));
+	mat4 Model = ModelFitTransform(AABB, RootTransform);
+
+	// NOTE(georgy): The workers are all busy with models, so each frame is rendered on the thread that asked for it
+	game_memory SerialMemory = {};
+	software_renderer* Renderer = &Worker->Renderer;
+	RenderSoftware(&SerialMemory, &Worker->Scratch, Renderer, Batch->Width, Batch->Height, Projection * View * Model,
+		Geometry->Meshes.Entries, Worker->Draws.Entries, Worker->Draws.EntriesCount,
+		Geometry->Positions.Entries, Geometry->TexCoords.Entries, Geometry->Positions.EntriesCount,
+		Geometry->Indices.Entries, Worker->Materials.Entries, &Worker->Textures);
+
+	Now = GetWallClockSeconds();
+	Worker->StageSeconds[ThumbnailStage_Render] += Now - StageStart;
+	StageStart = Now;
+
+	// NOTE(georgy): RGBA to BGRA, and the tile padding off the end of the rows
+	ResizeDynamicArray(&Worker->Image, Batch->Width * Batch->Height);
+	for (uint32_t Y = 0; Y < Batch->Height; Y++)
+	{
+		uint32_t* Source = &Renderer->Color[Y * Renderer->Pitch];
+		uint32_t* Dest = &Worker->Image[Y * Batch->Width];
+		for (uint32_t X = 0; X < Batch->Width; X++)
+		{
+			uint32_t Color = Source[X];
+			Dest[X] = (Color & 0xFF00FF00) | ((Color & 0xFF) << 16) | ((Color >> 16) & 0xFF);
+		}
+	}
+
+	// NOTE(georgy): Prefixed with the model's place in the list, catalogs reuse file names across directories
+	const char* FileName = FileNameFromPath(ModelFilePath);
+	const char* Extension = strrchr(FileName, '.');
+	int NameLength = Extension ? (int)(Extension - FileName) : (int)strlen(FileName);
+	char OutputPath[MAX_PATH];
+	snprintf(OutputPath, sizeof(OutputPath), "%s/%06u_%.*s.tga", Batch->OutputDirectory, ModelIndex, NameLength, FileName);
+	bool Result = WriteTGA(OutputPath, Batch->Width, Batch->Height, (uint8_t*)Worker->Image.Entries, true);
+	if (!Result)
+	{
+		printf("Failed to write %s\n", OutputPath);
+	}
+
+	Worker->StageSeconds[ThumbnailStage_Write] += GetWallClockSeconds() - StageStart;
+
+	return(Result);
+}
+
+static PLATFORM_WORK_QUEUE_CALLBACK(DoThumbnailWorker)
+{
+	(void)Queue;
+	MEMORY_TAG(MemoryTag_Thumbnails);
+
+	thumbnail_worker* Worker = (thumbnail_worker*)Data;
+	thumbnail_batch* Batch = Worker->Batch;
+
+	for (;;)
+	{
+		uint32_t ModelIndex = Batch->NextModel++;
+		if (ModelIndex >= Batch->ModelCount)
+		{
+			break;
+		}
+
+		if (RenderThumbnail(Worker, ModelIndex))
+		{
+			Worker->Written++;
+		}
+		else
+		{
+			Worker->Failed++;
+		}
+	}
+}
+
+// NOTE(georgy): Stage times are summed over all workers and divided by the model count, so they add up to the
+// time one model takes on one core. Files assimp has no importer for are skipped, not failed.
+uint32_t
+RenderThumbnails(game_memory* Memory, uint32_t ModelCount, const char** ModelPaths, const char* OutputDirectory,
+				 uint32_t Width, uint32_t Height)
+{
+	double StartTime = GetWallClockSeconds();
+
+#if defined(_WIN32)
+	_mkdir(OutputDirectory);
+#else
+	mkdir(OutputDirectory, 0755);
+#endif
+
+	dynamic_array<const char*> Models(ModelCount);
+	uint32_t SkippedCount = FilterImportableModels(ModelCount, ModelPaths, &Models);
+	ModelCount = Models.EntriesCount;
+
+	thumbnail_batch Batch;
+	Batch.ModelCount = ModelCount;
+	Batch.ModelPaths = Models.Entries;
+	Batch.OutputDirectory = OutputDirectory;
+	Batch.Width = Width;
+	Batch.Height = Height;
+	Batch.Camera = Memory->Camera;
+	Batch.NextModel = 0;
+
+	// NOTE(georgy): One per worker thread and one for the main thread, which works the queue while it waits
+	uint32_t WorkerCount = Memory->WorkQueue ? Min(Memory->WorkerThreadCount + 1, ModelCount) : 1;
+	WorkerCount = Max(WorkerCount, 1u);
+	thumbnail_worker* Workers = new thumbnail_worker[WorkerCount]();
+
+	// NOTE(georgy): Temporary storage is split evenly between the workers
+	memory_arena TemporaryArena;
+	InitializeArena(&TemporaryArena, Memory->TemporaryStorageSize, Memory->TemporaryStorage);
+	uint64_t ScratchSize = (Memory->TemporaryStorageSize / WorkerCount) & ~15ull;
+	for (uint32_t WorkerIndex = 0; WorkerIndex < WorkerCount; WorkerIndex++)
+	{
+		SubArena(&Workers[WorkerIndex].Scratch, &TemporaryArena, ScratchSize);
+	}
+
+	for (uint32_t WorkerIndex = 0; WorkerIndex < WorkerCount; WorkerIndex++)
+	{
+		Workers[WorkerIndex].Batch = &Batch;
+		if (Memory->WorkQueue)
+		{
+			Memory->PlatformAddEntry(Memory->WorkQueue, DoThumbnailWorker, &Workers[WorkerIndex]);
+		}
+		else
+		{
+			DoThumbnailWorker(0, &Workers[WorkerIndex]);
+		}
+	}
+	if (Memory->WorkQueue)
+	{
+		Memory->PlatformCompleteAllWork(Memory->WorkQueue);
+	}
+
+	uint32_t Written = 0;
+	uint32_t Failed = 0;
+	double StageSeconds[ThumbnailStage_Count] = {};
+	for (uint32_t WorkerIndex = 0; WorkerIndex < WorkerCount; WorkerIndex++)
+	{
+		thumbnail_worker* Worker = &Workers[WorkerIndex];
+		Written += Worker->Written;
+		Failed += Worker->Failed;
+		for (uint32_t Stage = 0; Stage < ThumbnailStage_Count; Stage++)
+		{
+			StageSeconds[Stage] += Worker->StageSeconds[Stage];
+		}
+	}
+	// NOTE(georgy): The arrays free themselves
+	delete[] Workers;
+
+	double Seconds = GetWallClockSeconds() - StartTime;
+	double PerModel = (ModelCount > 0) ? 1000.0 / ModelCount : 0.0;
+	printf("Thumbnails: %u written, %u failed, %u files skipped in %.2f s on %u workers, %.1f models/s\n",
+		Written, Failed, SkippedCount, Seconds, WorkerCount, (Seconds > 0.0) ? ModelCount / Seconds : 0.0);
+	printf("Per model on one core: import %.2f ms, textures %.2f ms, render %.2f ms, write %.2f ms\n",
+		PerModel * StageSeconds[ThumbnailStage_Import], PerModel * StageSeconds[ThumbnailStage_Textures],
+		PerModel * StageSeconds[ThumbnailStage_Render], PerModel * StageSeconds[ThumbnailStage_Write]);
+
+	return(Failed);
+}
+
+//
+// NOTE(georgy): Load benchmark
+//
+
+// NOTE(georgy): Everything LoadModel and BuildModelBVH allocated, GL objects included
+static void
+RemoveModelFileWatches(model* Model, file_watcher* Watcher)
+{
+	RemoveFileWatch(Watcher, Model->FileWatch);
+	Model->FileWatch = NO_FILE_WATCH;
+	for (uint32_t MaterialIndex = 0;
+		MaterialIndex < Model->TextureFiles.EntriesCount;
+		MaterialIndex++)
+	{
+		RemoveFileWatch(Watcher, Model->TextureFiles[MaterialIndex].Watch);
+		Model->TextureFiles[MaterialIndex].Watch = NO_FILE_WATCH;
+	}
+}
+
+static void
+ReleaseModel(model* Model)
+{
+	for (uint32_t VBOIndex = 0; VBOIndex < ArrayCount(Model->VBOs); VBOIndex++)
+	{
+		TrackGPUObject(MemoryTag_GPUBuffers, Model->VBOs[VBOIndex], 0);
+	}
+	glDeleteVertexArrays(1, &Model->VAO);
+	glDeleteBuffers(ArrayCount(Model->VBOs), Model->VBOs);
+	UploadTextureArray(&Model->TextureArray, 0);
+
+	FreeDynamicArray(&Model->Meshes);
+	FreeDynamicArray(&Model->Materials);
+	FreeDynamicArray(&Model->TextureFiles);
+	FreeDynamicArray(&Model->TextureArray.Texels);
+	FreeDynamicArray(&Model->TextureArray.Slots);
+	FreeCullBounds(&Model->MeshBounds);
+	FreeDynamicArray(&Model->Positions);
+	FreeDynamicArray(&Model->TexCoords);
+	FreeDynamicArray(&Model->Indices);
+	FreeSceneBVH(&Model->BVH);
+	FreeAnimationSet(&Model->Animation);
+	FreeMorphTargets(&Model->Morph);
+}
+
+// NOTE(georgy): Runs go over all models before the next run starts, so a slow phase of the machine doesn't land on
+// one model only. Each load starts from a fresh model, like the first load of the viewer. Medians are over runs.
+bool
+BenchmarkModelLoads(game_memory* Memory, uint32_t ModelCount, const char** ModelPaths, uint32_t RunCount,
+					const char* JSONPath, const char* BaselinePath, float RegressionThreshold)
+{
+	dynamic_array<const char*> Models(ModelCount);
+	uint32_t SkippedCount = FilterImportableModels(ModelCount, ModelPaths, &Models);
+	ModelCount = Models.EntriesCount;
+	if ((ModelCount == 0) || (RunCount == 0))
+	{
+		printf("Load benchmark: nothing to load, %u files skipped\n", SkippedCount);
+		return(false);
+	}
+
+	file_watcher Watcher = {};
+	InitializeFileWatcher(&Watcher);
+
+	memory_arena ImportScratch;
+	InitializeArena(&ImportScratch, Memory->TemporaryStorageSize, Memory->TemporaryStorage);
+
+	// NOTE(georgy): [Model][Stage][Run], the last stage is the total
+	uint32_t StageCount = LoadStage_Count + 1;
+	dynamic_array<load_stage_sample> Samples;
+	ResizeDynamicArray(&Samples, ModelCount * StageCount * RunCount);
+	uint32_t FailedCount = 0;
+	for (uint32_t Run = 0; Run < RunCount; Run++)
+	{
+		for (uint32_t ModelIndex = 0; ModelIndex < ModelCount; ModelIndex++)
+		{
+			model* Model = new model();
+			InitializeModel(Model);
+
+			load_profile Profile;
+			BeginLoadProfile(&Profile, Memory);
+			bool Loaded = LoadModel(Model, Models[ModelIndex], &Watcher, &ImportScratch, false, &Profile);
+			if (Loaded)
+			{
+				SwitchLoadStage(&Profile, LoadStage_BVH);
+				BuildModelBVH(Memory, Model);
+			}
+			SwitchLoadStage(&Profile, LoadStage_None);
+
+			RemoveModelFileWatches(Model, &Watcher);
+			ReleaseModel(Model);
+			delete Model;
+
+			if (!Loaded)
+			{
+				FailedCount++;
+			}
+
+			load_stage_sample Total = {};
+			for (uint32_t Stage = 0; Stage < StageCount; Stage++)
+			{
+				load_stage_sample Sample = (Stage < LoadStage_Count) ? Profile.Stages[Stage] : Total;
+				Samples[(ModelIndex * StageCount + Stage) * RunCount + Run] = Sample;
+
+				Total.WallSeconds += Sample.WallSeconds;
+				Total.CPUSeconds += Sample.CPUSeconds;
+				Total.PeakResidentBytes = Max(Total.PeakResidentBytes, Sample.PeakResidentBytes);
+				Total.PeakGrowthBytes = Max(Total.PeakGrowthBytes, Sample.PeakGrowthBytes);
+			}
+		}
+	}
+
+	ReleaseFileWatcher(&Watcher);
+
+	dynamic_array<double> Scratch;
+	ResizeDynamicArray(&Scratch, RunCount);
+	dynamic_array<load_stage_summary> Summaries;
+	ResizeDynamicArray(&Summaries, ModelCount * StageCount);
+	for (uint32_t Index = 0; Index < ModelCount * StageCount; Index++)
+	{
+		Summaries[Index] = SummarizeLoadStage(&Samples[Index * RunCount], RunCount, Scratch.Entries);
+	}
+
+	printf("\nLoad benchmark: %u models, %u runs each, %u failed loads, %u files skipped\n", ModelCount, RunCount, FailedCount, SkippedCount);
+	printf("%-32s %-12s %10s %10s %10s %10s %10s %10s %10s\n",
+		"model", "stage", "median ms", "p90 ms", "min ms", "max ms", "cpu ms", "peak MB", "growth MB");
+	for (uint32_t ModelIndex = 0; ModelIndex < ModelCount; ModelIndex++)
+	{
+		for (uint32_t Stage = 0; Stage < StageCount; Stage++)
+		{
+			load_stage_summary* Summary = &Summaries[ModelIndex * StageCount + Stage];
+			printf("%-32.32s %-12s %10.2f %10.2f %10.2f %10.2f %10.2f %10.1f %10.1f\n",
+				(Stage == 0) ? FileNameFromPath(Models[ModelIndex]) : "", LoadStageNames[Stage],
+				Summary->WallMedianMs, Summary->WallP90Ms, Summary->WallMinMs, Summary->WallMaxMs,
+				Summary->CPUMedianMs, Summary->PeakResidentMB, Summary->PeakGrowthMB);
+		}
+	}
+
+	bool Result = (FailedCount == 0);
+	if (JSONPath)
+	{
+		if (WriteLoadBenchmarkJSON(JSONPath, ModelCount, Models.Entries, RunCount, Summaries.Entries))
+		{
+			printf("Results written to %s\n", JSONPath);
+		}
+		else
+		{
+			printf("Failed to write %s\n", JSONPath);
+			Result = false;
+		}
+	}
+
+	// NOTE(georgy): Medians only, and differences under LOAD_BENCHMARK_NOISE_MS never count
+	if (BaselinePath)
+	{
+		read_entire_file_result Baseline = ReadEntireFile(BaselinePath);
+		if (Baseline.Memory)
+		{
+			char* BaselineText = (char*)MemoryRealloc(Baseline.Memory, Baseline.Size + 1);
+			BaselineText[Baseline.Size] = 0;
+
+			uint32_t RegressionCount = 0;
+			uint32_t MissingCount = 0;
+			for (uint32_t ModelIndex = 0; ModelIndex < ModelCount; ModelIndex++)
+			{
+				for (uint32_t Stage = 0; Stage < StageCount; Stage++)
+				{
+					double Current = Summaries[ModelIndex * StageCount + Stage].WallMedianMs;
+					double Base;
+					if (!FindBaselineMedian(BaselineText, Models[ModelIndex], LoadStageNames[Stage], &Base))
+					{
+						MissingCount++;
+					}
+					else if ((Current > Base * (1.0 + RegressionThreshold)) && (Current - Base > LOAD_BENCHMARK_NOISE_MS))
+					{
+						printf("Regression: %s %s, %.2f ms against %.2f ms in the baseline (+%.0f%%)\n",
+							Models[ModelIndex], LoadStageNames[Stage], Current, Base, (Base > 0.0) ? 100.0 * (Current / Base - 1.0) : 100.0);
+						RegressionCount++;
+					}
+				}
+			}
+
+			printf("Baseline %s: %u regressions over %.0f%%, %u stages not in the baseline\n",
+				BaselinePath, RegressionCount, 100.0f * RegressionThreshold, MissingCount);
+			Result = Result && (RegressionCount == 0);
+			MemoryFree(BaselineText);
+		}
+		else
+		{
+			printf("Can't read the baseline %s\n", BaselinePath);
+			Result = false;
+		}
+	}
+
+	return(Result);
+}
@@ -0,0 +1,718 @@
+#pragma once
+
+// NOTE(georgy): Compressed animation clips.
+// Every track (translation, rotation or scale of one node) is a run of uint16 words in KeyData:
+//   KeyCount words     - key times, quantized over [0, Clip->Duration]
+//   3*KeyCount words   - key values. Translations and scales are quantized within the track's own
+//                        [RangeMin, RangeMin + RangeExtent] box, rotations are stored smallest-three.
+// Keys that linear interpolation of their neighbours reproduces within the tolerance are dropped
+// at import. Playback goes through an animation_cursor that remembers the current key of every
+// track, so sampling a clip with increasing time never searches.
+
+#define ANIMATION_TIME_QUANTIZATION 65535.0f
+#define ANIMATION_VALUE_QUANTIZATION 65535.0f
+#define ANIMATION_ROTATION_QUANTIZATION 32767.0f
+#define INVALID_NODE_INDEX 0xFFFFFFFF
+#define MAX_BONES_PER_VERTEX 4
+
+enum animation_track_type
+{
+	Track_Translation,
+	Track_Rotation,
+	Track_Scale,
+
+	Track_Count
+};
+
+struct animation_node
+{
+	uint32_t ParentIndex;
+	uint32_t NameHash;
+	mat4 LocalTransform;
+};
+
+struct animation_bone
+{
+	uint32_t NodeIndex;
+	mat4 Offset;
+};
+
+struct vertex_skin
+{
+	uint16_t BoneIndices[MAX_BONES_PER_VERTEX];
+	float BoneWeights[MAX_BONES_PER_VERTEX];
+};
+
+struct animation_track
+{
+	uint32_t DataOffset;
+	uint32_t KeyCount;
+	vec3 RangeMin;
+	vec3 RangeExtent;
+};
+
+struct animation_channel
+{
+	uint32_t NodeIndex;
+	animation_track Tracks[Track_Count];
+};
+
+struct animation_clip
+{
+	float Duration;
+	uint32_t FirstChannel;
+	uint32_t ChannelCount;
+
+	uint32_t UncompressedSize;
+	uint32_t CompressedSize;
+	float MaxTranslationError;
+	float MaxRotationError;
+	float MaxScaleError;
+};
+
+struct animation_set
+{
+	// NOTE(georgy): Nodes are stored parents first, so a single forward pass computes global transforms
+	dynamic_array<animation_node> Nodes;
+	dynamic_array<animation_bone> Bones;
+
+	dynamic_array<animation_clip> Clips;
+	dynamic_array<animation_channel> Channels;
+	dynamic_array<uint16_t> KeyData;
+};
+
+struct animation_cursor
+{
+	uint32_t ClipIndex;
+	float LastTime;
+	dynamic_array<uint32_t> Keys;
+};
+
+struct animation_compression_settings
+{
+	float TranslationTolerance;
+	float RotationTolerance;
+	float ScaleTolerance;
+};
+
+static uint32_t
+HashNodeName(const char* Name)
+{
+	// NOTE(georgy): FNV-1a
+	uint32_t Result = 2166136261u;
+	for (const char* C = Name; *C; C++)
+	{
+		Result = (Result ^ (uint8_t)*C) * 16777619u;
+	}
+
+	return(Result);
+}
+
+static uint32_t
+FindNodeIndex(animation_set* Animation, const char* Name)
+{
+	uint32_t Result = INVALID_NODE_INDEX;
+
+	uint32_t NameHash = HashNodeName(Name);
+	for (uint32_t NodeIndex = 0;
+		NodeIndex < Animation->Nodes.EntriesCount;
+		NodeIndex++)
+	{
+		if (Animation->Nodes[NodeIndex].NameHash == NameHash)
+		{
+			Result = NodeIndex;
+			break;
+		}
+	}
+
+	return(Result);
+}
+
+static void
+AddNodeHierarchy(animation_set* Animation, const aiNode* Node, uint32_t ParentIndex)
+{
+	animation_node NewNode;
+	NewNode.ParentIndex = ParentIndex;
+	NewNode.NameHash = HashNodeName(Node->mName.C_Str());
+	NewNode.LocalTransform = Mat4FromAssimp(Node->mTransformation);
+	PushEntry(&Animation->Nodes, NewNode);
+
+	uint32_t NodeIndex = Animation->Nodes.EntriesCount - 1;
+	for (uint32_t ChildIndex = 0;
+		ChildIndex < Node->mNumChildren;
+		ChildIndex++)
+	{
+		AddNodeHierarchy(Animation, Node->mChildren[ChildIndex], NodeIndex);
+	}
+}
+
+inline uint16_t
+QuantizeUnit(float Value, float Quantization)
+{
+	uint16_t Result = (uint16_t)(Clamp(Value, 0.0f, 1.0f) * Quantization + 0.5f);
+
+	return(Result);
+}
+
+static void
+PackVec3(uint16_t* Dest, vec3 V, vec3 RangeMin, vec3 RangeExtent)
+{
+	for (uint32_t I = 0; I < 3; I++)
+	{
+		Dest[I] = (RangeExtent.E[I] > 0.0f) ? QuantizeUnit((V.E[I] - RangeMin.E[I]) / RangeExtent.E[I], ANIMATION_VALUE_QUANTIZATION) : 0;
+	}
+}
+
+inline vec3
+UnpackVec3(const uint16_t* Src, vec3 RangeMin, vec3 RangeExtent)
+{
+	vec3 Result;
+
+	Result.x = RangeMin.x + RangeExtent.x * (Src[0] * (1.0f / ANIMATION_VALUE_QUANTIZATION));
+	Result.y = RangeMin.y + RangeExtent.y * (Src[1] * (1.0f / ANIMATION_VALUE_QUANTIZATION));
+	Result.z = RangeMin.z + RangeExtent.z * (Src[2] * (1.0f / ANIMATION_VALUE_QUANTIZATION));
+
+	return(Result);
+}
+
+// NOTE(georgy): Smallest-three. The largest component is dropped (and made positive, q and -q are the same rotation),
+// the other three lie in [-1/sqrt(2), 1/sqrt(2)] and get 15 bits each. The 2-bit index of the dropped component
+// goes into the top bits of the first two words.
+static void
+PackQuat(uint16_t* Dest, quat Q)
+{
+	uint32_t Largest = 0;
+	for (uint32_t I = 1; I < 4; I++)
+	{
+		if (Absolute(Q.E[I]) > Absolute(Q.E[Largest]))
+		{
+			Largest = I;
+		}
+	}
+
+	float Sign = (Q.E[Largest] < 0.0f) ? -1.0f : 1.0f;
+	uint32_t Word = 0;
+	for (uint32_t I = 0; I < 4; I++)
+	{
+		if (I != Largest)
+		{
+			float Unit = Sign * Q.E[I] * (0.5f * 1.41421356f) + 0.5f;
+			Dest[Word++] = QuantizeUnit(Unit, ANIMATION_ROTATION_QUANTIZATION);
+		}
+	}
+
+	Dest[0] |= (uint16_t)((Largest >> 1) << 15);
+	Dest[1] |= (uint16_t)((Largest & 1) << 15);
+}
+
+inline quat
+UnpackQuat(const uint16_t* Src)
+{
+	quat Result;
+
+	uint32_t Largest = ((Src[0] >> 15) << 1) | (Src[1] >> 15);
+	float SumSq = 0.0f;
+	uint32_t Word = 0;
+	for (uint32_t I = 0; I < 4; I++)
+	{
+		if (I != Largest)
+		{
+			float Unit = (Src[Word++] & 0x7FFF) * (1.0f / ANIMATION_ROTATION_QUANTIZATION);
+			Result.E[I] = (Unit - 0.5f) * (2.0f / 1.41421356f);
+			SumSq += Result.E[I] * Result.E[I];
+		}
+	}
+	Result.E[Largest] = sqrtf(Max(0.0f, 1.0f - SumSq));
+
+	return(Result);
+}
+
+static vec3
+SampleTrackVec3(const animation_track* Track, const uint16_t* KeyData, uint32_t Key, float Time, float Duration)
+{
+	const uint16_t* Times = KeyData + Track->DataOffset;
+	const uint16_t* Values = Times + Track->KeyCount;
+
+	vec3 Result = UnpackVec3(Values + 3 * Key, Track->RangeMin, Track->RangeExtent);
+	if (Key + 1 < Track->KeyCount)
+	{
+		float TimeScale = Duration / ANIMATION_TIME_QUANTIZATION;
+		float T0 = Times[Key] * TimeScale;
+		float T1 = Times[Key + 1] * TimeScale;
+		float t = (T1 > T0) ? Clamp((Time - T0) / (T1 - T0), 0.0f, 1.0f) : 0.0f;
+
+		Result = Lerp(Result, UnpackVec3(Values + 3 * (Key + 1), Track->RangeMin, Track->RangeExtent), t);
+	}
+
+	return(Result);
+}
+
+static quat
+SampleTrackQuat(const animation_track* Track, const uint16_t* KeyData, uint32_t Key, float Time, float Duration)
+{
+	const uint16_t* Times = KeyData + Track->DataOffset;
+	const uint16_t* Values = Times + Track->KeyCount;
+
+	quat Result = UnpackQuat(Values + 3 * Key);
+	if (Key + 1 < Track->KeyCount)
+	{
+		float TimeScale = Duration / ANIMATION_TIME_QUANTIZATION;
+		float T0 = Times[Key] * TimeScale;
+		float T1 = Times[Key + 1] * TimeScale;
+		float t = (T1 > T0) ? Clamp((Time - T0) / (T1 - T0), 0.0f, 1.0f) : 0.0f;
+
+		Result = NLerp(Result, UnpackQuat(Values + 3 * (Key + 1)), t);
+	}
+
+	return(Result);
+}
+
+// NOTE(georgy): Moves Key forward to the last key at or before Time. Only rewinds when time goes backwards
+// (looping, seeking), so sequential playback is O(1) per track.
+inline uint32_t
+AdvanceTrackKey(const animation_track* Track, const uint16_t* KeyData, uint32_t Key, float Time, float Duration)
+{
+	const uint16_t* Times = KeyData + Track->DataOffset;
+	float QuantizedTime = (Duration > 0.0f) ? Clamp(Time / Duration, 0.0f, 1.0f) * ANIMATION_TIME_QUANTIZATION : 0.0f;
+
+	if ((Key >= Track->KeyCount) || (Times[Key] > QuantizedTime))
+	{
+		Key = 0;
+	}
+	while ((Key + 1 < Track->KeyCount) && (Times[Key + 1] <= QuantizedTime))
+	{
+		Key++;
+	}
+
+	return(Key);
+}
+
+static void
+InitializeAnimationCursor(animation_set* Animation, animation_cursor* Cursor, uint32_t ClipIndex)
+{
+	animation_clip* Clip = &Animation->Clips[ClipIndex];
+
+	Cursor->ClipIndex = ClipIndex;
+	Cursor->LastTime = 0.0f;
+	InitializeDynamicArray(&Cursor->Keys, Clip->ChannelCount * Track_Count);
+	ResizeDynamicArray(&Cursor->Keys, Clip->ChannelCount * Track_Count);
+}
+
+// NOTE(georgy): Global = Parent global * Local. Relies on parents being stored before their children.
+static void
+ComputeGlobalTransforms(animation_set* Animation, const mat4* LocalTransforms, mat4* GlobalTransforms)
+{
+	for (uint32_t NodeIndex = 0;
+		NodeIndex < Animation->Nodes.EntriesCount;
+		NodeIndex++)
+	{
+		uint32_t ParentIndex = Animation->Nodes[NodeIndex].ParentIndex;
+		GlobalTransforms[NodeIndex] = (ParentIndex == INVALID_NODE_INDEX) ?
+			LocalTransforms[NodeIndex] : GlobalTransforms[ParentIndex] * LocalTransforms[NodeIndex];
+	}
+}
+
+// NOTE(georgy): Writes the local transform of every node the clip animates. Nodes without a channel keep whatever is in LocalTransforms.
+static void
+SampleAnimationClip(animation_set* Animation, animation_cursor* Cursor, float Time, mat4* LocalTransforms)
+{
+	animation_clip* Clip = &Animation->Clips[Cursor->ClipIndex];
+	const uint16_t* KeyData = Animation->KeyData.Entries;
+
+	for (uint32_t ChannelIndex = 0;
+		ChannelIndex < Clip->ChannelCount;
+		ChannelIndex++)
+	{
+		animation_channel* Channel = &Animation->Channels[Clip->FirstChannel + ChannelIndex];
+		uint32_t* Keys = &Cursor->Keys[ChannelIndex * Track_Count];
+
+		for (uint32_t TrackIndex = 0; TrackIndex < Track_Count; TrackIndex++)
+		{
+			Keys[TrackIndex] = AdvanceTrackKey(&Channel->Tracks[TrackIndex], KeyData, Keys[TrackIndex], Time, Clip->Duration);
+		}
+
+		vec3 T = SampleTrackVec3(&Channel->Tracks[Track_Translation], KeyData, Keys[Track_Translation], Time, Clip->Duration);
+		quat R = SampleTrackQuat(&Channel->Tracks[Track_Rotation], KeyData, Keys[Track_Rotation], Time, Clip->Duration);
+		vec3 S = SampleTrackVec3(&Channel->Tracks[Track_Scale], KeyData, Keys[Track_Scale], Time, Clip->Duration);
+
+		LocalTransforms[Channel->NodeIndex] = TranslationRotationScale(T, R, S);
+	}
+
+	Cursor->LastTime = Time;
+}
+
+//
+// NOTE(georgy): Import
+//
+
+struct source_key
+{
+	float Time;
+	float V[4];
+};
+
+static float
+SourceKeyError(animation_track_type Type, const source_key* A, const source_key* B, const source_key* Key)
+{
+	float t = (B->Time > A->Time) ? (Key->Time - A->Time) / (B->Time - A->Time) : 0.0f;
+
+	float Result;
+	if (Type == Track_Rotation)
+	{
+		quat Interpolated = NLerp(quat(A->V[0], A->V[1], A->V[2], A->V[3]), quat(B->V[0], B->V[1], B->V[2], B->V[3]), t);
+		Result = AngleBetween(Interpolated, quat(Key->V[0], Key->V[1], Key->V[2], Key->V[3]));
+	}
+	else
+	{
+		vec3 Interpolated = Lerp(vec3(A->V[0], A->V[1], A->V[2]), vec3(B->V[0], B->V[1], B->V[2]), t);
+		Result = Length(Interpolated - vec3(Key->V[0], Key->V[1], Key->V[2]));
+	}
+
+	return(Result);
+}
+
+// NOTE(georgy): Greedy reduction. From the last kept key we extend the segment as long as every key it skips
+// stays within tolerance, then keep the key where it broke.
+static void
+ReduceSourceKeys(animation_track_type Type, const source_key* Keys, uint32_t KeyCount, float Tolerance, dynamic_array<uint32_t>* KeptKeys)
+{
+	KeptKeys->EntriesCount = 0;
+	PushEntry(KeptKeys, 0u);
+
+	// NOTE(georgy): A track that never moves collapses to a single key
+	bool IsConstant = true;
+	for (uint32_t KeyIndex = 1; IsConstant && (KeyIndex < KeyCount); KeyIndex++)
+	{
+		IsConstant = SourceKeyError(Type, &Keys[0], &Keys[0], &Keys[KeyIndex]) <= Tolerance;
+	}
+
+	if (!IsConstant)
+	{
+		uint32_t Anchor = 0;
+		for (uint32_t Candidate = 2; Candidate < KeyCount; Candidate++)
+		{
+			bool CanSkip = true;
+			for (uint32_t Skipped = Anchor + 1; CanSkip && (Skipped < Candidate); Skipped++)
+			{
+				CanSkip = SourceKeyError(Type, &Keys[Anchor], &Keys[Candidate], &Keys[Skipped]) <= Tolerance;
+			}
+
+			if (!CanSkip)
+			{
+				Anchor = Candidate - 1;
+				PushEntry(KeptKeys, Anchor);
+			}
+		}
+
+		PushEntry(KeptKeys, KeyCount - 1);
+	}
+}
+
+static void
+CompressTrack(animation_set* Animation, animation_track* Track, animation_track_type Type,
+			  const source_key* Keys, uint32_t KeyCount, float Duration, float Tolerance,
+			  dynamic_array<uint32_t>* KeptKeys)
+{
+	if (KeyCount == 0)
+	{
+		// NOTE(georgy): Missing track, store the identity so sampling never has to special-case it
+		source_key Identity = {};
+		if (Type == Track_Rotation) Identity.V[3] = 1.0f;
+		if (Type == Track_Scale) Identity.V[0] = Identity.V[1] = Identity.V[2] = 1.0f;
+
+		CompressTrack(Animation, Track, Type, &Identity, 1, Duration, Tolerance, KeptKeys);
+		return;
+	}
+
+	ReduceSourceKeys(Type, Keys, KeyCount, Tolerance, KeptKeys);
+
+	Track->DataOffset = Animation->KeyData.EntriesCount;
+	Track->KeyCount = KeptKeys->EntriesCount;
+	Track->RangeMin = vec3(FLT_MAX);
+	Track->RangeExtent = vec3(0.0f);
+
+	if (Type != Track_Rotation)
+	{
+		vec3 RangeMax = vec3(-FLT_MAX);
+		for (uint32_t I = 0; I < KeptKeys->EntriesCount; I++)
+		{
+			const source_key* Key = &Keys[(*KeptKeys)[I]];
+			for (uint32_t C = 0; C < 3; C++)
+			{
+				Track->RangeMin.E[C] = Min(Track->RangeMin.E[C], Key->V[C]);
+				RangeMax.E[C] = Max(RangeMax.E[C], Key->V[C]);
+			}
+		}
+		Track->RangeExtent = RangeMax - Track->RangeMin;
+	}
+
+	ResizeDynamicArray(&Animation->KeyData, Track->DataOffset + 4 * Track->KeyCount);
+	uint16_t* Times = &Animation->KeyData[Track->DataOffset];
+	uint16_t* Values = Times + Track->KeyCount;
+	for (uint32_t I = 0; I < KeptKeys->EntriesCount; I++)
+	{
+		const source_key* Key = &Keys[(*KeptKeys)[I]];
+
+		Times[I] = (Duration > 0.0f) ? QuantizeUnit(Key->Time / Duration, ANIMATION_TIME_QUANTIZATION) : 0;
+		if (Type == Track_Rotation)
+		{
+			PackQuat(Values + 3 * I, Normalize(quat(Key->V[0], Key->V[1], Key->V[2], Key->V[3])));
+		}
+		else
+		{
+			PackVec3(Values + 3 * I, vec3(Key->V[0], Key->V[1], Key->V[2]), Track->RangeMin, Track->RangeExtent);
+		}
+	}
+}
+
+// NOTE(georgy): Replays the source keys through the compressed track and returns the largest deviation
+static float
+MeasureTrackError(animation_set* Animation, animation_track* Track, animation_track_type Type,
+				  const source_key* Keys, uint32_t KeyCount, float Duration)
+{
+	float Result = 0.0f;
+
+	uint32_t Key = 0;
+	for (uint32_t KeyIndex = 0; KeyIndex < KeyCount; KeyIndex++)
+	{
+		const source_key* Source = &Keys[KeyIndex];
+		Key = AdvanceTrackKey(Track, Animation->KeyData.Entries, Key, Source->Time, Duration);
+
+		float Error;
+		if (Type == Track_Rotation)
+		{
+			quat Sampled = SampleTrackQuat(Track, Animation->KeyData.Entries, Key, Source->Time, Duration);
+			Error = AngleBetween(Sampled, quat(Source->V[0], Source->V[1], Source->V[2], Source->V[3]));
+		}
+		else
+		{
+			vec3 Sampled = SampleTrackVec3(Track, Animation->KeyData.Entries, Key, Source->Time, Duration);
+			Error = Length(Sampled - vec3(Source->V[0], Source->V[1], Source->V[2]));
+		}
+
+		Result = Max(Result, Error);
+	}
+
+	return(Result);
+}
+
+static void
+GatherVectorKeys(dynamic_array<source_key>* Keys, const aiVectorKey* AssimpKeys, uint32_t KeyCount, float SecondsPerTick)
+{
+	Keys->EntriesCount = 0;
+	ReserveDynamicArray(Keys, KeyCount);
+	for (uint32_t KeyIndex = 0; KeyIndex < KeyCount; KeyIndex++)
+	{
+		source_key Key = {};
+		Key.Time = (float)AssimpKeys[KeyIndex].mTime * SecondsPerTick;
+		Key.V[0] = AssimpKeys[KeyIndex].mValue.x;
+		Key.V[1] = AssimpKeys[KeyIndex].mValue.y;
+		Key.V[2] = AssimpKeys[KeyIndex].mValue.z;
+		PushEntry(Keys, Key);
+	}
+}
+
+static void
+GatherQuatKeys(dynamic_array<source_key>* Keys, const aiQuatKey* AssimpKeys, uint32_t KeyCount, float SecondsPerTick)
+{
+	Keys->EntriesCount = 0;
+	ReserveDynamicArray(Keys, KeyCount);
+	for (uint32_t KeyIndex = 0; KeyIndex < KeyCount; KeyIndex++)
+	{
+		source_key Key = {};
+		Key.Time = (float)AssimpKeys[KeyIndex].mTime * SecondsPerTick;
+		Key.V[0] = AssimpKeys[KeyIndex].mValue.x;
+		Key.V[1] = AssimpKeys[KeyIndex].mValue.y;
+		Key.V[2] = AssimpKeys[KeyIndex].mValue.z;
+		Key.V[3] = AssimpKeys[KeyIndex].mValue.w;
+		PushEntry(Keys, Key);
+	}
+}
+
+static void
+FreeAnimationSet(animation_set* Animation)
+{
+	FreeDynamicArray(&Animation->Nodes);
+	FreeDynamicArray(&Animation->Bones);
+	FreeDynamicArray(&Animation->Clips);
+	FreeDynamicArray(&Animation->Channels);
+	FreeDynamicArray(&Animation->KeyData);
+}
+
+static void
+LoadAnimations(animation_set* Animation, const aiScene* Scene, animation_compression_settings Settings, memory_arena* Scratch)
+{
+	PROFILE_ZONE("LoadAnimations");
+	MEMORY_TAG(MemoryTag_Animation);
+
+	InitializeDynamicArray(&Animation->Nodes);
+	InitializeDynamicArray(&Animation->Bones);
+	InitializeDynamicArray(&Animation->Clips);
+	InitializeDynamicArray(&Animation->Channels);
+	InitializeDynamicArray(&Animation->KeyData);
+
+	AddNodeHierarchy(Animation, Scene->mRootNode, INVALID_NODE_INDEX);
+
+	temporary_memory KeyMemory = BeginTemporaryMemory(Scratch);
+	dynamic_array<source_key> Keys(0, Scratch);
+	dynamic_array<uint32_t> KeptKeys(0, Scratch);
+	for (uint32_t AnimationIndex = 0;
+		AnimationIndex < Scene->mNumAnimations;
+		AnimationIndex++)
+	{
+		const aiAnimation* AssimpAnimation = Scene->mAnimations[AnimationIndex];
+
+		float TicksPerSecond = (AssimpAnimation->mTicksPerSecond > 0.0) ? (float)AssimpAnimation->mTicksPerSecond : 25.0f;
+		float SecondsPerTick = 1.0f / TicksPerSecond;
+
+		animation_clip Clip = {};
+		Clip.Duration = (float)AssimpAnimation->mDuration * SecondsPerTick;
+		Clip.FirstChannel = Animation->Channels.EntriesCount;
+		uint32_t FirstKeyWord = Animation->KeyData.EntriesCount;
+
+		for (uint32_t ChannelIndex = 0;
+			ChannelIndex < AssimpAnimation->mNumChannels;
+			ChannelIndex++)
+		{
+			const aiNodeAnim* AssimpChannel = AssimpAnimation->mChannels[ChannelIndex];
+
+			animation_channel Channel = {};
+			Channel.NodeIndex = FindNodeIndex(Animation, AssimpChannel->mNodeName.C_Str());
+			if (Channel.NodeIndex == INVALID_NODE_INDEX)
+			{
+				continue;
+			}
+
+			Clip.UncompressedSize += AssimpChannel->mNumPositionKeys * sizeof(aiVectorKey) +
+									 AssimpChannel->mNumRotationKeys * sizeof(aiQuatKey) +
+									 AssimpChannel->mNumScalingKeys * sizeof(aiVectorKey);
+
+			GatherVectorKeys(&Keys, AssimpChannel->mPositionKeys, AssimpChannel->mNumPositionKeys, SecondsPerTick);
+			CompressTrack(Animation, &Channel.Tracks[Track_Translation], Track_Translation, Keys.Entries, Keys.EntriesCount, Clip.Duration, Settings.TranslationTolerance, &KeptKeys);
+			Clip.MaxTranslationError = Max(Clip.MaxTranslationError,
+				MeasureTrackError(Animation, &Channel.Tracks[Track_Translation], Track_Translation, Keys.Entries, Keys.EntriesCount, Clip.Duration));
+
+			GatherQuatKeys(&Keys, AssimpChannel->mRotationKeys, AssimpChannel->mNumRotationKeys, SecondsPerTick);
+			CompressTrack(Animation, &Channel.Tracks[Track_Rotation], Track_Rotation, Keys.Entries, Keys.EntriesCount, Clip.Duration, Settings.RotationTolerance, &KeptKeys);
+			Clip.MaxRotationError = Max(Clip.MaxRotationError,
+				MeasureTrackError(Animation, &Channel.Tracks[Track_Rotation], Track_Rotation, Keys.Entries, Keys.EntriesCount, Clip.Duration));
+
+			GatherVectorKeys(&Keys, AssimpChannel->mScalingKeys, AssimpChannel->mNumScalingKeys, SecondsPerTick);
+			CompressTrack(Animation, &Channel.Tracks[Track_Scale], Track_Scale, Keys.Entries, Keys.EntriesCount, Clip.Duration, Settings.ScaleTolerance, &KeptKeys);
+			Clip.MaxScaleError = Max(Clip.MaxScaleError,
+				MeasureTrackError(Animation, &Channel.Tracks[Track_Scale], Track_Scale, Keys.Entries, Keys.EntriesCount, Clip.Duration));
+
+			PushEntry(&Animation->Channels, Channel);
+		}
+
+		Clip.ChannelCount = Animation->Channels.EntriesCount - Clip.FirstChannel;
+		Clip.CompressedSize = Clip.ChannelCount * sizeof(animation_channel) +
+							  (Animation->KeyData.EntriesCount - FirstKeyWord) * sizeof(uint16_t);
+		PushEntry(&Animation->Clips, Clip);
+
+		printf("Animation clip %u \"%s\": %.2fs, %u channels, %u -> %u bytes (ratio %.2f), max error: translation %f, rotation %f deg, scale %f\n",
+			AnimationIndex, AssimpAnimation->mName.C_Str(), Clip.Duration, Clip.ChannelCount,
+			Clip.UncompressedSize, Clip.CompressedSize,
+			(Clip.CompressedSize > 0) ? (float)Clip.UncompressedSize / (float)Clip.CompressedSize : 0.0f,
+			Clip.MaxTranslationError, Degrees(Clip.MaxRotationError), Clip.MaxScaleError);
+	}
+	EndTemporaryMemory(KeyMemory);
+}
+
+static uint32_t
+FindOrAddBone(animation_set* Animation, uint32_t NodeIndex, const aiMatrix4x4& OffsetMatrix)
+{
+	for (uint32_t BoneIndex = 0;
+		BoneIndex < Animation->Bones.EntriesCount;
+		BoneIndex++)
+	{
+		if (Animation->Bones[BoneIndex].NodeIndex == NodeIndex)
+		{
+			return(BoneIndex);
+		}
+	}
+
+	animation_bone Bone;
+	Bone.NodeIndex = NodeIndex;
+	Bone.Offset = Mat4FromAssimp(OffsetMatrix);
+	PushEntry(&Animation->Bones, Bone);
+
+	return(Animation->Bones.EntriesCount - 1);
+}
+
+// NOTE(georgy): Keeps the MAX_BONES_PER_VERTEX strongest influences of every vertex and renormalizes them.
+// Vertices of meshes without bones end up with zero weights, the skinning shaders treat those as rigid.
+// Must run after LoadAnimations, bones reference the node hierarchy.
+static void
+LoadSkin(animation_set* Animation, const aiScene* Scene, dynamic_array<vertex_skin>* Skins)
+{
+	MEMORY_TAG(MemoryTag_Animation);
+
+	uint32_t BaseVertex = 0;
+	for (uint32_t MeshIndex = 0;
+		MeshIndex < Scene->mNumMeshes;
+		MeshIndex++)
+	{
+		const aiMesh* AssimpMesh = Scene->mMeshes[MeshIndex];
+		vertex_skin* MeshSkins = &(*Skins)[BaseVertex];
+
+		for (uint32_t AssimpBoneIndex = 0;
+			AssimpBoneIndex < AssimpMesh->mNumBones;
+			AssimpBoneIndex++)
+		{
+			const aiBone* AssimpBone = AssimpMesh->mBones[AssimpBoneIndex];
+
+			uint32_t NodeIndex = FindNodeIndex(Animation, AssimpBone->mName.C_Str());
+			if (NodeIndex == INVALID_NODE_INDEX)
+			{
+				continue;
+			}
+
+			uint32_t BoneIndex = FindOrAddBone(Animation, NodeIndex, AssimpBone->mOffsetMatrix);
+			for (uint32_t WeightIndex = 0;
+				WeightIndex < AssimpBone->mNumWeights;
+				WeightIndex++)
+			{
+				const aiVertexWeight Weight = AssimpBone->mWeights[WeightIndex];
+				vertex_skin* Skin = &MeshSkins[Weight.mVertexId];
+
+				uint32_t WeakestSlot = 0;
+				for (uint32_t Slot = 1; Slot < MAX_BONES_PER_VERTEX; Slot++)
+				{
+					if (Skin->BoneWeights[Slot] < Skin->BoneWeights[WeakestSlot])
+					{
+						WeakestSlot = Slot;
+					}
+				}
+
+				if (Weight.mWeight > Skin->BoneWeights[WeakestSlot])
+				{
+					Skin->BoneIndices[WeakestSlot] = (uint16_t)BoneIndex;
+					Skin->BoneWeights[WeakestSlot] = Weight.mWeight;
+				}
+			}
+		}
+
+		for (uint32_t VertexIndex = 0;
+			VertexIndex < AssimpMesh->mNumVertices;
+			VertexIndex++)
+		{
+			vertex_skin* Skin = &MeshSkins[VertexIndex];
+
+			float WeightSum = 0.0f;
+			for (uint32_t Slot = 0; Slot < MAX_BONES_PER_VERTEX; Slot++)
+			{
+				WeightSum += Skin->BoneWeights[Slot];
+			}
+			if (WeightSum > 0.0f)
+			{
+				for (uint32_t Slot = 0; Slot < MAX_BONES_PER_VERTEX; Slot++)
+				{
+					Skin->BoneWeights[Slot] /= WeightSum;
+				}
+			}
+		}
+
+		BaseVertex += AssimpMesh->mNumVertices;
+	}
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+// NOTE(georgy): dynamic_array against std::vector on what ExtractGeometry does with a model: for every mesh a run
+// of vertices and three indices per face, into arrays that start empty. Each case gets the same input, the checksum
+// only keeps the compiler from dropping the work.
+
+#include <vector>
+
+#define ARRAY_BENCHMARK_MESHES 64
+#define ARRAY_BENCHMARK_VERTICES 16384
+#define ARRAY_BENCHMARK_FACES 32768
+
+struct array_benchmark_vertex
+{
+	float X, Y, Z;
+};
+
+enum array_benchmark_case
+{
+	ArrayBenchmark_PushEntry,
+	ArrayBenchmark_PushEntries,
+	ArrayBenchmark_ResizeUninitialized,
+	ArrayBenchmark_VectorPushBack,
+	ArrayBenchmark_VectorInsert,
+	ArrayBenchmark_VectorResize,
+
+	ArrayBenchmark_Count
+};
+
+static const char* ArrayBenchmarkNames[ArrayBenchmark_Count] =
+{
+	"dynamic_array PushEntry",
+	"dynamic_array PushEntries",
+	"dynamic_array ResizeUninitialized",
+	"std::vector push_back",
+	"std::vector insert",
+	"std::vector resize",
+};
+
+static uint64_t
+RunArrayBenchmarkCase(uint32_t Case, const array_benchmark_vertex* SourceVertices, const uint32_t* SourceIndices)
+{
+	uint64_t Result = 0;
+	if (Case < ArrayBenchmark_VectorPushBack)
+	{
+		dynamic_array<array_benchmark_vertex> Vertices;
+		dynamic_array<uint32_t> Indices;
+		for (uint32_t MeshIndex = 0; MeshIndex < ARRAY_BENCHMARK_MESHES; MeshIndex++)
+		{
+			if (Case == ArrayBenchmark_PushEntry)
+			{
+				for (uint32_t VertexIndex = 0; VertexIndex < ARRAY_BENCHMARK_VERTICES; VertexIndex++)
+				{
+					PushEntry(&Vertices, SourceVertices[VertexIndex]);
+				}
+				for (uint32_t FaceIndex = 0; FaceIndex < ARRAY_BENCHMARK_FACES; FaceIndex++)
+				{
+					PushEntry(&Indices, SourceIndices[3*FaceIndex + 0]);
+					PushEntry(&Indices, SourceIndices[3*FaceIndex + 1]);
+					PushEntry(&Indices, SourceIndices[3*FaceIndex + 2]);
+				}
+			}
+			else if (Case == ArrayBenchmark_PushEntries)
+			{
+				PushEntries(&Vertices, SourceVertices, ARRAY_BENCHMARK_VERTICES);
+				for (uint32_t FaceIndex = 0; FaceIndex < ARRAY_BENCHMARK_FACES; FaceIndex++)
+				{
+					PushEntries(&Indices, &SourceIndices[3*FaceIndex], 3);
+				}
+			}
+			else
+			{
+				uint32_t BaseVertex = Vertices.EntriesCount;
+				uint32_t BaseIndex = Indices.EntriesCount;
+				ResizeDynamicArrayUninitialized(&Vertices, BaseVertex + ARRAY_BENCHMARK_VERTICES);
+				ResizeDynamicArrayUninitialized(&Indices, BaseIndex + 3*ARRAY_BENCHMARK_FACES);
+				for (uint32_t VertexIndex = 0; VertexIndex < ARRAY_BENCHMARK_VERTICES; VertexIndex++)
+				{
+					Vertices[BaseVertex + VertexIndex] = SourceVertices[VertexIndex];
+				}
+				for (uint32_t Index = 0; Index < 3*ARRAY_BENCHMARK_FACES; Index++)
+				{
+					Indices[BaseIndex + Index] = SourceIndices[Index];
+				}
+			}
+		}
+		Result = Vertices.EntriesCount + Indices.EntriesCount + Indices[Indices.EntriesCount - 1];
+	}
+	else
+	{
+		std::vector<array_benchmark_vertex> Vertices;
+		std::vector<uint32_t> Indices;
+		for (uint32_t MeshIndex = 0; MeshIndex < ARRAY_BENCHMARK_MESHES; MeshIndex++)
+		{
+			if (Case == ArrayBenchmark_VectorPushBack)
+			{
+				for (uint32_t VertexIndex = 0; VertexIndex < ARRAY_BENCHMARK_VERTICES; VertexIndex++)
+				{
+					Vertices.push_back(SourceVertices[VertexIndex]);
+				}
+				for (uint32_t FaceIndex = 0; FaceIndex < ARRAY_BENCHMARK_FACES; FaceIndex++)
+				{
+					Indices.push_back(SourceIndices[3*FaceIndex + 0]);
+					Indices.push_back(SourceIndices[3*FaceIndex + 1]);
+					Indices.push_back(SourceIndices[3*FaceIndex + 2]);
+				}
+			}
+			else if (Case == ArrayBenchmark_VectorInsert)
+			{
+				Vertices.insert(Vertices.end(), SourceVertices, SourceVertices + ARRAY_BENCHMARK_VERTICES);
+				for (uint32_t FaceIndex = 0; FaceIndex < ARRAY_BENCHMARK_FACES; FaceIndex++)
+				{
+					Indices.insert(Indices.end(), &SourceIndices[3*FaceIndex], &SourceIndices[3*FaceIndex + 3]);
+				}
+			}
+			else
+			{
+				// NOTE(georgy): resize zeroes the new entries first, std::vector has no way around that
+				size_t BaseVertex = Vertices.size();
+				size_t BaseIndex = Indices.size();
+				Vertices.resize(BaseVertex + ARRAY_BENCHMARK_VERTICES);
+				Indices.resize(BaseIndex + 3*ARRAY_BENCHMARK_FACES);
+				for (uint32_t VertexIndex = 0; VertexIndex < ARRAY_BENCHMARK_VERTICES; VertexIndex++)
+				{
+					Vertices[BaseVertex + VertexIndex] = SourceVertices[VertexIndex];
+				}
+				for (uint32_t Index = 0; Index < 3*ARRAY_BENCHMARK_FACES; Index++)
+				{
+					Indices[BaseIndex + Index] = SourceIndices[Index];
+				}
+			}
+		}
+		Result = Vertices.size() + Indices.size() + Indices.back();
+	}
+
+	return(Result);
+}
+
+// NOTE(georgy): Best and mean of RunCount runs per case, relative to std::vector push_back
+static void
+RunArrayBenchmark(uint32_t RunCount)
+{
+	dynamic_array<array_benchmark_vertex> SourceVertices;
+	dynamic_array<uint32_t> SourceIndices;
+	ResizeDynamicArrayUninitialized(&SourceVertices, ARRAY_BENCHMARK_VERTICES);
+	ResizeDynamicArrayUninitialized(&SourceIndices, 3*ARRAY_BENCHMARK_FACES);
+	uint32_t Random = 0x9E3779B9;
+	for (uint32_t VertexIndex = 0; VertexIndex < ARRAY_BENCHMARK_VERTICES; VertexIndex++)
+	{
+		SourceVertices[VertexIndex] = { (float)VertexIndex, 0.5f * (float)VertexIndex, -(float)VertexIndex };
+	}
+	for (uint32_t Index = 0; Index < 3*ARRAY_BENCHMARK_FACES; Index++)
+	{
+		Random ^= Random << 13;
+		Random ^= Random >> 17;
+		Random ^= Random << 5;
+		SourceIndices[Index] = Random % ARRAY_BENCHMARK_VERTICES;
+	}
+
+	printf("%u meshes of %u vertices and %u faces, %u runs\n", ARRAY_BENCHMARK_MESHES, ARRAY_BENCHMARK_VERTICES,
+		ARRAY_BENCHMARK_FACES, RunCount);
+
+	double BestSeconds[ArrayBenchmark_Count];
+	double TotalSeconds[ArrayBenchmark_Count] = {};
+	uint64_t Checksum = 0;
+	for (uint32_t Case = 0; Case < ArrayBenchmark_Count; Case++)
+	{
+		BestSeconds[Case] = 1e30;
+	}
+	// NOTE(georgy): Cases take turns, so a slow stretch of the machine doesn't land on one of them
+	for (uint32_t Run = 0; Run < RunCount; Run++)
+	{
+		for (uint32_t Case = 0; Case < ArrayBenchmark_Count; Case++)
+		{
+			double StartTime = GetWallClockSeconds();
+			Checksum += RunArrayBenchmarkCase(Case, SourceVertices.Entries, SourceIndices.Entries);
+			double Seconds = GetWallClockSeconds() - StartTime;
+
+			BestSeconds[Case] = (Seconds < BestSeconds[Case]) ? Seconds : BestSeconds[Case];
+			TotalSeconds[Case] += Seconds;
+		}
+	}
+
+	for (uint32_t Case = 0; Case < ArrayBenchmark_Count; Case++)
+	{
+		printf("%-36s best %8.3f ms, mean %8.3f ms, %5.2fx std::vector push_back\n", ArrayBenchmarkNames[Case],
+			1000.0 * BestSeconds[Case], 1000.0 * TotalSeconds[Case] / RunCount,
+			BestSeconds[ArrayBenchmark_VectorPushBack] / BestSeconds[Case]);
+	}
+	printf("Checksum %llu\n", (unsigned long long)Checksum);
+}
@@ -0,0 +1,1052 @@
+#pragma once
+
+// NOTE(georgy): Bounding volume hierarchies over aabb.
+// A bvh is built over any set of primitive bounds with a binned SAH builder. The top few levels are split on the main
+// thread, the subtrees below them are built as jobs on the platform work queue. Every job writes into its own
+// pre-reserved node range, afterwards the nodes are compacted breadth-first into 32-byte bvh_nodes. Children always
+// sit next to each other and after their parent, so a refit is one reverse pass over the nodes.
+// A scene_bvh has two levels: one bvh per mesh over its triangles, and a top level over instances of those meshes.
+// Moving an instance only refits the top level.
+
+#define BVH_BIN_COUNT 16
+#define BVH_MAX_LEAF_PRIMS 4
+#define BVH_TRAVERSAL_COST 1.0f // NOTE(georgy): Relative to one primitive test
+#define BVH_PARALLEL_THRESHOLD 65536
+#define BVH_MAX_SUBTREE_JOBS 128
+#define BVH_STACK_SIZE 64
+#define BVH_MAX_DEPTH 60 // NOTE(georgy): Deeper nodes become leaves, so a traversal stack never overflows
+
+// NOTE(georgy): 32 bytes
+struct bvh_node
+{
+	vec3 Min;
+	uint32_t LeftFirst; // NOTE(georgy): Interior nodes: the left child, the right one is LeftFirst + 1. Leaves: first entry in PrimIndices.
+	vec3 Max;
+	uint32_t PrimCount; // NOTE(georgy): 0 for interior nodes
+};
+
+struct bvh
+{
+	dynamic_array<bvh_node> Nodes;
+	dynamic_array<uint32_t> PrimIndices;
+};
+
+//
+// NOTE(georgy): Builder
+//
+
+struct bvh_builder
+{
+	aabb* PrimBounds;
+	vec3* Centroids;
+	uint32_t* PrimIndices;
+	bvh_node* Nodes;
+};
+
+struct bvh_subtree
+{
+	bvh_builder* Builder;
+	uint32_t NodeIndex;
+	uint32_t First;
+	uint32_t Count;
+	uint32_t Depth;
+	uint32_t NextNode; // NOTE(georgy): Start of the node range reserved for the subtree
+};
+
+struct bvh_bin
+{
+	aabb Bounds;
+	uint32_t Count;
+};
+
+inline void
+SetNodeBounds(bvh_node* Node, aabb Bounds)
+{
+	Node->Min = Bounds.Min;
+	Node->Max = Bounds.Max;
+}
+
+inline aabb
+GetNodeBounds(bvh_node* Node)
+{
+	aabb Result = AABBMinMax(Node->Min, Node->Max);
+	return(Result);
+}
+
+// NOTE(georgy): Sets the bounds of the node and partitions its primitives.
+// Returns how many went to the left child, 0 if the node should stay a leaf.
+static uint32_t
+SplitBVHNode(bvh_builder* Builder, bvh_node* Node, uint32_t First, uint32_t Count)
+{
+	aabb Bounds = AABBMinMax(vec3(FLT_MAX), vec3(-FLT_MAX));
+	aabb CentroidBounds = Bounds;
+	for (uint32_t Index = First; Index < First + Count; Index++)
+	{
+		uint32_t Prim = Builder->PrimIndices[Index];
+		Bounds = AABBUnion(Bounds, Builder->PrimBounds[Prim]);
+		CentroidBounds = AABBUnion(CentroidBounds, AABBMinMax(Builder->Centroids[Prim], Builder->Centroids[Prim]));
+	}
+	SetNodeBounds(Node, Bounds);
+
+	if (Count <= 1)
+	{
+		return(0);
+	}
+
+	float NodeArea = Max(AABBSurfaceArea(Bounds), 1e-30f);
+	float BestCost = FLT_MAX;
+	uint32_t BestAxis = 0;
+	uint32_t BestSplit = 0;
+	for (uint32_t Axis = 0; Axis < 3; Axis++)
+	{
+		float AxisMin = CentroidBounds.Min.E[Axis];
+		float AxisExtent = CentroidBounds.Max.E[Axis] - AxisMin;
+		if (AxisExtent <= 0.0f)
+		{
+			continue;
+		}
+
+		bvh_bin Bins[BVH_BIN_COUNT];
+		for (uint32_t BinIndex = 0; BinIndex < BVH_BIN_COUNT; BinIndex++)
+		{
+			Bins[BinIndex].Bounds = AABBMinMax(vec3(FLT_MAX), vec3(-FLT_MAX));
+			Bins[BinIndex].Count = 0;
+		}
+
+		float Scale = BVH_BIN_COUNT / AxisExtent;
+		for (uint32_t Index = First; Index < First + Count; Index++)
+		{
+			uint32_t Prim = Builder->PrimIndices[Index];
+			uint32_t BinIndex = Min((uint32_t)((Builder->Centroids[Prim].E[Axis] - AxisMin) * Scale), (uint32_t)(BVH_BIN_COUNT - 1));
+			Bins[BinIndex].Bounds = AABBUnion(Bins[BinIndex].Bounds, Builder->PrimBounds[Prim]);
+			Bins[BinIndex].Count++;
+		}
+
+		// NOTE(georgy): Split i puts bins [0, i) on the left
+		float LeftAreas[BVH_BIN_COUNT];
+		uint32_t LeftCounts[BVH_BIN_COUNT];
+		aabb LeftBounds = AABBMinMax(vec3(FLT_MAX), vec3(-FLT_MAX));
+		uint32_t LeftCount = 0;
+		for (uint32_t Split = 1; Split < BVH_BIN_COUNT; Split++)
+		{
+			LeftBounds = AABBUnion(LeftBounds, Bins[Split - 1].Bounds);
+			LeftCount += Bins[Split - 1].Count;
+			LeftAreas[Split] = (LeftCount > 0) ? AABBSurfaceArea(LeftBounds) : 0.0f;
+			LeftCounts[Split] = LeftCount;
+		}
+
+		aabb RightBounds = AABBMinMax(vec3(FLT_MAX), vec3(-FLT_MAX));
+		uint32_t RightCount = 0;
+		for (uint32_t Split = BVH_BIN_COUNT - 1; Split > 0; Split--)
+		{
+			RightBounds = AABBUnion(RightBounds, Bins[Split].Bounds);
+			RightCount += Bins[Split].Count;
+			if ((LeftCounts[Split] == 0) || (RightCount == 0))
+			{
+				continue;
+			}
+
+			float Cost = BVH_TRAVERSAL_COST + (LeftCounts[Split]*LeftAreas[Split] + RightCount*AABBSurfaceArea(RightBounds)) / NodeArea;
+			if (Cost < BestCost)
+			{
+				BestCost = Cost;
+				BestAxis = Axis;
+				BestSplit = Split;
+			}
+		}
+	}
+
+	uint32_t Result = 0;
+	if (BestSplit == 0)
+	{
+		// NOTE(georgy): All centroids in one spot, nothing to bin. Halve by index if the leaf would be too big.
+		if (Count > BVH_MAX_LEAF_PRIMS)
+		{
+			Result = Count / 2;
+		}
+	}
+	else if ((BestCost < (float)Count) || (Count > BVH_MAX_LEAF_PRIMS))
+	{
+		float AxisMin = CentroidBounds.Min.E[BestAxis];
+		float Scale = BVH_BIN_COUNT / (CentroidBounds.Max.E[BestAxis] - AxisMin);
+		uint32_t* Left = Builder->PrimIndices + First;
+		uint32_t* Right = Builder->PrimIndices + First + Count - 1;
+		while (Left <= Right)
+		{
+			uint32_t BinIndex = Min((uint32_t)((Builder->Centroids[*Left].E[BestAxis] - AxisMin) * Scale), (uint32_t)(BVH_BIN_COUNT - 1));
+			if (BinIndex < BestSplit)
+			{
+				Left++;
+			}
+			else
+			{
+				uint32_t Temp = *Left;
+				*Left = *Right;
+				*Right-- = Temp;
+			}
+		}
+		Result = (uint32_t)(Left - (Builder->PrimIndices + First));
+	}
+
+	return(Result);
+}
+
+static void
+BuildBVHSubtree(bvh_subtree* Subtree)
+{
+	bvh_builder* Builder = Subtree->Builder;
+
+	bvh_subtree Stack[BVH_STACK_SIZE];
+	uint32_t StackCount = 0;
+	Stack[StackCount++] = *Subtree;
+	while (StackCount > 0)
+	{
+		bvh_subtree Task = Stack[--StackCount];
+		bvh_node* Node = &Builder->Nodes[Task.NodeIndex];
+
+		uint32_t LeftCount = SplitBVHNode(Builder, Node, Task.First, Task.Count);
+		if ((LeftCount == 0) || (Task.Depth + 1 >= BVH_MAX_DEPTH))
+		{
+			Node->LeftFirst = Task.First;
+			Node->PrimCount = Task.Count;
+		}
+		else
+		{
+			// NOTE(georgy): The smaller half goes on top, so the stack stays logarithmic
+			Node->LeftFirst = Subtree->NextNode;
+			Node->PrimCount = 0;
+			Subtree->NextNode += 2;
+			Assert(StackCount + 2 <= BVH_STACK_SIZE);
+
+			bvh_subtree LeftTask = Task, RightTask = Task;
+			LeftTask.Depth = RightTask.Depth = Task.Depth + 1;
+			LeftTask.NodeIndex = Node->LeftFirst;
+			LeftTask.Count = LeftCount;
+			RightTask.NodeIndex = Node->LeftFirst + 1;
+			RightTask.First = Task.First + LeftCount;
+			RightTask.Count = Task.Count - LeftCount;
+			if (LeftTask.Count < RightTask.Count)
+			{
+				Stack[StackCount++] = RightTask;
+				Stack[StackCount++] = LeftTask;
+			}
+			else
+			{
+				Stack[StackCount++] = LeftTask;
+				Stack[StackCount++] = RightTask;
+			}
+		}
+	}
+}
+
+static PLATFORM_WORK_QUEUE_CALLBACK(DoBuildBVHSubtree)
+{
+	(void)Queue;
+	MEMORY_TAG(MemoryTag_BVH);
+
+	BuildBVHSubtree((bvh_subtree*)Data);
+}
+
+// NOTE(georgy): Memory may be 0, then everything is built on the calling thread
+static void
+BuildBVH(game_memory* Memory, bvh* BVH, uint32_t PrimCount, aabb* PrimBounds)
+{
+	Assert(sizeof(bvh_node) == 32);
+
+	BVH->Nodes.EntriesCount = 0;
+	BVH->PrimIndices.EntriesCount = 0;
+	if (PrimCount == 0)
+	{
+		return;
+	}
+
+	ReserveDynamicArray(&BVH->PrimIndices, PrimCount);
+	BVH->PrimIndices.EntriesCount = PrimCount;
+	dynamic_array<vec3> Centroids(PrimCount);
+	for (uint32_t Prim = 0; Prim < PrimCount; Prim++)
+	{
+		BVH->PrimIndices[Prim] = Prim;
+		PushEntry(&Centroids, 0.5f*(PrimBounds[Prim].Min + PrimBounds[Prim].Max));
+	}
+
+	// NOTE(georgy): A binary tree with at least one primitive per leaf never has more than 2n - 1 nodes
+	uint32_t MaxNodeCount = 2 * PrimCount - 1;
+	dynamic_array<bvh_node> Nodes(MaxNodeCount);
+	Nodes.EntriesCount = MaxNodeCount;
+
+	bvh_builder Builder;
+	Builder.PrimBounds = PrimBounds;
+	Builder.Centroids = Centroids.Entries;
+	Builder.PrimIndices = BVH->PrimIndices.Entries;
+	Builder.Nodes = Nodes.Entries;
+
+	dynamic_array<bvh_subtree> Subtrees;
+	bvh_subtree Root;
+	Root.Builder = &Builder;
+	Root.NodeIndex = 0;
+	Root.First = 0;
+	Root.Count = PrimCount;
+	Root.Depth = 0;
+	PushEntry(&Subtrees, Root);
+	uint32_t NextNode = 1;
+
+	// NOTE(georgy): Split the biggest subtree on this thread until there are enough of them to keep the workers busy
+	bool Parallel = Memory && Memory->WorkQueue && (PrimCount >= BVH_PARALLEL_THRESHOLD);
+	uint32_t TargetSubtreeCount = Parallel ? Min(4 * (Memory->WorkerThreadCount + 1), (uint32_t)BVH_MAX_SUBTREE_JOBS) : 1;
+	while ((Subtrees.EntriesCount > 0) && (Subtrees.EntriesCount < TargetSubtreeCount))
+	{
+		uint32_t Biggest = 0;
+		for (uint32_t SubtreeIndex = 1; SubtreeIndex < Subtrees.EntriesCount; SubtreeIndex++)
+		{
+			if (Subtrees[SubtreeIndex].Count > Subtrees[Biggest].Count)
+			{
+				Biggest = SubtreeIndex;
+			}
+		}
+
+		bvh_subtree Task = Subtrees[Biggest];
+		if (Task.Count < BVH_PARALLEL_THRESHOLD / 8)
+		{
+			break;
+		}
+
+		bvh_node* Node = &Nodes[Task.NodeIndex];
+		uint32_t LeftCount = SplitBVHNode(&Builder, Node, Task.First, Task.Count);
+		Subtrees[Biggest] = Subtrees[--Subtrees.EntriesCount];
+		if (LeftCount == 0)
+		{
+			Node->LeftFirst = Task.First;
+			Node->PrimCount = Task.Count;
+			continue;
+		}
+
+		Node->LeftFirst = NextNode;
+		Node->PrimCount = 0;
+		NextNode += 2;
+
+		bvh_subtree LeftTask = Task, RightTask = Task;
+		LeftTask.Depth = RightTask.Depth = Task.Depth + 1;
+		LeftTask.NodeIndex = Node->LeftFirst;
+		LeftTask.Count = LeftCount;
+		RightTask.NodeIndex = Node->LeftFirst + 1;
+		RightTask.First = Task.First + LeftCount;
+		RightTask.Count = Task.Count - LeftCount;
+		PushEntry(&Subtrees, LeftTask);
+		PushEntry(&Subtrees, RightTask);
+	}
+
+	for (uint32_t SubtreeIndex = 0; SubtreeIndex < Subtrees.EntriesCount; SubtreeIndex++)
+	{
+		Subtrees[SubtreeIndex].NextNode = NextNode;
+		NextNode += 2 * Subtrees[SubtreeIndex].Count - 2;
+	}
+	Assert(NextNode <= MaxNodeCount);
+
+	if (Parallel)
+	{
+		for (uint32_t SubtreeIndex = 0; SubtreeIndex < Subtrees.EntriesCount; SubtreeIndex++)
+		{
+			Memory->PlatformAddEntry(Memory->WorkQueue, DoBuildBVHSubtree, &Subtrees[SubtreeIndex]);
+		}
+		Memory->PlatformCompleteAllWork(Memory->WorkQueue);
+	}
+	else
+	{
+		for (uint32_t SubtreeIndex = 0; SubtreeIndex < Subtrees.EntriesCount; SubtreeIndex++)
+		{
+			BuildBVHSubtree(&Subtrees[SubtreeIndex]);
+		}
+	}
+
+	// NOTE(georgy): Breadth-first copy that drops the unused parts of the reserved ranges
+	ReserveDynamicArray(&BVH->Nodes, MaxNodeCount);
+	BVH->Nodes[0] = Nodes[0];
+	uint32_t NodeCount = 1;
+	for (uint32_t NodeIndex = 0; NodeIndex < NodeCount; NodeIndex++)
+	{
+		bvh_node* Node = &BVH->Nodes[NodeIndex];
+		if (Node->PrimCount == 0)
+		{
+			uint32_t OldLeft = Node->LeftFirst;
+			Node->LeftFirst = NodeCount;
+			BVH->Nodes[NodeCount++] = Nodes[OldLeft];
+			BVH->Nodes[NodeCount++] = Nodes[OldLeft + 1];
+		}
+	}
+	BVH->Nodes.EntriesCount = NodeCount;
+}
+
+// NOTE(georgy): Same primitives with new bounds, the topology stays
+static void
+RefitBVH(bvh* BVH, aabb* PrimBounds)
+{
+	for (int32_t NodeIndex = (int32_t)BVH->Nodes.EntriesCount - 1; NodeIndex >= 0; NodeIndex--)
+	{
+		bvh_node* Node = &BVH->Nodes[NodeIndex];
+		aabb Bounds;
+		if (Node->PrimCount > 0)
+		{
+			Bounds = PrimBounds[BVH->PrimIndices[Node->LeftFirst]];
+			for (uint32_t Index = 1; Index < Node->PrimCount; Index++)
+			{
+				Bounds = AABBUnion(Bounds, PrimBounds[BVH->PrimIndices[Node->LeftFirst + Index]]);
+			}
+		}
+		else
+		{
+			Bounds = AABBUnion(GetNodeBounds(&BVH->Nodes[Node->LeftFirst]), GetNodeBounds(&BVH->Nodes[Node->LeftFirst + 1]));
+		}
+		SetNodeBounds(Node, Bounds);
+	}
+}
+
+static void
+FreeBVH(bvh* BVH)
+{
+	FreeDynamicArray(&BVH->Nodes);
+	FreeDynamicArray(&BVH->PrimIndices);
+}
+
+//
+// NOTE(georgy): Queries
+//
+
+struct bvh_ray
+{
+	vec3 Origin;
+	vec3 Direction;
+	vec3 InvDirection;
+};
+
+// NOTE(georgy): T is in units of Direction, which doesn't have to be normalized
+struct bvh_hit
+{
+	float T;
+	float U, V; // NOTE(georgy): Barycentrics of the second and third vertex
+	uint32_t InstanceIndex;
+	uint32_t MeshIndex;
+	uint32_t TriangleIndex;
+};
+
+inline bvh_ray
+MakeBVHRay(vec3 Origin, vec3 Direction)
+{
+	bvh_ray Result;
+
+	Result.Origin = Origin;
+	Result.Direction = Direction;
+	Result.InvDirection = vec3(1.0f / Direction.x, 1.0f / Direction.y, 1.0f / Direction.z);
+
+	return(Result);
+}
+
+// NOTE(georgy): Slab test, returns the entry distance or FLT_MAX if the box is missed or further than MaxT
+inline float
+IntersectRayNode(bvh_ray* Ray, bvh_node* Node, float MaxT)
+{
+	float TX0 = (Node->Min.x - Ray->Origin.x) * Ray->InvDirection.x, TX1 = (Node->Max.x - Ray->Origin.x) * Ray->InvDirection.x;
+	float TY0 = (Node->Min.y - Ray->Origin.y) * Ray->InvDirection.y, TY1 = (Node->Max.y - Ray->Origin.y) * Ray->InvDirection.y;
+	float TZ0 = (Node->Min.z - Ray->Origin.z) * Ray->InvDirection.z, TZ1 = (Node->Max.z - Ray->Origin.z) * Ray->InvDirection.z;
+
+	float TEnter = Max(Max(Min(TX0, TX1), Min(TY0, TY1)), Max(Min(TZ0, TZ1), 0.0f));
+	float TExit = Min(Min(Max(TX0, TX1), Max(TY0, TY1)), Min(Max(TZ0, TZ1), MaxT));
+
+	float Result = (TEnter <= TExit) ? TEnter : FLT_MAX;
+	return(Result);
+}
+
+// NOTE(georgy): Möller-Trumbore, both sides
+static bool
+IntersectRayTriangle(bvh_ray* Ray, vec3 V0, vec3 V1, vec3 V2, float* T, float* U, float* V)
+{
+	vec3 Edge1 = V1 - V0;
+	vec3 Edge2 = V2 - V0;
+	vec3 P = Cross(Ray->Direction, Edge2);
+	float Determinant = Dot(Edge1, P);
+	if (Absolute(Determinant) < 1e-12f)
+	{
+		return(false);
+	}
+
+	float OneOverDeterminant = 1.0f / Determinant;
+	vec3 ToOrigin = Ray->Origin - V0;
+	float HitU = Dot(ToOrigin, P) * OneOverDeterminant;
+	if ((HitU < 0.0f) || (HitU > 1.0f))
+	{
+		return(false);
+	}
+
+	vec3 Q = Cross(ToOrigin, Edge1);
+	float HitV = Dot(Ray->Direction, Q) * OneOverDeterminant;
+	if ((HitV < 0.0f) || (HitU + HitV > 1.0f))
+	{
+		return(false);
+	}
+
+	float HitT = Dot(Edge2, Q) * OneOverDeterminant;
+	if ((HitT < 0.0f) || (HitT >= *T))
+	{
+		return(false);
+	}
+
+	*T = HitT;
+	*U = HitU;
+	*V = HitV;
+	return(true);
+}
+
+#if CULL_SSE
+// NOTE(georgy): IntersectRayTriangle on up to 4 triangles at once, unused lanes repeat the first triangle.
+// Returns the lane of the closest hit nearer than *T, or -1.
+static int32_t
+IntersectRayTriangles4(bvh_ray* Ray, vec3* V0, vec3* V1, vec3* V2, uint32_t Count, float* T, float* U, float* V)
+{
+	vec3 A[4], B[4], C[4];
+	for (uint32_t Lane = 0; Lane < 4; Lane++)
+	{
+		uint32_t Source = (Lane < Count) ? Lane : 0;
+		A[Lane] = V0[Source]; B[Lane] = V1[Source]; C[Lane] = V2[Source];
+	}
+
+	__m128 V0X = _mm_setr_ps(A[0].x, A[1].x, A[2].x, A[3].x);
+	__m128 V0Y = _mm_setr_ps(A[0].y, A[1].y, A[2].y, A[3].y);
+	__m128 V0Z = _mm_setr_ps(A[0].z, A[1].z, A[2].z, A[3].z);
+	__m128 Edge1X = _mm_sub_ps(_mm_setr_ps(B[0].x, B[1].x, B[2].x, B[3].x), V0X);
+	__m128 Edge1Y = _mm_sub_ps(_mm_setr_ps(B[0].y, B[1].y, B[2].y, B[3].y), V0Y);
+	__m128 Edge1Z = _mm_sub_ps(_mm_setr_ps(B[0].z, B[1].z, B[2].z, B[3].z), V0Z);
+	__m128 Edge2X = _mm_sub_ps(_mm_setr_ps(C[0].x, C[1].x, C[2].x, C[3].x), V0X);
+	__m128 Edge2Y = _mm_sub_ps(_mm_setr_ps(C[0].y, C[1].y, C[2].y, C[3].y), V0Y);
+	__m128 Edge2Z = _mm_sub_ps(_mm_setr_ps(C[0].z, C[1].z, C[2].z, C[3].z), V0Z);
+
+	__m128 DX = _mm_set1_ps(Ray->Direction.x), DY = _mm_set1_ps(Ray->Direction.y), DZ = _mm_set1_ps(Ray->Direction.z);
+
+	// NOTE(georgy): P = D x Edge2
+	__m128 PX = _mm_sub_ps(_mm_mul_ps(DY, Edge2Z), _mm_mul_ps(DZ, Edge2Y));
+	__m128 PY = _mm_sub_ps(_mm_mul_ps(DZ, Edge2X), _mm_mul_ps(DX, Edge2Z));
+	__m128 PZ = _mm_sub_ps(_mm_mul_ps(DX, Edge2Y), _mm_mul_ps(DY, Edge2X));
+	__m128 Determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(Edge1X, PX), _mm_mul_ps(Edge1Y, PY)), _mm_mul_ps(Edge1Z, PZ));
+	__m128 AbsDeterminant = _mm_and_ps(Determinant, _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF)));
+	__m128 OneOverDeterminant = _mm_div_ps(_mm_set1_ps(1.0f), Determinant);
+
+	__m128 SX = _mm_sub_ps(_mm_set1_ps(Ray->Origin.x), V0X);
+	__m128 SY = _mm_sub_ps(_mm_set1_ps(Ray->Origin.y), V0Y);
+	__m128 SZ = _mm_sub_ps(_mm_set1_ps(Ray->Origin.z), V0Z);
+	__m128 HitU = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(SX, PX), _mm_mul_ps(SY, PY)), _mm_mul_ps(SZ, PZ)), OneOverDeterminant);
+
+	// NOTE(georgy): Q = S x Edge1
+	__m128 QX = _mm_sub_ps(_mm_mul_ps(SY, Edge1Z), _mm_mul_ps(SZ, Edge1Y));
+	__m128 QY = _mm_sub_ps(_mm_mul_ps(SZ, Edge1X), _mm_mul_ps(SX, Edge1Z));
+	__m128 QZ = _mm_sub_ps(_mm_mul_ps(SX, Edge1Y), _mm_mul_ps(SY, Edge1X));
+	__m128 HitV = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(DX, QX), _mm_mul_ps(DY, QY)), _mm_mul_ps(DZ, QZ)), OneOverDeterminant);
+	__m128 HitT = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(Edge2X, QX), _mm_mul_ps(Edge2Y, QY)), _mm_mul_ps(Edge2Z, QZ)), OneOverDeterminant);
+
+	__m128 Zero = _mm_setzero_ps(), One = _mm_set1_ps(1.0f);
+	__m128 Valid = _mm_cmpge_ps(AbsDeterminant, _mm_set1_ps(1e-12f));
+	Valid = _mm_and_ps(Valid, _mm_and_ps(_mm_cmpge_ps(HitU, Zero), _mm_cmple_ps(HitU, One)));
+	Valid = _mm_and_ps(Valid, _mm_and_ps(_mm_cmpge_ps(HitV, Zero), _mm_cmple_ps(_mm_add_ps(HitU, HitV), One)));
+	Valid = _mm_and_ps(Valid, _mm_and_ps(_mm_cmpge_ps(HitT, Zero), _mm_cmplt_ps(HitT, _mm_set1_ps(*T))));
+
+	int32_t Result = -1;
+	int32_t ValidMask = _mm_movemask_ps(Valid);
+	if (ValidMask)
+	{
+		float Ts[4], Us[4], Vs[4];
+		_mm_storeu_ps(Ts, HitT);
+		_mm_storeu_ps(Us, HitU);
+		_mm_storeu_ps(Vs, HitV);
+		for (int32_t Lane = 0; Lane < 4; Lane++)
+		{
+			if ((ValidMask & (1 << Lane)) && (Ts[Lane] < *T))
+			{
+				*T = Ts[Lane];
+				*U = Us[Lane];
+				*V = Vs[Lane];
+				Result = Lane;
+			}
+		}
+	}
+
+	return(Result);
+}
+#endif
+
+// NOTE(georgy): Nearest child first. Hit->T has to hold the max distance, it's only overwritten by closer hits.
+static bool
+IntersectRayMeshBVH(bvh* BVH, mesh* Mesh, vec3* Positions, uint32_t* Indices, bvh_ray* Ray, bvh_hit* Hit)
+{
+	bool Result = false;
+	if (BVH->Nodes.EntriesCount == 0)
+	{
+		return(Result);
+	}
+
+	vec3* MeshPositions = Positions + Mesh->BaseVertex;
+	uint32_t* MeshIndices = Indices + Mesh->BaseIndex;
+
+	uint32_t Stack[BVH_STACK_SIZE];
+	uint32_t StackCount = 0;
+	if (IntersectRayNode(Ray, &BVH->Nodes[0], Hit->T) != FLT_MAX)
+	{
+		Stack[StackCount++] = 0;
+	}
+	while (StackCount > 0)
+	{
+		bvh_node* Node = &BVH->Nodes[Stack[--StackCount]];
+		if (Node->PrimCount > 0)
+		{
+#if CULL_SSE
+			for (uint32_t Index = 0; Index < Node->PrimCount; Index += 4)
+			{
+				uint32_t Count = Min(Node->PrimCount - Index, 4u);
+				uint32_t Triangles[4];
+				vec3 V0[4], V1[4], V2[4];
+				for (uint32_t Lane = 0; Lane < Count; Lane++)
+				{
+					uint32_t Triangle = BVH->PrimIndices[Node->LeftFirst + Index + Lane];
+					Triangles[Lane] = Triangle;
+					V0[Lane] = MeshPositions[MeshIndices[3 * Triangle + 0]];
+					V1[Lane] = MeshPositions[MeshIndices[3 * Triangle + 1]];
+					V2[Lane] = MeshPositions[MeshIndices[3 * Triangle + 2]];
+				}
+
+				int32_t Lane = IntersectRayTriangles4(Ray, V0, V1, V2, Count, &Hit->T, &Hit->U, &Hit->V);
+				if (Lane >= 0)
+				{
+					Hit->TriangleIndex = Triangles[Lane];
+					Result = true;
+				}
+			}
+#else
+			for (uint32_t Index = 0; Index < Node->PrimCount; Index++)
+			{
+				uint32_t Triangle = BVH->PrimIndices[Node->LeftFirst + Index];
+				vec3 V0 = MeshPositions[MeshIndices[3 * Triangle + 0]];
+				vec3 V1 = MeshPositions[MeshIndices[3 * Triangle + 1]];
+				vec3 V2 = MeshPositions[MeshIndices[3 * Triangle + 2]];
+				if (IntersectRayTriangle(Ray, V0, V1, V2, &Hit->T, &Hit->U, &Hit->V))
+				{
+					Hit->TriangleIndex = Triangle;
+					Result = true;
+				}
+			}
+#endif
+			continue;
+		}
+
+		uint32_t Near = Node->LeftFirst, Far = Node->LeftFirst + 1;
+		float TNear = IntersectRayNode(Ray, &BVH->Nodes[Near], Hit->T);
+		float TFar = IntersectRayNode(Ray, &BVH->Nodes[Far], Hit->T);
+		if (TFar < TNear)
+		{
+			uint32_t TempIndex = Near; Near = Far; Far = TempIndex;
+			float TempT = TNear; TNear = TFar; TFar = TempT;
+		}
+
+		Assert(StackCount + 2 <= BVH_STACK_SIZE);
+		if (TFar != FLT_MAX)
+		{
+			Stack[StackCount++] = Far;
+		}
+		if (TNear != FLT_MAX)
+		{
+			Stack[StackCount++] = Near;
+		}
+	}
+
+	return(Result);
+}
+
+// NOTE(georgy): Candidates only, every primitive of every leaf the box touches
+static void
+QueryBVHOverlap(bvh* BVH, aabb Box, dynamic_array<uint32_t>* Prims)
+{
+	if (BVH->Nodes.EntriesCount == 0)
+	{
+		return;
+	}
+
+	uint32_t Stack[BVH_STACK_SIZE];
+	uint32_t StackCount = 0;
+	Stack[StackCount++] = 0;
+	while (StackCount > 0)
+	{
+		bvh_node* Node = &BVH->Nodes[Stack[--StackCount]];
+		bool Overlaps = (Node->Min.x <= Box.Max.x) && (Node->Max.x >= Box.Min.x) &&
+						(Node->Min.y <= Box.Max.y) && (Node->Max.y >= Box.Min.y) &&
+						(Node->Min.z <= Box.Max.z) && (Node->Max.z >= Box.Min.z);
+		if (!Overlaps)
+		{
+			continue;
+		}
+
+		if (Node->PrimCount > 0)
+		{
+			for (uint32_t Index = 0; Index < Node->PrimCount; Index++)
+			{
+				PushEntry(Prims, BVH->PrimIndices[Node->LeftFirst + Index]);
+			}
+		}
+		else
+		{
+			Assert(StackCount + 2 <= BVH_STACK_SIZE);
+			Stack[StackCount++] = Node->LeftFirst;
+			Stack[StackCount++] = Node->LeftFirst + 1;
+		}
+	}
+}
+
+//
+// NOTE(georgy): Two-level scene
+//
+
+struct bvh_instance
+{
+	mat4 Transform;
+	mat4 InverseTransform;
+	aabb Bounds; // NOTE(georgy): The mesh root box through Transform
+	uint32_t MeshIndex;
+};
+
+struct scene_bvh
+{
+	dynamic_array<bvh> MeshBVHs;
+	dynamic_array<bvh_instance> Instances;
+	bvh TopLevel;
+};
+
+struct mesh_bvh_job
+{
+	bvh* BVH;
+	mesh* Mesh;
+	vec3* Positions;
+	uint32_t* Indices;
+};
+
+// NOTE(georgy): Primitive i of a mesh BVH is triangle i of the mesh
+static void
+ComputeTriangleBounds(mesh* Mesh, vec3* Positions, uint32_t* Indices, aabb* Bounds)
+{
+	vec3* MeshPositions = Positions + Mesh->BaseVertex;
+	uint32_t* MeshIndices = Indices + Mesh->BaseIndex;
+	for (uint32_t Triangle = 0; Triangle < Mesh->IndexCount / 3; Triangle++)
+	{
+		vec3 V0 = MeshPositions[MeshIndices[3 * Triangle + 0]];
+		vec3 V1 = MeshPositions[MeshIndices[3 * Triangle + 1]];
+		vec3 V2 = MeshPositions[MeshIndices[3 * Triangle + 2]];
+		Bounds[Triangle] = AABBUnion(AABBMinMax(V0, V0), AABBUnion(AABBMinMax(V1, V1), AABBMinMax(V2, V2)));
+	}
+}
+
+static void
+BuildMeshBVH(game_memory* Memory, bvh* BVH, mesh* Mesh, vec3* Positions, uint32_t* Indices)
+{
+	uint32_t TriangleCount = Mesh->IndexCount / 3;
+	dynamic_array<aabb> Bounds(TriangleCount);
+	Bounds.EntriesCount = TriangleCount;
+	ComputeTriangleBounds(Mesh, Positions, Indices, Bounds.Entries);
+	BuildBVH(Memory, BVH, TriangleCount, Bounds.Entries);
+}
+
+static PLATFORM_WORK_QUEUE_CALLBACK(DoBuildMeshBVH)
+{
+	(void)Queue;
+	PROFILE_ZONE("DoBuildMeshBVH");
+	MEMORY_TAG(MemoryTag_BVH);
+
+	mesh_bvh_job* Job = (mesh_bvh_job*)Data;
+	BuildMeshBVH(0, Job->BVH, Job->Mesh, Job->Positions, Job->Indices);
+}
+
+// NOTE(georgy): After the vertices of a mesh moved, same triangles
+static void
+RefitMeshBVH(bvh* BVH, mesh* Mesh, vec3* Positions, uint32_t* Indices)
+{
+	uint32_t TriangleCount = Mesh->IndexCount / 3;
+	dynamic_array<aabb> Bounds(TriangleCount);
+	Bounds.EntriesCount = TriangleCount;
+	ComputeTriangleBounds(Mesh, Positions, Indices, Bounds.Entries);
+	RefitBVH(BVH, Bounds.Entries);
+}
+
+// NOTE(georgy): Small meshes are built one per job, big ones split into subtree jobs themselves
+static void
+BuildMeshBVHs(game_memory* Memory, scene_bvh* Scene, uint32_t MeshCount, mesh* Meshes, vec3* Positions, uint32_t* Indices)
+{
+	PROFILE_ZONE("BuildMeshBVHs");
+
+	for (uint32_t MeshIndex = 0; MeshIndex < Scene->MeshBVHs.EntriesCount; MeshIndex++)
+	{
+		FreeBVH(&Scene->MeshBVHs[MeshIndex]);
+	}
+	Scene->MeshBVHs.EntriesCount = 0;
+	ResizeDynamicArray(&Scene->MeshBVHs, MeshCount);
+
+	dynamic_array<mesh_bvh_job> Jobs(MeshCount);
+	for (uint32_t MeshIndex = 0; MeshIndex < MeshCount; MeshIndex++)
+	{
+		if (!Memory->WorkQueue || (Meshes[MeshIndex].IndexCount / 3 >= BVH_PARALLEL_THRESHOLD))
+		{
+			BuildMeshBVH(Memory, &Scene->MeshBVHs[MeshIndex], &Meshes[MeshIndex], Positions, Indices);
+		}
+		else
+		{
+			mesh_bvh_job Job;
+			Job.BVH = &Scene->MeshBVHs[MeshIndex];
+			Job.Mesh = &Meshes[MeshIndex];
+			Job.Positions = Positions;
+			Job.Indices = Indices;
+			PushEntry(&Jobs, Job);
+		}
+	}
+
+	// NOTE(georgy): In batches, the queue holds 256 entries
+	for (uint32_t JobIndex = 0; JobIndex < Jobs.EntriesCount; JobIndex++)
+	{
+		Memory->PlatformAddEntry(Memory->WorkQueue, DoBuildMeshBVH, &Jobs[JobIndex]);
+		if (((JobIndex + 1) % BVH_MAX_SUBTREE_JOBS) == 0)
+		{
+			Memory->PlatformCompleteAllWork(Memory->WorkQueue);
+		}
+	}
+	if (Jobs.EntriesCount > 0)
+	{
+		Memory->PlatformCompleteAllWork(Memory->WorkQueue);
+	}
+}
+
+static void
+SetBVHInstanceTransform(scene_bvh* Scene, uint32_t InstanceIndex, mat4 Transform)
+{
+	bvh_instance* Instance = &Scene->Instances[InstanceIndex];
+	Instance->Transform = Transform;
+	Instance->InverseTransform = AffineInverse(Transform);
+
+	bvh* MeshBVH = &Scene->MeshBVHs[Instance->MeshIndex];
+	Instance->Bounds = (MeshBVH->Nodes.EntriesCount > 0) ?
+		TransformAABB(Transform, GetNodeBounds(&MeshBVH->Nodes[0])) : AABBMinMax(vec3(FLT_MAX), vec3(-FLT_MAX));
+}
+
+static uint32_t
+AddBVHInstance(scene_bvh* Scene, uint32_t MeshIndex, mat4 Transform)
+{
+	bvh_instance Instance = {};
+	Instance.MeshIndex = MeshIndex;
+	PushEntry(&Scene->Instances, Instance);
+
+	uint32_t Result = Scene->Instances.EntriesCount - 1;
+	SetBVHInstanceTransform(Scene, Result, Transform);
+
+	return(Result);
+}
+
+static void
+BuildTopLevelBVH(game_memory* Memory, scene_bvh* Scene)
+{
+	uint32_t InstanceCount = Scene->Instances.EntriesCount;
+	dynamic_array<aabb> Bounds(InstanceCount);
+	for (uint32_t InstanceIndex = 0; InstanceIndex < InstanceCount; InstanceIndex++)
+	{
+		PushEntry(&Bounds, Scene->Instances[InstanceIndex].Bounds);
+	}
+	BuildBVH(Memory, &Scene->TopLevel, InstanceCount, Bounds.Entries);
+}
+
+// NOTE(georgy): After SetBVHInstanceTransform calls. Fine for moderate motion, rebuild when instances moved far.
+static void
+RefitTopLevelBVH(scene_bvh* Scene)
+{
+	uint32_t InstanceCount = Scene->Instances.EntriesCount;
+	dynamic_array<aabb> Bounds(InstanceCount);
+	for (uint32_t InstanceIndex = 0; InstanceIndex < InstanceCount; InstanceIndex++)
+	{
+		PushEntry(&Bounds, Scene->Instances[InstanceIndex].Bounds);
+	}
+	RefitBVH(&Scene->TopLevel, Bounds.Entries);
+}
+
+// NOTE(georgy): Hit->T has to hold the max distance. The ray goes into each instance's space untouched in length,
+// so T means the same at both levels.
+static bool
+IntersectRaySceneBVH(scene_bvh* Scene, mesh* Meshes, vec3* Positions, uint32_t* Indices, bvh_ray* Ray, bvh_hit* Hit)
+{
+	bool Result = false;
+	bvh* TopLevel = &Scene->TopLevel;
+	if (TopLevel->Nodes.EntriesCount == 0)
+	{
+		return(Result);
+	}
+
+	uint32_t Stack[BVH_STACK_SIZE];
+	uint32_t StackCount = 0;
+	Stack[StackCount++] = 0;
+	while (StackCount > 0)
+	{
+		bvh_node* Node = &TopLevel->Nodes[Stack[--StackCount]];
+		if (IntersectRayNode(Ray, Node, Hit->T) == FLT_MAX)
+		{
+			continue;
+		}
+
+		if (Node->PrimCount > 0)
+		{
+			for (uint32_t Index = 0; Index < Node->PrimCount; Index++)
+			{
+				uint32_t InstanceIndex = TopLevel->PrimIndices[Node->LeftFirst + Index];
+				bvh_instance* Instance = &Scene->Instances[InstanceIndex];
+
+				vec3 Origin = (Instance->InverseTransform * vec4(Ray->Origin, 1.0f)).xyz;
+				vec3 Direction = (Instance->InverseTransform * vec4(Ray->Direction, 0.0f)).xyz;
+				bvh_ray InstanceRay = MakeBVHRay(Origin, Direction);
+				if (IntersectRayMeshBVH(&Scene->MeshBVHs[Instance->MeshIndex], &Meshes[Instance->MeshIndex], Positions, Indices, &InstanceRay, Hit))
+				{
+					Hit->InstanceIndex = InstanceIndex;
+					Hit->MeshIndex = Instance->MeshIndex;
+					Result = true;
+				}
+			}
+		}
+		else
+		{
+			Assert(StackCount + 2 <= BVH_STACK_SIZE);
+			Stack[StackCount++] = Node->LeftFirst + 1;
+			Stack[StackCount++] = Node->LeftFirst;
+		}
+	}
+
+	return(Result);
+}
+
+static void
+FreeSceneBVH(scene_bvh* Scene)
+{
+	for (uint32_t MeshIndex = 0; MeshIndex < Scene->MeshBVHs.EntriesCount; MeshIndex++)
+	{
+		FreeBVH(&Scene->MeshBVHs[MeshIndex]);
+	}
+	FreeDynamicArray(&Scene->MeshBVHs);
+	FreeDynamicArray(&Scene->Instances);
+	FreeBVH(&Scene->TopLevel);
+}
+
+//
+// NOTE(georgy): Benchmark
+//
+
+#define BVH_BENCHMARK_RAY_COUNT 100000
+#define BVH_BENCHMARK_BOX_COUNT 10000
+
+inline float
+BenchmarkRandom(uint32_t* State)
+{
+	*State ^= *State << 13; *State ^= *State >> 17; *State ^= *State << 5;
+	float Result = (float)(*State & 0xFFFFFF) / (float)0xFFFFFF;
+
+	return(Result);
+}
+
+// NOTE(georgy): Rebuilds both levels and times builds, refits and queries. Rays start on a sphere around the scene
+// and aim at random points inside its box, query boxes are a tenth of the scene box.
+static void
+BenchmarkSceneBVH(game_memory* Memory, scene_bvh* Scene, uint32_t MeshCount, mesh* Meshes, vec3* Positions, uint32_t* Indices)
+{
+	uint32_t TriangleCount = 0;
+	uint32_t BiggestMesh = 0;
+	for (uint32_t MeshIndex = 0; MeshIndex < MeshCount; MeshIndex++)
+	{
+		TriangleCount += Meshes[MeshIndex].IndexCount / 3;
+		if (Meshes[MeshIndex].IndexCount > Meshes[BiggestMesh].IndexCount)
+		{
+			BiggestMesh = MeshIndex;
+		}
+	}
+
+	double StartTime = GetWallClockSeconds();
+	BuildMeshBVHs(Memory, Scene, MeshCount, Meshes, Positions, Indices);
+	double BottomBuildTime = GetWallClockSeconds() - StartTime;
+
+	for (uint32_t InstanceIndex = 0; InstanceIndex < Scene->Instances.EntriesCount; InstanceIndex++)
+	{
+		SetBVHInstanceTransform(Scene, InstanceIndex, Scene->Instances[InstanceIndex].Transform);
+	}
+	StartTime = GetWallClockSeconds();
+	BuildTopLevelBVH(Memory, Scene);
+	double TopBuildTime = GetWallClockSeconds() - StartTime;
+
+	StartTime = GetWallClockSeconds();
+	RefitTopLevelBVH(Scene);
+	double TopRefitTime = GetWallClockSeconds() - StartTime;
+
+	if (MeshCount == 0)
+	{
+		return;
+	}
+
+	double BottomRefitTime = 0.0;
+	{
+		StartTime = GetWallClockSeconds();
+		RefitMeshBVH(&Scene->MeshBVHs[BiggestMesh], &Meshes[BiggestMesh], Positions, Indices);
+		BottomRefitTime = GetWallClockSeconds() - StartTime;
+	}
+
+	uint32_t NodeCount = Scene->TopLevel.Nodes.EntriesCount;
+	for (uint32_t MeshIndex = 0; MeshIndex < Scene->MeshBVHs.EntriesCount; MeshIndex++)
+	{
+		NodeCount += Scene->MeshBVHs[MeshIndex].Nodes.EntriesCount;
+	}
+	printf("BVH build: %u triangles, %u nodes (%.2f MB), bottom levels %.2f ms, top level over %u instances %.3f ms\n",
+		TriangleCount, NodeCount, (float)(NodeCount * sizeof(bvh_node)) / (float)Megabytes(1),
+		1000.0 * BottomBuildTime, Scene->Instances.EntriesCount, 1000.0 * TopBuildTime);
+	printf("BVH refit: top level %.3f ms, biggest mesh (%u triangles) %.2f ms\n",
+		1000.0 * TopRefitTime, Meshes[BiggestMesh].IndexCount / 3, 1000.0 * BottomRefitTime);
+
+	if (Scene->TopLevel.Nodes.EntriesCount == 0)
+	{
+		return;
+	}
+
+	aabb SceneBounds = GetNodeBounds(&Scene->TopLevel.Nodes[0]);
+	vec3 Center = 0.5f*(SceneBounds.Min + SceneBounds.Max);
+	vec3 Size = SceneBounds.Max - SceneBounds.Min;
+	float Radius = Length(Size);
+	uint32_t RandomState = 0x9E3779B9;
+
+	uint32_t HitCount = 0;
+	StartTime = GetWallClockSeconds();
+	for (uint32_t RayIndex = 0; RayIndex < BVH_BENCHMARK_RAY_COUNT; RayIndex++)
+	{
+		vec3 OnSphere = NOZ(vec3(BenchmarkRandom(&RandomState) - 0.5f, BenchmarkRandom(&RandomState) - 0.5f, BenchmarkRandom(&RandomState) - 0.5f));
+		vec3 Target = SceneBounds.Min + Hadamard(Size, vec3(BenchmarkRandom(&RandomState), BenchmarkRandom(&RandomState), BenchmarkRandom(&RandomState)));
+		vec3 Origin = Center + Radius*OnSphere;
+
+		bvh_ray Ray = MakeBVHRay(Origin, Target - Origin);
+		bvh_hit Hit;
+		Hit.T = FLT_MAX;
+		HitCount += IntersectRaySceneBVH(Scene, Meshes, Positions, Indices, &Ray, &Hit);
+	}
+	double RayTime = GetWallClockSeconds() - StartTime;
+
+	uint32_t CandidateCount = 0;
+	dynamic_array<uint32_t> Candidates;
+	dynamic_array<uint32_t> Triangles;
+	StartTime = GetWallClockSeconds();
+	for (uint32_t BoxIndex = 0; BoxIndex < BVH_BENCHMARK_BOX_COUNT; BoxIndex++)
+	{
+		vec3 BoxCenter = SceneBounds.Min + Hadamard(Size, vec3(BenchmarkRandom(&RandomState), BenchmarkRandom(&RandomState), BenchmarkRandom(&RandomState)));
+		aabb Box = AABBMinMax(BoxCenter - 0.05f*Size, BoxCenter + 0.05f*Size);
+		Candidates.EntriesCount = 0;
+		QueryBVHOverlap(&Scene->TopLevel, Box, &Candidates);
+		for (uint32_t CandidateIndex = 0; CandidateIndex < Candidates.EntriesCount; CandidateIndex++)
+		{
+			bvh_instance* Instance = &Scene->Instances[Candidates[CandidateIndex]];
+			Triangles.EntriesCount = 0;
+			QueryBVHOverlap(&Scene->MeshBVHs[Instance->MeshIndex], TransformAABB(Instance->InverseTransform, Box), &Triangles);
+			CandidateCount += Triangles.EntriesCount;
+		}
+	}
+	double BoxTime = GetWallClockSeconds() - StartTime;
+
+	printf("BVH rays: %u in %.2f ms, %.2f Mrays/s, %u hits\n",
+		BVH_BENCHMARK_RAY_COUNT, 1000.0 * RayTime, (double)BVH_BENCHMARK_RAY_COUNT / RayTime / 1000000.0, HitCount);
+	printf("BVH box queries: %u in %.2f ms, %.1f candidate triangles per query\n",
+		BVH_BENCHMARK_BOX_COUNT, 1000.0 * BoxTime, (float)CandidateCount / (float)BVH_BENCHMARK_BOX_COUNT);
+}
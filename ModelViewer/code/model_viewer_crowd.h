@@ -0,0 +1,282 @@
+#pragma once
+
+// NOTE(georgy): Baked animation crowds.
+// Every clip is sampled once at a fixed rate into a float texture: one row per frame, three RGBA32F texels
+// (the rows of the 3x4 affine bone matrix) per bone. A crowd instance is just a position, a clip and a time
+// offset in a static instance buffer, CrowdVS.glsl fetches and blends the bone matrices itself.
+// The CPU culls the instance positions against the frustum and uploads the visible ones, but only when the frustum
+// changed, then issues one instanced draw per mesh.
+
+#define MAX_BAKED_CLIPS 32
+#define CROWD_BAKE_FRAMES_PER_SECOND 30.0f
+#define CROWD_GRID_SIZE 16
+
+enum crowd_attribute
+{
+	BoneIndices_Attribute = 3,
+	BoneWeights_Attribute,
+	InstancePositionTimeOffset_Attribute,
+	InstanceClip_Attribute,
+};
+
+struct crowd_instance
+{
+	vec3 Position;
+	float TimeOffset;
+	uint32_t ClipIndex;
+};
+
+struct baked_animation
+{
+	GLuint BoneTexture;
+	uint32_t BoneCount;
+	float FramesPerSecond;
+
+	uint32_t ClipCount;
+	int32_t ClipFirstFrame[MAX_BAKED_CLIPS];
+	int32_t ClipFrameCount[MAX_BAKED_CLIPS];
+};
+
+struct crowd
+{
+	bool IsBaked;
+	bool Enabled;
+
+	shader_permutations Shaders;
+	baked_animation Baked;
+
+	GLuint VAO;
+	GLuint InstanceVBO;
+	uint32_t InstanceCount;
+	uint32_t VisibleInstanceCount;
+
+	dynamic_array<crowd_instance> Instances;
+	dynamic_array<crowd_instance> VisibleInstances;
+	cull_bounds InstanceBounds;
+	dynamic_array<uint8_t> InstanceVisibility;
+
+	// NOTE(georgy): The instances never move, so what's visible only changes with this
+	bool IsCulled;
+	frustum CulledFrustum;
+};
+
+static void
+BakeAnimations(animation_set* Animation, baked_animation* Baked, float FramesPerSecond)
+{
+	Baked->BoneCount = Animation->Bones.EntriesCount;
+	Baked->ClipCount = Min(Animation->Clips.EntriesCount, MAX_BAKED_CLIPS);
+
+	GLint MaxTextureSize;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &MaxTextureSize);
+	Assert(3 * Baked->BoneCount <= (uint32_t)MaxTextureSize);
+
+	// NOTE(georgy): Lower the rate if all clips together don't fit into the texture height
+	float TotalDuration = 0.0f;
+	for (uint32_t ClipIndex = 0; ClipIndex < Baked->ClipCount; ClipIndex++)
+	{
+		TotalDuration += Animation->Clips[ClipIndex].Duration;
+	}
+	uint32_t MaxFrames = (uint32_t)MaxTextureSize - 2 * Baked->ClipCount;
+	if (TotalDuration * FramesPerSecond > (float)MaxFrames)
+	{
+		FramesPerSecond = (float)MaxFrames / TotalDuration;
+	}
+	Baked->FramesPerSecond = FramesPerSecond;
+
+	uint32_t TotalFrames = 0;
+	for (uint32_t ClipIndex = 0; ClipIndex < Baked->ClipCount; ClipIndex++)
+	{
+		Baked->ClipFirstFrame[ClipIndex] = TotalFrames;
+		Baked->ClipFrameCount[ClipIndex] = (int32_t)ceilf(Animation->Clips[ClipIndex].Duration * FramesPerSecond) + 1;
+		TotalFrames += Baked->ClipFrameCount[ClipIndex];
+	}
+
+	uint32_t NodeCount = Animation->Nodes.EntriesCount;
+	uint32_t TexelsPerFrame = 3 * Baked->BoneCount;
+	dynamic_array<mat4> LocalTransforms(NodeCount), GlobalTransforms(NodeCount);
+	dynamic_array<vec4> Texels(TexelsPerFrame * TotalFrames);
+	ResizeDynamicArray(&LocalTransforms, NodeCount);
+	ResizeDynamicArray(&GlobalTransforms, NodeCount);
+	ResizeDynamicArray(&Texels, TexelsPerFrame * TotalFrames);
+
+	for (uint32_t ClipIndex = 0; ClipIndex < Baked->ClipCount; ClipIndex++)
+	{
+		for (uint32_t NodeIndex = 0; NodeIndex < NodeCount; NodeIndex++)
+		{
+			LocalTransforms[NodeIndex] = Animation->Nodes[NodeIndex].LocalTransform;
+		}
+
+		// NOTE(georgy): Frames are sampled in order, so the cursor never searches
+		animation_cursor Cursor;
+		InitializeAnimationCursor(Animation, &Cursor, ClipIndex);
+		for (int32_t Frame = 0; Frame < Baked->ClipFrameCount[ClipIndex]; Frame++)
+		{
+			float Time = Min((float)Frame / FramesPerSecond, Animation->Clips[ClipIndex].Duration);
+			SampleAnimationClip(Animation, &Cursor, Time, LocalTransforms.Entries);
+			ComputeGlobalTransforms(Animation, LocalTransforms.Entries, GlobalTransforms.Entries);
+
+			vec4* Row = &Texels[(Baked->ClipFirstFrame[ClipIndex] + Frame) * TexelsPerFrame];
+			for (uint32_t BoneIndex = 0; BoneIndex < Baked->BoneCount; BoneIndex++)
+			{
+				animation_bone* Bone = &Animation->Bones[BoneIndex];
+				mat4 M = GlobalTransforms[Bone->NodeIndex] * Bone->Offset;
+
+				Row[3 * BoneIndex + 0] = vec4(M.a11, M.a12, M.a13, M.a14);
+				Row[3 * BoneIndex + 1] = vec4(M.a21, M.a22, M.a23, M.a24);
+				Row[3 * BoneIndex + 2] = vec4(M.a31, M.a32, M.a33, M.a34);
+			}
+		}
+	}
+
+	glGenTextures(1, &Baked->BoneTexture);
+	glBindTexture(GL_TEXTURE_2D, Baked->BoneTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, TexelsPerFrame, TotalFrames, 0, GL_RGBA, GL_FLOAT, Texels.Entries);
+	TrackGPUObject(MemoryTag_GPUTextures, Baked->BoneTexture, sizeof(vec4) * (uint64_t)TexelsPerFrame * TotalFrames);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	printf("Baked %u clips, %u bones, %u frames at %.1f fps: %.2f MB\n",
+		Baked->ClipCount, Baked->BoneCount, TotalFrames, FramesPerSecond,
+		(float)(Texels.EntriesCount * sizeof(vec4)) / (float)Megabytes(1));
+}
+
+// NOTE(georgy): VertexVBOs are the model's position, normal and texcoord buffers, SkinVBO holds vertex_skin entries
+static void
+InitializeCrowd(crowd* Crowd, animation_set* Animation, GLuint* VertexVBOs, GLuint SkinVBO, GLuint IndexVBO, float Spacing)
+{
+	MEMORY_TAG(MemoryTag_Crowd);
+
+	BakeAnimations(Animation, &Crowd->Baked, CROWD_BAKE_FRAMES_PER_SECOND);
+	// NOTE(georgy): The variants are built by the caller, once it knows which meshes it draws
+	InitializeShaderPermutations(&Crowd->Shaders, "shaders/CrowdVS.glsl", "shaders/DefaultFS.glsl",
+		ShaderFeature_TexCoords | ShaderFeature_Texture | ShaderFeature_Skinned);
+
+	Crowd->InstanceCount = CROWD_GRID_SIZE * CROWD_GRID_SIZE;
+	dynamic_array<crowd_instance>* Instances = &Crowd->Instances;
+	InitializeDynamicArray(Instances, Crowd->InstanceCount);
+	uint32_t RandomState = 0x9E3779B9;
+	for (uint32_t Z = 0; Z < CROWD_GRID_SIZE; Z++)
+	{
+		for (uint32_t X = 0; X < CROWD_GRID_SIZE; X++)
+		{
+			// NOTE(georgy): xorshift, only to desynchronize the instances
+			RandomState ^= RandomState << 13; RandomState ^= RandomState >> 17; RandomState ^= RandomState << 5;
+
+			crowd_instance Instance;
+			Instance.Position = Spacing * vec3((float)X - 0.5f * (CROWD_GRID_SIZE - 1), 0.0f, -(float)Z);
+			Instance.TimeOffset = (float)(RandomState & 0xFFFF) / 65535.0f * 10.0f;
+			Instance.ClipIndex = (Crowd->Baked.ClipCount > 0) ? (RandomState >> 16) % Crowd->Baked.ClipCount : 0;
+			PushEntry(Instances, Instance);
+		}
+	}
+
+	glGenVertexArrays(1, &Crowd->VAO);
+	glGenBuffers(1, &Crowd->InstanceVBO);
+	glBindVertexArray(Crowd->VAO);
+
+	glBindBuffer(GL_ARRAY_BUFFER, VertexVBOs[0]);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glBindBuffer(GL_ARRAY_BUFFER, VertexVBOs[1]);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glBindBuffer(GL_ARRAY_BUFFER, VertexVBOs[2]);
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, SkinVBO);
+	glEnableVertexAttribArray(BoneIndices_Attribute);
+	glVertexAttribIPointer(BoneIndices_Attribute, MAX_BONES_PER_VERTEX, GL_UNSIGNED_SHORT, sizeof(vertex_skin), (void*)OffsetOf(vertex_skin, BoneIndices));
+	glEnableVertexAttribArray(BoneWeights_Attribute);
+	glVertexAttribPointer(BoneWeights_Attribute, MAX_BONES_PER_VERTEX, GL_FLOAT, GL_FALSE, sizeof(vertex_skin), (void*)OffsetOf(vertex_skin, BoneWeights));
+
+	glBindBuffer(GL_ARRAY_BUFFER, Crowd->InstanceVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(crowd_instance) * Instances->EntriesCount, Instances->Entries, GL_STREAM_DRAW);
+	TrackGPUObject(MemoryTag_GPUBuffers, Crowd->InstanceVBO, sizeof(crowd_instance) * Instances->EntriesCount);
+	glEnableVertexAttribArray(InstancePositionTimeOffset_Attribute);
+	glVertexAttribPointer(InstancePositionTimeOffset_Attribute, 4, GL_FLOAT, GL_FALSE, sizeof(crowd_instance), (void*)OffsetOf(crowd_instance, Position));
+	glVertexAttribDivisor(InstancePositionTimeOffset_Attribute, 1);
+	glEnableVertexAttribArray(InstanceClip_Attribute);
+	glVertexAttribIPointer(InstanceClip_Attribute, 1, GL_UNSIGNED_INT, sizeof(crowd_instance), (void*)OffsetOf(crowd_instance, ClipIndex));
+	glVertexAttribDivisor(InstanceClip_Attribute, 1);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IndexVBO);
+	glBindVertexArray(0);
+
+	// NOTE(georgy): Instances are culled as points, the frustum is grown by the model box instead
+	ResizeCullBounds(&Crowd->InstanceBounds, Crowd->InstanceCount);
+	for (uint32_t InstanceIndex = 0; InstanceIndex < Crowd->InstanceCount; InstanceIndex++)
+	{
+		SetCullBounds(&Crowd->InstanceBounds, InstanceIndex, Crowd->Instances[InstanceIndex].Position, vec3(0.0f));
+	}
+	InitializeDynamicArray(&Crowd->VisibleInstances, Crowd->InstanceCount);
+	InitializeDynamicArray(&Crowd->InstanceVisibility, Crowd->InstanceCount);
+	ResizeDynamicArray(&Crowd->InstanceVisibility, Crowd->InstanceCount);
+	Crowd->VisibleInstanceCount = Crowd->InstanceCount;
+	Crowd->IsCulled = false;
+
+	Crowd->IsBaked = true;
+}
+
+// NOTE(georgy): InstanceBox is the box of one instance around its position, in world space.
+// Writes the visible instances into the instance buffer, they are drawn with VisibleInstanceCount.
+// Does nothing when the frustum and the box are the same as last time, which with the fixed crowd camera is most frames.
+static void
+CullCrowdInstances(game_memory* Memory, memory_arena* FrameArena, crowd* Crowd, frustum* Frustum, aabb InstanceBox)
+{
+	PROFILE_ZONE("CullCrowdInstances");
+	MEMORY_TAG(MemoryTag_Crowd);
+
+	vec3 Center = 0.5f*(InstanceBox.Min + InstanceBox.Max);
+	vec3 Extent = 0.5f*(InstanceBox.Max - InstanceBox.Min);
+	frustum InstanceFrustum = ExpandFrustumByBox(Frustum, Center, Extent);
+	if (Crowd->IsCulled && (memcmp(&InstanceFrustum, &Crowd->CulledFrustum, sizeof(frustum)) == 0))
+	{
+		return;
+	}
+	Crowd->IsCulled = true;
+	Crowd->CulledFrustum = InstanceFrustum;
+
+	CullBounds(Memory, FrameArena, &InstanceFrustum, &Crowd->InstanceBounds, Crowd->InstanceVisibility.Entries);
+
+	Crowd->VisibleInstances.EntriesCount = 0;
+	for (uint32_t InstanceIndex = 0; InstanceIndex < Crowd->InstanceCount; InstanceIndex++)
+	{
+		if (Crowd->InstanceVisibility[InstanceIndex])
+		{
+			PushEntry(&Crowd->VisibleInstances, Crowd->Instances[InstanceIndex]);
+		}
+	}
+	Crowd->VisibleInstanceCount = Crowd->VisibleInstances.EntriesCount;
+
+	// NOTE(georgy): Orphan the buffer, the previous frame may still be reading it
+	glBindBuffer(GL_ARRAY_BUFFER, Crowd->InstanceVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(crowd_instance) * Crowd->InstanceCount, 0, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(crowd_instance) * Crowd->VisibleInstanceCount, Crowd->VisibleInstances.Entries);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+static void
+ReleaseCrowd(crowd* Crowd)
+{
+	if (Crowd->IsBaked)
+	{
+		TrackGPUObject(MemoryTag_GPUTextures, Crowd->Baked.BoneTexture, 0);
+		TrackGPUObject(MemoryTag_GPUBuffers, Crowd->InstanceVBO, 0);
+		glDeleteTextures(1, &Crowd->Baked.BoneTexture);
+		glDeleteVertexArrays(1, &Crowd->VAO);
+		glDeleteBuffers(1, &Crowd->InstanceVBO);
+		DeleteShaderPermutations(&Crowd->Shaders);
+
+		FreeDynamicArray(&Crowd->Instances);
+		FreeDynamicArray(&Crowd->VisibleInstances);
+		FreeCullBounds(&Crowd->InstanceBounds);
+		FreeDynamicArray(&Crowd->InstanceVisibility);
+	}
+
+	Crowd->IsBaked = false;
+	Crowd->Enabled = false;
+}
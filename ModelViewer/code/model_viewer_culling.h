@@ -0,0 +1,234 @@
+#pragma once
+
+// NOTE(georgy): Frustum culling.
+// Bounds are kept as SoA center/extent arrays padded to a multiple of CULL_LANES, so the test runs over 4 boxes per
+// iteration with SSE (plain C elsewhere). Planes come straight out of a clip matrix: from Projection * View * Model the
+// planes are in model space and the mesh bounds never need transforming. Large sets are split across the platform work queue.
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#define CULL_SSE 1
+#endif
+
+#define CULL_LANES 4
+#define CULL_PARALLEL_THRESHOLD 100000
+#define CULL_JOB_SIZE 16384
+
+struct frustum
+{
+	// NOTE(georgy): Left, right, bottom, top, near, far. xyz is the normal pointing inside, w the distance.
+	vec4 Planes[6];
+};
+
+struct cull_bounds
+{
+	uint32_t Count;
+	dynamic_array<float> CenterX, CenterY, CenterZ;
+	dynamic_array<float> ExtentX, ExtentY, ExtentZ;
+};
+
+// NOTE(georgy): Gribb-Hartmann, a point is inside when every plane sees it at a non-negative distance
+static frustum
+FrustumFromMatrix(mat4 M)
+{
+	vec4 Row0 = vec4(M.a11, M.a12, M.a13, M.a14);
+	vec4 Row1 = vec4(M.a21, M.a22, M.a23, M.a24);
+	vec4 Row2 = vec4(M.a31, M.a32, M.a33, M.a34);
+	vec4 Row3 = vec4(M.a41, M.a42, M.a43, M.a44);
+
+	frustum Result;
+	Result.Planes[0] = Row3 + Row0;
+	Result.Planes[1] = Row3 - Row0;
+	Result.Planes[2] = Row3 + Row1;
+	Result.Planes[3] = Row3 - Row1;
+	Result.Planes[4] = Row3 + Row2;
+	Result.Planes[5] = Row3 - Row2;
+
+	for (uint32_t PlaneIndex = 0; PlaneIndex < ArrayCount(Result.Planes); PlaneIndex++)
+	{
+		vec4 Plane = Result.Planes[PlaneIndex];
+		float InvLength = 1.0f / Length(Plane.xyz);
+		Result.Planes[PlaneIndex] = InvLength * Plane;
+	}
+
+	return(Result);
+}
+
+// NOTE(georgy): For many copies of one box: the frustum for testing their positions as points.
+// Each plane is moved out by the box's offset and its extent, so a point test with zero extents gives the box test.
+static frustum
+ExpandFrustumByBox(frustum* Frustum, vec3 Offset, vec3 Extent)
+{
+	frustum Result;
+	for (uint32_t PlaneIndex = 0; PlaneIndex < ArrayCount(Frustum->Planes); PlaneIndex++)
+	{
+		vec4 Plane = Frustum->Planes[PlaneIndex];
+		float Radius = Absolute(Plane.x)*Extent.x + Absolute(Plane.y)*Extent.y + Absolute(Plane.z)*Extent.z;
+		Plane.w += Dot(Plane.xyz, Offset) + Radius;
+		Result.Planes[PlaneIndex] = Plane;
+	}
+
+	return(Result);
+}
+
+static void
+ResizeCullBounds(cull_bounds* Bounds, uint32_t Count)
+{
+	uint32_t PaddedCount = (Count + CULL_LANES - 1) / CULL_LANES * CULL_LANES;
+	dynamic_array<float>* Arrays[] = { &Bounds->CenterX, &Bounds->CenterY, &Bounds->CenterZ, &Bounds->ExtentX, &Bounds->ExtentY, &Bounds->ExtentZ };
+	for (uint32_t ArrayIndex = 0; ArrayIndex < ArrayCount(Arrays); ArrayIndex++)
+	{
+		ResizeDynamicArray(Arrays[ArrayIndex], PaddedCount);
+		for (uint32_t Index = Count; Index < PaddedCount; Index++)
+		{
+			(*Arrays[ArrayIndex])[Index] = 0.0f;
+		}
+	}
+
+	Bounds->Count = Count;
+}
+
+inline void
+SetCullBounds(cull_bounds* Bounds, uint32_t Index, vec3 Center, vec3 Extent)
+{
+	Bounds->CenterX[Index] = Center.x; Bounds->CenterY[Index] = Center.y; Bounds->CenterZ[Index] = Center.z;
+	Bounds->ExtentX[Index] = Extent.x; Bounds->ExtentY[Index] = Extent.y; Bounds->ExtentZ[Index] = Extent.z;
+}
+
+static void
+FreeCullBounds(cull_bounds* Bounds)
+{
+	FreeDynamicArray(&Bounds->CenterX); FreeDynamicArray(&Bounds->CenterY); FreeDynamicArray(&Bounds->CenterZ);
+	FreeDynamicArray(&Bounds->ExtentX); FreeDynamicArray(&Bounds->ExtentY); FreeDynamicArray(&Bounds->ExtentZ);
+	Bounds->Count = 0;
+}
+
+// NOTE(georgy): First has to be a multiple of CULL_LANES. Writes 1 into Visible for every box that touches the frustum,
+// returns how many did.
+static uint32_t
+CullBoundsRange(frustum* Frustum, cull_bounds* Bounds, uint32_t First, uint32_t OnePastLast, uint8_t* Visible)
+{
+	uint32_t Result = 0;
+
+#if CULL_SSE
+	__m128 Zero = _mm_setzero_ps();
+	__m128 SignMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	for (uint32_t Index = First; Index < OnePastLast; Index += CULL_LANES)
+	{
+		__m128 CenterX = _mm_loadu_ps(&Bounds->CenterX[Index]);
+		__m128 CenterY = _mm_loadu_ps(&Bounds->CenterY[Index]);
+		__m128 CenterZ = _mm_loadu_ps(&Bounds->CenterZ[Index]);
+		__m128 ExtentX = _mm_loadu_ps(&Bounds->ExtentX[Index]);
+		__m128 ExtentY = _mm_loadu_ps(&Bounds->ExtentY[Index]);
+		__m128 ExtentZ = _mm_loadu_ps(&Bounds->ExtentZ[Index]);
+
+		__m128 Outside = Zero;
+		for (uint32_t PlaneIndex = 0; PlaneIndex < ArrayCount(Frustum->Planes); PlaneIndex++)
+		{
+			vec4 Plane = Frustum->Planes[PlaneIndex];
+			__m128 NormalX = _mm_set1_ps(Plane.x);
+			__m128 NormalY = _mm_set1_ps(Plane.y);
+			__m128 NormalZ = _mm_set1_ps(Plane.z);
+
+			__m128 Distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(CenterX, NormalX), _mm_mul_ps(CenterY, NormalY)),
+										 _mm_add_ps(_mm_mul_ps(CenterZ, NormalZ), _mm_set1_ps(Plane.w)));
+			__m128 Radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ExtentX, _mm_and_ps(NormalX, SignMask)),
+												  _mm_mul_ps(ExtentY, _mm_and_ps(NormalY, SignMask))),
+									   _mm_mul_ps(ExtentZ, _mm_and_ps(NormalZ, SignMask)));
+			Outside = _mm_or_ps(Outside, _mm_cmplt_ps(_mm_add_ps(Distance, Radius), Zero));
+		}
+
+		int OutsideMask = _mm_movemask_ps(Outside);
+		for (uint32_t Lane = 0; (Lane < CULL_LANES) && (Index + Lane < OnePastLast); Lane++)
+		{
+			uint8_t IsVisible = !(OutsideMask & (1 << Lane));
+			Visible[Index + Lane] = IsVisible;
+			Result += IsVisible;
+		}
+	}
+#else
+	for (uint32_t Index = First; Index < OnePastLast; Index++)
+	{
+		bool IsOutside = false;
+		for (uint32_t PlaneIndex = 0; PlaneIndex < ArrayCount(Frustum->Planes); PlaneIndex++)
+		{
+			vec4 Plane = Frustum->Planes[PlaneIndex];
+			float Distance = Plane.x*Bounds->CenterX[Index] + Plane.y*Bounds->CenterY[Index] + Plane.z*Bounds->CenterZ[Index] + Plane.w;
+			float Radius = Absolute(Plane.x)*Bounds->ExtentX[Index] + Absolute(Plane.y)*Bounds->ExtentY[Index] + Absolute(Plane.z)*Bounds->ExtentZ[Index];
+			IsOutside = IsOutside || (Distance + Radius < 0.0f);
+		}
+
+		Visible[Index] = !IsOutside;
+		Result += !IsOutside;
+	}
+#endif
+
+	return(Result);
+}
+
+struct cull_job
+{
+	frustum* Frustum;
+	cull_bounds* Bounds;
+	uint32_t First;
+	uint32_t OnePastLast;
+	uint8_t* Visible;
+
+	uint32_t VisibleCount;
+};
+
+static PLATFORM_WORK_QUEUE_CALLBACK(DoCullJob)
+{
+	(void)Queue;
+	PROFILE_ZONE("DoCullJob");
+
+	cull_job* Job = (cull_job*)Data;
+	Job->VisibleCount = CullBoundsRange(Job->Frustum, Job->Bounds, Job->First, Job->OnePastLast, Job->Visible);
+}
+
+// NOTE(georgy): Visible needs Bounds->Count entries. Returns the visible count.
+static uint32_t
+CullBounds(game_memory* Memory, memory_arena* FrameArena, frustum* Frustum, cull_bounds* Bounds, uint8_t* Visible)
+{
+	PROFILE_ZONE("CullBounds");
+
+	uint32_t Result = 0;
+	if ((Bounds->Count < CULL_PARALLEL_THRESHOLD) || !Memory->WorkQueue)
+	{
+		Result = CullBoundsRange(Frustum, Bounds, 0, Bounds->Count, Visible);
+	}
+	else
+	{
+		// NOTE(georgy): Bigger jobs for huge sets, the queue holds 256 entries. Job starts stay multiples of CULL_LANES.
+		uint32_t JobSize = Max((uint32_t)CULL_JOB_SIZE, ((Bounds->Count / 128) + CULL_LANES - 1) / CULL_LANES * CULL_LANES);
+		uint32_t JobCount = (Bounds->Count + JobSize - 1) / JobSize;
+		temporary_memory JobMemory = BeginTemporaryMemory(FrameArena);
+		dynamic_array<cull_job> Jobs(JobCount, FrameArena);
+		for (uint32_t JobIndex = 0; JobIndex < JobCount; JobIndex++)
+		{
+			cull_job Job;
+			Job.Frustum = Frustum;
+			Job.Bounds = Bounds;
+			Job.First = JobIndex * JobSize;
+			Job.OnePastLast = Min(Job.First + JobSize, Bounds->Count);
+			Job.Visible = Visible;
+			Job.VisibleCount = 0;
+			PushEntry(&Jobs, Job);
+		}
+
+		// NOTE(georgy): Jobs is never resized after this point, the pointers stay valid
+		for (uint32_t JobIndex = 0; JobIndex < JobCount; JobIndex++)
+		{
+			Memory->PlatformAddEntry(Memory->WorkQueue, DoCullJob, &Jobs[JobIndex]);
+		}
+		Memory->PlatformCompleteAllWork(Memory->WorkQueue);
+
+		for (uint32_t JobIndex = 0; JobIndex < JobCount; JobIndex++)
+		{
+			Result += Jobs[JobIndex].VisibleCount;
+		}
+		EndTemporaryMemory(JobMemory);
+	}
+
+	return(Result);
+}
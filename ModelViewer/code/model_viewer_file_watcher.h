@@ -0,0 +1,233 @@
+#pragma once
+
+// NOTE(georgy): File change notifications for hot reload.
+// On Linux this is inotify on the containing directories (editors usually save by writing a new file and renaming it
+// over the old one, which a watch on the file itself would lose). Elsewhere we fall back to polling the modification time.
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// NOTE(georgy): For a file that isn't watched, FileChanged and RemoveFileWatch take it
+#define NO_FILE_WATCH 0xFFFFFFFF
+
+struct file_watch
+{
+	char Path[MAX_PATH];
+	uint32_t FileNameOffset;
+	bool InUse;
+	bool Changed;
+
+#if defined(__linux__)
+	int DirectoryWatch;
+#else
+	time_t LastWriteTime;
+#endif
+};
+
+struct file_watcher
+{
+#if defined(__linux__)
+	int INotify;
+#endif
+	dynamic_array<file_watch> Watches;
+};
+
+inline const char*
+FileNameFromPath(const char* Path)
+{
+	const char* Result = Path;
+	for (const char* C = Path; *C != 0; C++)
+	{
+		if ((*C == '\\') || (*C == '/'))
+		{
+			Result = C + 1;
+		}
+	}
+
+	return(Result);
+}
+
+#if !defined(__linux__)
+static time_t
+GetLastWriteTime(const char* Path)
+{
+	struct stat FileStat;
+	time_t Result = (stat(Path, &FileStat) == 0) ? FileStat.st_mtime : 0;
+
+	return(Result);
+}
+#endif
+
+static void
+InitializeFileWatcher(file_watcher* Watcher)
+{
+	InitializeDynamicArray(&Watcher->Watches);
+#if defined(__linux__)
+	Watcher->INotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+// NOTE(georgy): Closes the inotify instance, which drops all of its directory watches with it
+static void
+ReleaseFileWatcher(file_watcher* Watcher)
+{
+#if defined(__linux__)
+	if (Watcher->INotify >= 0)
+	{
+		close(Watcher->INotify);
+	}
+	Watcher->INotify = -1;
+#endif
+	FreeDynamicArray(&Watcher->Watches);
+}
+
+// NOTE(georgy): Returns the index to pass to FileChanged and RemoveFileWatch. Indices stay valid until removed,
+// a removed slot is handed out again.
+static uint32_t
+AddFileWatch(file_watcher* Watcher, const char* Path)
+{
+	file_watch Watch = {};
+	Watch.InUse = true;
+	strncpy(Watch.Path, Path, sizeof(Watch.Path) - 1);
+	Watch.FileNameOffset = (uint32_t)(FileNameFromPath(Watch.Path) - Watch.Path);
+
+#if defined(__linux__)
+	char Directory[MAX_PATH];
+	const char* FileName = FileNameFromPath(Path);
+	uint32_t DirectoryLength = (uint32_t)(FileName - Path);
+	if (DirectoryLength == 0)
+	{
+		Directory[0] = '.'; Directory[1] = 0;
+	}
+	else
+	{
+		memcpy(Directory, Path, DirectoryLength);
+		Directory[DirectoryLength] = 0;
+	}
+
+	// NOTE(georgy): inotify returns the same descriptor for a directory that is already watched
+	Watch.DirectoryWatch = (Watcher->INotify >= 0) ?
+		inotify_add_watch(Watcher->INotify, Directory, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) : -1;
+#else
+	Watch.LastWriteTime = GetLastWriteTime(Path);
+#endif
+
+	uint32_t Result = 0;
+	while ((Result < Watcher->Watches.EntriesCount) && Watcher->Watches[Result].InUse)
+	{
+		Result++;
+	}
+	if (Result < Watcher->Watches.EntriesCount)
+	{
+		Watcher->Watches[Result] = Watch;
+	}
+	else
+	{
+		PushEntry(&Watcher->Watches, Watch);
+	}
+
+	return(Result);
+}
+
+static void
+RemoveFileWatch(file_watcher* Watcher, uint32_t WatchIndex)
+{
+	if (WatchIndex == NO_FILE_WATCH)
+	{
+		return;
+	}
+
+	file_watch* Watch = &Watcher->Watches[WatchIndex];
+	Watch->InUse = false;
+	Watch->Changed = false;
+
+#if defined(__linux__)
+	// NOTE(georgy): The directory watch is shared by every file in it, it goes with the last one
+	bool DirectoryInUse = false;
+	for (uint32_t OtherIndex = 0;
+		OtherIndex < Watcher->Watches.EntriesCount;
+		OtherIndex++)
+	{
+		file_watch* Other = &Watcher->Watches[OtherIndex];
+		DirectoryInUse = DirectoryInUse || (Other->InUse && (Other->DirectoryWatch == Watch->DirectoryWatch));
+	}
+	if (!DirectoryInUse && (Watch->DirectoryWatch >= 0))
+	{
+		inotify_rm_watch(Watcher->INotify, Watch->DirectoryWatch);
+	}
+	Watch->DirectoryWatch = -1;
+#endif
+}
+
+// NOTE(georgy): Call once per frame. Marks changed watches, the caller clears them through FileChanged.
+static void
+PollFileWatcher(file_watcher* Watcher)
+{
+#if defined(__linux__)
+	if (Watcher->INotify < 0)
+	{
+		return;
+	}
+
+	alignas(inotify_event) char Buffer[4096];
+	for (;;)
+	{
+		ssize_t BytesRead = read(Watcher->INotify, Buffer, sizeof(Buffer));
+		if (BytesRead <= 0)
+		{
+			break;
+		}
+
+		for (char* At = Buffer; At < Buffer + BytesRead; )
+		{
+			inotify_event* Event = (inotify_event*)At;
+			if (Event->len > 0)
+			{
+				for (uint32_t WatchIndex = 0;
+					WatchIndex < Watcher->Watches.EntriesCount;
+					WatchIndex++)
+				{
+					file_watch* Watch = &Watcher->Watches[WatchIndex];
+					if (Watch->InUse && (Watch->DirectoryWatch == Event->wd) && (strcmp(Watch->Path + Watch->FileNameOffset, Event->name) == 0))
+					{
+						Watch->Changed = true;
+					}
+				}
+			}
+
+			At += sizeof(inotify_event) + Event->len;
+		}
+	}
+#else
+	for (uint32_t WatchIndex = 0;
+		WatchIndex < Watcher->Watches.EntriesCount;
+		WatchIndex++)
+	{
+		file_watch* Watch = &Watcher->Watches[WatchIndex];
+		time_t WriteTime = Watch->InUse ? GetLastWriteTime(Watch->Path) : Watch->LastWriteTime;
+		if (WriteTime != Watch->LastWriteTime)
+		{
+			Watch->LastWriteTime = WriteTime;
+			Watch->Changed = true;
+		}
+	}
+#endif
+}
+
+inline bool
+FileChanged(file_watcher* Watcher, uint32_t WatchIndex)
+{
+	bool Result = false;
+	if (WatchIndex != NO_FILE_WATCH)
+	{
+		file_watch* Watch = &Watcher->Watches[WatchIndex];
+		Result = Watch->Changed;
+		Watch->Changed = false;
+	}
+
+	return(Result);
+}
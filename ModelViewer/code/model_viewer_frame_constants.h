@@ -0,0 +1,77 @@
+#pragma once
+
+// NOTE(georgy): Per-frame constants shared by every program through the FrameConstants uniform block.
+// They are written once per frame into the next range of a ring and that range is bound to FrameConstants_Binding,
+// so no program needs its own camera uniforms. A fence per range keeps us from writing over a range the GPU still reads.
+
+#define FRAME_CONSTANTS_RING_SIZE 3
+
+// NOTE(georgy): std140, must match the FrameConstants block in the shaders
+struct frame_constants
+{
+	mat4 Projection;
+	mat4 View;
+};
+
+struct uniform_ring
+{
+	GLuint UBO;
+	uint32_t RangeSize;
+	uint32_t RangeIndex;
+	GLsync Fences[FRAME_CONSTANTS_RING_SIZE];
+};
+
+static void
+InitializeUniformRing(uniform_ring* Ring)
+{
+	GLint Alignment;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &Alignment);
+	Ring->RangeSize = (uint32_t)((sizeof(frame_constants) + Alignment - 1) / Alignment * Alignment);
+	Ring->RangeIndex = 0;
+
+	glGenBuffers(1, &Ring->UBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, Ring->UBO);
+	glBufferData(GL_UNIFORM_BUFFER, FRAME_CONSTANTS_RING_SIZE * Ring->RangeSize, 0, GL_DYNAMIC_DRAW);
+	TrackGPUObject(MemoryTag_GPUBuffers, Ring->UBO, FRAME_CONSTANTS_RING_SIZE * Ring->RangeSize);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	for (uint32_t FenceIndex = 0; FenceIndex < FRAME_CONSTANTS_RING_SIZE; FenceIndex++)
+	{
+		Ring->Fences[FenceIndex] = 0;
+	}
+}
+
+// NOTE(georgy): Call once per frame before the draws that read the constants
+static void
+PushFrameConstants(uniform_ring* Ring, frame_constants* Constants)
+{
+	Ring->RangeIndex = (Ring->RangeIndex + 1) % FRAME_CONSTANTS_RING_SIZE;
+
+	GLsync* Fence = &Ring->Fences[Ring->RangeIndex];
+	if (*Fence)
+	{
+		glClientWaitSync(*Fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+		glDeleteSync(*Fence);
+		*Fence = 0;
+	}
+
+	GLintptr Offset = Ring->RangeIndex * Ring->RangeSize;
+	glBindBuffer(GL_UNIFORM_BUFFER, Ring->UBO);
+	void* Memory = glMapBufferRange(GL_UNIFORM_BUFFER, Offset, sizeof(frame_constants),
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (Memory)
+	{
+		memcpy(Memory, Constants, sizeof(frame_constants));
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	glBindBufferRange(GL_UNIFORM_BUFFER, FrameConstants_Binding, Ring->UBO, Offset, sizeof(frame_constants));
+}
+
+// NOTE(georgy): Call after the last draw of the frame
+inline void
+EndFrameConstants(uniform_ring* Ring)
+{
+	Ring->Fences[Ring->RangeIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+// NOTE(georgy): Where the time of a model load goes.
+// LoadModel switches between stages as it goes, a stage entered again keeps adding to itself. Parse is Assimp reading
+// the file (and freeing the scene at the end), PostProcess its processing steps, Convert our own loops over the scene,
+// Textures the stb_image decode and packing, Upload every GL call, BVH the build after the load.
+// Memory is the resident peak while in a stage, and how far that went over the resident size at its start.
+
+#define LOAD_BENCHMARK_NOISE_MS 1.0
+
+enum load_stage
+{
+	LoadStage_Parse,
+	LoadStage_PostProcess,
+	LoadStage_Convert,
+	LoadStage_Textures,
+	LoadStage_Upload,
+	LoadStage_BVH,
+
+	LoadStage_Count,
+	LoadStage_None = LoadStage_Count
+};
+
+static const char* LoadStageNames[LoadStage_Count + 1] =
+{
+	"parse",
+	"post_process",
+	"convert",
+	"textures",
+	"upload",
+	"bvh",
+	"total"
+};
+
+struct load_stage_sample
+{
+	double WallSeconds;
+	double CPUSeconds;
+	uint64_t PeakResidentBytes;
+	uint64_t PeakGrowthBytes;
+};
+
+struct load_profile
+{
+	game_memory* Memory;
+	uint32_t Stage;
+	double StageWallStart;
+	double StageCPUStart;
+	uint64_t StageResidentStart;
+
+	load_stage_sample Stages[LoadStage_Count];
+};
+
+inline void
+BeginLoadProfile(load_profile* Profile, game_memory* Memory)
+{
+	*Profile = {};
+	Profile->Memory = Memory;
+	Profile->Stage = LoadStage_None;
+}
+
+// NOTE(georgy): Closes the current stage and opens the next one, LoadStage_None only closes. GL calls only queue work,
+// so the upload stage waits for it before it is closed. Profile may be 0, then this does nothing.
+static void
+SwitchLoadStage(load_profile* Profile, uint32_t Stage)
+{
+	if (!Profile)
+	{
+		return;
+	}
+
+	if (Profile->Stage == LoadStage_Upload)
+	{
+		glFinish();
+	}
+
+	double Wall = GetWallClockSeconds();
+	platform_process_stats Process;
+	Profile->Memory->PlatformGetProcessStats(&Process, true);
+	if (Profile->Stage != LoadStage_None)
+	{
+		load_stage_sample* Sample = &Profile->Stages[Profile->Stage];
+		Sample->WallSeconds += Wall - Profile->StageWallStart;
+		Sample->CPUSeconds += Process.CPUSeconds - Profile->StageCPUStart;
+		Sample->PeakResidentBytes = Max(Sample->PeakResidentBytes, Process.PeakResidentBytes);
+		if (Process.PeakResidentBytes > Profile->StageResidentStart)
+		{
+			Sample->PeakGrowthBytes = Max(Sample->PeakGrowthBytes, Process.PeakResidentBytes - Profile->StageResidentStart);
+		}
+	}
+
+	// NOTE(georgy): Taken after the stats, reading them isn't part of the next stage
+	Profile->Stage = Stage;
+	Profile->StageCPUStart = Process.CPUSeconds;
+	Profile->StageResidentStart = Process.ResidentBytes;
+	Profile->StageWallStart = GetWallClockSeconds();
+}
+
+static int
+CompareDoubles(const void* A, const void* B)
+{
+	double ValueA = *(double*)A;
+	double ValueB = *(double*)B;
+	int Result = (ValueA < ValueB) ? -1 : ((ValueA > ValueB) ? 1 : 0);
+
+	return(Result);
+}
+
+// NOTE(georgy): Nearest rank on sorted values, Percentile in [0, 1]
+inline double
+PercentileOfSorted(double* Sorted, uint32_t Count, double Percentile)
+{
+	uint32_t Rank = (uint32_t)ceil(Percentile * Count);
+	uint32_t Index = (Rank > 0) ? (Rank - 1) : 0;
+	double Result = (Count > 0) ? Sorted[Min(Index, Count - 1)] : 0.0;
+
+	return(Result);
+}
+
+// NOTE(georgy): Over all runs of one model and stage
+struct load_stage_summary
+{
+	double WallMedianMs;
+	double WallP90Ms;
+	double WallMinMs;
+	double WallMaxMs;
+	double CPUMedianMs;
+	double PeakResidentMB;
+	double PeakGrowthMB;
+};
+
+// NOTE(georgy): Samples has RunCount entries, Scratch room for as many. The peaks are the largest of all runs.
+static load_stage_summary
+SummarizeLoadStage(load_stage_sample* Samples, uint32_t RunCount, double* Scratch)
+{
+	load_stage_summary Result = {};
+
+	for (uint32_t Run = 0; Run < RunCount; Run++)
+	{
+		Scratch[Run] = 1000.0 * Samples[Run].CPUSeconds;
+		Result.PeakResidentMB = Max(Result.PeakResidentMB, (double)Samples[Run].PeakResidentBytes / (double)Megabytes(1));
+		Result.PeakGrowthMB = Max(Result.PeakGrowthMB, (double)Samples[Run].PeakGrowthBytes / (double)Megabytes(1));
+	}
+	qsort(Scratch, RunCount, sizeof(double), CompareDoubles);
+	Result.CPUMedianMs = PercentileOfSorted(Scratch, RunCount, 0.5);
+
+	for (uint32_t Run = 0; Run < RunCount; Run++)
+	{
+		Scratch[Run] = 1000.0 * Samples[Run].WallSeconds;
+	}
+	qsort(Scratch, RunCount, sizeof(double), CompareDoubles);
+	Result.WallMedianMs = PercentileOfSorted(Scratch, RunCount, 0.5);
+	Result.WallP90Ms = PercentileOfSorted(Scratch, RunCount, 0.9);
+	Result.WallMinMs = Scratch[0];
+	Result.WallMaxMs = Scratch[RunCount - 1];
+
+	return(Result);
+}
+
+// NOTE(georgy): Backslashes and quotes are all a path needs
+static void
+WriteJSONString(FILE* File, const char* String)
+{
+	fputc('"', File);
+	for (const char* C = String; *C; C++)
+	{
+		if ((*C == '"') || (*C == '\\'))
+		{
+			fputc('\\', File);
+		}
+		fputc(*C, File);
+	}
+	fputc('"', File);
+}
+
+// NOTE(georgy): Summaries has LoadStage_Count + 1 entries per model, the last one the total. One stage per line,
+// FindBaselineMedian relies on that layout.
+static bool
+WriteLoadBenchmarkJSON(const char* Path, uint32_t ModelCount, const char** ModelPaths, uint32_t RunCount, load_stage_summary* Summaries)
+{
+	FILE* File = fopen(Path, "w");
+	if (!File)
+	{
+		return(false);
+	}
+
+	fprintf(File, "{\n\t\"runs\": %u,\n\t\"models\": [\n", RunCount);
+	for (uint32_t ModelIndex = 0; ModelIndex < ModelCount; ModelIndex++)
+	{
+		fprintf(File, "\t\t{\n\t\t\t\"path\": ");
+		WriteJSONString(File, ModelPaths[ModelIndex]);
+		fprintf(File, ",\n\t\t\t\"stages\": {\n");
+		for (uint32_t Stage = 0; Stage <= LoadStage_Count; Stage++)
+		{
+			load_stage_summary* Summary = &Summaries[ModelIndex * (LoadStage_Count + 1) + Stage];
+			fprintf(File, "\t\t\t\t\"%s\": {\"wall_median_ms\": %.4f, \"wall_p90_ms\": %.4f, \"wall_min_ms\": %.4f, \"wall_max_ms\": %.4f, "
+				"\"cpu_median_ms\": %.4f, \"peak_resident_mb\": %.2f, \"peak_growth_mb\": %.2f}%s\n",
+				LoadStageNames[Stage], Summary->WallMedianMs, Summary->WallP90Ms, Summary->WallMinMs, Summary->WallMaxMs,
+				Summary->CPUMedianMs, Summary->PeakResidentMB, Summary->PeakGrowthMB, (Stage < LoadStage_Count) ? "," : "");
+		}
+		fprintf(File, "\t\t\t}\n\t\t}%s\n", (ModelIndex + 1 < ModelCount) ? "," : "");
+	}
+	fprintf(File, "\t]\n}\n");
+
+	bool Result = (ferror(File) == 0);
+	fclose(File);
+
+	return(Result);
+}
+
+// NOTE(georgy): Not a JSON parser, only reads back what WriteLoadBenchmarkJSON wrote. Returns false if the baseline
+// doesn't have the model or the stage.
+static bool
+FindBaselineMedian(const char* Baseline, const char* ModelPath, const char* StageName, double* MedianMs)
+{
+	char Key[2 * MAX_PATH + 16] = "\"path\": \"";
+	char* At = Key + strlen(Key);
+	for (const char* C = ModelPath; *C && (At < Key + sizeof(Key) - 3); C++)
+	{
+		if ((*C == '"') || (*C == '\\'))
+		{
+			*At++ = '\\';
+		}
+		*At++ = *C;
+	}
+	*At++ = '"';
+	*At = 0;
+
+	const char* Model = strstr(Baseline, Key);
+	if (!Model)
+	{
+		return(false);
+	}
+	const char* NextModel = strstr(Model + 1, "\"path\": ");
+
+	char StageKey[64];
+	snprintf(StageKey, sizeof(StageKey), "\"%s\": {\"wall_median_ms\": ", StageName);
+	const char* Stage = strstr(Model, StageKey);
+	if (!Stage || (NextModel && (Stage > NextModel)))
+	{
+		return(false);
+	}
+
+	*MedianMs = atof(Stage + strlen(StageKey));
+
+	return(true);
+}
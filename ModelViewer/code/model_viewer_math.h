@@ -3,6 +3,17 @@
 #include <math.h>
 #include <stdint.h>
 
+// NOTE(georgy): mat4 products and inverses use SSE where it's there, AVX widens the batch transforms to 8 lanes.
+// The ...Scalar versions are always compiled, they're the fallback and what the math benchmark compares to.
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#define MATH_SSE 1
+#endif
+#if defined(__AVX__)
+#include <immintrin.h>
+#define MATH_AVX 1
+#endif
+
 #define PI 3.14159265358979323846f
 
 #define Epsilon (1.19e-7f)
@@ -1205,7 +1216,7 @@ Perspective(float FoV, float AspectRatio, float Near, float Far)
 }
 
 static mat4
-operator*(mat4 A, mat4 B)
+MultiplyScalar(mat4 A, mat4 B)
 {
 	mat4 Result;
 
@@ -1232,7 +1243,7 @@ operator*(mat4 A, mat4 B)
 }
 
 static vec4
-operator*(mat4 A, vec4 B)
+MultiplyScalar(mat4 A, vec4 B)
 {
 	vec4 Result;
 
@@ -1244,6 +1255,146 @@ operator*(mat4 A, vec4 B)
 	return(Result);
 }
 
+// NOTE(georgy): Each column of the result is the columns of A weighted by a column of B, summed in the order the
+// scalar version sums
+static mat4
+operator*(mat4 A, mat4 B)
+{
+#if MATH_SSE
+	mat4 Result;
+
+	__m128 A0 = _mm_loadu_ps(&A.E[0]);
+	__m128 A1 = _mm_loadu_ps(&A.E[4]);
+	__m128 A2 = _mm_loadu_ps(&A.E[8]);
+	__m128 A3 = _mm_loadu_ps(&A.E[12]);
+	for (uint32_t Column = 0;
+		Column < 4;
+		Column++)
+	{
+		__m128 BColumn = _mm_loadu_ps(&B.E[Column * 4]);
+		__m128 Sum = _mm_mul_ps(A0, _mm_shuffle_ps(BColumn, BColumn, _MM_SHUFFLE(0, 0, 0, 0)));
+		Sum = _mm_add_ps(Sum, _mm_mul_ps(A1, _mm_shuffle_ps(BColumn, BColumn, _MM_SHUFFLE(1, 1, 1, 1))));
+		Sum = _mm_add_ps(Sum, _mm_mul_ps(A2, _mm_shuffle_ps(BColumn, BColumn, _MM_SHUFFLE(2, 2, 2, 2))));
+		Sum = _mm_add_ps(Sum, _mm_mul_ps(A3, _mm_shuffle_ps(BColumn, BColumn, _MM_SHUFFLE(3, 3, 3, 3))));
+		_mm_storeu_ps(&Result.E[Column * 4], Sum);
+	}
+#else
+	mat4 Result = MultiplyScalar(A, B);
+#endif
+
+	return(Result);
+}
+
+static vec4
+operator*(mat4 A, vec4 B)
+{
+#if MATH_SSE
+	vec4 Result;
+
+	__m128 Sum = _mm_mul_ps(_mm_loadu_ps(&A.E[0]), _mm_set1_ps(B.x));
+	Sum = _mm_add_ps(Sum, _mm_mul_ps(_mm_loadu_ps(&A.E[4]), _mm_set1_ps(B.y)));
+	Sum = _mm_add_ps(Sum, _mm_mul_ps(_mm_loadu_ps(&A.E[8]), _mm_set1_ps(B.z)));
+	Sum = _mm_add_ps(Sum, _mm_mul_ps(_mm_loadu_ps(&A.E[12]), _mm_set1_ps(B.w)));
+	_mm_storeu_ps(Result.E, Sum);
+#else
+	vec4 Result = MultiplyScalar(A, B);
+#endif
+
+	return(Result);
+}
+
+// 
+// NOTE(georgy): Quaternion
+// 
+
+union quat
+{
+	struct
+	{
+		float x, y, z, w;
+	};
+
+	float E[4];
+
+	quat() { x = y = z = 0.0f; w = 1.0f; }
+	quat(float X, float Y, float Z, float W) { x = X; y = Y; z = Z; w = W; }
+};
+
+inline float
+Dot(quat A, quat B)
+{
+	float Result = A.x * B.x + A.y * B.y + A.z * B.z + A.w * B.w;
+
+	return(Result);
+}
+
+inline quat
+Normalize(quat A)
+{
+	float OneOverLength = 1.0f / sqrtf(Dot(A, A));
+	quat Result = quat(A.x * OneOverLength, A.y * OneOverLength, A.z * OneOverLength, A.w * OneOverLength);
+
+	return(Result);
+}
+
+// NOTE(georgy): Normalized lerp along the shortest arc. Good enough between neighbouring keyframes.
+inline quat
+NLerp(quat A, quat B, float t)
+{
+	float Sign = (Dot(A, B) < 0.0f) ? -1.0f : 1.0f;
+
+	quat Result;
+	Result.x = A.x + (Sign * B.x - A.x) * t;
+	Result.y = A.y + (Sign * B.y - A.y) * t;
+	Result.z = A.z + (Sign * B.z - A.z) * t;
+	Result.w = A.w + (Sign * B.w - A.w) * t;
+	Result = Normalize(Result);
+
+	return(Result);
+}
+
+// NOTE(georgy): Angle in radians of the rotation that takes A to B
+inline float
+AngleBetween(quat A, quat B)
+{
+	float CosHalfAngle = Clamp(Absolute(Dot(A, B)), 0.0f, 1.0f);
+	float Result = 2.0f * acosf(CosHalfAngle);
+
+	return(Result);
+}
+
+static mat4
+TranslationRotationScale(vec3 T, quat R, vec3 S)
+{
+	mat4 Result;
+
+	float XX = R.x * R.x; float YY = R.y * R.y; float ZZ = R.z * R.z;
+	float XY = R.x * R.y; float XZ = R.x * R.z; float YZ = R.y * R.z;
+	float WX = R.w * R.x; float WY = R.w * R.y; float WZ = R.w * R.z;
+
+	Result.a11 = (1.0f - 2.0f * (YY + ZZ)) * S.x;
+	Result.a21 = (2.0f * (XY + WZ)) * S.x;
+	Result.a31 = (2.0f * (XZ - WY)) * S.x;
+	Result.a41 = 0.0f;
+
+	Result.a12 = (2.0f * (XY - WZ)) * S.y;
+	Result.a22 = (1.0f - 2.0f * (XX + ZZ)) * S.y;
+	Result.a32 = (2.0f * (YZ + WX)) * S.y;
+	Result.a42 = 0.0f;
+
+	Result.a13 = (2.0f * (XZ + WY)) * S.z;
+	Result.a23 = (2.0f * (YZ - WX)) * S.z;
+	Result.a33 = (1.0f - 2.0f * (XX + YY)) * S.z;
+	Result.a43 = 0.0f;
+
+	Result.a14 = T.x;
+	Result.a24 = T.y;
+	Result.a34 = T.z;
+	Result.a44 = 1.0f;
+
+	return(Result);
+}
+
 // 
 // NOTE(georgy): AABB
 // 
@@ -1279,14 +1430,386 @@ AABBFromVertices(uint32_t Count, vec3 *Vertices)
 		vec3 Vertex = Vertices[VertexIndex];
 
 		if(Vertex.x < Result.Min.x) Result.Min.x = Vertex.x;
-		else if(Vertex.x > Result.Max.x) Result.Max.x = Vertex.x;
+		if(Vertex.x > Result.Max.x) Result.Max.x = Vertex.x;
 
 		if(Vertex.y < Result.Min.y) Result.Min.y = Vertex.y;
-		else if(Vertex.y > Result.Max.y) Result.Max.y = Vertex.y;
+		if(Vertex.y > Result.Max.y) Result.Max.y = Vertex.y;
 		
 		if(Vertex.z < Result.Min.z) Result.Min.z = Vertex.z;
-		else if(Vertex.z > Result.Max.z) Result.Max.z = Vertex.z;
+		if(Vertex.z > Result.Max.z) Result.Max.z = Vertex.z;
 	}
 
 	return(Result);
-}
\ No newline at end of file
+}
+// NOTE(georgy): Bounds of the transformed box (Arvo), only the center is transformed, the extent goes through the absolute matrix
+static aabb
+TransformAABB(mat4 M, aabb Box)
+{
+	vec3 Center = 0.5f*(Box.Min + Box.Max);
+	vec3 Extent = 0.5f*(Box.Max - Box.Min);
+
+	vec3 NewCenter = vec3(M.a11*Center.x + M.a12*Center.y + M.a13*Center.z + M.a14,
+						  M.a21*Center.x + M.a22*Center.y + M.a23*Center.z + M.a24,
+						  M.a31*Center.x + M.a32*Center.y + M.a33*Center.z + M.a34);
+	vec3 NewExtent = vec3(Absolute(M.a11)*Extent.x + Absolute(M.a12)*Extent.y + Absolute(M.a13)*Extent.z,
+						  Absolute(M.a21)*Extent.x + Absolute(M.a22)*Extent.y + Absolute(M.a23)*Extent.z,
+						  Absolute(M.a31)*Extent.x + Absolute(M.a32)*Extent.y + Absolute(M.a33)*Extent.z);
+
+	aabb Result = AABBMinMax(NewCenter - NewExtent, NewCenter + NewExtent);
+	return(Result);
+}
+
+inline aabb
+AABBUnion(aabb A, aabb B)
+{
+	aabb Result;
+
+	Result.Min = vec3(Min(A.Min.x, B.Min.x), Min(A.Min.y, B.Min.y), Min(A.Min.z, B.Min.z));
+	Result.Max = vec3(Max(A.Max.x, B.Max.x), Max(A.Max.y, B.Max.y), Max(A.Max.z, B.Max.z));
+
+	return(Result);
+}
+
+inline float
+AABBSurfaceArea(aabb Box)
+{
+	vec3 Size = Box.Max - Box.Min;
+	float Result = 2.0f*(Size.x*Size.y + Size.y*Size.z + Size.z*Size.x);
+
+	return(Result);
+}
+
+// NOTE(georgy): Inverse of a transform without projection: the 3x3 part is inverted by cofactors, the translation follows it
+static mat4
+AffineInverseScalar(mat4 M)
+{
+	mat4 Result = Identity();
+
+	float C11 = M.a22*M.a33 - M.a23*M.a32;
+	float C12 = M.a23*M.a31 - M.a21*M.a33;
+	float C13 = M.a21*M.a32 - M.a22*M.a31;
+	float Determinant = M.a11*C11 + M.a12*C12 + M.a13*C13;
+	if (Absolute(Determinant) > 0.0f)
+	{
+		float OneOverDeterminant = 1.0f / Determinant;
+
+		Result.a11 = C11 * OneOverDeterminant;
+		Result.a12 = (M.a13*M.a32 - M.a12*M.a33) * OneOverDeterminant;
+		Result.a13 = (M.a12*M.a23 - M.a13*M.a22) * OneOverDeterminant;
+		Result.a21 = C12 * OneOverDeterminant;
+		Result.a22 = (M.a11*M.a33 - M.a13*M.a31) * OneOverDeterminant;
+		Result.a23 = (M.a13*M.a21 - M.a11*M.a23) * OneOverDeterminant;
+		Result.a31 = C13 * OneOverDeterminant;
+		Result.a32 = (M.a12*M.a31 - M.a11*M.a32) * OneOverDeterminant;
+		Result.a33 = (M.a11*M.a22 - M.a12*M.a21) * OneOverDeterminant;
+
+		Result.a14 = -(Result.a11*M.a14 + Result.a12*M.a24 + Result.a13*M.a34);
+		Result.a24 = -(Result.a21*M.a14 + Result.a22*M.a24 + Result.a23*M.a34);
+		Result.a34 = -(Result.a31*M.a14 + Result.a32*M.a24 + Result.a33*M.a34);
+	}
+
+	return(Result);
+}
+
+#if MATH_SSE
+#define MATH_SWIZZLE(V, X, Y, Z, W) _mm_shuffle_ps((V), (V), _MM_SHUFFLE((W), (Z), (Y), (X)))
+
+// NOTE(georgy): xyz of A x B, w comes out 0
+inline __m128
+CrossSSE(__m128 A, __m128 B)
+{
+	__m128 Result = _mm_sub_ps(_mm_mul_ps(A, MATH_SWIZZLE(B, 1, 2, 0, 3)), _mm_mul_ps(MATH_SWIZZLE(A, 1, 2, 0, 3), B));
+	Result = MATH_SWIZZLE(Result, 1, 2, 0, 3);
+
+	return(Result);
+}
+
+// NOTE(georgy): 2x2 matrices packed as (m00, m01, m10, m11). A * B, Adjugate(A) * B and A * Adjugate(B).
+inline __m128
+Mat2Multiply(__m128 A, __m128 B)
+{
+	__m128 Result = _mm_add_ps(_mm_mul_ps(A, MATH_SWIZZLE(B, 0, 3, 0, 3)),
+							   _mm_mul_ps(MATH_SWIZZLE(A, 1, 0, 3, 2), MATH_SWIZZLE(B, 2, 1, 2, 1)));
+	return(Result);
+}
+
+inline __m128
+Mat2AdjugateMultiply(__m128 A, __m128 B)
+{
+	__m128 Result = _mm_sub_ps(_mm_mul_ps(MATH_SWIZZLE(A, 3, 3, 0, 0), B),
+							   _mm_mul_ps(MATH_SWIZZLE(A, 1, 1, 2, 2), MATH_SWIZZLE(B, 2, 3, 0, 1)));
+	return(Result);
+}
+
+inline __m128
+Mat2MultiplyAdjugate(__m128 A, __m128 B)
+{
+	__m128 Result = _mm_sub_ps(_mm_mul_ps(A, MATH_SWIZZLE(B, 3, 0, 3, 0)),
+							   _mm_mul_ps(MATH_SWIZZLE(A, 1, 0, 3, 2), MATH_SWIZZLE(B, 2, 1, 2, 1)));
+	return(Result);
+}
+#endif
+
+static mat4
+AffineInverse(mat4 M)
+{
+#if MATH_SSE
+	mat4 Result = Identity();
+
+	// NOTE(georgy): The rows of the inverse 3x3 are cross products of the columns over the determinant
+	__m128 XYZMask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+	__m128 Column0 = _mm_and_ps(_mm_loadu_ps(&M.E[0]), XYZMask);
+	__m128 Column1 = _mm_and_ps(_mm_loadu_ps(&M.E[4]), XYZMask);
+	__m128 Column2 = _mm_and_ps(_mm_loadu_ps(&M.E[8]), XYZMask);
+	__m128 Row0 = CrossSSE(Column1, Column2);
+	__m128 Row1 = CrossSSE(Column2, Column0);
+	__m128 Row2 = CrossSSE(Column0, Column1);
+
+	__m128 Determinant = _mm_mul_ps(Column0, Row0);
+	Determinant = _mm_add_ps(Determinant, MATH_SWIZZLE(Determinant, 1, 0, 3, 2));
+	Determinant = _mm_add_ps(Determinant, MATH_SWIZZLE(Determinant, 2, 3, 0, 1));
+	if (Absolute(_mm_cvtss_f32(Determinant)) > 0.0f)
+	{
+		__m128 OneOverDeterminant = _mm_div_ps(_mm_set1_ps(1.0f), Determinant);
+		Row0 = _mm_mul_ps(Row0, OneOverDeterminant);
+		Row1 = _mm_mul_ps(Row1, OneOverDeterminant);
+		Row2 = _mm_mul_ps(Row2, OneOverDeterminant);
+		__m128 Row3 = _mm_setzero_ps();
+
+		// NOTE(georgy): After this Row0-2 hold the columns of the inverse 3x3, with w 0
+		_MM_TRANSPOSE4_PS(Row0, Row1, Row2, Row3);
+		__m128 Translation = _mm_add_ps(_mm_add_ps(_mm_mul_ps(Row0, _mm_set1_ps(M.a14)), _mm_mul_ps(Row1, _mm_set1_ps(M.a24))),
+										_mm_mul_ps(Row2, _mm_set1_ps(M.a34)));
+		Translation = _mm_sub_ps(_mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f), Translation);
+
+		_mm_storeu_ps(&Result.E[0], Row0);
+		_mm_storeu_ps(&Result.E[4], Row1);
+		_mm_storeu_ps(&Result.E[8], Row2);
+		_mm_storeu_ps(&Result.E[12], Translation);
+	}
+#else
+	mat4 Result = AffineInverseScalar(M);
+#endif
+
+	return(Result);
+}
+
+// NOTE(georgy): General inverse from the 2x2 sub-determinants, identity if M is singular. Works on E as if it was
+// row-major, the inverse of the transpose is the transpose of the inverse.
+static mat4
+InverseScalar(mat4 M)
+{
+	mat4 Result = Identity();
+	float* E = M.E;
+
+	float S0 = E[0] * E[5] - E[4] * E[1];
+	float S1 = E[0] * E[6] - E[4] * E[2];
+	float S2 = E[0] * E[7] - E[4] * E[3];
+	float S3 = E[1] * E[6] - E[5] * E[2];
+	float S4 = E[1] * E[7] - E[5] * E[3];
+	float S5 = E[2] * E[7] - E[6] * E[3];
+
+	float C5 = E[10] * E[15] - E[14] * E[11];
+	float C4 = E[9] * E[15] - E[13] * E[11];
+	float C3 = E[9] * E[14] - E[13] * E[10];
+	float C2 = E[8] * E[15] - E[12] * E[11];
+	float C1 = E[8] * E[14] - E[12] * E[10];
+	float C0 = E[8] * E[13] - E[12] * E[9];
+
+	float Determinant = S0 * C5 - S1 * C4 + S2 * C3 + S3 * C2 - S4 * C1 + S5 * C0;
+	if (Absolute(Determinant) > 0.0f)
+	{
+		float OneOverDeterminant = 1.0f / Determinant;
+
+		Result.E[0] = (E[5] * C5 - E[6] * C4 + E[7] * C3) * OneOverDeterminant;
+		Result.E[1] = (-E[1] * C5 + E[2] * C4 - E[3] * C3) * OneOverDeterminant;
+		Result.E[2] = (E[13] * S5 - E[14] * S4 + E[15] * S3) * OneOverDeterminant;
+		Result.E[3] = (-E[9] * S5 + E[10] * S4 - E[11] * S3) * OneOverDeterminant;
+
+		Result.E[4] = (-E[4] * C5 + E[6] * C2 - E[7] * C1) * OneOverDeterminant;
+		Result.E[5] = (E[0] * C5 - E[2] * C2 + E[3] * C1) * OneOverDeterminant;
+		Result.E[6] = (-E[12] * S5 + E[14] * S2 - E[15] * S1) * OneOverDeterminant;
+		Result.E[7] = (E[8] * S5 - E[10] * S2 + E[11] * S1) * OneOverDeterminant;
+
+		Result.E[8] = (E[4] * C4 - E[5] * C2 + E[7] * C0) * OneOverDeterminant;
+		Result.E[9] = (-E[0] * C4 + E[1] * C2 - E[3] * C0) * OneOverDeterminant;
+		Result.E[10] = (E[12] * S4 - E[13] * S2 + E[15] * S0) * OneOverDeterminant;
+		Result.E[11] = (-E[8] * S4 + E[9] * S2 - E[11] * S0) * OneOverDeterminant;
+
+		Result.E[12] = (-E[4] * C3 + E[5] * C1 - E[6] * C0) * OneOverDeterminant;
+		Result.E[13] = (E[0] * C3 - E[1] * C1 + E[2] * C0) * OneOverDeterminant;
+		Result.E[14] = (-E[12] * S3 + E[13] * S1 - E[14] * S0) * OneOverDeterminant;
+		Result.E[15] = (E[8] * S3 - E[9] * S1 + E[10] * S0) * OneOverDeterminant;
+	}
+
+	return(Result);
+}
+
+// NOTE(georgy): The SSE version splits M into 2x2 blocks and inverts it blockwise, with the same row-major reading
+// as the scalar version
+static mat4
+Inverse(mat4 M)
+{
+#if MATH_SSE
+	mat4 Result = Identity();
+
+	__m128 M0 = _mm_loadu_ps(&M.E[0]);
+	__m128 M1 = _mm_loadu_ps(&M.E[4]);
+	__m128 M2 = _mm_loadu_ps(&M.E[8]);
+	__m128 M3 = _mm_loadu_ps(&M.E[12]);
+
+	// NOTE(georgy): M is | A B |
+	//                   | C D |
+	__m128 A = _mm_movelh_ps(M0, M1);
+	__m128 B = _mm_movehl_ps(M1, M0);
+	__m128 C = _mm_movelh_ps(M2, M3);
+	__m128 D = _mm_movehl_ps(M3, M2);
+
+	// NOTE(georgy): (|A|, |B|, |C|, |D|)
+	__m128 SubDeterminants = _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(M0, M2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(M1, M3, _MM_SHUFFLE(3, 1, 3, 1))),
+										_mm_mul_ps(_mm_shuffle_ps(M0, M2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(M1, M3, _MM_SHUFFLE(2, 0, 2, 0))));
+	__m128 DeterminantA = MATH_SWIZZLE(SubDeterminants, 0, 0, 0, 0);
+	__m128 DeterminantB = MATH_SWIZZLE(SubDeterminants, 1, 1, 1, 1);
+	__m128 DeterminantC = MATH_SWIZZLE(SubDeterminants, 2, 2, 2, 2);
+	__m128 DeterminantD = MATH_SWIZZLE(SubDeterminants, 3, 3, 3, 3);
+
+	__m128 AdjugateDC = Mat2AdjugateMultiply(D, C);
+	__m128 AdjugateAB = Mat2AdjugateMultiply(A, B);
+	__m128 X = _mm_sub_ps(_mm_mul_ps(DeterminantD, A), Mat2Multiply(B, AdjugateDC));
+	__m128 W = _mm_sub_ps(_mm_mul_ps(DeterminantA, D), Mat2Multiply(C, AdjugateAB));
+	__m128 Y = _mm_sub_ps(_mm_mul_ps(DeterminantB, C), Mat2MultiplyAdjugate(D, AdjugateAB));
+	__m128 Z = _mm_sub_ps(_mm_mul_ps(DeterminantC, B), Mat2MultiplyAdjugate(A, AdjugateDC));
+
+	// NOTE(georgy): |M| = |A||D| + |B||C| - tr(Adjugate(A)B Adjugate(D)C)
+	__m128 Trace = _mm_mul_ps(AdjugateAB, MATH_SWIZZLE(AdjugateDC, 0, 2, 1, 3));
+	Trace = _mm_add_ps(Trace, _mm_movehl_ps(Trace, Trace));
+	Trace = _mm_add_ps(Trace, MATH_SWIZZLE(Trace, 1, 1, 1, 1));
+	Trace = MATH_SWIZZLE(Trace, 0, 0, 0, 0);
+	__m128 Determinant = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(DeterminantA, DeterminantD), _mm_mul_ps(DeterminantB, DeterminantC)), Trace);
+	if (Absolute(_mm_cvtss_f32(Determinant)) > 0.0f)
+	{
+		__m128 OneOverDeterminant = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), Determinant);
+		X = _mm_mul_ps(X, OneOverDeterminant);
+		Y = _mm_mul_ps(Y, OneOverDeterminant);
+		Z = _mm_mul_ps(Z, OneOverDeterminant);
+		W = _mm_mul_ps(W, OneOverDeterminant);
+
+		// NOTE(georgy): The adjugates of the blocks, put back in place
+		_mm_storeu_ps(&Result.E[0], _mm_shuffle_ps(X, Y, _MM_SHUFFLE(1, 3, 1, 3)));
+		_mm_storeu_ps(&Result.E[4], _mm_shuffle_ps(X, Y, _MM_SHUFFLE(0, 2, 0, 2)));
+		_mm_storeu_ps(&Result.E[8], _mm_shuffle_ps(Z, W, _MM_SHUFFLE(1, 3, 1, 3)));
+		_mm_storeu_ps(&Result.E[12], _mm_shuffle_ps(Z, W, _MM_SHUFFLE(0, 2, 0, 2)));
+	}
+#else
+	mat4 Result = InverseScalar(M);
+#endif
+
+	return(Result);
+}
+
+// NOTE(georgy): Inverse transpose of the 3x3 part, for normals. Its columns are cross products of the columns of M.
+static mat3
+NormalMatrix(mat4 M)
+{
+	mat3 Result = Identity3x3();
+
+	vec3 Column0 = vec3(M.a11, M.a21, M.a31);
+	vec3 Column1 = vec3(M.a12, M.a22, M.a32);
+	vec3 Column2 = vec3(M.a13, M.a23, M.a33);
+	vec3 Cross0 = Cross(Column1, Column2);
+	vec3 Cross1 = Cross(Column2, Column0);
+	vec3 Cross2 = Cross(Column0, Column1);
+
+	float Determinant = Dot(Column0, Cross0);
+	if (Absolute(Determinant) > 0.0f)
+	{
+		float OneOverDeterminant = 1.0f / Determinant;
+
+		Result.a11 = Cross0.x * OneOverDeterminant;
+		Result.a21 = Cross0.y * OneOverDeterminant;
+		Result.a31 = Cross0.z * OneOverDeterminant;
+		Result.a12 = Cross1.x * OneOverDeterminant;
+		Result.a22 = Cross1.y * OneOverDeterminant;
+		Result.a32 = Cross1.z * OneOverDeterminant;
+		Result.a13 = Cross2.x * OneOverDeterminant;
+		Result.a23 = Cross2.y * OneOverDeterminant;
+		Result.a33 = Cross2.z * OneOverDeterminant;
+	}
+
+	return(Result);
+}
+
+// 
+// NOTE(georgy): Batch transforms
+// 
+
+// NOTE(georgy): Over SoA arrays, any Count and no alignment needed. Points have w = 1 and M is taken as affine,
+// nothing is divided by w. The outputs may be the inputs.
+static void
+TransformPointsScalar(mat4 M, uint32_t Count, const float* X, const float* Y, const float* Z, float* OutX, float* OutY, float* OutZ)
+{
+	for (uint32_t Index = 0;
+		Index < Count;
+		Index++)
+	{
+		float PX = X[Index];
+		float PY = Y[Index];
+		float PZ = Z[Index];
+
+		OutX[Index] = M.a11 * PX + M.a12 * PY + M.a13 * PZ + M.a14;
+		OutY[Index] = M.a21 * PX + M.a22 * PY + M.a23 * PZ + M.a24;
+		OutZ[Index] = M.a31 * PX + M.a32 * PY + M.a33 * PZ + M.a34;
+	}
+}
+
+static void
+TransformPoints(mat4 M, uint32_t Count, const float* X, const float* Y, const float* Z, float* OutX, float* OutY, float* OutZ)
+{
+	uint32_t Index = 0;
+
+#if MATH_AVX
+	__m256 M11 = _mm256_set1_ps(M.a11), M12 = _mm256_set1_ps(M.a12), M13 = _mm256_set1_ps(M.a13), M14 = _mm256_set1_ps(M.a14);
+	__m256 M21 = _mm256_set1_ps(M.a21), M22 = _mm256_set1_ps(M.a22), M23 = _mm256_set1_ps(M.a23), M24 = _mm256_set1_ps(M.a24);
+	__m256 M31 = _mm256_set1_ps(M.a31), M32 = _mm256_set1_ps(M.a32), M33 = _mm256_set1_ps(M.a33), M34 = _mm256_set1_ps(M.a34);
+	for (; Index + 8 <= Count; Index += 8)
+	{
+		__m256 PX = _mm256_loadu_ps(X + Index);
+		__m256 PY = _mm256_loadu_ps(Y + Index);
+		__m256 PZ = _mm256_loadu_ps(Z + Index);
+
+		_mm256_storeu_ps(OutX + Index, _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(M11, PX), _mm256_mul_ps(M12, PY)), _mm256_mul_ps(M13, PZ)), M14));
+		_mm256_storeu_ps(OutY + Index, _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(M21, PX), _mm256_mul_ps(M22, PY)), _mm256_mul_ps(M23, PZ)), M24));
+		_mm256_storeu_ps(OutZ + Index, _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(M31, PX), _mm256_mul_ps(M32, PY)), _mm256_mul_ps(M33, PZ)), M34));
+	}
+#elif MATH_SSE
+	__m128 M11 = _mm_set1_ps(M.a11), M12 = _mm_set1_ps(M.a12), M13 = _mm_set1_ps(M.a13), M14 = _mm_set1_ps(M.a14);
+	__m128 M21 = _mm_set1_ps(M.a21), M22 = _mm_set1_ps(M.a22), M23 = _mm_set1_ps(M.a23), M24 = _mm_set1_ps(M.a24);
+	__m128 M31 = _mm_set1_ps(M.a31), M32 = _mm_set1_ps(M.a32), M33 = _mm_set1_ps(M.a33), M34 = _mm_set1_ps(M.a34);
+	for (; Index + 4 <= Count; Index += 4)
+	{
+		__m128 PX = _mm_loadu_ps(X + Index);
+		__m128 PY = _mm_loadu_ps(Y + Index);
+		__m128 PZ = _mm_loadu_ps(Z + Index);
+
+		_mm_storeu_ps(OutX + Index, _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(M11, PX), _mm_mul_ps(M12, PY)), _mm_mul_ps(M13, PZ)), M14));
+		_mm_storeu_ps(OutY + Index, _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(M21, PX), _mm_mul_ps(M22, PY)), _mm_mul_ps(M23, PZ)), M24));
+		_mm_storeu_ps(OutZ + Index, _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(M31, PX), _mm_mul_ps(M32, PY)), _mm_mul_ps(M33, PZ)), M34));
+	}
+#endif
+
+	TransformPointsScalar(M, Count - Index, X + Index, Y + Index, Z + Index, OutX + Index, OutY + Index, OutZ + Index);
+}
+
+// NOTE(georgy): N is a normal matrix (see NormalMatrix), normals aren't renormalized. The same kernel as the points,
+// with no translation.
+static void
+TransformNormalsScalar(mat3 N, uint32_t Count, const float* X, const float* Y, const float* Z, float* OutX, float* OutY, float* OutZ)
+{
+	TransformPointsScalar(Mat4(N), Count, X, Y, Z, OutX, OutY, OutZ);
+}
+
+static void
+TransformNormals(mat3 N, uint32_t Count, const float* X, const float* Y, const float* Z, float* OutX, float* OutY, float* OutZ)
+{
+	TransformPoints(Mat4(N), Count, X, Y, Z, OutX, OutY, OutZ);
+}
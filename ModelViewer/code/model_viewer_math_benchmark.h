@@ -0,0 +1,212 @@
+#pragma once
+
+// NOTE(georgy): The SSE/AVX math against the ...Scalar versions. Matrices are well conditioned (random plus a
+// dominant diagonal), so the inverses can be compared. Difference is the largest absolute one between the two
+// results of the last run.
+
+#define MATH_BENCHMARK_MATRICES 4096
+#define MATH_BENCHMARK_REPEATS 64
+#define MATH_BENCHMARK_POINTS (1 << 20)
+
+enum math_benchmark_case
+{
+	MathBenchmark_Multiply,
+	MathBenchmark_Transform,
+	MathBenchmark_AffineInverse,
+	MathBenchmark_Inverse,
+	MathBenchmark_TransformPoints,
+	MathBenchmark_TransformNormals,
+
+	MathBenchmark_Count
+};
+
+static const char* MathBenchmarkNames[MathBenchmark_Count] =
+{
+	"mat4 * mat4",
+	"mat4 * vec4",
+	"AffineInverse",
+	"Inverse",
+	"TransformPoints",
+	"TransformNormals",
+};
+
+struct math_benchmark_data
+{
+	dynamic_array<mat4> Matrices;
+	dynamic_array<mat4> AffineMatrices;
+	dynamic_array<vec4> Vectors;
+	dynamic_array<float> X, Y, Z;
+
+	// NOTE(georgy): [0] gets the scalar results, [1] the SIMD ones
+	dynamic_array<mat4> MatrixResults[2];
+	dynamic_array<vec4> VectorResults[2];
+	dynamic_array<float> OutX[2], OutY[2], OutZ[2];
+};
+
+static void
+RunMathBenchmarkCase(math_benchmark_data* Data, uint32_t Case, bool Scalar)
+{
+	uint32_t Slot = Scalar ? 0 : 1;
+	mat4* Matrices = Data->Matrices.Entries;
+	mat4* MatrixResults = Data->MatrixResults[Slot].Entries;
+	vec4* VectorResults = Data->VectorResults[Slot].Entries;
+
+	if (Case < MathBenchmark_TransformPoints)
+	{
+		for (uint32_t Repeat = 0; Repeat < MATH_BENCHMARK_REPEATS; Repeat++)
+		{
+			for (uint32_t Index = 0; Index < MATH_BENCHMARK_MATRICES; Index++)
+			{
+				mat4 M = Matrices[Index];
+				switch (Case)
+				{
+					case MathBenchmark_Multiply:
+					{
+						mat4 Next = Matrices[(Index + 1) % MATH_BENCHMARK_MATRICES];
+						MatrixResults[Index] = Scalar ? MultiplyScalar(M, Next) : M * Next;
+					} break;
+
+					case MathBenchmark_Transform:
+					{
+						VectorResults[Index] = Scalar ? MultiplyScalar(M, Data->Vectors[Index]) : M * Data->Vectors[Index];
+					} break;
+
+					case MathBenchmark_AffineInverse:
+					{
+						mat4 Affine = Data->AffineMatrices[Index];
+						MatrixResults[Index] = Scalar ? AffineInverseScalar(Affine) : AffineInverse(Affine);
+					} break;
+
+					case MathBenchmark_Inverse:
+					{
+						MatrixResults[Index] = Scalar ? InverseScalar(M) : Inverse(M);
+					} break;
+				}
+			}
+		}
+	}
+	else if (Case == MathBenchmark_TransformPoints)
+	{
+		(Scalar ? TransformPointsScalar : TransformPoints)(Matrices[0], MATH_BENCHMARK_POINTS, Data->X.Entries, Data->Y.Entries, Data->Z.Entries,
+			Data->OutX[Slot].Entries, Data->OutY[Slot].Entries, Data->OutZ[Slot].Entries);
+	}
+	else if (Case == MathBenchmark_TransformNormals)
+	{
+		(Scalar ? TransformNormalsScalar : TransformNormals)(NormalMatrix(Matrices[0]), MATH_BENCHMARK_POINTS, Data->X.Entries, Data->Y.Entries, Data->Z.Entries,
+			Data->OutX[Slot].Entries, Data->OutY[Slot].Entries, Data->OutZ[Slot].Entries);
+	}
+}
+
+static float
+MathBenchmarkDifference(math_benchmark_data* Data, uint32_t Case)
+{
+	float Result = 0.0f;
+	if (Case == MathBenchmark_Transform)
+	{
+		for (uint32_t Index = 0; Index < MATH_BENCHMARK_MATRICES; Index++)
+		{
+			for (uint32_t E = 0; E < 4; E++)
+			{
+				Result = Max(Result, Absolute(Data->VectorResults[0][Index].E[E] - Data->VectorResults[1][Index].E[E]));
+			}
+		}
+	}
+	else if (Case < MathBenchmark_TransformPoints)
+	{
+		for (uint32_t Index = 0; Index < MATH_BENCHMARK_MATRICES; Index++)
+		{
+			for (uint32_t E = 0; E < 16; E++)
+			{
+				Result = Max(Result, Absolute(Data->MatrixResults[0][Index].E[E] - Data->MatrixResults[1][Index].E[E]));
+			}
+		}
+	}
+	else
+	{
+		for (uint32_t Index = 0; Index < MATH_BENCHMARK_POINTS; Index++)
+		{
+			Result = Max(Result, Absolute(Data->OutX[0][Index] - Data->OutX[1][Index]));
+			Result = Max(Result, Absolute(Data->OutY[0][Index] - Data->OutY[1][Index]));
+			Result = Max(Result, Absolute(Data->OutZ[0][Index] - Data->OutZ[1][Index]));
+		}
+	}
+
+	return(Result);
+}
+
+// NOTE(georgy): Best of RunCount runs for each version, the versions take turns
+void
+BenchmarkMath(uint32_t RunCount)
+{
+	math_benchmark_data Data;
+	ResizeDynamicArrayUninitialized(&Data.Matrices, MATH_BENCHMARK_MATRICES);
+	ResizeDynamicArrayUninitialized(&Data.AffineMatrices, MATH_BENCHMARK_MATRICES);
+	ResizeDynamicArrayUninitialized(&Data.Vectors, MATH_BENCHMARK_MATRICES);
+	ResizeDynamicArrayUninitialized(&Data.X, MATH_BENCHMARK_POINTS);
+	ResizeDynamicArrayUninitialized(&Data.Y, MATH_BENCHMARK_POINTS);
+	ResizeDynamicArrayUninitialized(&Data.Z, MATH_BENCHMARK_POINTS);
+	for (uint32_t Slot = 0; Slot < 2; Slot++)
+	{
+		ResizeDynamicArrayUninitialized(&Data.MatrixResults[Slot], MATH_BENCHMARK_MATRICES);
+		ResizeDynamicArrayUninitialized(&Data.VectorResults[Slot], MATH_BENCHMARK_MATRICES);
+		ResizeDynamicArrayUninitialized(&Data.OutX[Slot], MATH_BENCHMARK_POINTS);
+		ResizeDynamicArrayUninitialized(&Data.OutY[Slot], MATH_BENCHMARK_POINTS);
+		ResizeDynamicArrayUninitialized(&Data.OutZ[Slot], MATH_BENCHMARK_POINTS);
+	}
+
+	uint32_t Random = 0x2545F491;
+	float* Values[] = { Data.X.Entries, Data.Y.Entries, Data.Z.Entries, &Data.Matrices[0].E[0], &Data.Vectors[0].E[0] };
+	uint32_t ValueCounts[] = { MATH_BENCHMARK_POINTS, MATH_BENCHMARK_POINTS, MATH_BENCHMARK_POINTS, 16 * MATH_BENCHMARK_MATRICES, 4 * MATH_BENCHMARK_MATRICES };
+	for (uint32_t ArrayIndex = 0; ArrayIndex < ArrayCount(Values); ArrayIndex++)
+	{
+		for (uint32_t Index = 0; Index < ValueCounts[ArrayIndex]; Index++)
+		{
+			Random ^= Random << 13;
+			Random ^= Random >> 17;
+			Random ^= Random << 5;
+			Values[ArrayIndex][Index] = 2.0f * ((float)(Random >> 8) / (float)(1 << 24)) - 1.0f;
+		}
+	}
+	for (uint32_t Index = 0; Index < MATH_BENCHMARK_MATRICES; Index++)
+	{
+		Data.Matrices[Index].a11 += 3.0f;
+		Data.Matrices[Index].a22 += 3.0f;
+		Data.Matrices[Index].a33 += 3.0f;
+		Data.Matrices[Index].a44 += 3.0f;
+
+		mat4* Affine = &Data.AffineMatrices[Index];
+		*Affine = Data.Matrices[Index];
+		Affine->a41 = Affine->a42 = Affine->a43 = 0.0f;
+		Affine->a44 = 1.0f;
+	}
+
+#if MATH_AVX
+	const char* Width = "AVX";
+#elif MATH_SSE
+	const char* Width = "SSE";
+#else
+	const char* Width = "scalar";
+#endif
+	printf("%u matrices x %u, %u points, %u runs, SIMD is %s\n", MATH_BENCHMARK_MATRICES, MATH_BENCHMARK_REPEATS,
+		MATH_BENCHMARK_POINTS, RunCount, Width);
+
+	for (uint32_t Case = 0; Case < MathBenchmark_Count; Case++)
+	{
+		double BestSeconds[2] = { 1e30, 1e30 };
+		for (uint32_t Run = 0; Run < RunCount; Run++)
+		{
+			for (uint32_t Slot = 0; Slot < 2; Slot++)
+			{
+				double StartTime = GetWallClockSeconds();
+				RunMathBenchmarkCase(&Data, Case, Slot == 0);
+				double Seconds = GetWallClockSeconds() - StartTime;
+				BestSeconds[Slot] = Min(BestSeconds[Slot], Seconds);
+			}
+		}
+
+		uint32_t OperationCount = (Case < MathBenchmark_TransformPoints) ? (MATH_BENCHMARK_MATRICES * MATH_BENCHMARK_REPEATS) : MATH_BENCHMARK_POINTS;
+		printf("%-18s scalar %8.3f ms, SIMD %8.3f ms, %5.2fx, %7.2f ns per op, difference %g\n", MathBenchmarkNames[Case],
+			1000.0 * BestSeconds[0], 1000.0 * BestSeconds[1], BestSeconds[0] / BestSeconds[1],
+			1e9 * BestSeconds[1] / OperationCount, MathBenchmarkDifference(&Data, Case));
+	}
+}
@@ -0,0 +1,375 @@
+#pragma once
+
+// NOTE(georgy): Memory accounting by subsystem.
+// Every heap allocation of ours (dynamic_array, stb_image) goes through MemoryAlloc, which puts a small header in
+// front of the block with its size and tag. The tag is whatever MEMORY_TAG scope the allocating thread is in, and the
+// block keeps it wherever it is freed. What we don't allocate ourselves, the Assimp scene and GL objects, is estimated
+// from its contents and added with TrackMemory.
+//
+// The counters are shared by both translation units, that is why they live in an inline function.
+//
+// Arenas are carved out of game_memory and bypass all of that: a push moves a pointer, temporary memory puts it back.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <atomic>
+
+enum memory_tag
+{
+	MemoryTag_Untagged,
+	MemoryTag_Geometry,
+	MemoryTag_Animation,
+	MemoryTag_Morph,
+	MemoryTag_Textures,
+	MemoryTag_BVH,
+	MemoryTag_Occlusion,
+	MemoryTag_Crowd,
+	MemoryTag_Render,
+	MemoryTag_Software,
+	MemoryTag_Thumbnails,
+	MemoryTag_AssimpScene, // NOTE(georgy): Estimated
+	MemoryTag_GPUBuffers, // NOTE(georgy): Estimated
+	MemoryTag_GPUTextures, // NOTE(georgy): Estimated
+
+	MemoryTag_Count
+};
+
+static const char* MemoryTagNames[MemoryTag_Count] =
+{
+	"untagged",
+	"geometry",
+	"animation",
+	"morph",
+	"textures",
+	"bvh",
+	"occlusion",
+	"crowd",
+	"render",
+	"software",
+	"thumbnails",
+	"assimp scene*",
+	"gpu buffers*",
+	"gpu textures*"
+};
+
+struct memory_tag_stats
+{
+	std::atomic<int64_t> CurrentBytes;
+	std::atomic<int64_t> PeakBytes;
+	std::atomic<int64_t> LiveCount;
+	std::atomic<int64_t> TotalCount;
+};
+
+// NOTE(georgy): GL objects by name, so that respecifying a buffer replaces its old size. GL is main thread only.
+#define MEMORY_MAX_GPU_OBJECTS 1024
+
+struct memory_gpu_object
+{
+	uint32_t Tag;
+	uint32_t Name;
+	uint64_t Bytes;
+};
+
+struct memory_tracker
+{
+	memory_tag_stats Tags[MemoryTag_Count];
+	std::atomic<uint64_t> HeapAllocationCount;
+
+	uint32_t GPUObjectCount;
+	memory_gpu_object GPUObjects[MEMORY_MAX_GPU_OBJECTS];
+};
+
+inline memory_tracker*
+GetMemoryTracker(void)
+{
+	static memory_tracker Tracker;
+
+	return(&Tracker);
+}
+
+inline uint32_t*
+CurrentMemoryTag(void)
+{
+	static thread_local uint32_t Tag = MemoryTag_Untagged;
+
+	return(&Tag);
+}
+
+struct memory_tag_scope
+{
+	uint32_t PreviousTag;
+
+	memory_tag_scope(uint32_t Tag)
+	{
+		PreviousTag = *CurrentMemoryTag();
+		*CurrentMemoryTag() = Tag;
+	}
+
+	~memory_tag_scope()
+	{
+		*CurrentMemoryTag() = PreviousTag;
+	}
+};
+
+#define MEMORY_TAG_NAME__(Prefix, Line) Prefix##Line
+#define MEMORY_TAG_NAME_(Prefix, Line) MEMORY_TAG_NAME__(Prefix, Line)
+#define MEMORY_TAG(Tag) memory_tag_scope MEMORY_TAG_NAME_(MemoryTagScope, __LINE__)(Tag)
+
+// NOTE(georgy): Bytes may be negative for a release. Counts go with the sign, 0 only moves the bytes.
+static void
+TrackMemory(uint32_t Tag, int64_t Bytes, int32_t CountDelta = 1)
+{
+	memory_tag_stats* Stats = &GetMemoryTracker()->Tags[Tag];
+	int64_t Current = Stats->CurrentBytes.fetch_add(Bytes, std::memory_order_relaxed) + Bytes;
+	int64_t Peak = Stats->PeakBytes.load(std::memory_order_relaxed);
+	while ((Current > Peak) && !Stats->PeakBytes.compare_exchange_weak(Peak, Current, std::memory_order_relaxed))
+	{
+	}
+
+	Stats->LiveCount.fetch_add(CountDelta, std::memory_order_relaxed);
+	if (CountDelta > 0)
+	{
+		Stats->TotalCount.fetch_add(CountDelta, std::memory_order_relaxed);
+	}
+}
+
+// NOTE(georgy): 16 bytes, so the block behind it stays as aligned as malloc's
+struct memory_header
+{
+	uint64_t Size;
+	uint32_t Tag;
+	uint32_t Reserved;
+};
+
+static void*
+MemoryAlloc(size_t Size)
+{
+	memory_header* Header = (memory_header*)malloc(sizeof(memory_header) + Size);
+	if (!Header)
+	{
+		return(0);
+	}
+
+	Header->Size = Size;
+	Header->Tag = *CurrentMemoryTag();
+	TrackMemory(Header->Tag, (int64_t)Size);
+	GetMemoryTracker()->HeapAllocationCount.fetch_add(1, std::memory_order_relaxed);
+
+	return(Header + 1);
+}
+
+static void
+MemoryFree(void* Memory)
+{
+	if (Memory)
+	{
+		memory_header* Header = (memory_header*)Memory - 1;
+		TrackMemory(Header->Tag, -(int64_t)Header->Size, -1);
+		free(Header);
+	}
+}
+
+// NOTE(georgy): The block keeps the tag it was allocated with
+static void*
+MemoryRealloc(void* Memory, size_t Size)
+{
+	if (!Memory)
+	{
+		return(MemoryAlloc(Size));
+	}
+
+	memory_header* Header = (memory_header*)Memory - 1;
+	uint32_t Tag = Header->Tag;
+	uint64_t OldSize = Header->Size;
+	memory_header* NewHeader = (memory_header*)realloc(Header, sizeof(memory_header) + Size);
+	if (!NewHeader)
+	{
+		return(0);
+	}
+
+	NewHeader->Size = Size;
+	TrackMemory(Tag, (int64_t)Size - (int64_t)OldSize, 0);
+	GetMemoryTracker()->HeapAllocationCount.fetch_add(1, std::memory_order_relaxed);
+
+	return(NewHeader + 1);
+}
+
+// NOTE(georgy): Every MemoryAlloc and MemoryRealloc so far, from any thread
+inline uint64_t
+HeapAllocationCount(void)
+{
+	uint64_t Result = GetMemoryTracker()->HeapAllocationCount.load(std::memory_order_relaxed);
+
+	return(Result);
+}
+
+// NOTE(georgy): Sets what a GL object holds, 0 when it is deleted. Tag is MemoryTag_GPUBuffers or MemoryTag_GPUTextures,
+// buffer and texture names are separate.
+static void
+TrackGPUObject(uint32_t Tag, uint32_t Name, uint64_t Bytes)
+{
+	memory_tracker* Tracker = GetMemoryTracker();
+
+	memory_gpu_object* Object = 0;
+	for (uint32_t ObjectIndex = 0; ObjectIndex < Tracker->GPUObjectCount; ObjectIndex++)
+	{
+		if ((Tracker->GPUObjects[ObjectIndex].Tag == Tag) && (Tracker->GPUObjects[ObjectIndex].Name == Name))
+		{
+			Object = &Tracker->GPUObjects[ObjectIndex];
+			break;
+		}
+	}
+
+	if (Object)
+	{
+		TrackMemory(Tag, (int64_t)Bytes - (int64_t)Object->Bytes, (Bytes > 0) ? 0 : -1);
+		if (Bytes > 0)
+		{
+			Object->Bytes = Bytes;
+		}
+		else
+		{
+			*Object = Tracker->GPUObjects[--Tracker->GPUObjectCount];
+		}
+	}
+	else if ((Bytes > 0) && (Tracker->GPUObjectCount < MEMORY_MAX_GPU_OBJECTS))
+	{
+		Object = &Tracker->GPUObjects[Tracker->GPUObjectCount++];
+		Object->Tag = Tag;
+		Object->Name = Name;
+		Object->Bytes = Bytes;
+		TrackMemory(Tag, (int64_t)Bytes);
+	}
+}
+
+static void
+PrintMemoryReport(void)
+{
+	memory_tracker* Tracker = GetMemoryTracker();
+
+	printf("Memory by tag (* estimated):\n");
+	printf("    %-16s %12s %12s %10s %12s\n", "tag", "current MB", "peak MB", "live", "allocations");
+	int64_t TotalCurrent = 0;
+	for (uint32_t Tag = 0; Tag < MemoryTag_Count; Tag++)
+	{
+		memory_tag_stats* Stats = &Tracker->Tags[Tag];
+		int64_t Current = Stats->CurrentBytes.load();
+		int64_t TotalCount = Stats->TotalCount.load();
+		if (TotalCount > 0)
+		{
+			printf("    %-16s %12.2f %12.2f %10lld %12lld\n", MemoryTagNames[Tag],
+				(double)Current / (double)Megabytes(1), (double)Stats->PeakBytes.load() / (double)Megabytes(1),
+				(long long)Stats->LiveCount.load(), (long long)TotalCount);
+		}
+		TotalCurrent += Current;
+	}
+	printf("    %-16s %12.2f\n", "total", (double)TotalCurrent / (double)Megabytes(1));
+}
+
+//
+// NOTE(georgy): Arenas
+//
+
+// NOTE(georgy): One thread at a time. Temporary memory nests like a stack, the last one begun is the first one ended.
+struct memory_arena
+{
+	uint64_t Size;
+	uint8_t* Base;
+	uint64_t Used;
+	uint64_t PeakUsed;
+
+	uint32_t TempCount;
+};
+
+struct temporary_memory
+{
+	memory_arena* Arena;
+	uint64_t Used;
+};
+
+inline void
+InitializeArena(memory_arena* Arena, uint64_t Size, void* Base)
+{
+	Arena->Size = Size;
+	Arena->Base = (uint8_t*)Base;
+	Arena->Used = 0;
+	Arena->PeakUsed = 0;
+	Arena->TempCount = 0;
+}
+
+inline uint64_t
+GetAlignmentOffset(memory_arena* Arena, uint64_t Alignment)
+{
+	uint64_t ResultPointer = (uint64_t)(Arena->Base + Arena->Used);
+	uint64_t AlignmentMask = Alignment - 1;
+	uint64_t Result = (ResultPointer & AlignmentMask) ? (Alignment - (ResultPointer & AlignmentMask)) : 0;
+
+	return(Result);
+}
+
+#define PushStruct(Arena, type, ...) (type*)PushSize_(Arena, sizeof(type), ## __VA_ARGS__)
+#define PushArray(Arena, Count, type, ...) (type*)PushSize_(Arena, (Count)*sizeof(type), ## __VA_ARGS__)
+#define PushSize(Arena, Size, ...) PushSize_(Arena, Size, ## __VA_ARGS__)
+// NOTE(georgy): Not zeroed, Alignment is a power of two
+inline void*
+PushSize_(memory_arena* Arena, uint64_t Size, uint64_t Alignment = 16)
+{
+	uint64_t AlignmentOffset = GetAlignmentOffset(Arena, Alignment);
+	Assert((Arena->Used + AlignmentOffset + Size) <= Arena->Size);
+
+	void* Result = Arena->Base + Arena->Used + AlignmentOffset;
+	Arena->Used += AlignmentOffset + Size;
+	Arena->PeakUsed = (Arena->Used > Arena->PeakUsed) ? Arena->Used : Arena->PeakUsed;
+
+	return(Result);
+}
+
+// NOTE(georgy): Grows the last push in place. Returns false if Block isn't the last push or the arena is too small.
+inline bool
+ExtendArenaBlock(memory_arena* Arena, void* Block, uint64_t OldSize, uint64_t NewSize)
+{
+	bool Result = false;
+	if (((uint8_t*)Block + OldSize == Arena->Base + Arena->Used) && ((Arena->Used - OldSize + NewSize) <= Arena->Size))
+	{
+		Arena->Used = Arena->Used - OldSize + NewSize;
+		Arena->PeakUsed = (Arena->Used > Arena->PeakUsed) ? Arena->Used : Arena->PeakUsed;
+		Result = true;
+	}
+
+	return(Result);
+}
+
+inline void
+SubArena(memory_arena* Result, memory_arena* Arena, uint64_t Size, uint64_t Alignment = 16)
+{
+	InitializeArena(Result, Size, PushSize_(Arena, Size, Alignment));
+}
+
+inline temporary_memory
+BeginTemporaryMemory(memory_arena* Arena)
+{
+	temporary_memory Result;
+	Result.Arena = Arena;
+	Result.Used = Arena->Used;
+	Arena->TempCount++;
+
+	return(Result);
+}
+
+inline void
+EndTemporaryMemory(temporary_memory TempMemory)
+{
+	memory_arena* Arena = TempMemory.Arena;
+	Assert(Arena->Used >= TempMemory.Used);
+	Assert(Arena->TempCount > 0);
+	Arena->Used = TempMemory.Used;
+	Arena->TempCount--;
+}
+
+// NOTE(georgy): Everything pushed so far is gone. Only with no temporary memory open.
+inline void
+ResetArena(memory_arena* Arena)
+{
+	Assert(Arena->TempCount == 0);
+	Arena->Used = 0;
+}
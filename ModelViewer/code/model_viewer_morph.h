@@ -0,0 +1,423 @@
+#pragma once
+
+// NOTE(georgy): Morph targets (aiMesh::mAnimMeshes).
+// A target keeps only the vertices it actually moves: a run of morph_delta entries (global vertex index + position delta)
+// in one static buffer. Each frame the MAX_ACTIVE_MORPH_TARGETS heaviest targets are scattered as points with additive
+// blending into a float texture that has one texel per model vertex, and DefaultVS.glsl adds
+// texelFetch(MorphDeltas, gl_VertexID) to the position. The GPU cost is proportional to the deltas of the active targets only.
+// Normal deltas are not stored, nothing in the viewer is lit.
+
+#define MAX_ACTIVE_MORPH_TARGETS 8
+#define MORPH_DELTA_EPSILON 1e-6f
+#define MORPH_TEXTURE_WIDTH 1024
+
+struct morph_delta
+{
+	uint32_t VertexIndex;
+	vec3 PositionDelta;
+};
+
+struct morph_target
+{
+	uint32_t FirstDelta;
+	uint32_t DeltaCount;
+};
+
+struct morph_weight_key
+{
+	float Time;
+	uint32_t FirstValue;
+	uint32_t ValueCount;
+};
+
+struct morph_weight_value
+{
+	uint32_t TargetIndex;
+	float Weight;
+};
+
+// NOTE(georgy): One per aiMeshMorphAnim and mesh it drives, its keys are a sorted run of morph_set::Keys
+struct morph_channel
+{
+	uint32_t FirstKey;
+	uint32_t KeyCount;
+	uint32_t CurrentKey;
+};
+
+struct morph_set
+{
+	dynamic_array<morph_target> Targets;
+	dynamic_array<float> Weights;
+	// NOTE(georgy): What the delta texture currently holds, starts as FLT_MAX so the first scatter always clears it
+	dynamic_array<float> ScatteredWeights;
+
+	// NOTE(georgy): Morph channels of the first clip, each one keeps its own keys and cursor
+	dynamic_array<morph_channel> Channels;
+	dynamic_array<morph_weight_key> Keys;
+	dynamic_array<morph_weight_value> KeyValues;
+	float Duration;
+
+	uint32_t TextureWidth;
+	uint32_t TextureHeight;
+	GLuint DeltaVBO;
+	GLuint ScatterVAO;
+	GLuint DeltaTexture;
+	GLuint DeltaFBO;
+	shader ScatterShader;
+};
+
+static void
+AddMorphWeightKeys(morph_set* Morph, const aiMeshMorphAnim* Channel, uint32_t FirstTarget, float SecondsPerTick)
+{
+	if (Channel->mNumKeys == 0)
+	{
+		return;
+	}
+
+	morph_channel MorphChannel;
+	MorphChannel.FirstKey = Morph->Keys.EntriesCount;
+	MorphChannel.KeyCount = Channel->mNumKeys;
+	MorphChannel.CurrentKey = 0;
+	PushEntry(&Morph->Channels, MorphChannel);
+
+	for (uint32_t KeyIndex = 0;
+		KeyIndex < Channel->mNumKeys;
+		KeyIndex++)
+	{
+		const aiMeshMorphKey* AssimpKey = &Channel->mKeys[KeyIndex];
+
+		morph_weight_key Key;
+		Key.Time = (float)AssimpKey->mTime * SecondsPerTick;
+		Key.FirstValue = Morph->KeyValues.EntriesCount;
+		Key.ValueCount = AssimpKey->mNumValuesAndWeights;
+		for (uint32_t ValueIndex = 0;
+			ValueIndex < AssimpKey->mNumValuesAndWeights;
+			ValueIndex++)
+		{
+			morph_weight_value Value;
+			Value.TargetIndex = FirstTarget + AssimpKey->mValues[ValueIndex];
+			Value.Weight = (float)AssimpKey->mWeights[ValueIndex];
+			PushEntry(&Morph->KeyValues, Value);
+		}
+		PushEntry(&Morph->Keys, Key);
+	}
+}
+
+static void
+LoadMorphTargets(morph_set* Morph, const aiScene* Scene, memory_arena* Scratch)
+{
+	PROFILE_ZONE("LoadMorphTargets");
+	MEMORY_TAG(MemoryTag_Morph);
+
+	InitializeDynamicArray(&Morph->Targets);
+	InitializeDynamicArray(&Morph->Weights);
+	InitializeDynamicArray(&Morph->ScatteredWeights);
+	InitializeDynamicArray(&Morph->Channels);
+	InitializeDynamicArray(&Morph->Keys);
+	InitializeDynamicArray(&Morph->KeyValues);
+	Morph->Duration = 0.0f;
+	Morph->TextureWidth = Morph->TextureHeight = 0;
+
+	temporary_memory DeltaMemory = BeginTemporaryMemory(Scratch);
+	dynamic_array<uint32_t> MeshFirstTarget(Scene->mNumMeshes, Scratch);
+	dynamic_array<morph_delta> Deltas(0, Scratch);
+	uint32_t BaseVertex = 0;
+	uint64_t DenseSize = 0;
+	for (uint32_t MeshIndex = 0;
+		MeshIndex < Scene->mNumMeshes;
+		MeshIndex++)
+	{
+		const aiMesh* AssimpMesh = Scene->mMeshes[MeshIndex];
+		PushEntry(&MeshFirstTarget, Morph->Targets.EntriesCount);
+
+		for (uint32_t AnimMeshIndex = 0;
+			AnimMeshIndex < AssimpMesh->mNumAnimMeshes;
+			AnimMeshIndex++)
+		{
+			const aiAnimMesh* AnimMesh = AssimpMesh->mAnimMeshes[AnimMeshIndex];
+
+			morph_target Target;
+			Target.FirstDelta = Deltas.EntriesCount;
+			if (AnimMesh->HasPositions())
+			{
+				uint32_t VertexCount = Min(AnimMesh->mNumVertices, AssimpMesh->mNumVertices);
+				for (uint32_t VertexIndex = 0;
+					VertexIndex < VertexCount;
+					VertexIndex++)
+				{
+					aiVector3D Delta = AnimMesh->mVertices[VertexIndex] - AssimpMesh->mVertices[VertexIndex];
+					if (Delta.SquareLength() > MORPH_DELTA_EPSILON * MORPH_DELTA_EPSILON)
+					{
+						morph_delta MorphDelta;
+						MorphDelta.VertexIndex = BaseVertex + VertexIndex;
+						MorphDelta.PositionDelta = vec3(Delta.x, Delta.y, Delta.z);
+						PushEntry(&Deltas, MorphDelta);
+					}
+				}
+			}
+			Target.DeltaCount = Deltas.EntriesCount - Target.FirstDelta;
+			DenseSize += AssimpMesh->mNumVertices * sizeof(vec3);
+
+			PushEntry(&Morph->Targets, Target);
+			PushEntry(&Morph->Weights, AnimMesh->mWeight);
+			PushEntry(&Morph->ScatteredWeights, FLT_MAX);
+		}
+
+		BaseVertex += AssimpMesh->mNumVertices;
+	}
+
+	if (Morph->Targets.EntriesCount == 0)
+	{
+		EndTemporaryMemory(DeltaMemory);
+		return;
+	}
+
+	if (Scene->mNumAnimations > 0)
+	{
+		const aiAnimation* AssimpAnimation = Scene->mAnimations[0];
+		float TicksPerSecond = (AssimpAnimation->mTicksPerSecond > 0.0) ? (float)AssimpAnimation->mTicksPerSecond : 25.0f;
+		Morph->Duration = (float)AssimpAnimation->mDuration / TicksPerSecond;
+
+		for (uint32_t ChannelIndex = 0;
+			ChannelIndex < AssimpAnimation->mNumMorphMeshChannels;
+			ChannelIndex++)
+		{
+			const aiMeshMorphAnim* Channel = AssimpAnimation->mMorphMeshChannels[ChannelIndex];
+
+			// NOTE(georgy): Importers name the channel either after the mesh or after the node that references it
+			for (uint32_t MeshIndex = 0; MeshIndex < Scene->mNumMeshes; MeshIndex++)
+			{
+				if (Scene->mMeshes[MeshIndex]->mName == Channel->mName)
+				{
+					AddMorphWeightKeys(Morph, Channel, MeshFirstTarget[MeshIndex], 1.0f / TicksPerSecond);
+				}
+			}
+			const aiNode* Node = Scene->mRootNode->FindNode(Channel->mName);
+			for (uint32_t I = 0; Node && (I < Node->mNumMeshes); I++)
+			{
+				if (Scene->mMeshes[Node->mMeshes[I]]->mName != Channel->mName)
+				{
+					AddMorphWeightKeys(Morph, Channel, MeshFirstTarget[Node->mMeshes[I]], 1.0f / TicksPerSecond);
+				}
+			}
+		}
+	}
+
+	Morph->TextureWidth = MORPH_TEXTURE_WIDTH;
+	Morph->TextureHeight = (BaseVertex + MORPH_TEXTURE_WIDTH - 1) / MORPH_TEXTURE_WIDTH;
+
+	Morph->ScatterShader = shader("shaders/MorphScatterVS.glsl", "shaders/MorphScatterFS.glsl");
+
+	glGenVertexArrays(1, &Morph->ScatterVAO);
+	glGenBuffers(1, &Morph->DeltaVBO);
+	glBindVertexArray(Morph->ScatterVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, Morph->DeltaVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(morph_delta) * Deltas.EntriesCount, Deltas.Entries, GL_STATIC_DRAW);
+	TrackGPUObject(MemoryTag_GPUBuffers, Morph->DeltaVBO, sizeof(morph_delta) * Deltas.EntriesCount);
+	glEnableVertexAttribArray(0);
+	glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, sizeof(morph_delta), (void*)OffsetOf(morph_delta, VertexIndex));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(morph_delta), (void*)OffsetOf(morph_delta, PositionDelta));
+	glBindVertexArray(0);
+
+	glGenTextures(1, &Morph->DeltaTexture);
+	glBindTexture(GL_TEXTURE_2D, Morph->DeltaTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, Morph->TextureWidth, Morph->TextureHeight, 0, GL_RGBA, GL_FLOAT, 0);
+	TrackGPUObject(MemoryTag_GPUTextures, Morph->DeltaTexture, sizeof(vec4) * (uint64_t)Morph->TextureWidth * Morph->TextureHeight);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// NOTE(georgy): Whatever framebuffer the platform layer has bound (the multisampled one in -headless) has to survive this
+	GLint DrawFramebuffer, ReadFramebuffer;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &DrawFramebuffer);
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &ReadFramebuffer);
+
+	glGenFramebuffers(1, &Morph->DeltaFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, Morph->DeltaFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, Morph->DeltaTexture, 0);
+	Assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, DrawFramebuffer);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, ReadFramebuffer);
+
+	printf("Morph targets: %u, %u deltas, %.2f MB sparse vs %.2f MB dense\n",
+		Morph->Targets.EntriesCount, Deltas.EntriesCount,
+		(float)(Deltas.EntriesCount * sizeof(morph_delta)) / (float)Megabytes(1),
+		(float)DenseSize / (float)Megabytes(1));
+
+	EndTemporaryMemory(DeltaMemory);
+}
+
+static void
+FreeMorphTargets(morph_set* Morph)
+{
+	FreeDynamicArray(&Morph->Targets);
+	FreeDynamicArray(&Morph->Weights);
+	FreeDynamicArray(&Morph->ScatteredWeights);
+	FreeDynamicArray(&Morph->Channels);
+	FreeDynamicArray(&Morph->Keys);
+	FreeDynamicArray(&Morph->KeyValues);
+
+	if (Morph->TextureWidth > 0)
+	{
+		glDeleteFramebuffers(1, &Morph->DeltaFBO);
+		TrackGPUObject(MemoryTag_GPUTextures, Morph->DeltaTexture, 0);
+		TrackGPUObject(MemoryTag_GPUBuffers, Morph->DeltaVBO, 0);
+		glDeleteTextures(1, &Morph->DeltaTexture);
+		glDeleteVertexArrays(1, &Morph->ScatterVAO);
+		glDeleteBuffers(1, &Morph->DeltaVBO);
+		Morph->ScatterShader.Delete();
+	}
+	Morph->TextureWidth = Morph->TextureHeight = 0;
+}
+
+static void
+AnimateMorphWeights(morph_set* Morph, float Time)
+{
+	if (Morph->Channels.EntriesCount == 0)
+	{
+		return;
+	}
+
+	if (Morph->Duration > 0.0f)
+	{
+		Time = fmodf(Time, Morph->Duration);
+	}
+
+	for (uint32_t ChannelIndex = 0;
+		ChannelIndex < Morph->Channels.EntriesCount;
+		ChannelIndex++)
+	{
+		morph_channel* Channel = &Morph->Channels[ChannelIndex];
+		morph_weight_key* Keys = &Morph->Keys[Channel->FirstKey];
+
+		// NOTE(georgy): Same cursor idea as the clip tracks, only rewinds when the time wraps
+		if (Keys[Channel->CurrentKey].Time > Time)
+		{
+			Channel->CurrentKey = 0;
+		}
+		while ((Channel->CurrentKey + 1 < Channel->KeyCount) && (Keys[Channel->CurrentKey + 1].Time <= Time))
+		{
+			Channel->CurrentKey++;
+		}
+
+		morph_weight_key* Key = &Keys[Channel->CurrentKey];
+		morph_weight_key* NextKey = (Channel->CurrentKey + 1 < Channel->KeyCount) ? &Keys[Channel->CurrentKey + 1] : Key;
+		float t = (NextKey->Time > Key->Time) ? Clamp((Time - Key->Time) / (NextKey->Time - Key->Time), 0.0f, 1.0f) : 0.0f;
+
+		// NOTE(georgy): A target that one of the two keys doesn't list counts as 0 in that key
+		for (uint32_t I = 0; I < NextKey->ValueCount; I++)
+		{
+			Morph->Weights[Morph->KeyValues[NextKey->FirstValue + I].TargetIndex] = 0.0f;
+		}
+		for (uint32_t I = 0; I < Key->ValueCount; I++)
+		{
+			morph_weight_value* Value = &Morph->KeyValues[Key->FirstValue + I];
+			Morph->Weights[Value->TargetIndex] = (1.0f - t) * Value->Weight;
+		}
+		if (NextKey != Key)
+		{
+			for (uint32_t I = 0; I < NextKey->ValueCount; I++)
+			{
+				morph_weight_value* Value = &Morph->KeyValues[NextKey->FirstValue + I];
+				Morph->Weights[Value->TargetIndex] += t * Value->Weight;
+			}
+		}
+	}
+}
+
+// NOTE(georgy): Rebuilds the delta texture from the heaviest targets. Does nothing when the weights didn't change.
+// The framebuffer bindings and the viewport are put back the way the caller had them.
+static void
+ScatterMorphTargets(morph_set* Morph)
+{
+	PROFILE_ZONE("ScatterMorphTargets");
+
+	uint32_t ActiveTargets[MAX_ACTIVE_MORPH_TARGETS];
+	uint32_t ActiveCount = 0;
+	for (uint32_t TargetIndex = 0;
+		TargetIndex < Morph->Targets.EntriesCount;
+		TargetIndex++)
+	{
+		float Weight = Absolute(Morph->Weights[TargetIndex]);
+		if ((Weight <= Epsilon) || (Morph->Targets[TargetIndex].DeltaCount == 0))
+		{
+			continue;
+		}
+
+		if (ActiveCount < MAX_ACTIVE_MORPH_TARGETS)
+		{
+			ActiveTargets[ActiveCount++] = TargetIndex;
+		}
+		else
+		{
+			uint32_t Lightest = 0;
+			for (uint32_t I = 1; I < ActiveCount; I++)
+			{
+				if (Absolute(Morph->Weights[ActiveTargets[I]]) < Absolute(Morph->Weights[ActiveTargets[Lightest]]))
+				{
+					Lightest = I;
+				}
+			}
+			if (Weight > Absolute(Morph->Weights[ActiveTargets[Lightest]]))
+			{
+				ActiveTargets[Lightest] = TargetIndex;
+			}
+		}
+	}
+
+	bool Changed = false;
+	for (uint32_t TargetIndex = 0;
+		TargetIndex < Morph->Targets.EntriesCount;
+		TargetIndex++)
+	{
+		float Weight = 0.0f;
+		for (uint32_t I = 0; I < ActiveCount; I++)
+		{
+			if (ActiveTargets[I] == TargetIndex) Weight = Morph->Weights[TargetIndex];
+		}
+
+		Changed = Changed || (Weight != Morph->ScatteredWeights[TargetIndex]);
+		Morph->ScatteredWeights[TargetIndex] = Weight;
+	}
+
+	if (!Changed)
+	{
+		return;
+	}
+
+	float ClearColor[4];
+	GLint Viewport[4];
+	GLint DrawFramebuffer, ReadFramebuffer;
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, ClearColor);
+	glGetIntegerv(GL_VIEWPORT, Viewport);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &DrawFramebuffer);
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &ReadFramebuffer);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, Morph->DeltaFBO);
+	glViewport(0, 0, Morph->TextureWidth, Morph->TextureHeight);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glDisable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+
+	Morph->ScatterShader.Use();
+	Morph->ScatterShader.SetVec2("TargetSize", vec2i(Morph->TextureWidth, Morph->TextureHeight));
+	glBindVertexArray(Morph->ScatterVAO);
+	for (uint32_t I = 0; I < ActiveCount; I++)
+	{
+		morph_target* Target = &Morph->Targets[ActiveTargets[I]];
+		Morph->ScatterShader.SetR32("Weight", Morph->Weights[ActiveTargets[I]]);
+		glDrawArrays(GL_POINTS, Target->FirstDelta, Target->DeltaCount);
+	}
+	glBindVertexArray(0);
+
+	glDisable(GL_BLEND);
+	glEnable(GL_DEPTH_TEST);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, DrawFramebuffer);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, ReadFramebuffer);
+	glViewport(Viewport[0], Viewport[1], Viewport[2], Viewport[3]);
+	glClearColor(ClearColor[0], ClearColor[1], ClearColor[2], ClearColor[3]);
+}
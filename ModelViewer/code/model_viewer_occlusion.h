@@ -0,0 +1,398 @@
+#pragma once
+
+// NOTE(georgy): Software occlusion culling.
+// The biggest meshes of the model (by box area, within a triangle budget) are occluders. Every frame their triangles
+// are rasterized on the CPU into a small depth buffer that keeps the nearest depth per pixel. The buffer is split into
+// rows of tiles, each row is a job on the work queue and fills 4 pixels per step with SSE. Each tile also keeps the
+// farthest depth in it, so a box test can accept whole tiles at once and only looks at pixels where a tile is not fully
+// in front of the box. Only frustum-visible meshes are rasterized or tested, and occluders are never tested themselves.
+// All of it happens before the frame's draws are submitted, while the GPU still works on the previous frame.
+
+#define OCCLUSION_WIDTH 256
+#define OCCLUSION_HEIGHT 128
+#define OCCLUSION_TILE_SIZE 8
+#define OCCLUSION_TILES_X (OCCLUSION_WIDTH / OCCLUSION_TILE_SIZE)
+#define OCCLUSION_TILES_Y (OCCLUSION_HEIGHT / OCCLUSION_TILE_SIZE)
+#define OCCLUSION_MAX_OCCLUDERS 32
+#define OCCLUSION_TRIANGLE_BUDGET 65536
+#define OCCLUSION_MIN_W 1e-4f
+
+// NOTE(georgy): Pixels in x and y, depth in [0, 1]
+struct occlusion_vertex
+{
+	float X, Y, Z;
+	uint32_t Clipped;
+};
+
+struct occlusion_buffer
+{
+	float Depth[OCCLUSION_WIDTH * OCCLUSION_HEIGHT];
+	float TileMaxDepth[OCCLUSION_TILES_X * OCCLUSION_TILES_Y];
+
+	dynamic_array<uint32_t> Occluders;
+	dynamic_array<uint8_t> IsOccluder;
+
+	// NOTE(georgy): This frame's occluder triangles
+	dynamic_array<occlusion_vertex> Vertices;
+	dynamic_array<uint32_t> Indices;
+};
+
+struct occlusion_row_job
+{
+	occlusion_buffer* Buffer;
+	uint32_t TileY;
+};
+
+struct occluder_candidate
+{
+	float Area;
+	uint32_t MeshIndex;
+};
+
+static int
+CompareOccluderCandidates(const void* A, const void* B)
+{
+	float AreaA = ((occluder_candidate*)A)->Area;
+	float AreaB = ((occluder_candidate*)B)->Area;
+	int Result = (AreaA > AreaB) ? -1 : ((AreaA < AreaB) ? 1 : 0);
+
+	return(Result);
+}
+
+// NOTE(georgy): Call after every load, picks the occluders for the following frames
+static void
+SelectOccluders(occlusion_buffer* Buffer, uint32_t MeshCount, mesh* Meshes)
+{
+	MEMORY_TAG(MemoryTag_Occlusion);
+
+	dynamic_array<occluder_candidate> Candidates(MeshCount);
+	for (uint32_t MeshIndex = 0; MeshIndex < MeshCount; MeshIndex++)
+	{
+		occluder_candidate Candidate;
+		Candidate.Area = AABBSurfaceArea(Meshes[MeshIndex].AABB);
+		Candidate.MeshIndex = MeshIndex;
+		PushEntry(&Candidates, Candidate);
+	}
+	qsort(Candidates.Entries, Candidates.EntriesCount, sizeof(occluder_candidate), CompareOccluderCandidates);
+
+	Buffer->Occluders.EntriesCount = 0;
+	Buffer->IsOccluder.EntriesCount = 0;
+	ResizeDynamicArray(&Buffer->IsOccluder, MeshCount);
+	uint32_t TriangleCount = 0;
+	for (uint32_t CandidateIndex = 0;
+		(CandidateIndex < Candidates.EntriesCount) && (Buffer->Occluders.EntriesCount < OCCLUSION_MAX_OCCLUDERS);
+		CandidateIndex++)
+	{
+		mesh* Mesh = &Meshes[Candidates[CandidateIndex].MeshIndex];
+		if (TriangleCount + Mesh->IndexCount / 3 <= OCCLUSION_TRIANGLE_BUDGET)
+		{
+			PushEntry(&Buffer->Occluders, Candidates[CandidateIndex].MeshIndex);
+			Buffer->IsOccluder[Candidates[CandidateIndex].MeshIndex] = 1;
+			TriangleCount += Mesh->IndexCount / 3;
+		}
+	}
+
+	printf("Occlusion culling: %u occluders, %u triangles\n", Buffer->Occluders.EntriesCount, TriangleCount);
+}
+
+inline float
+OcclusionEdge(occlusion_vertex* A, occlusion_vertex* B, float X, float Y)
+{
+	float Result = (B->X - A->X)*(Y - A->Y) - (B->Y - A->Y)*(X - A->X);
+	return(Result);
+}
+
+// NOTE(georgy): Both windings are drawn, with the nearest depth kept. Pixel centers inside the triangle are covered.
+static void
+RasterizeOcclusionTriangle(occlusion_buffer* Buffer, occlusion_vertex* V0, occlusion_vertex* V1, occlusion_vertex* V2, int32_t RowMin, int32_t RowMax)
+{
+	float Area = OcclusionEdge(V0, V1, V2->X, V2->Y);
+	if (Area == 0.0f)
+	{
+		return;
+	}
+	if (Area < 0.0f)
+	{
+		occlusion_vertex* Temp = V1; V1 = V2; V2 = Temp;
+		Area = -Area;
+	}
+
+	int32_t MinX = Max((int32_t)floorf(Min(V0->X, Min(V1->X, V2->X))), 0);
+	int32_t MaxX = Min((int32_t)ceilf(Max(V0->X, Max(V1->X, V2->X))), OCCLUSION_WIDTH - 1);
+	int32_t MinY = Max((int32_t)floorf(Min(V0->Y, Min(V1->Y, V2->Y))), RowMin);
+	int32_t MaxY = Min((int32_t)ceilf(Max(V0->Y, Max(V1->Y, V2->Y))), RowMax);
+	if ((MinX > MaxX) || (MinY > MaxY))
+	{
+		return;
+	}
+	MinX &= ~3;
+
+	// NOTE(georgy): Edge functions are linear, so they step by constants in x and y
+	float InvArea = 1.0f / Area;
+	float StepX0 = V1->Y - V2->Y, StepY0 = V2->X - V1->X;
+	float StepX1 = V2->Y - V0->Y, StepY1 = V0->X - V2->X;
+	float StepX2 = V0->Y - V1->Y, StepY2 = V1->X - V0->X;
+	float StartX = (float)MinX + 0.5f, StartY = (float)MinY + 0.5f;
+	float Row0 = OcclusionEdge(V1, V2, StartX, StartY);
+	float Row1 = OcclusionEdge(V2, V0, StartX, StartY);
+	float Row2 = OcclusionEdge(V0, V1, StartX, StartY);
+
+	// NOTE(georgy): Depth as a plane over the pixel grid
+	float Z1 = (V1->Z - V0->Z) * InvArea, Z2 = (V2->Z - V0->Z) * InvArea;
+	float DepthStepX = StepX1*Z1 + StepX2*Z2;
+	float DepthStepY = StepY1*Z1 + StepY2*Z2;
+	float DepthRow = V0->Z + Row1*Z1 + Row2*Z2;
+
+#if CULL_SSE
+	__m128 LaneOffsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+	__m128 Zero = _mm_setzero_ps();
+	__m128 Edge0Step = _mm_set1_ps(4.0f * StepX0);
+	__m128 Edge1Step = _mm_set1_ps(4.0f * StepX1);
+	__m128 Edge2Step = _mm_set1_ps(4.0f * StepX2);
+	__m128 DepthStep = _mm_set1_ps(4.0f * DepthStepX);
+	for (int32_t Y = MinY; Y <= MaxY; Y++)
+	{
+		__m128 Edge0 = _mm_add_ps(_mm_set1_ps(Row0), _mm_mul_ps(LaneOffsets, _mm_set1_ps(StepX0)));
+		__m128 Edge1 = _mm_add_ps(_mm_set1_ps(Row1), _mm_mul_ps(LaneOffsets, _mm_set1_ps(StepX1)));
+		__m128 Edge2 = _mm_add_ps(_mm_set1_ps(Row2), _mm_mul_ps(LaneOffsets, _mm_set1_ps(StepX2)));
+		__m128 Depth = _mm_add_ps(_mm_set1_ps(DepthRow), _mm_mul_ps(LaneOffsets, _mm_set1_ps(DepthStepX)));
+
+		float* Pixels = Buffer->Depth + Y * OCCLUSION_WIDTH;
+		for (int32_t X = MinX; X <= MaxX; X += 4)
+		{
+			__m128 Inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(Edge0, Zero), _mm_cmpge_ps(Edge1, Zero)), _mm_cmpge_ps(Edge2, Zero));
+			if (_mm_movemask_ps(Inside))
+			{
+				__m128 Old = _mm_loadu_ps(Pixels + X);
+				__m128 New = _mm_min_ps(Old, Depth);
+				_mm_storeu_ps(Pixels + X, _mm_or_ps(_mm_and_ps(Inside, New), _mm_andnot_ps(Inside, Old)));
+			}
+
+			Edge0 = _mm_add_ps(Edge0, Edge0Step);
+			Edge1 = _mm_add_ps(Edge1, Edge1Step);
+			Edge2 = _mm_add_ps(Edge2, Edge2Step);
+			Depth = _mm_add_ps(Depth, DepthStep);
+		}
+
+		Row0 += StepY0; Row1 += StepY1; Row2 += StepY2;
+		DepthRow += DepthStepY;
+	}
+#else
+	for (int32_t Y = MinY; Y <= MaxY; Y++)
+	{
+		float Edge0 = Row0, Edge1 = Row1, Edge2 = Row2, Depth = DepthRow;
+		float* Pixels = Buffer->Depth + Y * OCCLUSION_WIDTH;
+		for (int32_t X = MinX; X <= MaxX; X++)
+		{
+			if ((Edge0 >= 0.0f) && (Edge1 >= 0.0f) && (Edge2 >= 0.0f))
+			{
+				Pixels[X] = Min(Pixels[X], Depth);
+			}
+
+			Edge0 += StepX0; Edge1 += StepX1; Edge2 += StepX2;
+			Depth += DepthStepX;
+		}
+
+		Row0 += StepY0; Row1 += StepY1; Row2 += StepY2;
+		DepthRow += DepthStepY;
+	}
+#endif
+}
+
+// NOTE(georgy): One row of tiles: clear, draw every triangle that reaches it, then the tile maxima
+static PLATFORM_WORK_QUEUE_CALLBACK(DoOcclusionRow)
+{
+	(void)Queue;
+	PROFILE_ZONE("DoOcclusionRow");
+
+	occlusion_row_job* Job = (occlusion_row_job*)Data;
+	occlusion_buffer* Buffer = Job->Buffer;
+	int32_t RowMin = Job->TileY * OCCLUSION_TILE_SIZE;
+	int32_t RowMax = RowMin + OCCLUSION_TILE_SIZE - 1;
+
+	for (int32_t Index = RowMin * OCCLUSION_WIDTH; Index < (RowMax + 1) * OCCLUSION_WIDTH; Index++)
+	{
+		Buffer->Depth[Index] = 1.0f;
+	}
+
+	for (uint32_t Index = 0; Index + 2 < Buffer->Indices.EntriesCount; Index += 3)
+	{
+		occlusion_vertex* V0 = &Buffer->Vertices[Buffer->Indices[Index + 0]];
+		occlusion_vertex* V1 = &Buffer->Vertices[Buffer->Indices[Index + 1]];
+		occlusion_vertex* V2 = &Buffer->Vertices[Buffer->Indices[Index + 2]];
+		float MinY = Min(V0->Y, Min(V1->Y, V2->Y));
+		float MaxY = Max(V0->Y, Max(V1->Y, V2->Y));
+		if ((MaxY >= (float)RowMin) && (MinY <= (float)(RowMax + 1)))
+		{
+			RasterizeOcclusionTriangle(Buffer, V0, V1, V2, RowMin, RowMax);
+		}
+	}
+
+	for (uint32_t TileX = 0; TileX < OCCLUSION_TILES_X; TileX++)
+	{
+		float TileMax = 0.0f;
+		for (int32_t Y = RowMin; Y <= RowMax; Y++)
+		{
+			for (uint32_t X = TileX * OCCLUSION_TILE_SIZE; X < (TileX + 1) * OCCLUSION_TILE_SIZE; X++)
+			{
+				TileMax = Max(TileMax, Buffer->Depth[Y * OCCLUSION_WIDTH + X]);
+			}
+		}
+		Buffer->TileMaxDepth[Job->TileY * OCCLUSION_TILES_X + TileX] = TileMax;
+	}
+}
+
+inline occlusion_vertex
+ProjectOcclusionVertex(mat4 ClipFromModel, vec3 P)
+{
+	vec4 Clip = ClipFromModel * vec4(P, 1.0f);
+
+	// NOTE(georgy): In front of the near plane (z < -w), the w test only keeps the divide safe for odd projections
+	occlusion_vertex Result;
+	Result.Clipped = (Clip.z < -Clip.w) || (Clip.w < OCCLUSION_MIN_W);
+	float InvW = Result.Clipped ? 0.0f : 1.0f / Clip.w;
+	Result.X = (Clip.x * InvW * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+	Result.Y = (Clip.y * InvW * 0.5f + 0.5f) * OCCLUSION_HEIGHT;
+	Result.Z = Clip.z * InvW * 0.5f + 0.5f;
+
+	return(Result);
+}
+
+// NOTE(georgy): Visible holds the frustum results, occluders outside the frustum are left out
+static void
+RasterizeOccluders(game_memory* Memory, occlusion_buffer* Buffer, mat4 ClipFromModel, mesh* Meshes, vec3* Positions, uint32_t* Indices, uint8_t* Visible)
+{
+	PROFILE_ZONE("RasterizeOccluders");
+	MEMORY_TAG(MemoryTag_Occlusion);
+
+	Buffer->Vertices.EntriesCount = 0;
+	Buffer->Indices.EntriesCount = 0;
+	for (uint32_t OccluderIndex = 0; OccluderIndex < Buffer->Occluders.EntriesCount; OccluderIndex++)
+	{
+		uint32_t MeshIndex = Buffer->Occluders[OccluderIndex];
+		if (!Visible[MeshIndex])
+		{
+			continue;
+		}
+
+		mesh* Mesh = &Meshes[MeshIndex];
+		uint32_t BaseVertex = Buffer->Vertices.EntriesCount;
+		for (uint32_t VertexIndex = 0; VertexIndex < Mesh->VertexCount; VertexIndex++)
+		{
+			PushEntry(&Buffer->Vertices, ProjectOcclusionVertex(ClipFromModel, Positions[Mesh->BaseVertex + VertexIndex]));
+		}
+
+		// NOTE(georgy): Triangles crossing the near plane are dropped, drawing less occluder is always safe
+		uint32_t* MeshIndices = Indices + Mesh->BaseIndex;
+		for (uint32_t Index = 0; Index < Mesh->IndexCount; Index += 3)
+		{
+			uint32_t I0 = BaseVertex + MeshIndices[Index + 0];
+			uint32_t I1 = BaseVertex + MeshIndices[Index + 1];
+			uint32_t I2 = BaseVertex + MeshIndices[Index + 2];
+			if (!Buffer->Vertices[I0].Clipped && !Buffer->Vertices[I1].Clipped && !Buffer->Vertices[I2].Clipped)
+			{
+				uint32_t Triangle[3] = { I0, I1, I2 };
+				PushEntries(&Buffer->Indices, Triangle, 3);
+			}
+		}
+	}
+
+	occlusion_row_job Jobs[OCCLUSION_TILES_Y];
+	for (uint32_t TileY = 0; TileY < OCCLUSION_TILES_Y; TileY++)
+	{
+		Jobs[TileY].Buffer = Buffer;
+		Jobs[TileY].TileY = TileY;
+		if (Memory->WorkQueue)
+		{
+			Memory->PlatformAddEntry(Memory->WorkQueue, DoOcclusionRow, &Jobs[TileY]);
+		}
+		else
+		{
+			DoOcclusionRow(0, &Jobs[TileY]);
+		}
+	}
+	if (Memory->WorkQueue)
+	{
+		Memory->PlatformCompleteAllWork(Memory->WorkQueue);
+	}
+}
+
+// NOTE(georgy): True if every pixel the box's screen rectangle touches has an occluder in front of the box's nearest point
+static bool
+IsBoxOccluded(occlusion_buffer* Buffer, mat4 ClipFromModel, vec3 Center, vec3 Extent)
+{
+	float MinX = FLT_MAX, MinY = FLT_MAX, MaxX = -FLT_MAX, MaxY = -FLT_MAX;
+	float MinZ = FLT_MAX;
+	for (uint32_t Corner = 0; Corner < 8; Corner++)
+	{
+		vec3 P = Center + vec3((Corner & 1) ? Extent.x : -Extent.x, (Corner & 2) ? Extent.y : -Extent.y, (Corner & 4) ? Extent.z : -Extent.z);
+		occlusion_vertex V = ProjectOcclusionVertex(ClipFromModel, P);
+		if (V.Clipped)
+		{
+			return(false);
+		}
+
+		MinX = Min(MinX, V.X); MaxX = Max(MaxX, V.X);
+		MinY = Min(MinY, V.Y); MaxY = Max(MaxY, V.Y);
+		MinZ = Min(MinZ, V.Z);
+	}
+
+	int32_t X0 = Max((int32_t)floorf(MinX), 0), X1 = Min((int32_t)ceilf(MaxX), OCCLUSION_WIDTH - 1);
+	int32_t Y0 = Max((int32_t)floorf(MinY), 0), Y1 = Min((int32_t)ceilf(MaxY), OCCLUSION_HEIGHT - 1);
+	if ((X0 > X1) || (Y0 > Y1))
+	{
+		return(false);
+	}
+
+	for (int32_t TileY = Y0 / OCCLUSION_TILE_SIZE; TileY <= Y1 / OCCLUSION_TILE_SIZE; TileY++)
+	{
+		for (int32_t TileX = X0 / OCCLUSION_TILE_SIZE; TileX <= X1 / OCCLUSION_TILE_SIZE; TileX++)
+		{
+			if (Buffer->TileMaxDepth[TileY * OCCLUSION_TILES_X + TileX] < MinZ)
+			{
+				continue;
+			}
+
+			int32_t PixelY0 = Max(Y0, TileY * OCCLUSION_TILE_SIZE), PixelY1 = Min(Y1, (TileY + 1) * OCCLUSION_TILE_SIZE - 1);
+			int32_t PixelX0 = Max(X0, TileX * OCCLUSION_TILE_SIZE), PixelX1 = Min(X1, (TileX + 1) * OCCLUSION_TILE_SIZE - 1);
+			for (int32_t Y = PixelY0; Y <= PixelY1; Y++)
+			{
+				for (int32_t X = PixelX0; X <= PixelX1; X++)
+				{
+					if (Buffer->Depth[Y * OCCLUSION_WIDTH + X] >= MinZ)
+					{
+						return(false);
+					}
+				}
+			}
+		}
+	}
+
+	return(true);
+}
+
+// NOTE(georgy): Clears Visible for the occluded meshes, returns how many
+static uint32_t
+CullOccludedMeshes(occlusion_buffer* Buffer, mat4 ClipFromModel, cull_bounds* Bounds, uint8_t* Visible)
+{
+	PROFILE_ZONE("CullOccludedMeshes");
+
+	uint32_t Result = 0;
+	for (uint32_t MeshIndex = 0; MeshIndex < Bounds->Count; MeshIndex++)
+	{
+		if (!Visible[MeshIndex] || Buffer->IsOccluder[MeshIndex])
+		{
+			continue;
+		}
+
+		vec3 Center = vec3(Bounds->CenterX[MeshIndex], Bounds->CenterY[MeshIndex], Bounds->CenterZ[MeshIndex]);
+		vec3 Extent = vec3(Bounds->ExtentX[MeshIndex], Bounds->ExtentY[MeshIndex], Bounds->ExtentZ[MeshIndex]);
+		if (IsBoxOccluded(Buffer, ClipFromModel, Center, Extent))
+		{
+			Visible[MeshIndex] = 0;
+			Result++;
+		}
+	}
+
+	return(Result);
+}
@@ -2,10 +2,203 @@
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+// NOTE(georgy): On Linux -headless gets a surfaceless EGL context (link with -lEGL), so it needs no X server.
+// MODEL_VIEWER_NO_EGL falls back to the invisible GLFW window, which is all the other platforms have.
+#if defined(__linux__) && !defined(MODEL_VIEWER_NO_EGL) && !defined(MODEL_VIEWER_EGL)
+#define MODEL_VIEWER_EGL
+#endif
+#if defined(MODEL_VIEWER_EGL)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
 
-// NOTE(georgy): These are for malloc() and memset()
+// NOTE(georgy): These are for malloc(), atoi() and memset()
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <io.h>
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#endif
+
+#include "dynamic_array.h"
+#include "model_viewer_profiler.h"
+#include "model_viewer_array_benchmark.h"
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+struct platform_work_queue_entry
+{
+	platform_work_queue_callback* Callback;
+	void* Data;
+};
+
+struct platform_work_queue
+{
+	std::atomic<uint32_t> CompletionGoal;
+	std::atomic<uint32_t> CompletionCount;
+
+	std::atomic<uint32_t> NextEntryToWrite;
+	std::atomic<uint32_t> NextEntryToRead;
+
+	// NOTE(georgy): Sleeping workers wait on this while the queue is empty
+	std::mutex Mutex;
+	std::condition_variable WakeUp;
+
+	platform_work_queue_entry Entries[256];
+};
+
+static void
+AddEntry(platform_work_queue* Queue, platform_work_queue_callback* Callback, void* Data)
+{
+	uint32_t NewNextEntryToWrite = (Queue->NextEntryToWrite + 1) % ArrayCount(Queue->Entries);
+	Assert(NewNextEntryToWrite != Queue->NextEntryToRead);
+
+	platform_work_queue_entry* Entry = &Queue->Entries[Queue->NextEntryToWrite];
+	Entry->Callback = Callback;
+	Entry->Data = Data;
+	++Queue->CompletionGoal;
+
+	// NOTE(georgy): The entry has to be written before the index is published
+	Queue->NextEntryToWrite.store(NewNextEntryToWrite);
+	{
+		std::lock_guard<std::mutex> Lock(Queue->Mutex);
+	}
+	Queue->WakeUp.notify_one();
+}
+
+// NOTE(georgy): Returns true if there was nothing to do
+static bool
+DoNextWorkQueueEntry(platform_work_queue* Queue)
+{
+	bool WeShouldSleep = false;
+
+	uint32_t OriginalNextEntryToRead = Queue->NextEntryToRead;
+	uint32_t NewNextEntryToRead = (OriginalNextEntryToRead + 1) % ArrayCount(Queue->Entries);
+	if (OriginalNextEntryToRead != Queue->NextEntryToWrite)
+	{
+		if (Queue->NextEntryToRead.compare_exchange_strong(OriginalNextEntryToRead, NewNextEntryToRead))
+		{
+			platform_work_queue_entry Entry = Queue->Entries[OriginalNextEntryToRead];
+			Entry.Callback(Queue, Entry.Data);
+			++Queue->CompletionCount;
+		}
+	}
+	else
+	{
+		WeShouldSleep = true;
+	}
+
+	return(WeShouldSleep);
+}
+
+// NOTE(georgy): The main thread works on the queue too while it waits
+static void
+CompleteAllWork(platform_work_queue* Queue)
+{
+	while (Queue->CompletionGoal != Queue->CompletionCount)
+	{
+		DoNextWorkQueueEntry(Queue);
+	}
+
+	Queue->CompletionGoal = 0;
+	Queue->CompletionCount = 0;
+}
+
+static void
+WorkerThreadProc(platform_work_queue* Queue)
+{
+	for (;;)
+	{
+		if (DoNextWorkQueueEntry(Queue))
+		{
+			std::unique_lock<std::mutex> Lock(Queue->Mutex);
+			while (Queue->NextEntryToRead == Queue->NextEntryToWrite)
+			{
+				Queue->WakeUp.wait(Lock);
+			}
+		}
+	}
+}
+
+static platform_work_queue WorkQueue;
+
+static void
+GetProcessStats(platform_process_stats* Stats, bool ResetPeak)
+{
+	*Stats = {};
+#if defined(_WIN32)
+	FILETIME CreationTime, ExitTime, KernelTime, UserTime;
+	if (GetProcessTimes(GetCurrentProcess(), &CreationTime, &ExitTime, &KernelTime, &UserTime))
+	{
+		uint64_t Ticks = (((uint64_t)KernelTime.dwHighDateTime << 32) | KernelTime.dwLowDateTime) +
+						 (((uint64_t)UserTime.dwHighDateTime << 32) | UserTime.dwLowDateTime);
+		Stats->CPUSeconds = 1e-7 * (double)Ticks;
+	}
+
+	PROCESS_MEMORY_COUNTERS Counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &Counters, sizeof(Counters)))
+	{
+		Stats->ResidentBytes = Counters.WorkingSetSize;
+		Stats->PeakResidentBytes = Counters.PeakWorkingSetSize;
+	}
+#else
+	rusage Usage;
+	if (getrusage(RUSAGE_SELF, &Usage) == 0)
+	{
+		Stats->CPUSeconds = (double)(Usage.ru_utime.tv_sec + Usage.ru_stime.tv_sec) +
+							1e-6 * (double)(Usage.ru_utime.tv_usec + Usage.ru_stime.tv_usec);
+#if defined(__APPLE__)
+		Stats->PeakResidentBytes = Usage.ru_maxrss;
+#else
+		Stats->PeakResidentBytes = 1024 * (uint64_t)Usage.ru_maxrss;
+#endif
+	}
+
+#if defined(__linux__)
+	// NOTE(georgy): ru_maxrss can't be reset, VmHWM can
+	FILE* Status = fopen("/proc/self/status", "r");
+	if (Status)
+	{
+		char Line[256];
+		unsigned long long Kilobytes;
+		while (fgets(Line, sizeof(Line), Status))
+		{
+			if (sscanf(Line, "VmHWM: %llu kB", &Kilobytes) == 1)
+			{
+				Stats->PeakResidentBytes = 1024 * (uint64_t)Kilobytes;
+			}
+			else if (sscanf(Line, "VmRSS: %llu kB", &Kilobytes) == 1)
+			{
+				Stats->ResidentBytes = 1024 * (uint64_t)Kilobytes;
+			}
+		}
+		fclose(Status);
+	}
+
+	if (ResetPeak)
+	{
+		FILE* ClearRefs = fopen("/proc/self/clear_refs", "w");
+		if (ClearRefs)
+		{
+			fputs("5", ClearRefs);
+			fclose(ClearRefs);
+		}
+	}
+#endif
+#endif
+}
 
 static void
 GLFWKeyCallback(GLFWwindow* Window, int Key, int ScanCode, int Action, int Mods)
@@ -64,6 +257,71 @@ GLFWKeyCallback(GLFWwindow* Window, int Key, int ScanCode, int Action, int Mods)
 			++Input->S.HalfTransitionCount;
 		}
 	}
+	if (Key == GLFW_KEY_C)
+	{
+		if (Action == GLFW_PRESS)
+		{
+			Input->C.EndedDown = true;
+			++Input->C.HalfTransitionCount;
+		}
+		else if (Action == GLFW_RELEASE)
+		{
+			Input->C.EndedDown = false;
+			++Input->C.HalfTransitionCount;
+		}
+	}
+	if (Key == GLFW_KEY_B)
+	{
+		if (Action == GLFW_PRESS)
+		{
+			Input->B.EndedDown = true;
+			++Input->B.HalfTransitionCount;
+		}
+		else if (Action == GLFW_RELEASE)
+		{
+			Input->B.EndedDown = false;
+			++Input->B.HalfTransitionCount;
+		}
+	}
+	if (Key == GLFW_KEY_R)
+	{
+		if (Action == GLFW_PRESS)
+		{
+			Input->R.EndedDown = true;
+			++Input->R.HalfTransitionCount;
+		}
+		else if (Action == GLFW_RELEASE)
+		{
+			Input->R.EndedDown = false;
+			++Input->R.HalfTransitionCount;
+		}
+	}
+	if (Key == GLFW_KEY_P)
+	{
+		if (Action == GLFW_PRESS)
+		{
+			Input->P.EndedDown = true;
+			++Input->P.HalfTransitionCount;
+		}
+		else if (Action == GLFW_RELEASE)
+		{
+			Input->P.EndedDown = false;
+			++Input->P.HalfTransitionCount;
+		}
+	}
+	if (Key == GLFW_KEY_M)
+	{
+		if (Action == GLFW_PRESS)
+		{
+			Input->M.EndedDown = true;
+			++Input->M.HalfTransitionCount;
+		}
+		else if (Action == GLFW_RELEASE)
+		{
+			Input->M.EndedDown = false;
+			++Input->M.HalfTransitionCount;
+		}
+	}
 }
 
 static void
@@ -111,8 +369,639 @@ GLFWCursorPosCallback(GLFWwindow* Window, double XPos, double YPos)
 	Input->MouseY = (int)YPos;
 }
 
-int main()
+struct command_line
+{
+	bool Headless;
+	const char* ThumbnailSource;
+	const char* BenchmarkSource;
+	bool ArrayBenchmark;
+	bool MathBenchmark;
+	uint32_t RunCount;
+	const char* JSONPath;
+	const char* BaselinePath;
+	float RegressionThreshold;
+	bool HugePages;
+	const char* ModelPath;
+	const char* OutputPath;
+	uint32_t Width;
+	uint32_t Height;
+	game_camera Camera;
+};
+
+// NOTE(georgy): ModelViewer -headless -model <path> -output <image.tga> [-size <width> <height>]
+// [-camera <x> <y> <z> <target x> <target y> <target z>] [-fov <degrees>]
+// ModelViewer -thumbnails <directory or list file> -output <directory> [-size <width> <height>] [-camera ...] [-fov ...]
+// ModelViewer -benchmark <directory or list file> [-runs <count>] [-json <path>] [-baseline <path>] [-threshold <percent>]
+// ModelViewer -array_benchmark [-runs <count>]
+// ModelViewer -math_benchmark [-runs <count>]
+// -huge_pages goes with any of them.
+static bool
+ParseCommandLine(int ArgCount, char** Args, command_line* CommandLine)
+{
+	*CommandLine = {};
+	CommandLine->RunCount = 5;
+	CommandLine->RegressionThreshold = 0.1f;
+	bool SizeGiven = false;
+	CommandLine->Camera.Position[2] = 3.0f;
+	CommandLine->Camera.FieldOfView = 45.0f;
+
+	for (int ArgIndex = 1; ArgIndex < ArgCount; ArgIndex++)
+	{
+		const char* Arg = Args[ArgIndex];
+		int Remaining = ArgCount - ArgIndex - 1;
+		if (strcmp(Arg, "-headless") == 0)
+		{
+			CommandLine->Headless = true;
+		}
+		else if ((strcmp(Arg, "-thumbnails") == 0) && (Remaining >= 1))
+		{
+			CommandLine->ThumbnailSource = Args[++ArgIndex];
+		}
+		else if ((strcmp(Arg, "-benchmark") == 0) && (Remaining >= 1))
+		{
+			CommandLine->BenchmarkSource = Args[++ArgIndex];
+		}
+		else if (strcmp(Arg, "-array_benchmark") == 0)
+		{
+			CommandLine->ArrayBenchmark = true;
+		}
+		else if (strcmp(Arg, "-math_benchmark") == 0)
+		{
+			CommandLine->MathBenchmark = true;
+		}
+		else if ((strcmp(Arg, "-runs") == 0) && (Remaining >= 1))
+		{
+			CommandLine->RunCount = (uint32_t)atoi(Args[++ArgIndex]);
+		}
+		else if ((strcmp(Arg, "-json") == 0) && (Remaining >= 1))
+		{
+			CommandLine->JSONPath = Args[++ArgIndex];
+		}
+		else if ((strcmp(Arg, "-baseline") == 0) && (Remaining >= 1))
+		{
+			CommandLine->BaselinePath = Args[++ArgIndex];
+		}
+		else if ((strcmp(Arg, "-threshold") == 0) && (Remaining >= 1))
+		{
+			CommandLine->RegressionThreshold = 0.01f * (float)atof(Args[++ArgIndex]);
+		}
+		else if (strcmp(Arg, "-huge_pages") == 0)
+		{
+			CommandLine->HugePages = true;
+		}
+		else if ((strcmp(Arg, "-model") == 0) && (Remaining >= 1))
+		{
+			CommandLine->ModelPath = Args[++ArgIndex];
+		}
+		else if ((strcmp(Arg, "-output") == 0) && (Remaining >= 1))
+		{
+			CommandLine->OutputPath = Args[++ArgIndex];
+		}
+		else if ((strcmp(Arg, "-size") == 0) && (Remaining >= 2))
+		{
+			CommandLine->Width = (uint32_t)atoi(Args[++ArgIndex]);
+			CommandLine->Height = (uint32_t)atoi(Args[++ArgIndex]);
+			SizeGiven = true;
+		}
+		else if ((strcmp(Arg, "-camera") == 0) && (Remaining >= 6))
+		{
+			for (uint32_t I = 0; I < 3; I++)
+			{
+				CommandLine->Camera.Position[I] = (float)atof(Args[++ArgIndex]);
+			}
+			for (uint32_t I = 0; I < 3; I++)
+			{
+				CommandLine->Camera.Target[I] = (float)atof(Args[++ArgIndex]);
+			}
+			CommandLine->Camera.Override = true;
+		}
+		else if ((strcmp(Arg, "-fov") == 0) && (Remaining >= 1))
+		{
+			CommandLine->Camera.FieldOfView = (float)atof(Args[++ArgIndex]);
+			CommandLine->Camera.Override = true;
+		}
+		else
+		{
+			printf("Unknown or incomplete argument: %s\n", Arg);
+			return(false);
+		}
+	}
+
+	if (!SizeGiven)
+	{
+		CommandLine->Width = CommandLine->ThumbnailSource ? 256 : 900;
+		CommandLine->Height = CommandLine->ThumbnailSource ? 256 : 540;
+	}
+
+	bool BadSize = (CommandLine->Width == 0) || (CommandLine->Height == 0) || (CommandLine->Width > 0xFFFF) || (CommandLine->Height > 0xFFFF);
+	if (CommandLine->Headless &&
+		(!CommandLine->ModelPath || !CommandLine->OutputPath || BadSize))
+	{
+		printf("Usage: ModelViewer -headless -model <path> -output <image.tga> [-size <width> <height>] "
+			"[-camera <x> <y> <z> <target x> <target y> <target z>] [-fov <degrees>]\n");
+		return(false);
+	}
+
+	if (CommandLine->ThumbnailSource &&
+		(CommandLine->Headless || !CommandLine->OutputPath || BadSize))
+	{
+		printf("Usage: ModelViewer -thumbnails <directory or list file> -output <directory> [-size <width> <height>] "
+			"[-camera <x> <y> <z> <target x> <target y> <target z>] [-fov <degrees>]\n");
+		return(false);
+	}
+
+	if (CommandLine->BenchmarkSource &&
+		(CommandLine->Headless || CommandLine->ThumbnailSource || (CommandLine->RunCount == 0) || (CommandLine->RegressionThreshold < 0.0f)))
+	{
+		printf("Usage: ModelViewer -benchmark <directory or list file> [-runs <count>] [-json <path>] [-baseline <path>] "
+			"[-threshold <percent>]\n");
+		return(false);
+	}
+
+	if (CommandLine->ArrayBenchmark &&
+		(CommandLine->Headless || CommandLine->ThumbnailSource || CommandLine->BenchmarkSource || (CommandLine->RunCount == 0)))
+	{
+		printf("Usage: ModelViewer -array_benchmark [-runs <count>]\n");
+		return(false);
+	}
+
+	if (CommandLine->MathBenchmark &&
+		(CommandLine->Headless || CommandLine->ThumbnailSource || CommandLine->BenchmarkSource || CommandLine->ArrayBenchmark ||
+		 (CommandLine->RunCount == 0)))
+	{
+		printf("Usage: ModelViewer -math_benchmark [-runs <count>]\n");
+		return(false);
+	}
+
+	return(true);
+}
+
+// NOTE(georgy): The same state the window gets, with either context
+static void
+InitializeGLState(uint32_t Width, uint32_t Height)
+{
+	glViewport(0, 0, Width, Height);
+	glEnable(GL_MULTISAMPLE);
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_CULL_FACE);
+	// glEnable(GL_FRAMEBUFFER_SRGB);
+
+	glClearColor(0.7f, 0.7f, 0.7f, 1.0f);
+}
+
+#if defined(MODEL_VIEWER_EGL)
+// NOTE(georgy): Surfaceless, so Mesa's llvmpipe works without any display server
+static bool
+CreateHeadlessContext(void)
+{
+	PFNEGLGETPLATFORMDISPLAYEXTPROC GetPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	EGLDisplay Display = GetPlatformDisplay ? GetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0) : eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if ((Display == EGL_NO_DISPLAY) || !eglInitialize(Display, 0, 0))
+	{
+		printf("EGL: no display\n");
+		return(false);
+	}
+
+	EGLint ConfigAttributes[] =
+	{
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	EGLConfig Config;
+	EGLint ConfigCount = 0;
+	if (!eglChooseConfig(Display, ConfigAttributes, &Config, 1, &ConfigCount) || (ConfigCount == 0) || !eglBindAPI(EGL_OPENGL_API))
+	{
+		printf("EGL: no desktop GL config\n");
+		return(false);
+	}
+
+	EGLint ContextAttributes[] =
+	{
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLContext Context = eglCreateContext(Display, Config, EGL_NO_CONTEXT, ContextAttributes);
+	if ((Context == EGL_NO_CONTEXT) || !eglMakeCurrent(Display, EGL_NO_SURFACE, EGL_NO_SURFACE, Context))
+	{
+		printf("EGL: can't create a 3.3 core context\n");
+		return(false);
+	}
+
+	return(true);
+}
+#else
+// NOTE(georgy): An invisible window only to own the context, nothing is drawn to it
+static bool
+CreateHeadlessContext(void)
 {
+	glfwInit();
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+	GLFWwindow* Window = glfwCreateWindow(1, 1, "ModelViewer", 0, 0);
+	if (!Window)
+	{
+		printf("Can't create a GL context\n");
+		return(false);
+	}
+	glfwMakeContextCurrent(Window);
+
+	return(true);
+}
+#endif
+
+// NOTE(georgy): One frame into a multisampled FBO like the window's, resolved and read back. Returns the exit code.
+static int
+RenderHeadless(game_memory* Memory, command_line* CommandLine)
+{
+	if (!CreateHeadlessContext())
+	{
+		return(1);
+	}
+
+	GLenum GlewResult = glewInit();
+#if defined(MODEL_VIEWER_EGL)
+	// NOTE(georgy): A GLEW built for GLX loads the GL entry points first and only then fails to find an X display
+	if (GlewResult == GLEW_ERROR_NO_GLX_DISPLAY)
+	{
+		GlewResult = GLEW_OK;
+	}
+#endif
+	if (GlewResult != GLEW_OK)
+	{
+		printf("GLEW: %s\n", glewGetErrorString(GlewResult));
+		return(1);
+	}
+
+	uint32_t Width = CommandLine->Width;
+	uint32_t Height = CommandLine->Height;
+
+	GLuint Renderbuffers[3];
+	glGenRenderbuffers(ArrayCount(Renderbuffers), Renderbuffers);
+	glBindRenderbuffer(GL_RENDERBUFFER, Renderbuffers[0]);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, 4, GL_RGBA8, Width, Height);
+	glBindRenderbuffer(GL_RENDERBUFFER, Renderbuffers[1]);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, 4, GL_DEPTH24_STENCIL8, Width, Height);
+	glBindRenderbuffer(GL_RENDERBUFFER, Renderbuffers[2]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, Width, Height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	GLuint Framebuffers[2];
+	glGenFramebuffers(ArrayCount(Framebuffers), Framebuffers);
+	glBindFramebuffer(GL_FRAMEBUFFER, Framebuffers[1]);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, Renderbuffers[2]);
+	glBindFramebuffer(GL_FRAMEBUFFER, Framebuffers[0]);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, Renderbuffers[0]);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, Renderbuffers[1]);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		printf("Offscreen framebuffer is incomplete\n");
+		return(1);
+	}
+
+	InitializeGLState(Width, Height);
+
+	Memory->ModelFilePath = CommandLine->ModelPath;
+	Memory->Camera = CommandLine->Camera;
+	game_input GameInput = {};
+	UpdateAndRender(Memory, &GameInput, Width, Height);
+	if (!Memory->ModelLoaded)
+	{
+		return(1);
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, Framebuffers[0]);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, Framebuffers[1]);
+	glBlitFramebuffer(0, 0, Width, Height, 0, 0, Width, Height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+	MEMORY_TAG(MemoryTag_Render);
+	uint8_t* Pixels = (uint8_t*)MemoryAlloc(4 * (size_t)Width * Height);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, Framebuffers[1]);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, Width, Height, GL_BGRA, GL_UNSIGNED_BYTE, Pixels);
+
+	int Result = 0;
+	if (WriteTGA(CommandLine->OutputPath, Width, Height, Pixels, false))
+	{
+		printf("Wrote %ux%u image to %s\n", Width, Height, CommandLine->OutputPath);
+	}
+	else
+	{
+		printf("Failed to write %s\n", CommandLine->OutputPath);
+		Result = 1;
+	}
+	MemoryFree(Pixels);
+
+	return(Result);
+}
+
+static void
+AddPath(dynamic_array<char*>* Paths, const char* Path)
+{
+	size_t Length = strlen(Path);
+	char* Copy = (char*)MemoryAlloc(Length + 1);
+	memcpy(Copy, Path, Length + 1);
+	PushEntry(Paths, Copy);
+}
+
+static int
+ComparePaths(const void* A, const void* B)
+{
+	int Result = strcmp(*(char**)A, *(char**)B);
+
+	return(Result);
+}
+
+static void ListFilesRecursive(const char* Directory, dynamic_array<char*>* Paths);
+
+static void
+AddDirectoryEntry(const char* Directory, const char* Name, dynamic_array<char*>* Paths)
+{
+	if ((strcmp(Name, ".") == 0) || (strcmp(Name, "..") == 0))
+	{
+		return;
+	}
+
+	char Path[MAX_PATH];
+	if (snprintf(Path, sizeof(Path), "%s/%s", Directory, Name) >= (int)sizeof(Path))
+	{
+		printf("Path too long, skipped: %s/%s\n", Directory, Name);
+		return;
+	}
+
+	struct stat Stat;
+	if (stat(Path, &Stat) == 0)
+	{
+		if (Stat.st_mode & S_IFDIR)
+		{
+			ListFilesRecursive(Path, Paths);
+		}
+		else
+		{
+			AddPath(Paths, Path);
+		}
+	}
+}
+
+// NOTE(georgy): Every file under Directory, subdirectories included
+static void
+ListFilesRecursive(const char* Directory, dynamic_array<char*>* Paths)
+{
+#if defined(_WIN32)
+	char Pattern[MAX_PATH];
+	snprintf(Pattern, sizeof(Pattern), "%s/*", Directory);
+	_finddata_t FindData;
+	intptr_t Find = _findfirst(Pattern, &FindData);
+	if (Find != -1)
+	{
+		do
+		{
+			AddDirectoryEntry(Directory, FindData.name, Paths);
+		} while (_findnext(Find, &FindData) == 0);
+		_findclose(Find);
+	}
+#else
+	DIR* Dir = opendir(Directory);
+	if (Dir)
+	{
+		while (dirent* Entry = readdir(Dir))
+		{
+			AddDirectoryEntry(Directory, Entry->d_name, Paths);
+		}
+		closedir(Dir);
+	}
+#endif
+}
+
+// NOTE(georgy): A directory is walked and sorted, so the order doesn't depend on the file system.
+// Anything else is read as a list with one path per line, in its own order.
+static void
+CollectModelFiles(const char* Source, dynamic_array<char*>* Paths)
+{
+	struct stat Stat;
+	if ((stat(Source, &Stat) == 0) && (Stat.st_mode & S_IFDIR))
+	{
+		ListFilesRecursive(Source, Paths);
+		qsort(Paths->Entries, Paths->EntriesCount, sizeof(char*), ComparePaths);
+	}
+	else
+	{
+		FILE* File = fopen(Source, "r");
+		if (!File)
+		{
+			printf("Can't open %s\n", Source);
+			return;
+		}
+
+		char Line[MAX_PATH + 2];
+		while (fgets(Line, sizeof(Line), File))
+		{
+			size_t Length = strlen(Line);
+			while ((Length > 0) && ((Line[Length - 1] == '\n') || (Line[Length - 1] == '\r') || (Line[Length - 1] == ' ')))
+			{
+				Line[--Length] = 0;
+			}
+			char* Start = Line;
+			while (*Start == ' ')
+			{
+				Start++;
+			}
+			if (*Start)
+			{
+				AddPath(Paths, Start);
+			}
+		}
+		fclose(File);
+	}
+}
+
+static void
+FreePaths(dynamic_array<char*>* Paths)
+{
+	for (uint32_t PathIndex = 0; PathIndex < Paths->EntriesCount; PathIndex++)
+	{
+		MemoryFree((*Paths)[PathIndex]);
+	}
+	FreeDynamicArray(Paths);
+}
+
+// NOTE(georgy): The storage is only reserved. The OS gives a page physical memory the first time it's touched and
+// hands it out zeroed, so nothing has to be cleared and startup doesn't depend on the size. HugePages asks for
+// transparent huge pages on the permanent block, where the game state lives. Windows only gets those with
+// SeLockMemoryPrivilege and commits them up front, so there it's ignored.
+static bool
+ReserveGameStorage(game_memory* Memory, bool HugePages)
+{
+	double StartTime = GetWallClockSeconds();
+
+	uint64_t TotalSize = Memory->PermanentStorageSize + Memory->TemporaryStorageSize;
+#if defined(_WIN32)
+	// NOTE(georgy): MEM_COMMIT only charges the commit limit here, the pages themselves come on first touch
+	void* Base = VirtualAlloc(0, (SIZE_T)TotalSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+	void* Base = mmap(0, TotalSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (Base == MAP_FAILED)
+	{
+		Base = 0;
+	}
+#if defined(MADV_HUGEPAGE)
+	if (Base && HugePages && (madvise(Base, Memory->PermanentStorageSize, MADV_HUGEPAGE) != 0))
+	{
+		printf("Transparent huge pages aren't available, using regular pages\n");
+	}
+#endif
+#endif
+	if (!Base)
+	{
+		return(false);
+	}
+
+	Memory->PermanentStorage = Base;
+	Memory->TemporaryStorage = (uint8_t*)Base + Memory->PermanentStorageSize;
+
+	double EndTime = GetWallClockSeconds();
+	platform_process_stats Process;
+	GetProcessStats(&Process, false);
+	printf("Game storage: %llu MB reserved in %.3f ms, %.1f MB resident\n", (unsigned long long)(TotalSize / Megabytes(1)),
+		1000.0 * (EndTime - StartTime), (double)Process.ResidentBytes / (double)Megabytes(1));
+
+	return(true);
+}
+
+// NOTE(georgy): Returns the exit code, which is 1 if any model failed
+static int
+RenderThumbnailBatch(game_memory* Memory, command_line* CommandLine)
+{
+	dynamic_array<char*> Paths;
+	CollectModelFiles(CommandLine->ThumbnailSource, &Paths);
+	if (Paths.EntriesCount == 0)
+	{
+		printf("No files in %s\n", CommandLine->ThumbnailSource);
+		return(1);
+	}
+
+	Memory->Camera = CommandLine->Camera;
+	uint32_t FailedCount = RenderThumbnails(Memory, Paths.EntriesCount, (const char**)Paths.Entries, CommandLine->OutputPath,
+		CommandLine->Width, CommandLine->Height);
+	FreePaths(&Paths);
+
+	return((FailedCount == 0) ? 0 : 1);
+}
+
+// NOTE(georgy): The upload stage needs a context, the same one headless rendering uses. Returns the exit code,
+// which is 1 if a load failed or a stage regressed against the baseline.
+static int
+RunLoadBenchmark(game_memory* Memory, command_line* CommandLine)
+{
+	if (!CreateHeadlessContext())
+	{
+		return(1);
+	}
+
+	GLenum GlewResult = glewInit();
+#if defined(MODEL_VIEWER_EGL)
+	// NOTE(georgy): A GLEW built for GLX loads the GL entry points first and only then fails to find an X display
+	if (GlewResult == GLEW_ERROR_NO_GLX_DISPLAY)
+	{
+		GlewResult = GLEW_OK;
+	}
+#endif
+	if (GlewResult != GLEW_OK)
+	{
+		printf("GLEW: %s\n", glewGetErrorString(GlewResult));
+		return(1);
+	}
+
+	dynamic_array<char*> Paths;
+	CollectModelFiles(CommandLine->BenchmarkSource, &Paths);
+	if (Paths.EntriesCount == 0)
+	{
+		printf("No files in %s\n", CommandLine->BenchmarkSource);
+		return(1);
+	}
+
+	bool Passed = BenchmarkModelLoads(Memory, Paths.EntriesCount, (const char**)Paths.Entries, CommandLine->RunCount,
+		CommandLine->JSONPath, CommandLine->BaselinePath, CommandLine->RegressionThreshold);
+	FreePaths(&Paths);
+
+	return(Passed ? 0 : 1);
+}
+
+int main(int ArgCount, char** Args)
+{
+	command_line CommandLine;
+	if (!ParseCommandLine(ArgCount, Args, &CommandLine))
+	{
+		return(1);
+	}
+
+	if (CommandLine.ArrayBenchmark)
+	{
+		RunArrayBenchmark(CommandLine.RunCount);
+		return(0);
+	}
+
+	if (CommandLine.MathBenchmark)
+	{
+		BenchmarkMath(CommandLine.RunCount);
+		return(0);
+	}
+
+	game_memory GameMemory = {};
+	GameMemory.PermanentStorageSize = Megabytes(256);
+	GameMemory.TemporaryStorageSize = Gigabytes(3);
+	if (!ReserveGameStorage(&GameMemory, CommandLine.HugePages))
+	{
+		printf("Can't reserve %llu MB of game storage\n",
+			(unsigned long long)((GameMemory.PermanentStorageSize + GameMemory.TemporaryStorageSize) / Megabytes(1)));
+		return(1);
+	}
+
+	uint32_t CoreCount = std::thread::hardware_concurrency();
+	uint32_t WorkerThreadCount = (CoreCount > 1) ? (CoreCount - 1) : 1;
+	for (uint32_t ThreadIndex = 0; ThreadIndex < WorkerThreadCount; ThreadIndex++)
+	{
+		std::thread(WorkerThreadProc, &WorkQueue).detach();
+	}
+	GameMemory.WorkQueue = &WorkQueue;
+	GameMemory.WorkerThreadCount = WorkerThreadCount;
+	GameMemory.PlatformAddEntry = AddEntry;
+	GameMemory.PlatformCompleteAllWork = CompleteAllWork;
+	GameMemory.PlatformGetProcessStats = GetProcessStats;
+
+	if (CommandLine.Headless || CommandLine.ThumbnailSource || CommandLine.BenchmarkSource)
+	{
+		int Result;
+		if (CommandLine.Headless)
+		{
+			Result = RenderHeadless(&GameMemory, &CommandLine);
+		}
+		else if (CommandLine.ThumbnailSource)
+		{
+			Result = RenderThumbnailBatch(&GameMemory, &CommandLine);
+		}
+		else
+		{
+			Result = RunLoadBenchmark(&GameMemory, &CommandLine);
+		}
+		PrintMemoryReport();
+
+		return(Result);
+	}
+
+	GameMemory.ModelFilePath = CommandLine.ModelPath;
+	GameMemory.Camera = CommandLine.Camera;
+
+	// NOTE(georgy): Big enough to not want it on the stack, and the workers may still write to it at exit
+	static profiler Profiler;
+	InitializeProfiler(&Profiler);
+	GameMemory.Profiler = &Profiler;
+
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -127,52 +1016,52 @@ int main()
 	glfwSetCursorPosCallback(Window, GLFWCursorPosCallback);
 	// glfwSetInputMode(Window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-	game_memory GameMemory = {};
-	GameMemory.PermanentStorageSize = Megabytes(256);
-	GameMemory.TemporaryStorageSize = Gigabytes(3);
-	GameMemory.PermanentStorage = malloc(GameMemory.PermanentStorageSize + GameMemory.TemporaryStorageSize);
-	GameMemory.TemporaryStorage = (uint8_t*)GameMemory.PermanentStorage + GameMemory.PermanentStorageSize;
-
-	if (GameMemory.TemporaryStorage)
-	{
-		memset(GameMemory.PermanentStorage, 0, GameMemory.PermanentStorageSize + GameMemory.TemporaryStorageSize);
-
-		game_input GameInput = {};
-		GLFWmonitor* Monitor = glfwGetPrimaryMonitor();
-		const GLFWvidmode* VidMode = glfwGetVideoMode(Monitor);
-		int32_t GameUpdateHz = VidMode->refreshRate;
-		float TargetSecondsPerFrame = 1.0f / GameUpdateHz;
-		GameInput.dt = TargetSecondsPerFrame;
-		glfwSetWindowUserPointer(Window, &GameInput);
+	game_input GameInput = {};
+	GLFWmonitor* Monitor = glfwGetPrimaryMonitor();
+	const GLFWvidmode* VidMode = glfwGetVideoMode(Monitor);
+	int32_t GameUpdateHz = VidMode->refreshRate;
+	float TargetSecondsPerFrame = 1.0f / GameUpdateHz;
+	GameInput.dt = TargetSecondsPerFrame;
+	glfwSetWindowUserPointer(Window, &GameInput);
 
-		glewInit();
+	glewInit();
 
-		glViewport(0, 0, 900, 540);
-		glEnable(GL_MULTISAMPLE);
-		glEnable(GL_DEPTH_TEST);
-		glEnable(GL_CULL_FACE);
-		// glEnable(GL_FRAMEBUFFER_SRGB);
+	InitializeGLState(900, 540);
+	EnableProfilerGPU(&Profiler);
 
-		glClearColor(0.7f, 0.7f, 0.7f, 1.0f);
+	while (!glfwWindowShouldClose(Window))
+	{
+		PROFILE_ZONE("Frame");
 
-		while (!glfwWindowShouldClose(Window))
+		GameInput.MouseDeltaX = GameInput.MouseDeltaY = 0.0f;
+		GameInput.MouseLeft.HalfTransitionCount = GameInput.MouseRight.HalfTransitionCount = 0;
+		for (uint32_t ButtonIndex = 0;
+			ButtonIndex < ArrayCount(GameInput.Buttons);
+			ButtonIndex++)
 		{
-			GameInput.MouseDeltaX = GameInput.MouseDeltaY = 0.0f;
-			GameInput.MouseLeft.HalfTransitionCount = GameInput.MouseRight.HalfTransitionCount = 0;
-			for (uint32_t ButtonIndex = 0;
-				ButtonIndex < ArrayCount(GameInput.Buttons);
-				ButtonIndex++)
-			{
-				GameInput.Buttons[ButtonIndex].HalfTransitionCount = 0;
-			}
+			GameInput.Buttons[ButtonIndex].HalfTransitionCount = 0;
+		}
 
+		{
+			PROFILE_ZONE("Poll events");
 			glfwPollEvents();
+		}
+		if (WasDown(&GameInput.P))
+		{
+			ToggleProfilerCapture(&Profiler);
+		}
 
-			UpdateAndRender(&GameMemory, &GameInput, 900, 540);
+		UpdateAndRender(&GameMemory, &GameInput, 900, 540);
 
+		{
+			PROFILE_ZONE("Swap");
 			glfwSwapBuffers(Window);
 		}
+
+		CollectProfilerFrame(&Profiler);
 	}
 
+	PrintMemoryReport();
+
 	return(0);
-}
\ No newline at end of file
+}
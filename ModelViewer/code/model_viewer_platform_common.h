@@ -1,14 +1,20 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
 
 #define Assert(Expression) if(!(Expression)) { *(int *)0 = 0; }
 #define ArrayCount(Array) (sizeof(Array)/sizeof((Array)[0]))
+#define OffsetOf(Type, Member) ((size_t)&(((Type*)0)->Member))
 
 #define Kilobytes(Value) (1024LL*(Value))
 #define Megabytes(Value) (1024LL*Kilobytes(Value))
 #define Gigabytes(Value) (1024LL*Megabytes(Value))
 
+#define MAX_PATH 260
+
 struct button
 {
 	bool EndedDown;
@@ -29,8 +35,13 @@ struct game_input
 			button S;
 			button D;
 			button A;
+			button C;
+			button B;
+			button R;
+			button P;
+			button M;
 		};
-		button Buttons[4];
+		button Buttons[9];
 	};
 };
 
@@ -43,6 +54,88 @@ WasDown(button* Button)
 	return(Result);
 }
 
+// NOTE(georgy): 64-bit FNV-1a over 8-byte words, the tail is hashed bytewise. Not cryptographic, only for change detection.
+static uint64_t
+HashBytes(const void* Data, uint64_t Size, uint64_t Hash = 14695981039346656037ull)
+{
+	const uint8_t* At = (const uint8_t*)Data;
+	for (; Size >= 8; Size -= 8, At += 8)
+	{
+		uint64_t Word;
+		memcpy(&Word, At, sizeof(Word));
+		Hash = (Hash ^ Word) * 1099511628211ull;
+	}
+	for (; Size > 0; Size--, At++)
+	{
+		Hash = (Hash ^ *At) * 1099511628211ull;
+	}
+
+	return(Hash);
+}
+
+inline double
+GetWallClockSeconds(void)
+{
+	double Result = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+	return(Result);
+}
+
+// NOTE(georgy): Uncompressed 32-bit TGA. glReadPixels gives the bottom row first, which is where TGA starts by default.
+static bool
+WriteTGA(const char* Path, uint32_t Width, uint32_t Height, uint8_t* BGRAPixels, bool TopRowFirst)
+{
+	FILE* File = fopen(Path, "wb");
+	if (!File)
+	{
+		return(false);
+	}
+
+	uint8_t Header[18] = {};
+	Header[2] = 2; // NOTE(georgy): Uncompressed true color
+	Header[12] = (uint8_t)(Width & 0xFF); Header[13] = (uint8_t)(Width >> 8);
+	Header[14] = (uint8_t)(Height & 0xFF); Header[15] = (uint8_t)(Height >> 8);
+	Header[16] = 32;
+	Header[17] = 8 | (TopRowFirst ? 0x20 : 0); // NOTE(georgy): 8 alpha bits
+	bool Result = (fwrite(Header, sizeof(Header), 1, File) == 1) &&
+				  (fwrite(BGRAPixels, 4 * (size_t)Width * Height, 1, File) == 1);
+	fclose(File);
+
+	return(Result);
+}
+
+// NOTE(georgy): Work queue. The platform runs a worker thread per extra core, entries go to whichever thread is free.
+// Only the main thread adds entries and waits for them.
+struct platform_work_queue;
+#define PLATFORM_WORK_QUEUE_CALLBACK(name) void name(platform_work_queue* Queue, void* Data)
+typedef PLATFORM_WORK_QUEUE_CALLBACK(platform_work_queue_callback);
+
+typedef void platform_add_entry(platform_work_queue* Queue, platform_work_queue_callback* Callback, void* Data);
+typedef void platform_complete_all_work(platform_work_queue* Queue);
+
+// NOTE(georgy): CPU time is over all threads of the process. Where the platform can reset the peak resident size
+// (Linux), it is the peak since the last reset, elsewhere the peak since the process started. Resident is 0 where
+// the platform doesn't tell.
+struct platform_process_stats
+{
+	double CPUSeconds;
+	uint64_t ResidentBytes;
+	uint64_t PeakResidentBytes;
+};
+typedef void platform_get_process_stats(platform_process_stats* Stats, bool ResetPeak);
+
+// NOTE(georgy): See model_viewer_profiler.h
+struct profiler;
+
+// NOTE(georgy): In the viewer's own space, where the model is centered on the origin and 0.6 units high
+struct game_camera
+{
+	bool Override;
+	float Position[3];
+	float Target[3];
+	float FieldOfView; // NOTE(georgy): Vertical, in degrees
+};
+
 struct game_memory
 {
 	uint64_t PermanentStorageSize;
@@ -50,6 +143,44 @@ struct game_memory
 
 	uint64_t TemporaryStorageSize;
 	void* TemporaryStorage;
+
+	platform_work_queue* WorkQueue;
+	uint32_t WorkerThreadCount;
+	platform_add_entry* PlatformAddEntry;
+	platform_complete_all_work* PlatformCompleteAllWork;
+	platform_get_process_stats* PlatformGetProcessStats;
+	// NOTE(georgy): 0 when nothing collects the zones, outside the window
+	profiler* Profiler;
+
+	// NOTE(georgy): Startup options from the platform. Without a model path the file dialog asks for one.
+	const char* ModelFilePath;
+	game_camera Camera;
+
+	// NOTE(georgy): Set by the game after the first frame
+	bool ModelLoaded;
+};
+
+// NOTE(georgy): What is under a pixel of the last frame. Barycentrics are per vertex of the triangle,
+// the position is in the model file's own coordinates.
+struct pick_result
+{
+	bool Hit;
+	uint32_t MeshIndex;
+	uint32_t TriangleIndex;
+	float Barycentrics[3];
+	float Position[3];
+	double Milliseconds;
 };
 
-void UpdateAndRender(game_memory* Memory, game_input* Input, uint32_t BufferWidth, uint32_t BufferHeight);
\ No newline at end of file
+void UpdateAndRender(game_memory* Memory, game_input* Input, uint32_t BufferWidth, uint32_t BufferHeight);
+// NOTE(georgy): Also for anything driving the viewer from outside, not only the mouse
+bool PickAtPixel(game_memory* Memory, int32_t X, int32_t Y, uint32_t BufferWidth, uint32_t BufferHeight, pick_result* Result);
+// NOTE(georgy): Software rendered on the work queue, no GL context needed. Returns how many models failed.
+uint32_t RenderThumbnails(game_memory* Memory, uint32_t ModelCount, const char** ModelPaths, const char* OutputDirectory,
+						  uint32_t Width, uint32_t Height);
+// NOTE(georgy): Loads every model RunCount times with a breakdown per load stage. Needs a current GL context.
+// Returns false if a load failed or a stage regressed against the baseline by more than RegressionThreshold (0.1 is 10%).
+bool BenchmarkModelLoads(game_memory* Memory, uint32_t ModelCount, const char** ModelPaths, uint32_t RunCount,
+						 const char* JSONPath, const char* BaselinePath, float RegressionThreshold);
+// NOTE(georgy): The SIMD math against its scalar fallback, printed
+void BenchmarkMath(uint32_t RunCount);
\ No newline at end of file
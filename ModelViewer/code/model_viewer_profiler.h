@@ -0,0 +1,600 @@
+#pragma once
+
+// NOTE(georgy): Frame profiler.
+// CPU zones are timed with the TSC and written on scope exit into a ring owned by the thread, with no locks: the thread
+// is the only writer, the main thread the only reader. GPU zones are a pair of GL_TIMESTAMP queries, read back
+// PROFILER_GPU_FRAMES frames later when they are long done, so reading them never waits on the GPU.
+// Once a frame the platform collects everything into the rolling per-zone statistics and, while capturing, into a
+// Chrome trace (chrome://tracing or ui.perfetto.dev).
+// Counters are per-frame numbers (draw calls, culled meshes, ...) set from the main thread, they go into the same
+// rolling history and show up in the summary instead of being printed every frame.
+//
+// The platform owns the profiler and hands it over through game_memory. Every translation unit keeps its own
+// GlobalProfiler pointer, 0 means zones cost a branch and nothing else.
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#define PROFILER_MAX_THREADS 64
+#define PROFILER_RING_SIZE 16384 // NOTE(georgy): Power of two
+#define PROFILER_MAX_ZONES 256
+#define PROFILER_HISTORY_FRAMES 64
+#define PROFILER_GPU_FRAMES 4
+#define PROFILER_MAX_GPU_ZONES 64
+#define PROFILER_MAX_COUNTERS 32
+#define PROFILER_MAX_CAPTURE_EVENTS (1 << 21)
+#define PROFILER_TRACE_PATH "profile_trace.json"
+
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+#define PROFILER_TSC 1
+#else
+#define PROFILER_TSC 0
+#endif
+
+inline uint64_t
+ReadProfilerTicks(void)
+{
+#if PROFILER_TSC
+	uint64_t Result = __rdtsc();
+#else
+	uint64_t Result = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+
+	return(Result);
+}
+
+struct profiler_event
+{
+	const char* Name;
+	uint64_t Begin;
+	uint64_t End;
+};
+
+struct profiler_ring
+{
+	std::atomic<uint32_t> WriteIndex;
+	std::atomic<uint32_t> ReadIndex;
+	std::atomic<uint32_t> DroppedCount;
+
+	std::thread::id Owner;
+	char Name[32];
+	profiler_event Events[PROFILER_RING_SIZE];
+};
+
+struct profiler_zone_stats
+{
+	const char* Name;
+	uint64_t Key;
+	bool IsGPU;
+
+	double FrameSeconds;
+	uint32_t FrameCalls;
+
+	double Seconds[PROFILER_HISTORY_FRAMES];
+	uint32_t Calls[PROFILER_HISTORY_FRAMES];
+};
+
+struct profiler_counter
+{
+	const char* Name;
+	uint32_t FrameValue;
+	uint32_t Values[PROFILER_HISTORY_FRAMES];
+};
+
+struct profiler_capture_event
+{
+	const char* Name;
+	uint64_t Begin;
+	uint64_t End;
+	uint32_t Thread;
+};
+
+struct profiler_gpu_frame
+{
+	uint32_t ZoneCount;
+	const char* Names[PROFILER_MAX_GPU_ZONES];
+	GLuint Queries[2 * PROFILER_MAX_GPU_ZONES];
+};
+
+struct profiler
+{
+	std::mutex RegisterMutex;
+	std::atomic<uint32_t> ThreadCount;
+	profiler_ring Rings[PROFILER_MAX_THREADS];
+
+	uint64_t StartTicks;
+	double StartSeconds;
+	double TicksPerSecond;
+
+	// NOTE(georgy): Open addressing on the name, so the same zone name from two translation units is one zone
+	profiler_zone_stats Zones[PROFILER_MAX_ZONES];
+	uint32_t ZoneCount;
+	uint32_t FrameIndex;
+
+	profiler_counter Counters[PROFILER_MAX_COUNTERS];
+	uint32_t CounterCount;
+
+	bool Capturing;
+	dynamic_array<profiler_capture_event> Capture;
+
+	bool GPUEnabled;
+	uint32_t GPUFrame;
+	uint32_t GPUDroppedFrames;
+	int64_t GPUSyncTime;
+	uint64_t GPUSyncTicks;
+	profiler_gpu_frame GPUFrames[PROFILER_GPU_FRAMES];
+};
+
+static profiler* GlobalProfiler;
+static thread_local profiler_ring* ProfilerThreadRing;
+
+// NOTE(georgy): Each translation unit has its own thread_local, so a thread that already has a ring from another one
+// is found by its id. Only the first zone of a thread in a translation unit gets here.
+static profiler_ring*
+RegisterProfilerThread(profiler* Profiler)
+{
+	std::lock_guard<std::mutex> Lock(Profiler->RegisterMutex);
+
+	std::thread::id Self = std::this_thread::get_id();
+	uint32_t ThreadCount = Profiler->ThreadCount.load();
+	for (uint32_t ThreadIndex = 0; ThreadIndex < ThreadCount; ThreadIndex++)
+	{
+		if (Profiler->Rings[ThreadIndex].Owner == Self)
+		{
+			return(&Profiler->Rings[ThreadIndex]);
+		}
+	}
+
+	profiler_ring* Result = 0;
+	if (ThreadCount < PROFILER_MAX_THREADS)
+	{
+		Result = &Profiler->Rings[ThreadCount];
+		Result->Owner = Self;
+		snprintf(Result->Name, sizeof(Result->Name), (ThreadCount == 0) ? "Main" : "Worker %u", ThreadCount);
+		Profiler->ThreadCount.store(ThreadCount + 1);
+	}
+
+	return(Result);
+}
+
+struct profiler_zone
+{
+	profiler_ring* Ring;
+	const char* Name;
+	uint64_t Begin;
+
+	profiler_zone(const char* ZoneName)
+	{
+		Ring = 0;
+		if (GlobalProfiler)
+		{
+			if (!ProfilerThreadRing)
+			{
+				ProfilerThreadRing = RegisterProfilerThread(GlobalProfiler);
+			}
+			Ring = ProfilerThreadRing;
+			Name = ZoneName;
+			Begin = ReadProfilerTicks();
+		}
+	}
+
+	~profiler_zone()
+	{
+		if (Ring)
+		{
+			uint64_t End = ReadProfilerTicks();
+
+			// NOTE(georgy): A full ring drops the zone rather than overwrite what the reader hasn't seen
+			uint32_t Write = Ring->WriteIndex.load(std::memory_order_relaxed);
+			if (Write - Ring->ReadIndex.load(std::memory_order_acquire) < PROFILER_RING_SIZE)
+			{
+				profiler_event* Event = &Ring->Events[Write & (PROFILER_RING_SIZE - 1)];
+				Event->Name = Name;
+				Event->Begin = Begin;
+				Event->End = End;
+				Ring->WriteIndex.store(Write + 1, std::memory_order_release);
+			}
+			else
+			{
+				Ring->DroppedCount.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+	}
+};
+
+// NOTE(georgy): Main thread only, it has the GL context
+struct profiler_gpu_zone
+{
+	profiler_gpu_frame* Frame;
+	uint32_t Index;
+
+	profiler_gpu_zone(const char* ZoneName)
+	{
+		Frame = 0;
+		if (GlobalProfiler && GlobalProfiler->GPUEnabled)
+		{
+			profiler_gpu_frame* CurrentFrame = &GlobalProfiler->GPUFrames[GlobalProfiler->GPUFrame];
+			if (CurrentFrame->ZoneCount < PROFILER_MAX_GPU_ZONES)
+			{
+				Frame = CurrentFrame;
+				Index = Frame->ZoneCount++;
+				Frame->Names[Index] = ZoneName;
+				glQueryCounter(Frame->Queries[2 * Index], GL_TIMESTAMP);
+			}
+		}
+	}
+
+	~profiler_gpu_zone()
+	{
+		if (Frame)
+		{
+			glQueryCounter(Frame->Queries[2 * Index + 1], GL_TIMESTAMP);
+		}
+	}
+};
+
+#define PROFILE_ZONE_NAME__(Prefix, Line) Prefix##Line
+#define PROFILE_ZONE_NAME_(Prefix, Line) PROFILE_ZONE_NAME__(Prefix, Line)
+#define PROFILE_ZONE(Name) profiler_zone PROFILE_ZONE_NAME_(ProfilerZone, __LINE__)(Name)
+#define PROFILE_GPU_ZONE(Name) profiler_gpu_zone PROFILE_ZONE_NAME_(ProfilerGPUZone, __LINE__)(Name)
+
+// NOTE(georgy): Main thread only. The last value set in a frame is the one that frame keeps.
+// Names are compared by content, the same literal from two translation units is one counter.
+static void
+SetProfilerCounter(const char* Name, uint32_t Value)
+{
+	profiler* Profiler = GlobalProfiler;
+	if (!Profiler)
+	{
+		return;
+	}
+
+	for (uint32_t CounterIndex = 0; CounterIndex < Profiler->CounterCount; CounterIndex++)
+	{
+		profiler_counter* Counter = &Profiler->Counters[CounterIndex];
+		if (strcmp(Counter->Name, Name) == 0)
+		{
+			Counter->FrameValue = Value;
+			return;
+		}
+	}
+
+	if (Profiler->CounterCount < PROFILER_MAX_COUNTERS)
+	{
+		profiler_counter* Counter = &Profiler->Counters[Profiler->CounterCount++];
+		Counter->Name = Name;
+		Counter->FrameValue = Value;
+	}
+}
+
+#define PROFILE_COUNTER(Name, Value) SetProfilerCounter(Name, (uint32_t)(Value))
+
+// NOTE(georgy): On the main thread, it gets the first ring
+static void
+InitializeProfiler(profiler* Profiler)
+{
+	Profiler->StartTicks = ReadProfilerTicks();
+	Profiler->StartSeconds = GetWallClockSeconds();
+	Profiler->TicksPerSecond = PROFILER_TSC ? 0.0 : 1e9;
+	InitializeDynamicArray(&Profiler->Capture);
+
+	GlobalProfiler = Profiler;
+	ProfilerThreadRing = RegisterProfilerThread(Profiler);
+}
+
+// NOTE(georgy): Needs the GL context current
+static void
+EnableProfilerGPU(profiler* Profiler)
+{
+	for (uint32_t FrameIndex = 0; FrameIndex < PROFILER_GPU_FRAMES; FrameIndex++)
+	{
+		glGenQueries(ArrayCount(Profiler->GPUFrames[FrameIndex].Queries), Profiler->GPUFrames[FrameIndex].Queries);
+	}
+	Profiler->GPUEnabled = true;
+}
+
+inline double
+ProfilerTicksToSeconds(profiler* Profiler, uint64_t Ticks)
+{
+	double Result = (Profiler->TicksPerSecond > 0.0) ? (double)Ticks / Profiler->TicksPerSecond : 0.0;
+
+	return(Result);
+}
+
+static void
+AddProfilerEvent(profiler* Profiler, const char* Name, uint64_t Begin, uint64_t End, uint32_t Thread, bool IsGPU)
+{
+	uint64_t Key = HashBytes(Name, strlen(Name)) ^ (IsGPU ? 1 : 0);
+	uint32_t Slot = (uint32_t)(Key % PROFILER_MAX_ZONES);
+	for (uint32_t Probe = 0; Probe < PROFILER_MAX_ZONES; Probe++)
+	{
+		profiler_zone_stats* Zone = &Profiler->Zones[Slot];
+		if (!Zone->Name && (Profiler->ZoneCount < PROFILER_MAX_ZONES - 1))
+		{
+			Zone->Name = Name;
+			Zone->Key = Key;
+			Zone->IsGPU = IsGPU;
+			Profiler->ZoneCount++;
+		}
+
+		if (Zone->Name && (Zone->Key == Key))
+		{
+			Zone->FrameSeconds += ProfilerTicksToSeconds(Profiler, End - Begin);
+			Zone->FrameCalls++;
+			break;
+		}
+		Slot = (Slot + 1) % PROFILER_MAX_ZONES;
+	}
+
+	if (Profiler->Capturing && (Profiler->Capture.EntriesCount < PROFILER_MAX_CAPTURE_EVENTS))
+	{
+		profiler_capture_event Event;
+		Event.Name = Name;
+		Event.Begin = Begin;
+		Event.End = End;
+		Event.Thread = Thread;
+		PushEntry(&Profiler->Capture, Event);
+	}
+}
+
+// NOTE(georgy): The GPU clock is mapped onto the TSC through a pair of readings taken at the same moment every frame
+static void
+ResolveProfilerGPUFrame(profiler* Profiler)
+{
+	GLint64 GPUNow;
+	glGetInteger64v(GL_TIMESTAMP, &GPUNow);
+	Profiler->GPUSyncTime = GPUNow;
+	Profiler->GPUSyncTicks = ReadProfilerTicks();
+
+	Profiler->GPUFrame = (Profiler->GPUFrame + 1) % PROFILER_GPU_FRAMES;
+	profiler_gpu_frame* Frame = &Profiler->GPUFrames[Profiler->GPUFrame];
+	if (Frame->ZoneCount > 0)
+	{
+		// NOTE(georgy): Zones nest, so the last query issued isn't always the last one of the array
+		GLuint Available = 1;
+		for (uint32_t ZoneIndex = 0; Available && (ZoneIndex < Frame->ZoneCount); ZoneIndex++)
+		{
+			glGetQueryObjectuiv(Frame->Queries[2 * ZoneIndex + 1], GL_QUERY_RESULT_AVAILABLE, &Available);
+		}
+		if (Available)
+		{
+			for (uint32_t ZoneIndex = 0; ZoneIndex < Frame->ZoneCount; ZoneIndex++)
+			{
+				GLuint64 Times[2];
+				glGetQueryObjectui64v(Frame->Queries[2 * ZoneIndex], GL_QUERY_RESULT, &Times[0]);
+				glGetQueryObjectui64v(Frame->Queries[2 * ZoneIndex + 1], GL_QUERY_RESULT, &Times[1]);
+
+				uint64_t Ticks[2];
+				for (uint32_t I = 0; I < 2; I++)
+				{
+					double Seconds = 1e-9 * (double)((int64_t)Times[I] - Profiler->GPUSyncTime);
+					Ticks[I] = Profiler->GPUSyncTicks + (int64_t)(Seconds * Profiler->TicksPerSecond);
+				}
+				AddProfilerEvent(Profiler, Frame->Names[ZoneIndex], Ticks[0], Ticks[1], PROFILER_MAX_THREADS, true);
+			}
+		}
+		else
+		{
+			Profiler->GPUDroppedFrames++;
+		}
+	}
+	Frame->ZoneCount = 0;
+}
+
+static bool
+WriteChromeTrace(profiler* Profiler, const char* Path)
+{
+	FILE* File = fopen(Path, "w");
+	if (!File)
+	{
+		return(false);
+	}
+
+	fprintf(File, "{\"traceEvents\":[\n");
+	uint32_t ThreadCount = Profiler->ThreadCount.load();
+	for (uint32_t ThreadIndex = 0; ThreadIndex <= ThreadCount; ThreadIndex++)
+	{
+		uint32_t Thread = (ThreadIndex < ThreadCount) ? ThreadIndex : PROFILER_MAX_THREADS;
+		const char* Name = (ThreadIndex < ThreadCount) ? Profiler->Rings[ThreadIndex].Name : "GPU";
+		fprintf(File, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}},\n", Thread, Name);
+		fprintf(File, "{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"sort_index\":%u}},\n", Thread, Thread);
+	}
+
+	for (uint32_t EventIndex = 0; EventIndex < Profiler->Capture.EntriesCount; EventIndex++)
+	{
+		profiler_capture_event* Event = &Profiler->Capture[EventIndex];
+		double Start = 1e6 * ProfilerTicksToSeconds(Profiler, Event->Begin - Profiler->StartTicks);
+		double Duration = 1e6 * ProfilerTicksToSeconds(Profiler, Event->End - Event->Begin);
+		fprintf(File, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}%s\n",
+			Event->Name, Event->Thread, Start, Duration, (EventIndex + 1 < Profiler->Capture.EntriesCount) ? "," : "");
+	}
+	fprintf(File, "]}\n");
+
+	bool Result = (ferror(File) == 0);
+	fclose(File);
+
+	return(Result);
+}
+
+static int
+CompareZonesByTime(const void* A, const void* B)
+{
+	double TimeA = (*(profiler_zone_stats**)A)->FrameSeconds;
+	double TimeB = (*(profiler_zone_stats**)B)->FrameSeconds;
+	int Result = (TimeA > TimeB) ? -1 : ((TimeA < TimeB) ? 1 : 0);
+
+	return(Result);
+}
+
+// NOTE(georgy): Average and worst frame of every zone over the last PROFILER_HISTORY_FRAMES frames, slowest first,
+// then the counters over the same frames
+static void
+PrintProfilerSummary(profiler* Profiler)
+{
+	uint32_t FrameCount = (Profiler->FrameIndex < PROFILER_HISTORY_FRAMES) ? Profiler->FrameIndex : PROFILER_HISTORY_FRAMES;
+	if (FrameCount == 0)
+	{
+		return;
+	}
+
+	// NOTE(georgy): FrameSeconds is free between frames, it holds the average for sorting here
+	profiler_zone_stats* Sorted[PROFILER_MAX_ZONES];
+	uint32_t SortedCount = 0;
+	for (uint32_t Slot = 0; Slot < PROFILER_MAX_ZONES; Slot++)
+	{
+		profiler_zone_stats* Zone = &Profiler->Zones[Slot];
+		if (Zone->Name)
+		{
+			double Total = 0.0;
+			for (uint32_t Frame = 0; Frame < FrameCount; Frame++)
+			{
+				Total += Zone->Seconds[Frame];
+			}
+			Zone->FrameSeconds = Total / FrameCount;
+			Sorted[SortedCount++] = Zone;
+		}
+	}
+	qsort(Sorted, SortedCount, sizeof(profiler_zone_stats*), CompareZonesByTime);
+
+	printf("Profile over the last %u frames:\n", FrameCount);
+	printf("    %-32s %10s %10s %10s\n", "zone", "avg ms", "max ms", "calls");
+	for (uint32_t ZoneIndex = 0; ZoneIndex < SortedCount; ZoneIndex++)
+	{
+		profiler_zone_stats* Zone = Sorted[ZoneIndex];
+		double MaxSeconds = 0.0;
+		uint32_t Calls = 0;
+		for (uint32_t Frame = 0; Frame < FrameCount; Frame++)
+		{
+			if (Zone->Seconds[Frame] > MaxSeconds)
+			{
+				MaxSeconds = Zone->Seconds[Frame];
+			}
+			Calls += Zone->Calls[Frame];
+		}
+
+		char Name[48];
+		snprintf(Name, sizeof(Name), "%s%s", Zone->IsGPU ? "GPU " : "", Zone->Name);
+		printf("    %-32s %10.3f %10.3f %10.1f\n", Name, 1000.0 * Zone->FrameSeconds, 1000.0 * MaxSeconds, (double)Calls / FrameCount);
+		Zone->FrameSeconds = 0.0;
+	}
+
+	uint32_t DroppedCount = 0;
+	for (uint32_t ThreadIndex = 0; ThreadIndex < Profiler->ThreadCount.load(); ThreadIndex++)
+	{
+		DroppedCount += Profiler->Rings[ThreadIndex].DroppedCount.load();
+	}
+	if ((DroppedCount > 0) || (Profiler->GPUDroppedFrames > 0))
+	{
+		printf("    %u CPU zones dropped on full rings, %u GPU frames not ready in time\n", DroppedCount, Profiler->GPUDroppedFrames);
+	}
+
+	if (Profiler->CounterCount > 0)
+	{
+		printf("    %-32s %10s %10s %10s\n", "counter", "avg", "min", "max");
+	}
+	for (uint32_t CounterIndex = 0; CounterIndex < Profiler->CounterCount; CounterIndex++)
+	{
+		profiler_counter* Counter = &Profiler->Counters[CounterIndex];
+		uint64_t Total = 0;
+		uint32_t MinValue = Counter->Values[0], MaxValue = Counter->Values[0];
+		for (uint32_t Frame = 0; Frame < FrameCount; Frame++)
+		{
+			Total += Counter->Values[Frame];
+			MinValue = (Counter->Values[Frame] < MinValue) ? Counter->Values[Frame] : MinValue;
+			MaxValue = (Counter->Values[Frame] > MaxValue) ? Counter->Values[Frame] : MaxValue;
+		}
+		printf("    %-32s %10.1f %10u %10u\n", Counter->Name, (double)Total / FrameCount, MinValue, MaxValue);
+	}
+}
+
+// NOTE(georgy): Prints the summary either way. Stopping writes the trace.
+static void
+ToggleProfilerCapture(profiler* Profiler)
+{
+	if (!Profiler)
+	{
+		return;
+	}
+
+	PrintProfilerSummary(Profiler);
+	if (Profiler->Capturing)
+	{
+		Profiler->Capturing = false;
+		if (WriteChromeTrace(Profiler, PROFILER_TRACE_PATH))
+		{
+			printf("Trace of %u zones written to %s\n", Profiler->Capture.EntriesCount, PROFILER_TRACE_PATH);
+		}
+		else
+		{
+			printf("Failed to write %s\n", PROFILER_TRACE_PATH);
+		}
+		Profiler->Capture.EntriesCount = 0;
+	}
+	else
+	{
+		Profiler->Capturing = true;
+		printf("Capturing a trace, press P again to write it\n");
+	}
+}
+
+// NOTE(georgy): Once per frame on the main thread, after the swap. Zones that end while this runs go into the next frame.
+static void
+CollectProfilerFrame(profiler* Profiler)
+{
+#if PROFILER_TSC
+	double Seconds = GetWallClockSeconds() - Profiler->StartSeconds;
+	if (Seconds > 0.01)
+	{
+		Profiler->TicksPerSecond = (double)(ReadProfilerTicks() - Profiler->StartTicks) / Seconds;
+	}
+#endif
+
+	uint32_t ThreadCount = Profiler->ThreadCount.load();
+	for (uint32_t ThreadIndex = 0; ThreadIndex < ThreadCount; ThreadIndex++)
+	{
+		profiler_ring* Ring = &Profiler->Rings[ThreadIndex];
+		uint32_t Read = Ring->ReadIndex.load(std::memory_order_relaxed);
+		uint32_t Write = Ring->WriteIndex.load(std::memory_order_acquire);
+		for (; Read != Write; Read++)
+		{
+			profiler_event* Event = &Ring->Events[Read & (PROFILER_RING_SIZE - 1)];
+			AddProfilerEvent(Profiler, Event->Name, Event->Begin, Event->End, ThreadIndex, false);
+		}
+		Ring->ReadIndex.store(Read, std::memory_order_release);
+	}
+
+	if (Profiler->GPUEnabled)
+	{
+		ResolveProfilerGPUFrame(Profiler);
+	}
+
+	uint32_t HistoryIndex = Profiler->FrameIndex % PROFILER_HISTORY_FRAMES;
+	for (uint32_t Slot = 0; Slot < PROFILER_MAX_ZONES; Slot++)
+	{
+		profiler_zone_stats* Zone = &Profiler->Zones[Slot];
+		Zone->Seconds[HistoryIndex] = Zone->FrameSeconds;
+		Zone->Calls[HistoryIndex] = Zone->FrameCalls;
+		Zone->FrameSeconds = 0.0;
+		Zone->FrameCalls = 0;
+	}
+	for (uint32_t CounterIndex = 0; CounterIndex < Profiler->CounterCount; CounterIndex++)
+	{
+		profiler_counter* Counter = &Profiler->Counters[CounterIndex];
+		Counter->Values[HistoryIndex] = Counter->FrameValue;
+		Counter->FrameValue = 0;
+	}
+	Profiler->FrameIndex++;
+
+	if (Profiler->Capturing && (Profiler->Capture.EntriesCount >= PROFILER_MAX_CAPTURE_EVENTS))
+	{
+		printf("Trace buffer full\n");
+		ToggleProfilerCapture(Profiler);
+	}
+}
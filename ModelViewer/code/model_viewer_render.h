@@ -0,0 +1,194 @@
+#pragma once
+
+// NOTE(georgy): Draw submission.
+// Draws go into a list sorted by a packed key, most expensive state first: program, texture, vertex array, then depth
+// front to back. All binds while walking the list go through gl_state_cache, which only calls GL when the value changes
+// and counts what was actually issued.
+
+#define DRAW_KEY_PROGRAM_SHIFT 56
+#define DRAW_KEY_TEXTURE_SHIFT 40
+#define DRAW_KEY_VERTEX_ARRAY_SHIFT 32
+
+#define GL_STATE_CACHE_TEXTURE_UNITS 8
+#define GL_STATE_UNKNOWN 0xFFFFFFFF
+
+struct draw_command
+{
+	uint64_t SortKey;
+	uint32_t MeshIndex;
+};
+
+// NOTE(georgy): Layout fixed by GL for GL_DRAW_INDIRECT_BUFFER
+struct draw_elements_indirect_command
+{
+	uint32_t Count;
+	uint32_t InstanceCount;
+	uint32_t FirstIndex;
+	int32_t BaseVertex;
+	uint32_t BaseInstance;
+};
+
+// NOTE(georgy): Depth is a positive view distance, the bits of a positive float sort like the float itself
+inline uint64_t
+MakeDrawKey(uint32_t Program, uint32_t Texture, uint32_t VertexArray, float Depth)
+{
+	Depth = Max(Depth, 0.0f);
+	uint32_t DepthBits;
+	memcpy(&DepthBits, &Depth, sizeof(DepthBits));
+
+	uint64_t Result = ((uint64_t)(Program & 0xFF) << DRAW_KEY_PROGRAM_SHIFT) |
+					  ((uint64_t)(Texture & 0xFFFF) << DRAW_KEY_TEXTURE_SHIFT) |
+					  ((uint64_t)(VertexArray & 0xFF) << DRAW_KEY_VERTEX_ARRAY_SHIFT) |
+					  DepthBits;
+
+	return(Result);
+}
+
+// NOTE(georgy): Draws with the same state bits can go into one multi-draw
+inline uint64_t
+DrawKeyState(uint64_t SortKey)
+{
+	uint64_t Result = SortKey >> DRAW_KEY_VERTEX_ARRAY_SHIFT;
+	return(Result);
+}
+
+static int
+CompareDrawCommands(const void* A, const void* B)
+{
+	uint64_t KeyA = ((draw_command*)A)->SortKey;
+	uint64_t KeyB = ((draw_command*)B)->SortKey;
+	int Result = (KeyA < KeyB) ? -1 : ((KeyA > KeyB) ? 1 : 0);
+
+	return(Result);
+}
+
+inline void
+SortDrawCommands(dynamic_array<draw_command>* DrawList)
+{
+	qsort(DrawList->Entries, DrawList->EntriesCount, sizeof(draw_command), CompareDrawCommands);
+}
+
+struct render_stats
+{
+	uint32_t ProgramBinds;
+	uint32_t VertexArrayBinds;
+	uint32_t ActiveTextureSwitches;
+	uint32_t TextureBinds;
+	uint32_t SkippedBinds;
+	uint32_t DrawCalls;
+	uint32_t MeshDraws;
+
+	uint32_t VisibleMeshes;
+	uint32_t CulledMeshes;
+	uint32_t VisibleInstances;
+	uint32_t CulledInstances;
+	uint32_t OccludedMeshes;
+	uint32_t OccluderTriangles;
+
+	uint32_t HeapAllocations;
+	uint32_t FrameArenaKB;
+};
+
+struct gl_state_cache
+{
+	GLuint Program;
+	GLuint VertexArray;
+	uint32_t ActiveTextureUnit;
+	GLuint Textures[GL_STATE_CACHE_TEXTURE_UNITS];
+
+	render_stats Stats;
+};
+
+// NOTE(georgy): Call at the start of the frame. Code outside the draw loop binds things behind the cache's back
+// (uploads, the morph scatter pass), so nothing is trusted from the previous frame.
+static void
+ResetStateCache(gl_state_cache* Cache)
+{
+	Cache->Program = GL_STATE_UNKNOWN;
+	Cache->VertexArray = GL_STATE_UNKNOWN;
+	Cache->ActiveTextureUnit = GL_STATE_UNKNOWN;
+	for (uint32_t Unit = 0; Unit < GL_STATE_CACHE_TEXTURE_UNITS; Unit++)
+	{
+		Cache->Textures[Unit] = GL_STATE_UNKNOWN;
+	}
+
+	Cache->Stats = {};
+}
+
+// NOTE(georgy): Returns true if the program changed
+inline bool
+CacheUseProgram(gl_state_cache* Cache, GLuint Program)
+{
+	bool Result = (Cache->Program != Program);
+	if (Result)
+	{
+		glUseProgram(Program);
+		Cache->Program = Program;
+		Cache->Stats.ProgramBinds++;
+	}
+	else
+	{
+		Cache->Stats.SkippedBinds++;
+	}
+
+	return(Result);
+}
+
+inline void
+CacheBindVertexArray(gl_state_cache* Cache, GLuint VertexArray)
+{
+	if (Cache->VertexArray != VertexArray)
+	{
+		glBindVertexArray(VertexArray);
+		Cache->VertexArray = VertexArray;
+		Cache->Stats.VertexArrayBinds++;
+	}
+	else
+	{
+		Cache->Stats.SkippedBinds++;
+	}
+}
+
+inline void
+CacheBindTexture(gl_state_cache* Cache, uint32_t Unit, GLenum Target, GLuint Texture)
+{
+	Assert(Unit < GL_STATE_CACHE_TEXTURE_UNITS);
+	if (Cache->Textures[Unit] != Texture)
+	{
+		if (Cache->ActiveTextureUnit != Unit)
+		{
+			glActiveTexture(GL_TEXTURE0 + Unit);
+			Cache->ActiveTextureUnit = Unit;
+			Cache->Stats.ActiveTextureSwitches++;
+		}
+
+		glBindTexture(Target, Texture);
+		Cache->Textures[Unit] = Texture;
+		Cache->Stats.TextureBinds++;
+	}
+	else
+	{
+		Cache->Stats.SkippedBinds++;
+	}
+}
+
+// NOTE(georgy): Into the profiler's counters, they show up in the summary P prints
+static void
+RecordRenderStats(render_stats* Stats)
+{
+	PROFILE_COUNTER("Program binds", Stats->ProgramBinds);
+	PROFILE_COUNTER("Vertex array binds", Stats->VertexArrayBinds);
+	PROFILE_COUNTER("Active texture switches", Stats->ActiveTextureSwitches);
+	PROFILE_COUNTER("Texture binds", Stats->TextureBinds);
+	PROFILE_COUNTER("Skipped binds", Stats->SkippedBinds);
+	PROFILE_COUNTER("Draw calls", Stats->DrawCalls);
+	PROFILE_COUNTER("Mesh draws", Stats->MeshDraws);
+	PROFILE_COUNTER("Visible meshes", Stats->VisibleMeshes);
+	PROFILE_COUNTER("Frustum culled meshes", Stats->CulledMeshes);
+	PROFILE_COUNTER("Visible instances", Stats->VisibleInstances);
+	PROFILE_COUNTER("Frustum culled instances", Stats->CulledInstances);
+	PROFILE_COUNTER("Occluded meshes", Stats->OccludedMeshes);
+	PROFILE_COUNTER("Occluder triangles", Stats->OccluderTriangles);
+	PROFILE_COUNTER("Frame heap allocations", Stats->HeapAllocations);
+	PROFILE_COUNTER("Frame arena KB", Stats->FrameArenaKB);
+}
@@ -1,17 +1,89 @@
 #pragma once
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#if defined(_WIN32)
+#include <direct.h>
+#include <process.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define PROGRAM_CACHE_DIRECTORY "shadercache"
+
+// NOTE(georgy): Permutation feature bits. Each one becomes a #define in front of the sources, see ShaderFeatureDefines.
+enum shader_feature
+{
+	ShaderFeature_TexCoords = 0x1,
+	ShaderFeature_Texture = 0x2,
+	ShaderFeature_Skinned = 0x4,
+	ShaderFeature_Morph = 0x8,
+};
+#define SHADER_FEATURE_COUNT 4
+#define SHADER_PERMUTATION_COUNT (1 << SHADER_FEATURE_COUNT)
+
+static const char* ShaderFeatureDefines[SHADER_FEATURE_COUNT] =
+{
+	"HAS_UV",
+	"HAS_TEXTURE",
+	"SKINNED",
+	"MORPH",
+};
+
+// NOTE(georgy): Must be a power of two
+#define SHADER_UNIFORM_TABLE_SIZE 64
+#define SHADER_UNIFORM_BLOCK_TABLE_SIZE 8
+
+// NOTE(georgy): GLSL 3.30 can't give a block a binding point itself, so blocks with these names get theirs at link time
+enum uniform_block_binding
+{
+	FrameConstants_Binding,
+};
+
+struct shader_uniform
+{
+	uint64_t NameHash; // NOTE(georgy): 0 marks an empty slot
+	GLint Location;
+};
 
 class shader
 {
 private:
 	uint32_t ID;
 
+	// NOTE(georgy): Active uniforms and uniform blocks, reflected after every link. Location is the block index for blocks.
+	shader_uniform Uniforms[SHADER_UNIFORM_TABLE_SIZE];
+	shader_uniform UniformBlocks[SHADER_UNIFORM_BLOCK_TABLE_SIZE];
+
+	// NOTE(georgy): Hot reload. The pending program compiles and links in the background while ID keeps being used
+	uint32_t PendingID;
+	uint32_t PendingVS;
+	uint32_t PendingFS;
+	uint64_t PendingCacheKey;
+	double PendingStartTime;
+
+	char VSPath[MAX_PATH];
+	char FSPath[MAX_PATH];
+	uint32_t Features;
+
 public:
 	shader() {}
-	shader(const char* VSPath, const char* FSPath);
+	shader(const char* VSPath, const char* FSPath, uint32_t Features = 0);
 
 	void Use(void);
+	void Delete(void);
+	void BeginBuild(const char* VSPath, const char* FSPath, uint32_t Features);
+	bool FinishBuild(void);
+	bool BeginReload(void);
+	bool UpdateReload(void);
+	bool IsBuilt(void) { return(ID != 0); }
+	GLuint GetID(void) { return(ID); }
+	const char* GetVSPath(void) { return(VSPath); }
+	const char* GetFSPath(void) { return(FSPath); }
+	GLint GetUniformLocation(const char* Name);
+	GLint GetUniformBlockIndex(const char* Name);
+
 	void SetR32(const char* Name, float Value);
 	void SetI32(const char* Name, int32_t Value);
 	void SetVec2(const char* Name, vec2 V);
@@ -19,6 +91,10 @@ public:
 	void SetVec4(const char* Name, vec4 V);
 	void SetMat4(const char* Name, const mat4& M);
 	void SetVec2Array(const char* Name, uint32_t Count, vec2* V);
+	void SetI32Array(const char* Name, uint32_t Count, int32_t* V);
+
+private:
+	void Reflect(void);
 };
 
 struct read_entire_file_result
@@ -38,7 +114,7 @@ ReadEntireFile(const char* Filename)
 		Result.Size = ftell(File);
 		fseek(File, 0, SEEK_SET);
 
-		Result.Memory = malloc(Result.Size);
+		Result.Memory = MemoryAlloc(Result.Size);
 		fread(Result.Memory, 1, Result.Size, File);
 
 		fclose(File);
@@ -47,20 +123,292 @@ ReadEntireFile(const char* Filename)
 	return(Result);
 }
 
-shader::shader(const char* VSPath, const char* FSPath)
+//
+// NOTE(georgy): Program binary cache
+//
+// Linked programs are stored in PROGRAM_CACHE_DIRECTORY, one file per program, named after the key.
+// The key hashes the sources exactly as they are handed to GL (so anything injected into them is covered)
+// together with the vendor, renderer and version strings, a driver update just misses the cache.
+
+#define PROGRAM_CACHE_MAGIC 0x4E494250 // NOTE(georgy): "PBIN"
+#define PROGRAM_CACHE_VERSION 1
+
+struct program_cache_header
+{
+	uint32_t Magic;
+	uint32_t Version;
+	uint64_t Key;
+	uint32_t BinaryFormat;
+	uint32_t BinarySize;
+	float BuildMilliseconds;
+};
+
+static bool
+IsProgramCacheSupported(void)
+{
+	GLint FormatCount = 0;
+	if (GLEW_ARB_get_program_binary)
+	{
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &FormatCount);
+	}
+
+	return(FormatCount > 0);
+}
+
+static uint64_t
+ProgramCacheKey(read_entire_file_result VSSourceCode, read_entire_file_result FSSourceCode)
+{
+	uint64_t Result = HashBytes(&VSSourceCode.Size, sizeof(VSSourceCode.Size));
+	Result = HashBytes(VSSourceCode.Memory, VSSourceCode.Size, Result);
+	Result = HashBytes(&FSSourceCode.Size, sizeof(FSSourceCode.Size), Result);
+	Result = HashBytes(FSSourceCode.Memory, FSSourceCode.Size, Result);
+
+	GLenum DriverStrings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+	for (uint32_t StringIndex = 0;
+		StringIndex < ArrayCount(DriverStrings);
+		StringIndex++)
+	{
+		const char* String = (const char*)glGetString(DriverStrings[StringIndex]);
+		if (String)
+		{
+			Result = HashBytes(String, strlen(String) + 1, Result);
+		}
+	}
+
+	return(Result);
+}
+
+inline void
+ProgramCachePath(char* Path, uint32_t PathSize, uint64_t Key)
+{
+	snprintf(Path, PathSize, PROGRAM_CACHE_DIRECTORY "/%016llx.bin", (unsigned long long)Key);
+}
+
+// NOTE(georgy): Returns false on a miss, or if the driver rejects the binary. The caller compiles from source then.
+static bool
+LoadCachedProgram(GLuint Program, uint64_t Key, float* BuildMilliseconds)
+{
+	bool Result = false;
+
+	char Path[MAX_PATH];
+	ProgramCachePath(Path, sizeof(Path), Key);
+	read_entire_file_result File = ReadEntireFile(Path);
+	if (File.Memory)
+	{
+		program_cache_header* Header = (program_cache_header*)File.Memory;
+		if ((File.Size >= sizeof(program_cache_header)) &&
+			(Header->Magic == PROGRAM_CACHE_MAGIC) &&
+			(Header->Version == PROGRAM_CACHE_VERSION) &&
+			(Header->Key == Key) &&
+			(Header->BinarySize == File.Size - sizeof(program_cache_header)))
+		{
+			glProgramBinary(Program, Header->BinaryFormat, Header + 1, Header->BinarySize);
+
+			GLint Success;
+			glGetProgramiv(Program, GL_LINK_STATUS, &Success);
+			Result = (Success != 0);
+			*BuildMilliseconds = Header->BuildMilliseconds;
+		}
+
+		MemoryFree(File.Memory);
+	}
+
+	return(Result);
+}
+
+static void
+StoreCachedProgram(GLuint Program, uint64_t Key, float BuildMilliseconds)
+{
+	GLint BinarySize = 0;
+	glGetProgramiv(Program, GL_PROGRAM_BINARY_LENGTH, &BinarySize);
+	if (BinarySize <= 0)
+	{
+		return;
+	}
+
+	MEMORY_TAG(MemoryTag_Render);
+	void* Memory = MemoryAlloc(sizeof(program_cache_header) + BinarySize);
+	program_cache_header* Header = (program_cache_header*)Memory;
+	Header->Magic = PROGRAM_CACHE_MAGIC;
+	Header->Version = PROGRAM_CACHE_VERSION;
+	Header->Key = Key;
+	Header->BuildMilliseconds = BuildMilliseconds;
+
+	GLenum BinaryFormat;
+	GLsizei Written = 0;
+	glGetProgramBinary(Program, BinarySize, &Written, &BinaryFormat, Header + 1);
+	Header->BinaryFormat = BinaryFormat;
+	Header->BinarySize = Written;
+
+	if (Written > 0)
+	{
+#if defined(_WIN32)
+		_mkdir(PROGRAM_CACHE_DIRECTORY);
+#else
+		mkdir(PROGRAM_CACHE_DIRECTORY, 0755);
+#endif
+
+		// NOTE(georgy): Written next to the target and renamed over it, so a crash or another viewer sharing the
+		// directory never sees half a file. The same key means the same binary, if the rename loses the race
+		// (Windows doesn't replace an existing file) the one already there is as good.
+		char Path[MAX_PATH];
+		char TempPath[MAX_PATH];
+		ProgramCachePath(Path, sizeof(Path), Key);
+#if defined(_WIN32)
+		int ProcessID = _getpid();
+#else
+		int ProcessID = (int)getpid();
+#endif
+		snprintf(TempPath, sizeof(TempPath), "%s.%d.tmp", Path, ProcessID);
+
+		FILE* File = fopen(TempPath, "wb");
+		if (File)
+		{
+			size_t Size = sizeof(program_cache_header) + Written;
+			bool Complete = (fwrite(Memory, 1, Size, File) == Size);
+			Complete = (fclose(File) == 0) && Complete;
+			if (!Complete || (rename(TempPath, Path) != 0))
+			{
+				remove(TempPath);
+			}
+		}
+	}
+
+	MemoryFree(Memory);
+}
+
+// NOTE(georgy): #version has to stay the first line, so the defines go right after it.
+// The #line directive keeps the line numbers in compile errors pointing into the file.
+static void
+AddShaderDefines(read_entire_file_result* Source, uint32_t Features)
 {
+	if (!Source->Memory || !Features)
+	{
+		return;
+	}
+
+	char Defines[256];
+	uint32_t DefinesLength = 0;
+	for (uint32_t FeatureIndex = 0;
+		FeatureIndex < SHADER_FEATURE_COUNT;
+		FeatureIndex++)
+	{
+		if (Features & (1 << FeatureIndex))
+		{
+			DefinesLength += snprintf(Defines + DefinesLength, sizeof(Defines) - DefinesLength, "#define %s 1\n", ShaderFeatureDefines[FeatureIndex]);
+		}
+	}
+	DefinesLength += snprintf(Defines + DefinesLength, sizeof(Defines) - DefinesLength, "#line 2\n");
+
+	char* Text = (char*)Source->Memory;
+	uint32_t VersionLineLength = 0;
+	while ((VersionLineLength < Source->Size) && (Text[VersionLineLength] != '\n'))
+	{
+		VersionLineLength++;
+	}
+	if (VersionLineLength < Source->Size)
+	{
+		VersionLineLength++;
+	}
+
+	char* Result = (char*)MemoryAlloc(Source->Size + DefinesLength);
+	memcpy(Result, Text, VersionLineLength);
+	memcpy(Result + VersionLineLength, Defines, DefinesLength);
+	memcpy(Result + VersionLineLength + DefinesLength, Text + VersionLineLength, Source->Size - VersionLineLength);
+
+	MemoryFree(Source->Memory);
+	Source->Memory = Result;
+	Source->Size += DefinesLength;
+}
+
+// NOTE(georgy): Only issues the work. Nothing here queries compile or link status, so with KHR_parallel_shader_compile
+// (or a driver that compiles on its own threads anyway) this returns right away.
+// A program cache hit is already linked when this returns, VS and FS are 0 then.
+static void
+StartProgramBuild(const char* VSPath, const char* FSPath, uint32_t Features, GLuint* Program, GLuint* VS, GLuint* FS, uint64_t* CacheKey)
+{
+	MEMORY_TAG(MemoryTag_Render);
+
 	read_entire_file_result VSSourceCode = ReadEntireFile(VSPath);
 	read_entire_file_result FSSourceCode = ReadEntireFile(FSPath);
+	AddShaderDefines(&VSSourceCode, Features);
+	AddShaderDefines(&FSSourceCode, Features);
 
-	GLuint VS = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FS = glCreateShader(GL_FRAGMENT_SHADER);
-	ID = glCreateProgram();
+	*VS = *FS = 0;
+	*CacheKey = 0;
+	*Program = glCreateProgram();
+
+	bool CacheSupported = IsProgramCacheSupported();
+	if (CacheSupported)
+	{
+		double StartTime = GetWallClockSeconds();
+		*CacheKey = ProgramCacheKey(VSSourceCode, FSSourceCode);
+
+		float BuildMilliseconds;
+		if (LoadCachedProgram(*Program, *CacheKey, &BuildMilliseconds))
+		{
+			float LoadMilliseconds = (float)(1000.0 * (GetWallClockSeconds() - StartTime));
+			printf("Program cache hit: %s, %s, features 0x%x (%.2f ms, saved %.2f ms)\n", VSPath, FSPath, Features,
+				LoadMilliseconds, Max(BuildMilliseconds - LoadMilliseconds, 0.0f));
+
+			MemoryFree(VSSourceCode.Memory);
+			MemoryFree(FSSourceCode.Memory);
+			return;
+		}
+
+		printf("Program cache miss: %s, %s, features 0x%x\n", VSPath, FSPath, Features);
+
+		// NOTE(georgy): A rejected binary can leave the program unusable, start over with a fresh one
+		glDeleteProgram(*Program);
+		*Program = glCreateProgram();
+		glProgramParameteri(*Program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+
+	*VS = glCreateShader(GL_VERTEX_SHADER);
+	*FS = glCreateShader(GL_FRAGMENT_SHADER);
+
+	glShaderSource(*VS, 1, (char**)&VSSourceCode.Memory, (GLint*)&VSSourceCode.Size);
+	glCompileShader(*VS);
+
+	glShaderSource(*FS, 1, (char**)&FSSourceCode.Memory, (GLint*)&FSSourceCode.Size);
+	glCompileShader(*FS);
+
+	glAttachShader(*Program, *VS);
+	glAttachShader(*Program, *FS);
+	glLinkProgram(*Program);
+
+	MemoryFree(VSSourceCode.Memory);
+	MemoryFree(FSSourceCode.Memory);
+}
+
+// NOTE(georgy): Without KHR_parallel_shader_compile this always says yes, and whatever asks for the link status next
+// waits until the driver is done.
+static bool
+IsProgramBuildComplete(GLuint Program)
+{
+	GLint Complete = GL_TRUE;
+	if (GLEW_KHR_parallel_shader_compile)
+	{
+		glGetProgramiv(Program, GL_COMPLETION_STATUS_KHR, &Complete);
+	}
+
+	return(Complete == GL_TRUE);
+}
+
+// NOTE(georgy): Blocks until the build is done. Prints the logs and returns false if anything failed.
+// A successful source build is written to the program cache, StartTime is when it was issued.
+static bool
+FinishProgramBuild(GLuint Program, GLuint VS, GLuint FS, uint64_t CacheKey, double StartTime)
+{
+	if (!VS)
+	{
+		// NOTE(georgy): Loaded from the program cache, already checked
+		return(true);
+	}
 
 	int32_t Success;
 	char InfoLog[1024];
 
-	glShaderSource(VS, 1, (char**)&VSSourceCode.Memory, (GLint*)&VSSourceCode.Size);
-	glCompileShader(VS);
 	glGetShaderiv(VS, GL_COMPILE_STATUS, &Success);
 	if (!Success)
 	{
@@ -68,8 +416,6 @@ shader::shader(const char* VSPath, const char* FSPath)
 		printf("ERROR::SHADER_COMPILATION_ERROR of type: VS\n %s", InfoLog);
 	}
 
-	glShaderSource(FS, 1, (char**)&FSSourceCode.Memory, (GLint*)&FSSourceCode.Size);
-	glCompileShader(FS);
 	glGetShaderiv(FS, GL_COMPILE_STATUS, &Success);
 	if (!Success)
 	{
@@ -77,20 +423,216 @@ shader::shader(const char* VSPath, const char* FSPath)
 		printf("ERROR::SHADER_COMPILATION_ERROR of type: FS\n %s", InfoLog);
 	}
 
-	glAttachShader(ID, VS);
-	glAttachShader(ID, FS);
-	glLinkProgram(ID);
-	glGetProgramiv(ID, GL_LINK_STATUS, &Success);
+	glGetProgramiv(Program, GL_LINK_STATUS, &Success);
 	if (!Success)
 	{
-		glGetProgramInfoLog(ID, sizeof(InfoLog), 0, InfoLog);
+		glGetProgramInfoLog(Program, sizeof(InfoLog), 0, InfoLog);
 		printf("ERROR::PROGRAM_LINKING_ERROR of type:: PROGRAM\n %s", InfoLog);
 	}
 
+	glDetachShader(Program, VS);
+	glDetachShader(Program, FS);
 	glDeleteShader(VS);
 	glDeleteShader(FS);
-	free(VSSourceCode.Memory);
-	free(FSSourceCode.Memory);
+
+	if (Success && CacheKey)
+	{
+		float BuildMilliseconds = (float)(1000.0 * (GetWallClockSeconds() - StartTime));
+		StoreCachedProgram(Program, CacheKey, BuildMilliseconds);
+		printf("Program built in %.2f ms, cached\n", BuildMilliseconds);
+	}
+
+	return(Success != 0);
+}
+
+//
+// NOTE(georgy): Uniform reflection
+//
+
+// NOTE(georgy): Arrays are reported as "Name[0]", they are looked up by the plain name
+inline uint64_t
+HashUniformName(const char* Name)
+{
+	size_t Length = strlen(Name);
+	if ((Length > 3) && (strcmp(Name + Length - 3, "[0]") == 0))
+	{
+		Length -= 3;
+	}
+
+	uint64_t Result = HashBytes(Name, Length);
+	if (Result == 0)
+	{
+		Result = 1;
+	}
+
+	return(Result);
+}
+
+static void
+AddShaderUniform(shader_uniform* Table, uint32_t TableSize, uint64_t NameHash, GLint Location)
+{
+	for (uint32_t Probe = 0; Probe < TableSize; Probe++)
+	{
+		shader_uniform* Slot = &Table[(NameHash + Probe) & (TableSize - 1)];
+		if ((Slot->NameHash == 0) || (Slot->NameHash == NameHash))
+		{
+			Slot->NameHash = NameHash;
+			Slot->Location = Location;
+			return;
+		}
+	}
+
+	printf("Shader uniform table is full, raise SHADER_UNIFORM_TABLE_SIZE\n");
+}
+
+// NOTE(georgy): Returns -1 for names the program doesn't use, glUniform* ignores that location
+static GLint
+FindShaderUniform(shader_uniform* Table, uint32_t TableSize, uint64_t NameHash)
+{
+	GLint Result = -1;
+	for (uint32_t Probe = 0; Probe < TableSize; Probe++)
+	{
+		shader_uniform* Slot = &Table[(NameHash + Probe) & (TableSize - 1)];
+		if (Slot->NameHash == NameHash)
+		{
+			Result = Slot->Location;
+			break;
+		}
+		else if (Slot->NameHash == 0)
+		{
+			break;
+		}
+	}
+
+	return(Result);
+}
+
+void shader::Reflect(void)
+{
+	memset(Uniforms, 0, sizeof(Uniforms));
+	memset(UniformBlocks, 0, sizeof(UniformBlocks));
+
+	char Name[256];
+	GLint UniformCount = 0;
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &UniformCount);
+	for (GLint UniformIndex = 0;
+		UniformIndex < UniformCount;
+		UniformIndex++)
+	{
+		GLint Size;
+		GLenum Type;
+		glGetActiveUniform(ID, UniformIndex, sizeof(Name), 0, &Size, &Type, Name);
+
+		// NOTE(georgy): Members of uniform blocks have no location
+		GLint Location = glGetUniformLocation(ID, Name);
+		if (Location >= 0)
+		{
+			AddShaderUniform(Uniforms, SHADER_UNIFORM_TABLE_SIZE, HashUniformName(Name), Location);
+		}
+	}
+
+	GLint BlockCount = 0;
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCKS, &BlockCount);
+	for (GLint BlockIndex = 0;
+		BlockIndex < BlockCount;
+		BlockIndex++)
+	{
+		glGetActiveUniformBlockName(ID, BlockIndex, sizeof(Name), 0, Name);
+		AddShaderUniform(UniformBlocks, SHADER_UNIFORM_BLOCK_TABLE_SIZE, HashUniformName(Name), BlockIndex);
+
+		if (strcmp(Name, "FrameConstants") == 0)
+		{
+			glUniformBlockBinding(ID, BlockIndex, FrameConstants_Binding);
+		}
+	}
+}
+
+GLint shader::GetUniformLocation(const char* Name)
+{
+	GLint Result = FindShaderUniform(Uniforms, SHADER_UNIFORM_TABLE_SIZE, HashUniformName(Name));
+	return(Result);
+}
+
+GLint shader::GetUniformBlockIndex(const char* Name)
+{
+	GLint Result = FindShaderUniform(UniformBlocks, SHADER_UNIFORM_BLOCK_TABLE_SIZE, HashUniformName(Name));
+	return(Result);
+}
+
+shader::shader(const char* VSPath, const char* FSPath, uint32_t Features)
+{
+	ID = 0;
+	BeginBuild(VSPath, FSPath, Features);
+	FinishBuild();
+}
+
+// NOTE(georgy): Issues the first build without waiting for it. Start several and then finish them to compile them in parallel.
+void shader::BeginBuild(const char* VSPath, const char* FSPath, uint32_t Features)
+{
+	strncpy(this->VSPath, VSPath, sizeof(this->VSPath) - 1);
+	this->VSPath[sizeof(this->VSPath) - 1] = 0;
+	strncpy(this->FSPath, FSPath, sizeof(this->FSPath) - 1);
+	this->FSPath[sizeof(this->FSPath) - 1] = 0;
+	this->Features = Features;
+	PendingID = 0;
+
+	BeginReload();
+}
+
+// NOTE(georgy): Blocks until the pending build is done and swaps it in. A failed build keeps the old program,
+// unless there is none yet. Returns true when the program changed.
+bool shader::FinishBuild(void)
+{
+	bool Result = false;
+	if (PendingID)
+	{
+		if (FinishProgramBuild(PendingID, PendingVS, PendingFS, PendingCacheKey, PendingStartTime) || !ID)
+		{
+			glDeleteProgram(ID);
+			ID = PendingID;
+			Reflect();
+			Result = true;
+		}
+		else
+		{
+			printf("Shader build failed, keeping the previous program: %s, %s\n", VSPath, FSPath);
+			glDeleteProgram(PendingID);
+		}
+
+		PendingID = 0;
+	}
+
+	return(Result);
+}
+
+// NOTE(georgy): Starts rebuilding from the current sources. A reload that is still in flight is dropped.
+bool shader::BeginReload(void)
+{
+	if (PendingID)
+	{
+		glDeleteProgram(PendingID);
+		glDeleteShader(PendingVS);
+		glDeleteShader(PendingFS);
+		PendingID = 0;
+	}
+
+	PendingStartTime = GetWallClockSeconds();
+	StartProgramBuild(VSPath, FSPath, Features, &PendingID, &PendingVS, &PendingFS, &PendingCacheKey);
+
+	return(PendingID != 0);
+}
+
+// NOTE(georgy): Call once per frame, starting the frame after BeginReload. Swaps the new program in once it has linked,
+// a failed build keeps the old one. Returns true when the program changed.
+bool shader::UpdateReload(void)
+{
+	bool Result = false;
+	if (PendingID && IsProgramBuildComplete(PendingID))
+	{
+		Result = FinishBuild();
+	}
+
+	return(Result);
 }
 
 void shader::Use(void)
@@ -98,37 +640,133 @@ void shader::Use(void)
 	glUseProgram(ID);
 }
 
+void shader::Delete(void)
+{
+	glDeleteProgram(ID);
+	ID = 0;
+
+	if (PendingID)
+	{
+		glDeleteProgram(PendingID);
+		glDeleteShader(PendingVS);
+		glDeleteShader(PendingFS);
+		PendingID = 0;
+	}
+}
+
 void shader::SetR32(const char* Name, float Value)
 {
-	glUniform1f(glGetUniformLocation(ID, Name), Value);
+	glUniform1f(GetUniformLocation(Name), Value);
 }
 
 void shader::SetI32(const char* Name, int32_t Value)
 {
-	glUniform1i(glGetUniformLocation(ID, Name), Value);
+	glUniform1i(GetUniformLocation(Name), Value);
 }
 
 void shader::SetVec2(const char* Name, vec2 V)
 {
-	glUniform2f(glGetUniformLocation(ID, Name), V.x, V.y);
+	glUniform2f(GetUniformLocation(Name), V.x, V.y);
 }
 
 void shader::SetVec3(const char* Name, vec3 V)
 {
-	glUniform3fv(glGetUniformLocation(ID, Name), 1, &V.x);
+	glUniform3fv(GetUniformLocation(Name), 1, &V.x);
 }
 
 void shader::SetVec4(const char* Name, vec4 V)
 {
-	glUniform4fv(glGetUniformLocation(ID, Name), 1, &V.x);
+	glUniform4fv(GetUniformLocation(Name), 1, &V.x);
 }
 
 void shader::SetMat4(const char* Name, const mat4& M)
 {
-	glUniformMatrix4fv(glGetUniformLocation(ID, Name), 1, GL_FALSE, M.E);
+	glUniformMatrix4fv(GetUniformLocation(Name), 1, GL_FALSE, M.E);
 }
 
 void shader::SetVec2Array(const char* Name, uint32_t Count, vec2* V)
 {
-	glUniform2fv(glGetUniformLocation(ID, Name), Count, (GLfloat*)V);
-}
\ No newline at end of file
+	glUniform2fv(GetUniformLocation(Name), Count, (GLfloat*)V);
+}
+
+void shader::SetI32Array(const char* Name, uint32_t Count, int32_t* V)
+{
+	glUniform1iv(GetUniformLocation(Name), Count, (GLint*)V);
+}
+
+//
+// NOTE(georgy): Permutations
+//
+// One program per combination of the supported feature bits, built on demand.
+// Callers pass the full feature bits of what they draw, bits the shaders don't support are ignored.
+
+struct shader_permutations
+{
+	char VSPath[MAX_PATH];
+	char FSPath[MAX_PATH];
+	uint32_t SupportedFeatures;
+
+	shader Variants[SHADER_PERMUTATION_COUNT];
+};
+
+static void
+InitializeShaderPermutations(shader_permutations* Permutations, const char* VSPath, const char* FSPath, uint32_t SupportedFeatures)
+{
+	strncpy(Permutations->VSPath, VSPath, sizeof(Permutations->VSPath) - 1);
+	strncpy(Permutations->FSPath, FSPath, sizeof(Permutations->FSPath) - 1);
+	Permutations->SupportedFeatures = SupportedFeatures;
+}
+
+inline shader*
+GetShaderPermutation(shader_permutations* Permutations, uint32_t Features)
+{
+	shader* Result = &Permutations->Variants[Features & Permutations->SupportedFeatures];
+	return(Result);
+}
+
+// NOTE(georgy): NeededVariants has a bit per variant (1 << (Features & SupportedFeatures)).
+// All missing variants are issued before the first one is waited on, so they compile in parallel.
+static uint32_t
+BuildShaderPermutations(shader_permutations* Permutations, uint32_t NeededVariants)
+{
+	uint32_t StartedVariants = 0;
+	for (uint32_t Features = 0;
+		Features < SHADER_PERMUTATION_COUNT;
+		Features++)
+	{
+		shader* Variant = &Permutations->Variants[Features];
+		if ((NeededVariants & (1 << Features)) && !Variant->IsBuilt())
+		{
+			Variant->BeginBuild(Permutations->VSPath, Permutations->FSPath, Features);
+			StartedVariants |= (1 << Features);
+		}
+	}
+
+	uint32_t BuiltCount = 0;
+	for (uint32_t Features = 0;
+		Features < SHADER_PERMUTATION_COUNT;
+		Features++)
+	{
+		if (StartedVariants & (1 << Features))
+		{
+			Permutations->Variants[Features].FinishBuild();
+			BuiltCount++;
+		}
+	}
+
+	return(BuiltCount);
+}
+
+static void
+DeleteShaderPermutations(shader_permutations* Permutations)
+{
+	for (uint32_t Features = 0;
+		Features < SHADER_PERMUTATION_COUNT;
+		Features++)
+	{
+		if (Permutations->Variants[Features].IsBuilt())
+		{
+			Permutations->Variants[Features].Delete();
+		}
+	}
+}
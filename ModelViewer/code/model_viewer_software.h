@@ -0,0 +1,770 @@
+#pragma once
+
+// NOTE(georgy): Software renderer.
+// The GL default pass done on the CPU: indexed triangles through Projection * View * Model, back faces culled,
+// a less-than depth test and the albedo sampled from the CPU copy of the texture array. It runs in three rounds of jobs.
+// Vertex jobs transform ranges of the vertex buffer to clip space. Bin jobs take consecutive triangles of the draw list,
+// clip them against the near plane, set them up and sort them into the tiles their bounds touch. Tile jobs clear their
+// tiles and draw the bins in draw order, 4 pixels per step with SSE (plain C elsewhere). A tile is only ever touched by
+// one job, so nothing is locked. The frame is RGBA8, top row first. Morphs aren't applied, meshes are drawn in their bind pose.
+
+#define SOFTWARE_TILE_SIZE 64
+#define SOFTWARE_VERTEX_JOB_SIZE 16384
+#define SOFTWARE_BIN_JOB_SIZE 8192
+#define SOFTWARE_MAX_BINS 64
+#define SOFTWARE_MAX_TILE_JOBS 128
+#define SOFTWARE_CLEAR_COLOR 0xFFB3B3B3 // NOTE(georgy): The platform's glClearColor, 0.7 grey
+#define SOFTWARE_UNTEXTURED_COLOR 0xFFCCCCCC // NOTE(georgy): What DefaultFS.glsl writes without a texture, 0.8 grey
+
+// NOTE(georgy): An attribute as a plane over the pixel grid: its value at vertex 0 and how it changes per pixel
+struct software_plane
+{
+	float Value;
+	float StepX, StepY;
+};
+
+// NOTE(georgy): Pixels in x and y, y down. Wound so the edge functions are positive inside.
+struct software_triangle
+{
+	float X[3], Y[3];
+	software_plane Z;
+	software_plane InvW;
+	software_plane UOverW, VOverW;
+	int32_t MinX, MinY, MaxX, MaxY;
+	int32_t MaterialIndex; // NOTE(georgy): Negative for untextured meshes
+};
+
+struct software_clip_vertex
+{
+	vec4 P;
+	vec2 UV;
+};
+
+struct software_frame;
+
+// NOTE(georgy): One bin job's triangles. The ones touching a tile are TileTriangles[TileFirst[Tile]] up to TileTriangles[TileFirst[Tile + 1]].
+struct software_bin
+{
+	software_frame* Frame;
+	uint32_t FirstTriangle;
+	uint32_t OnePastLastTriangle;
+
+	dynamic_array<software_triangle> Triangles;
+	dynamic_array<uint32_t> TileFirst;
+	dynamic_array<uint32_t> TileTriangles;
+};
+
+struct software_stats
+{
+	uint64_t Triangles;
+	uint64_t DrawnTriangles;
+	uint64_t Pixels;
+	uint32_t Frames;
+	double Seconds;
+};
+
+struct software_renderer
+{
+	uint32_t Width, Height;
+	uint32_t Pitch; // NOTE(georgy): Width rounded up to whole tiles
+	uint32_t TilesX, TilesY;
+	dynamic_array<uint32_t> Color;
+	dynamic_array<float> Depth;
+
+	dynamic_array<vec4> ClipPositions;
+	dynamic_array<uint32_t> DrawFirstTriangle;
+	software_bin Bins[SOFTWARE_MAX_BINS];
+	uint32_t BinCount;
+
+	software_stats Stats;
+	double LastReportTime;
+
+	// NOTE(georgy): For showing the frame in the GL window
+	bool PresentInitialized;
+	GLuint PresentTexture;
+	GLuint PresentVAO;
+	shader PresentShader;
+};
+
+// NOTE(georgy): Everything a frame reads, shared by all of its jobs
+struct software_frame
+{
+	software_renderer* Renderer;
+	mat4 ClipFromModel;
+
+	mesh* Meshes;
+	draw_command* Draws;
+	uint32_t DrawCount;
+	vec3* Positions;
+	vec2* TexCoords;
+	uint32_t* Indices;
+	material_texture* Materials;
+	texture_array* Textures;
+};
+
+struct software_vertex_job
+{
+	software_frame* Frame;
+	uint32_t First;
+	uint32_t OnePastLast;
+};
+
+struct software_tile_job
+{
+	software_frame* Frame;
+	uint32_t FirstTile;
+	uint32_t TileStride;
+
+	uint64_t Pixels;
+};
+
+static PLATFORM_WORK_QUEUE_CALLBACK(DoSoftwareVertexJob)
+{
+	(void)Queue;
+	PROFILE_ZONE("DoSoftwareVertexJob");
+
+	software_vertex_job* Job = (software_vertex_job*)Data;
+	software_frame* Frame = Job->Frame;
+	vec4* ClipPositions = Frame->Renderer->ClipPositions.Entries;
+	for (uint32_t VertexIndex = Job->First; VertexIndex < Job->OnePastLast; VertexIndex++)
+	{
+		ClipPositions[VertexIndex] = Frame->ClipFromModel * vec4(Frame->Positions[VertexIndex], 1.0f);
+	}
+}
+
+inline software_plane
+SoftwarePlane(float* Values, float InvArea, float StepX1, float StepY1, float StepX2, float StepY2)
+{
+	float D1 = (Values[1] - Values[0]) * InvArea;
+	float D2 = (Values[2] - Values[0]) * InvArea;
+
+	software_plane Result;
+	Result.Value = Values[0];
+	Result.StepX = StepX1*D1 + StepX2*D2;
+	Result.StepY = StepY1*D1 + StepY2*D2;
+
+	return(Result);
+}
+
+// NOTE(georgy): Vertices are in front of the near plane. Back faces, triangles without a pixel center in them
+// and ones off screen are dropped.
+static void
+SetupSoftwareTriangle(software_bin* Bin, software_clip_vertex* A, software_clip_vertex* B, software_clip_vertex* C, int32_t MaterialIndex)
+{
+	software_renderer* Renderer = Bin->Frame->Renderer;
+	software_clip_vertex* Vertices[3] = { A, B, C };
+	float X[3], Y[3], Z[3], InvW[3], UOverW[3], VOverW[3];
+	for (uint32_t I = 0; I < 3; I++)
+	{
+		vec4 P = Vertices[I]->P;
+		InvW[I] = 1.0f / P.w;
+		X[I] = (P.x * InvW[I] * 0.5f + 0.5f) * (float)Renderer->Width;
+		Y[I] = (0.5f - P.y * InvW[I] * 0.5f) * (float)Renderer->Height;
+		Z[I] = P.z * InvW[I] * 0.5f + 0.5f;
+		UOverW[I] = Vertices[I]->UV.x * InvW[I];
+		VOverW[I] = Vertices[I]->UV.y * InvW[I];
+	}
+
+	// NOTE(georgy): y points down here, so GL's counter-clockwise front faces come out with a negative area
+	float Area = (X[1] - X[0])*(Y[2] - Y[0]) - (Y[1] - Y[0])*(X[2] - X[0]);
+	if (!(Area < 0.0f))
+	{
+		return;
+	}
+
+	// NOTE(georgy): Bounds of the pixels whose centers can be inside, tiny triangles between centers end up empty
+	software_triangle Triangle;
+	Triangle.MinX = Max((int32_t)ceilf(Min(X[0], Min(X[1], X[2])) - 0.5f), 0);
+	Triangle.MinY = Max((int32_t)ceilf(Min(Y[0], Min(Y[1], Y[2])) - 0.5f), 0);
+	Triangle.MaxX = Min(FloorReal32ToInt32(Max(X[0], Max(X[1], X[2])) - 0.5f), (int32_t)Renderer->Width - 1);
+	Triangle.MaxY = Min(FloorReal32ToInt32(Max(Y[0], Max(Y[1], Y[2])) - 0.5f), (int32_t)Renderer->Height - 1);
+	if ((Triangle.MinX > Triangle.MaxX) || (Triangle.MinY > Triangle.MaxY))
+	{
+		return;
+	}
+
+	float* Attributes[] = { X, Y, Z, InvW, UOverW, VOverW };
+	for (uint32_t AttributeIndex = 0; AttributeIndex < ArrayCount(Attributes); AttributeIndex++)
+	{
+		float Temp = Attributes[AttributeIndex][1];
+		Attributes[AttributeIndex][1] = Attributes[AttributeIndex][2];
+		Attributes[AttributeIndex][2] = Temp;
+	}
+	Area = -Area;
+
+	float InvArea = 1.0f / Area;
+	float StepX1 = Y[2] - Y[0], StepY1 = X[0] - X[2];
+	float StepX2 = Y[0] - Y[1], StepY2 = X[1] - X[0];
+	for (uint32_t I = 0; I < 3; I++)
+	{
+		Triangle.X[I] = X[I];
+		Triangle.Y[I] = Y[I];
+	}
+	Triangle.Z = SoftwarePlane(Z, InvArea, StepX1, StepY1, StepX2, StepY2);
+	Triangle.InvW = SoftwarePlane(InvW, InvArea, StepX1, StepY1, StepX2, StepY2);
+	Triangle.UOverW = SoftwarePlane(UOverW, InvArea, StepX1, StepY1, StepX2, StepY2);
+	Triangle.VOverW = SoftwarePlane(VOverW, InvArea, StepX1, StepY1, StepX2, StepY2);
+	Triangle.MaterialIndex = MaterialIndex;
+
+	PushEntry(&Bin->Triangles, Triangle);
+}
+
+inline software_clip_vertex
+LerpClipVertex(software_clip_vertex* A, software_clip_vertex* B, float t)
+{
+	software_clip_vertex Result;
+	Result.P = A->P + t*(B->P - A->P);
+	Result.UV = Lerp(A->UV, B->UV, t);
+
+	return(Result);
+}
+
+// NOTE(georgy): Only the near plane is clipped against, x and y are left to the pixel bounds.
+// A triangle becomes a polygon of up to 4 vertices, drawn as a fan.
+static void
+ClipSoftwareTriangle(software_bin* Bin, software_clip_vertex* Vertices, int32_t MaterialIndex)
+{
+	software_clip_vertex Polygon[4];
+	uint32_t PolygonCount = 0;
+	for (uint32_t I = 0; I < 3; I++)
+	{
+		software_clip_vertex* A = &Vertices[I];
+		software_clip_vertex* B = &Vertices[(I + 1) % 3];
+		float DistanceA = A->P.z + A->P.w;
+		float DistanceB = B->P.z + B->P.w;
+		if (DistanceA >= 0.0f)
+		{
+			Polygon[PolygonCount++] = *A;
+		}
+		if ((DistanceA >= 0.0f) != (DistanceB >= 0.0f))
+		{
+			Polygon[PolygonCount++] = LerpClipVertex(A, B, DistanceA / (DistanceA - DistanceB));
+		}
+	}
+
+	for (uint32_t I = 2; I < PolygonCount; I++)
+	{
+		SetupSoftwareTriangle(Bin, &Polygon[0], &Polygon[I - 1], &Polygon[I], MaterialIndex);
+	}
+}
+
+inline uint32_t
+ClipOutcode(vec4 P)
+{
+	uint32_t Result = ((P.x < -P.w) ? 0x01 : 0) | ((P.x > P.w) ? 0x02 : 0) |
+					  ((P.y < -P.w) ? 0x04 : 0) | ((P.y > P.w) ? 0x08 : 0) |
+					  ((P.z < -P.w) ? 0x10 : 0) | ((P.z > P.w) ? 0x20 : 0);
+	return(Result);
+}
+
+static PLATFORM_WORK_QUEUE_CALLBACK(DoSoftwareBinJob)
+{
+	(void)Queue;
+	PROFILE_ZONE("DoSoftwareBinJob");
+
+	software_bin* Bin = (software_bin*)Data;
+	software_frame* Frame = Bin->Frame;
+	software_renderer* Renderer = Frame->Renderer;
+	vec4* ClipPositions = Renderer->ClipPositions.Entries;
+	uint32_t* DrawFirstTriangle = Renderer->DrawFirstTriangle.Entries;
+
+	Bin->Triangles.EntriesCount = 0;
+	for (uint32_t DrawIndex = 0; DrawIndex < Frame->DrawCount; DrawIndex++)
+	{
+		uint32_t First = Max(DrawFirstTriangle[DrawIndex], Bin->FirstTriangle);
+		uint32_t OnePastLast = Min(DrawFirstTriangle[DrawIndex + 1], Bin->OnePastLastTriangle);
+		if (First >= OnePastLast)
+		{
+			continue;
+		}
+
+		mesh* Mesh = &Frame->Meshes[Frame->Draws[DrawIndex].MeshIndex];
+		int32_t MaterialIndex = (Mesh->ShaderFeatures & ShaderFeature_Texture) ? (int32_t)Mesh->MaterialIndex : -1;
+		uint32_t* MeshIndices = Frame->Indices + Mesh->BaseIndex;
+		for (uint32_t TriangleIndex = First - DrawFirstTriangle[DrawIndex];
+			TriangleIndex < OnePastLast - DrawFirstTriangle[DrawIndex];
+			TriangleIndex++)
+		{
+			software_clip_vertex Vertices[3];
+			uint32_t OutcodeAnd = 0xFF, OutcodeOr = 0;
+			for (uint32_t I = 0; I < 3; I++)
+			{
+				uint32_t VertexIndex = Mesh->BaseVertex + MeshIndices[3 * TriangleIndex + I];
+				Vertices[I].P = ClipPositions[VertexIndex];
+				Vertices[I].UV = Frame->TexCoords[VertexIndex];
+
+				uint32_t Outcode = ClipOutcode(Vertices[I].P);
+				OutcodeAnd &= Outcode;
+				OutcodeOr |= Outcode;
+			}
+
+			if (OutcodeAnd)
+			{
+				continue;
+			}
+			if (OutcodeOr & 0x10)
+			{
+				ClipSoftwareTriangle(Bin, Vertices, MaterialIndex);
+			}
+			else
+			{
+				SetupSoftwareTriangle(Bin, &Vertices[0], &Vertices[1], &Vertices[2], MaterialIndex);
+			}
+		}
+	}
+
+	// NOTE(georgy): Count per tile, then place. Triangles stay in draw order within each tile.
+	uint32_t TileCount = Renderer->TilesX * Renderer->TilesY;
+	ResizeDynamicArray(&Bin->TileFirst, TileCount + 1);
+	memset(Bin->TileFirst.Entries, 0, sizeof(uint32_t) * (TileCount + 1));
+	for (uint32_t TriangleIndex = 0; TriangleIndex < Bin->Triangles.EntriesCount; TriangleIndex++)
+	{
+		software_triangle* Triangle = &Bin->Triangles[TriangleIndex];
+		for (int32_t TileY = Triangle->MinY / SOFTWARE_TILE_SIZE; TileY <= Triangle->MaxY / SOFTWARE_TILE_SIZE; TileY++)
+		{
+			for (int32_t TileX = Triangle->MinX / SOFTWARE_TILE_SIZE; TileX <= Triangle->MaxX / SOFTWARE_TILE_SIZE; TileX++)
+			{
+				Bin->TileFirst[TileY * Renderer->TilesX + TileX + 1]++;
+			}
+		}
+	}
+	for (uint32_t Tile = 0; Tile < TileCount; Tile++)
+	{
+		Bin->TileFirst[Tile + 1] += Bin->TileFirst[Tile];
+	}
+
+	ResizeDynamicArray(&Bin->TileTriangles, Bin->TileFirst[TileCount]);
+	for (uint32_t TriangleIndex = 0; TriangleIndex < Bin->Triangles.EntriesCount; TriangleIndex++)
+	{
+		software_triangle* Triangle = &Bin->Triangles[TriangleIndex];
+		for (int32_t TileY = Triangle->MinY / SOFTWARE_TILE_SIZE; TileY <= Triangle->MaxY / SOFTWARE_TILE_SIZE; TileY++)
+		{
+			for (int32_t TileX = Triangle->MinX / SOFTWARE_TILE_SIZE; TileX <= Triangle->MaxX / SOFTWARE_TILE_SIZE; TileX++)
+			{
+				Bin->TileTriangles[Bin->TileFirst[TileY * Renderer->TilesX + TileX]++] = TriangleIndex;
+			}
+		}
+	}
+
+	// NOTE(georgy): Placing moved every start to the next tile's, shift them back
+	for (uint32_t Tile = TileCount; Tile > 0; Tile--)
+	{
+		Bin->TileFirst[Tile] = Bin->TileFirst[Tile - 1];
+	}
+	Bin->TileFirst[0] = 0;
+}
+
+// NOTE(georgy): Lerps all four channels with an 8-bit weight, two channels per multiply
+inline uint32_t
+LerpTexel(uint32_t A, uint32_t B, uint32_t Weight)
+{
+	uint32_t RB = ((A & 0x00FF00FF) * (256 - Weight) + (B & 0x00FF00FF) * Weight) >> 8;
+	uint32_t GA = (((A >> 8) & 0x00FF00FF) * (256 - Weight) + ((B >> 8) & 0x00FF00FF) * Weight) >> 8;
+	uint32_t Result = (RB & 0x00FF00FF) | ((GA & 0x00FF00FF) << 8);
+
+	return(Result);
+}
+
+// NOTE(georgy): Same wrapping and atlas transform as DefaultFS.glsl, but bilinear from mip 0 only
+inline uint32_t
+SampleSoftwareTexture(texture_array* Textures, material_texture* Material, float U, float V)
+{
+	float LayerSize = (float)Textures->LayerSize;
+	U = (U - floorf(U)) * Material->UVTransform.x + Material->UVTransform.z;
+	V = (V - floorf(V)) * Material->UVTransform.y + Material->UVTransform.w;
+	float X = U * LayerSize - 0.5f;
+	float Y = V * LayerSize - 0.5f;
+	int32_t X0 = FloorReal32ToInt32(X);
+	int32_t Y0 = FloorReal32ToInt32(Y);
+	uint32_t WeightX = (uint32_t)((X - (float)X0) * 256.0f);
+	uint32_t WeightY = (uint32_t)((Y - (float)Y0) * 256.0f);
+
+	int32_t Last = (int32_t)Textures->LayerSize - 1;
+	int32_t X1 = Min(X0 + 1, Last), Y1 = Min(Y0 + 1, Last);
+	X0 = Max(X0, 0); Y0 = Max(Y0, 0);
+	X1 = Max(X1, 0); Y1 = Max(Y1, 0);
+
+	uint32_t* Layer = Textures->Texels.Entries + (size_t)Material->Layer * Textures->LayerSize * Textures->LayerSize;
+	uint32_t Top = LerpTexel(Layer[Y0 * Textures->LayerSize + X0], Layer[Y0 * Textures->LayerSize + X1], WeightX);
+	uint32_t Bottom = LerpTexel(Layer[Y1 * Textures->LayerSize + X0], Layer[Y1 * Textures->LayerSize + X1], WeightX);
+	uint32_t Result = LerpTexel(Top, Bottom, WeightY) | 0xFF000000;
+
+	return(Result);
+}
+
+inline float
+EvaluateSoftwarePlane(software_plane* Plane, software_triangle* Triangle, float X, float Y)
+{
+	float Result = Plane->Value + Plane->StepX*(X - Triangle->X[0]) + Plane->StepY*(Y - Triangle->Y[0]);
+	return(Result);
+}
+
+inline float
+SoftwareEdge(software_triangle* Triangle, uint32_t A, uint32_t B, float X, float Y)
+{
+	float Result = (Triangle->X[B] - Triangle->X[A])*(Y - Triangle->Y[A]) - (Triangle->Y[B] - Triangle->Y[A])*(X - Triangle->X[A]);
+	return(Result);
+}
+
+// NOTE(georgy): Draws the part of the triangle inside the tile's pixel rectangle. Returns how many pixels passed the depth test.
+static uint32_t
+RasterizeSoftwareTriangle(software_frame* Frame, software_triangle* Triangle, int32_t TileMinX, int32_t TileMinY, int32_t TileMaxX, int32_t TileMaxY)
+{
+	software_renderer* Renderer = Frame->Renderer;
+	int32_t MinX = Max(Triangle->MinX, TileMinX) & ~3;
+	int32_t MinY = Max(Triangle->MinY, TileMinY);
+	int32_t MaxX = Min(Triangle->MaxX, TileMaxX);
+	int32_t MaxY = Min(Triangle->MaxY, TileMaxY);
+	if ((MinX > MaxX) || (MinY > MaxY))
+	{
+		return(0);
+	}
+
+	float StepX0 = Triangle->Y[1] - Triangle->Y[2], StepY0 = Triangle->X[2] - Triangle->X[1];
+	float StepX1 = Triangle->Y[2] - Triangle->Y[0], StepY1 = Triangle->X[0] - Triangle->X[2];
+	float StepX2 = Triangle->Y[0] - Triangle->Y[1], StepY2 = Triangle->X[1] - Triangle->X[0];
+	float StartX = (float)MinX + 0.5f, StartY = (float)MinY + 0.5f;
+	float Row0 = SoftwareEdge(Triangle, 1, 2, StartX, StartY);
+	float Row1 = SoftwareEdge(Triangle, 2, 0, StartX, StartY);
+	float Row2 = SoftwareEdge(Triangle, 0, 1, StartX, StartY);
+	float DepthRow = EvaluateSoftwarePlane(&Triangle->Z, Triangle, StartX, StartY);
+	float InvWRow = EvaluateSoftwarePlane(&Triangle->InvW, Triangle, StartX, StartY);
+	float URow = EvaluateSoftwarePlane(&Triangle->UOverW, Triangle, StartX, StartY);
+	float VRow = EvaluateSoftwarePlane(&Triangle->VOverW, Triangle, StartX, StartY);
+
+	bool Textured = (Triangle->MaterialIndex >= 0);
+	material_texture* Material = Textured ? &Frame->Materials[Triangle->MaterialIndex] : 0;
+	uint32_t Result = 0;
+
+#if CULL_SSE
+	__m128 LaneOffsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+	__m128 Zero = _mm_setzero_ps();
+	__m128 One = _mm_set1_ps(1.0f);
+	__m128 Four = _mm_set1_ps(4.0f);
+	__m128 LastX = _mm_set1_ps((float)MaxX);
+	__m128 Edge0Step = _mm_set1_ps(4.0f * StepX0);
+	__m128 Edge1Step = _mm_set1_ps(4.0f * StepX1);
+	__m128 Edge2Step = _mm_set1_ps(4.0f * StepX2);
+	__m128 DepthStep = _mm_set1_ps(4.0f * Triangle->Z.StepX);
+	__m128 InvWStep = _mm_set1_ps(4.0f * Triangle->InvW.StepX);
+	__m128 UStep = _mm_set1_ps(4.0f * Triangle->UOverW.StepX);
+	__m128 VStep = _mm_set1_ps(4.0f * Triangle->VOverW.StepX);
+	__m128i Untextured = _mm_set1_epi32((int32_t)SOFTWARE_UNTEXTURED_COLOR);
+	for (int32_t Y = MinY; Y <= MaxY; Y++)
+	{
+		__m128 Edge0 = _mm_add_ps(_mm_set1_ps(Row0), _mm_mul_ps(LaneOffsets, _mm_set1_ps(StepX0)));
+		__m128 Edge1 = _mm_add_ps(_mm_set1_ps(Row1), _mm_mul_ps(LaneOffsets, _mm_set1_ps(StepX1)));
+		__m128 Edge2 = _mm_add_ps(_mm_set1_ps(Row2), _mm_mul_ps(LaneOffsets, _mm_set1_ps(StepX2)));
+		__m128 Depth = _mm_add_ps(_mm_set1_ps(DepthRow), _mm_mul_ps(LaneOffsets, _mm_set1_ps(Triangle->Z.StepX)));
+		__m128 InvW = _mm_add_ps(_mm_set1_ps(InvWRow), _mm_mul_ps(LaneOffsets, _mm_set1_ps(Triangle->InvW.StepX)));
+		__m128 UOverW = _mm_add_ps(_mm_set1_ps(URow), _mm_mul_ps(LaneOffsets, _mm_set1_ps(Triangle->UOverW.StepX)));
+		__m128 VOverW = _mm_add_ps(_mm_set1_ps(VRow), _mm_mul_ps(LaneOffsets, _mm_set1_ps(Triangle->VOverW.StepX)));
+		__m128 PixelX = _mm_add_ps(_mm_set1_ps((float)MinX), LaneOffsets);
+
+		float* DepthPixels = Renderer->Depth.Entries + (size_t)Y * Renderer->Pitch;
+		uint32_t* ColorPixels = Renderer->Color.Entries + (size_t)Y * Renderer->Pitch;
+		for (int32_t X = MinX; X <= MaxX; X += 4)
+		{
+			__m128 Inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(Edge0, Zero), _mm_cmpge_ps(Edge1, Zero)),
+									   _mm_and_ps(_mm_cmpge_ps(Edge2, Zero), _mm_cmple_ps(PixelX, LastX)));
+			if (_mm_movemask_ps(Inside))
+			{
+				__m128 OldDepth = _mm_loadu_ps(DepthPixels + X);
+				__m128 Write = _mm_and_ps(Inside, _mm_cmplt_ps(Depth, OldDepth));
+				int WriteMask = _mm_movemask_ps(Write);
+				if (WriteMask)
+				{
+					_mm_storeu_ps(DepthPixels + X, _mm_or_ps(_mm_and_ps(Write, Depth), _mm_andnot_ps(Write, OldDepth)));
+
+					if (Textured)
+					{
+						// NOTE(georgy): SSE2 has no gather, the texels are fetched lane by lane
+						__m128 W = _mm_div_ps(One, InvW);
+						float U[4], V[4];
+						_mm_storeu_ps(U, _mm_mul_ps(UOverW, W));
+						_mm_storeu_ps(V, _mm_mul_ps(VOverW, W));
+						for (uint32_t Lane = 0; Lane < 4; Lane++)
+						{
+							if (WriteMask & (1 << Lane))
+							{
+								ColorPixels[X + Lane] = SampleSoftwareTexture(Frame->Textures, Material, U[Lane], V[Lane]);
+							}
+						}
+					}
+					else
+					{
+						__m128i WriteBits = _mm_castps_si128(Write);
+						__m128i OldColor = _mm_loadu_si128((__m128i*)(ColorPixels + X));
+						_mm_storeu_si128((__m128i*)(ColorPixels + X), _mm_or_si128(_mm_and_si128(WriteBits, Untextured), _mm_andnot_si128(WriteBits, OldColor)));
+					}
+
+					Result += (WriteMask & 1) + ((WriteMask >> 1) & 1) + ((WriteMask >> 2) & 1) + ((WriteMask >> 3) & 1);
+				}
+			}
+
+			Edge0 = _mm_add_ps(Edge0, Edge0Step);
+			Edge1 = _mm_add_ps(Edge1, Edge1Step);
+			Edge2 = _mm_add_ps(Edge2, Edge2Step);
+			Depth = _mm_add_ps(Depth, DepthStep);
+			InvW = _mm_add_ps(InvW, InvWStep);
+			UOverW = _mm_add_ps(UOverW, UStep);
+			VOverW = _mm_add_ps(VOverW, VStep);
+			PixelX = _mm_add_ps(PixelX, Four);
+		}
+
+		Row0 += StepY0; Row1 += StepY1; Row2 += StepY2;
+		DepthRow += Triangle->Z.StepY;
+		InvWRow += Triangle->InvW.StepY;
+		URow += Triangle->UOverW.StepY;
+		VRow += Triangle->VOverW.StepY;
+	}
+#else
+	for (int32_t Y = MinY; Y <= MaxY; Y++)
+	{
+		float Edge0 = Row0, Edge1 = Row1, Edge2 = Row2;
+		float Depth = DepthRow, InvW = InvWRow, UOverW = URow, VOverW = VRow;
+		float* DepthPixels = Renderer->Depth.Entries + (size_t)Y * Renderer->Pitch;
+		uint32_t* ColorPixels = Renderer->Color.Entries + (size_t)Y * Renderer->Pitch;
+		for (int32_t X = MinX; X <= MaxX; X++)
+		{
+			if ((Edge0 >= 0.0f) && (Edge1 >= 0.0f) && (Edge2 >= 0.0f) && (Depth < DepthPixels[X]))
+			{
+				DepthPixels[X] = Depth;
+				ColorPixels[X] = Textured ? SampleSoftwareTexture(Frame->Textures, Material, UOverW / InvW, VOverW / InvW) : SOFTWARE_UNTEXTURED_COLOR;
+				Result++;
+			}
+
+			Edge0 += StepX0; Edge1 += StepX1; Edge2 += StepX2;
+			Depth += Triangle->Z.StepX;
+			InvW += Triangle->InvW.StepX;
+			UOverW += Triangle->UOverW.StepX;
+			VOverW += Triangle->VOverW.StepX;
+		}
+
+		Row0 += StepY0; Row1 += StepY1; Row2 += StepY2;
+		DepthRow += Triangle->Z.StepY;
+		InvWRow += Triangle->InvW.StepY;
+		URow += Triangle->UOverW.StepY;
+		VRow += Triangle->VOverW.StepY;
+	}
+#endif
+
+	return(Result);
+}
+
+static PLATFORM_WORK_QUEUE_CALLBACK(DoSoftwareTileJob)
+{
+	(void)Queue;
+	PROFILE_ZONE("DoSoftwareTileJob");
+
+	software_tile_job* Job = (software_tile_job*)Data;
+	software_frame* Frame = Job->Frame;
+	software_renderer* Renderer = Frame->Renderer;
+
+	Job->Pixels = 0;
+	uint32_t TileCount = Renderer->TilesX * Renderer->TilesY;
+	for (uint32_t Tile = Job->FirstTile; Tile < TileCount; Tile += Job->TileStride)
+	{
+		int32_t TileMinX = (Tile % Renderer->TilesX) * SOFTWARE_TILE_SIZE;
+		int32_t TileMinY = (Tile / Renderer->TilesX) * SOFTWARE_TILE_SIZE;
+		int32_t TileMaxX = TileMinX + SOFTWARE_TILE_SIZE - 1;
+		int32_t TileMaxY = TileMinY + SOFTWARE_TILE_SIZE - 1;
+
+		for (int32_t Y = TileMinY; Y <= TileMaxY; Y++)
+		{
+			float* DepthPixels = Renderer->Depth.Entries + (size_t)Y * Renderer->Pitch;
+			uint32_t* ColorPixels = Renderer->Color.Entries + (size_t)Y * Renderer->Pitch;
+			for (int32_t X = TileMinX; X <= TileMaxX; X++)
+			{
+				DepthPixels[X] = 1.0f;
+				ColorPixels[X] = SOFTWARE_CLEAR_COLOR;
+			}
+		}
+
+		for (uint32_t BinIndex = 0; BinIndex < Renderer->BinCount; BinIndex++)
+		{
+			software_bin* Bin = &Renderer->Bins[BinIndex];
+			for (uint32_t Index = Bin->TileFirst[Tile]; Index < Bin->TileFirst[Tile + 1]; Index++)
+			{
+				software_triangle* Triangle = &Bin->Triangles[Bin->TileTriangles[Index]];
+				Job->Pixels += RasterizeSoftwareTriangle(Frame, Triangle, TileMinX, TileMinY, TileMaxX, TileMaxY);
+			}
+		}
+	}
+}
+
+static void
+RunSoftwareJobs(game_memory* Memory, platform_work_queue_callback* Callback, void* Jobs, uint32_t JobSize, uint32_t JobCount)
+{
+	for (uint32_t JobIndex = 0; JobIndex < JobCount; JobIndex++)
+	{
+		void* Job = (uint8_t*)Jobs + (size_t)JobSize * JobIndex;
+		if (Memory->WorkQueue)
+		{
+			Memory->PlatformAddEntry(Memory->WorkQueue, Callback, Job);
+		}
+		else
+		{
+			Callback(0, Job);
+		}
+	}
+	if (Memory->WorkQueue)
+	{
+		Memory->PlatformCompleteAllWork(Memory->WorkQueue);
+	}
+}
+
+// NOTE(georgy): Draws the draw list's meshes into the renderer's color buffer, which is Width x Height with Pitch pixels per row
+static void
+RenderSoftware(game_memory* Memory, memory_arena* FrameArena, software_renderer* Renderer, uint32_t Width, uint32_t Height, mat4 ClipFromModel,
+			   mesh* Meshes, draw_command* Draws, uint32_t DrawCount, vec3* Positions, vec2* TexCoords, uint32_t VertexCount,
+			   uint32_t* Indices, material_texture* Materials, texture_array* Textures)
+{
+	PROFILE_ZONE("RenderSoftware");
+	MEMORY_TAG(MemoryTag_Software);
+
+	double StartTime = GetWallClockSeconds();
+
+	if ((Renderer->Width != Width) || (Renderer->Height != Height))
+	{
+		Renderer->Width = Width;
+		Renderer->Height = Height;
+		Renderer->TilesX = (Width + SOFTWARE_TILE_SIZE - 1) / SOFTWARE_TILE_SIZE;
+		Renderer->TilesY = (Height + SOFTWARE_TILE_SIZE - 1) / SOFTWARE_TILE_SIZE;
+		Renderer->Pitch = Renderer->TilesX * SOFTWARE_TILE_SIZE;
+
+		uint32_t PixelCount = Renderer->Pitch * Renderer->TilesY * SOFTWARE_TILE_SIZE;
+		ReserveDynamicArray(&Renderer->Color, PixelCount);
+		ReserveDynamicArray(&Renderer->Depth, PixelCount);
+		Renderer->Color.EntriesCount = Renderer->Depth.EntriesCount = PixelCount;
+	}
+
+	software_frame Frame;
+	Frame.Renderer = Renderer;
+	Frame.ClipFromModel = ClipFromModel;
+	Frame.Meshes = Meshes;
+	Frame.Draws = Draws;
+	Frame.DrawCount = DrawCount;
+	Frame.Positions = Positions;
+	Frame.TexCoords = TexCoords;
+	Frame.Indices = Indices;
+	Frame.Materials = Materials;
+	Frame.Textures = Textures;
+
+	// NOTE(georgy): Every vertex is transformed, also the ones of culled meshes. The ranges stay simple and evenly sized.
+	ReserveDynamicArray(&Renderer->ClipPositions, VertexCount);
+	Renderer->ClipPositions.EntriesCount = VertexCount;
+	uint32_t VertexJobSize = Max((uint32_t)SOFTWARE_VERTEX_JOB_SIZE, (VertexCount + 127) / 128);
+	uint32_t VertexJobCount = (VertexCount + VertexJobSize - 1) / VertexJobSize;
+	temporary_memory JobMemory = BeginTemporaryMemory(FrameArena);
+	dynamic_array<software_vertex_job> VertexJobs(VertexJobCount, FrameArena);
+	for (uint32_t JobIndex = 0; JobIndex < VertexJobCount; JobIndex++)
+	{
+		software_vertex_job Job;
+		Job.Frame = &Frame;
+		Job.First = JobIndex * VertexJobSize;
+		Job.OnePastLast = Min(Job.First + VertexJobSize, VertexCount);
+		PushEntry(&VertexJobs, Job);
+	}
+	RunSoftwareJobs(Memory, DoSoftwareVertexJob, VertexJobs.Entries, sizeof(software_vertex_job), VertexJobCount);
+	EndTemporaryMemory(JobMemory);
+
+	ResizeDynamicArray(&Renderer->DrawFirstTriangle, DrawCount + 1);
+	uint32_t TriangleCount = 0;
+	for (uint32_t DrawIndex = 0; DrawIndex < DrawCount; DrawIndex++)
+	{
+		Renderer->DrawFirstTriangle[DrawIndex] = TriangleCount;
+		TriangleCount += Meshes[Draws[DrawIndex].MeshIndex].IndexCount / 3;
+	}
+	Renderer->DrawFirstTriangle[DrawCount] = TriangleCount;
+
+	uint32_t BinCount = Min((uint32_t)SOFTWARE_MAX_BINS, (TriangleCount + SOFTWARE_BIN_JOB_SIZE - 1) / SOFTWARE_BIN_JOB_SIZE);
+	uint32_t BinSize = (BinCount > 0) ? (TriangleCount + BinCount - 1) / BinCount : 0;
+	Renderer->BinCount = BinCount;
+	for (uint32_t BinIndex = 0; BinIndex < BinCount; BinIndex++)
+	{
+		software_bin* Bin = &Renderer->Bins[BinIndex];
+		Bin->Frame = &Frame;
+		Bin->FirstTriangle = BinIndex * BinSize;
+		Bin->OnePastLastTriangle = Min(Bin->FirstTriangle + BinSize, TriangleCount);
+	}
+	RunSoftwareJobs(Memory, DoSoftwareBinJob, Renderer->Bins, sizeof(software_bin), BinCount);
+
+	// NOTE(georgy): Tiles are dealt out round robin, neighbouring tiles usually cost about the same
+	uint32_t TileCount = Renderer->TilesX * Renderer->TilesY;
+	uint32_t TileJobCount = Min(TileCount, (uint32_t)SOFTWARE_MAX_TILE_JOBS);
+	software_tile_job TileJobs[SOFTWARE_MAX_TILE_JOBS];
+	for (uint32_t JobIndex = 0; JobIndex < TileJobCount; JobIndex++)
+	{
+		TileJobs[JobIndex].Frame = &Frame;
+		TileJobs[JobIndex].FirstTile = JobIndex;
+		TileJobs[JobIndex].TileStride = TileJobCount;
+		TileJobs[JobIndex].Pixels = 0;
+	}
+	RunSoftwareJobs(Memory, DoSoftwareTileJob, TileJobs, sizeof(software_tile_job), TileJobCount);
+
+	software_stats* Stats = &Renderer->Stats;
+	Stats->Triangles += TriangleCount;
+	for (uint32_t BinIndex = 0; BinIndex < BinCount; BinIndex++)
+	{
+		Stats->DrawnTriangles += Renderer->Bins[BinIndex].Triangles.EntriesCount;
+	}
+	for (uint32_t JobIndex = 0; JobIndex < TileJobCount; JobIndex++)
+	{
+		Stats->Pixels += TileJobs[JobIndex].Pixels;
+	}
+	Stats->Frames++;
+	Stats->Seconds += GetWallClockSeconds() - StartTime;
+}
+
+// NOTE(georgy): About once a second, rates are over the time spent rendering only
+static void
+ReportSoftwareStats(software_renderer* Renderer)
+{
+	double Now = GetWallClockSeconds();
+	software_stats* Stats = &Renderer->Stats;
+	if ((Now - Renderer->LastReportTime >= 1.0) && (Stats->Frames > 0) && (Stats->Seconds > 0.0))
+	{
+		printf("Software renderer: %ux%u, %.2f ms per frame, %.2f M triangles/s (%.1f%% drawn after culling), %.2f M pixels/s\n",
+			Renderer->Width, Renderer->Height, 1000.0 * Stats->Seconds / Stats->Frames,
+			(double)Stats->Triangles / Stats->Seconds / 1000000.0,
+			(Stats->Triangles > 0) ? 100.0 * (double)Stats->DrawnTriangles / (double)Stats->Triangles : 0.0,
+			(double)Stats->Pixels / Stats->Seconds / 1000000.0);
+
+		*Stats = {};
+		Renderer->LastReportTime = Now;
+	}
+}
+
+// NOTE(georgy): A fullscreen triangle sampling the frame. The default framebuffer is multisampled, so it can't be blitted to.
+static void
+PresentSoftwareFrame(software_renderer* Renderer, gl_state_cache* Cache)
+{
+	if (!Renderer->PresentInitialized)
+	{
+		Renderer->PresentShader = shader("shaders/PresentVS.glsl", "shaders/PresentFS.glsl");
+		glGenVertexArrays(1, &Renderer->PresentVAO);
+		glGenTextures(1, &Renderer->PresentTexture);
+		glBindTexture(GL_TEXTURE_2D, Renderer->PresentTexture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		Renderer->PresentInitialized = true;
+	}
+
+	CacheBindTexture(Cache, 0, GL_TEXTURE_2D, Renderer->PresentTexture);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, Renderer->Pitch);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, Renderer->Width, Renderer->Height, 0, GL_RGBA, GL_UNSIGNED_BYTE, Renderer->Color.Entries);
+	TrackGPUObject(MemoryTag_GPUTextures, Renderer->PresentTexture, 4 * (uint64_t)Renderer->Width * Renderer->Height);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+	if (CacheUseProgram(Cache, Renderer->PresentShader.GetID()))
+	{
+		Renderer->PresentShader.SetI32("Frame", 0);
+	}
+	CacheBindVertexArray(Cache, Renderer->PresentVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	Cache->Stats.DrawCalls++;
+}
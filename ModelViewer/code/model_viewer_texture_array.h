@@ -0,0 +1,421 @@
+#pragma once
+
+// NOTE(georgy): All material textures of a model live in one RGBA8 GL_TEXTURE_2D_ARRAY, so every draw shares a single binding.
+// The layer size is the largest texture dimension (clamped). Textures of exactly that size get a layer of their own,
+// smaller ones are shelf-packed into shared layers. Packed textures get a padding border filled with their own wrapped
+// texels and sit on a padding-aligned grid, so bilinear filtering and the first mips don't bleed between neighbours.
+// A material keeps its layer, the UV transform into the layer and the highest mip it may use, DefaultFS.glsl applies them.
+// The top mip of every layer also stays in memory for the software renderer.
+
+#define TEXTURE_ARRAY_MAX_LAYER_SIZE 2048
+#define ATLAS_PADDING 8
+#define ATLAS_PADDING_LOG2 3
+
+enum material_attribute
+{
+	MaterialUVTransform_Attribute = 7,
+	MaterialLayer_Attribute,
+};
+
+// NOTE(georgy): Also the layout of the per-material vertex attributes
+struct material_texture
+{
+	vec4 UVTransform; // NOTE(georgy): xy scale, zw offset
+	float Layer; // NOTE(georgy): Negative for untextured materials
+	float MaxLod;
+};
+
+// NOTE(georgy): Where a material's texture ended up, Width is 0 if it has none
+struct texture_slot
+{
+	uint32_t X, Y, Layer;
+	uint32_t Width, Height;
+	bool OwnLayer;
+};
+
+struct texture_array
+{
+	GLuint Texture;
+	uint32_t LayerSize;
+	uint32_t LayerCount;
+
+	// NOTE(georgy): RGBA8, layer after layer, mip 0 only
+	dynamic_array<uint32_t> Texels;
+	// NOTE(georgy): One per material, so a changed texture can go back into its old place
+	dynamic_array<texture_slot> Slots;
+};
+
+struct atlas_image
+{
+	uint8_t* Pixels;
+	uint32_t Width;
+	uint32_t Height;
+	uint32_t MaterialIndex;
+
+	uint32_t X, Y, Layer;
+	bool OwnLayer;
+};
+
+// NOTE(georgy): 2x2 box filter, in place. Only for textures larger than the layer size.
+static void
+HalveImage(atlas_image* Image)
+{
+	uint32_t Width = Max(Image->Width / 2, 1u);
+	uint32_t Height = Max(Image->Height / 2, 1u);
+	for (uint32_t Y = 0; Y < Height; Y++)
+	{
+		for (uint32_t X = 0; X < Width; X++)
+		{
+			uint32_t X0 = Min(2 * X, Image->Width - 1), X1 = Min(2 * X + 1, Image->Width - 1);
+			uint32_t Y0 = Min(2 * Y, Image->Height - 1), Y1 = Min(2 * Y + 1, Image->Height - 1);
+			for (uint32_t Channel = 0; Channel < 4; Channel++)
+			{
+				uint32_t Sum = Image->Pixels[4 * (Y0 * Image->Width + X0) + Channel] + Image->Pixels[4 * (Y0 * Image->Width + X1) + Channel] +
+							   Image->Pixels[4 * (Y1 * Image->Width + X0) + Channel] + Image->Pixels[4 * (Y1 * Image->Width + X1) + Channel];
+				Image->Pixels[4 * (Y * Width + X) + Channel] = (uint8_t)((Sum + 2) / 4);
+			}
+		}
+	}
+
+	Image->Width = Width;
+	Image->Height = Height;
+}
+
+inline uint32_t
+AlignUp(uint32_t Value, uint32_t Alignment)
+{
+	uint32_t Result = (Value + Alignment - 1) / Alignment * Alignment;
+	return(Result);
+}
+
+static int
+CompareAtlasImageHeights(const void* A, const void* B)
+{
+	uint32_t HeightA = ((atlas_image*)A)->Height;
+	uint32_t HeightB = ((atlas_image*)B)->Height;
+	int Result = (HeightA > HeightB) ? -1 : ((HeightA < HeightB) ? 1 : 0);
+
+	return(Result);
+}
+
+// NOTE(georgy): Decodes to RGBA8 and halves until it fits MaxLayerSize. Pixels have to go back to stbi_image_free.
+static bool
+LoadAtlasImage(const char* Path, uint32_t MaterialIndex, uint32_t MaxLayerSize, atlas_image* Image)
+{
+	*Image = {};
+
+	int Width, Height, Channels;
+	stbi_uc* Pixels = stbi_load(Path, &Width, &Height, &Channels, 4);
+	if (!Pixels)
+	{
+		printf("Failed to load texture %s\n", Path);
+		return(false);
+	}
+
+	Image->Pixels = Pixels;
+	Image->Width = Width;
+	Image->Height = Height;
+	Image->MaterialIndex = MaterialIndex;
+	while ((Image->Width > MaxLayerSize) || (Image->Height > MaxLayerSize))
+	{
+		HalveImage(Image);
+	}
+
+	return(true);
+}
+
+// NOTE(georgy): Writes the image with its wrapped padding border, Width x Height plus Padding on every side
+static void
+CopyImageToLayer(uint8_t* Layer, uint32_t LayerSize, atlas_image* Image, uint32_t Padding, uint32_t FillWidth, uint32_t FillHeight)
+{
+	for (uint32_t Y = 0; Y < FillHeight; Y++)
+	{
+		uint32_t SourceY = (Y + Image->Height - (Padding % Image->Height)) % Image->Height;
+		uint8_t* Row = Layer + 4 * ((size_t)(Image->Y - Padding + Y) * LayerSize + (Image->X - Padding));
+		for (uint32_t X = 0; X < FillWidth; X++)
+		{
+			uint32_t SourceX = (X + Image->Width - (Padding % Image->Width)) % Image->Width;
+			memcpy(Row + 4 * X, Image->Pixels + 4 * ((size_t)SourceY * Image->Width + SourceX), 4);
+		}
+	}
+}
+
+// NOTE(georgy): A texture alone in its layer tiles the whole layer, so sampling past its edge still wraps
+static void
+WriteAtlasImage(texture_array* Array, atlas_image* Image)
+{
+	uint32_t LayerSize = Array->LayerSize;
+	uint8_t* Layer = (uint8_t*)(Array->Texels.Entries + (size_t)Image->Layer * LayerSize * LayerSize);
+	if (Image->OwnLayer)
+	{
+		CopyImageToLayer(Layer, LayerSize, Image, 0, LayerSize, LayerSize);
+	}
+	else
+	{
+		CopyImageToLayer(Layer, LayerSize, Image, ATLAS_PADDING, Image->Width + 2 * ATLAS_PADDING, Image->Height + 2 * ATLAS_PADDING);
+	}
+}
+
+// NOTE(georgy): The CPU half: decodes, packs into Texels and fills Materials, one entry per path. Paths[MaterialIndex] may be empty.
+// Materials with the same path share one decode and one slot. No GL here, so it runs on any thread.
+// Returns how many textures were packed, 0 if there is nothing to sample.
+static uint32_t
+PackTextureArray(texture_array* Array, uint32_t MaterialCount, const char** Paths, material_texture* Materials, uint32_t MaxLayerSize,
+				 memory_arena* Scratch)
+{
+	PROFILE_ZONE("PackTextureArray");
+	MEMORY_TAG(MemoryTag_Textures);
+
+	Array->LayerSize = Array->LayerCount = 0;
+	Array->Texels.EntriesCount = 0;
+	Array->Slots.EntriesCount = 0;
+	ResizeDynamicArray(&Array->Slots, MaterialCount);
+
+	temporary_memory ImageMemory = BeginTemporaryMemory(Scratch);
+	dynamic_array<atlas_image> Images(0, Scratch);
+	// NOTE(georgy): The first material with the same path, the material itself if there is none
+	dynamic_array<uint32_t> FirstWithPath(MaterialCount, Scratch);
+	for (uint32_t MaterialIndex = 0; MaterialIndex < MaterialCount; MaterialIndex++)
+	{
+		Materials[MaterialIndex].UVTransform = vec4(1.0f, 1.0f, 0.0f, 0.0f);
+		Materials[MaterialIndex].Layer = -1.0f;
+		Materials[MaterialIndex].MaxLod = 0.0f;
+
+		uint32_t First = MaterialIndex;
+		for (uint32_t Other = 0; Paths[MaterialIndex][0] && (Other < MaterialIndex); Other++)
+		{
+			if (strcmp(Paths[Other], Paths[MaterialIndex]) == 0)
+			{
+				First = Other;
+				break;
+			}
+		}
+		PushEntry(&FirstWithPath, First);
+
+		atlas_image Image;
+		if ((First == MaterialIndex) && Paths[MaterialIndex][0] && LoadAtlasImage(Paths[MaterialIndex], MaterialIndex, MaxLayerSize, &Image))
+		{
+			Array->LayerSize = Max(Array->LayerSize, Max(Image.Width, Image.Height));
+			PushEntry(&Images, Image);
+		}
+	}
+
+	if (Images.EntriesCount == 0)
+	{
+		EndTemporaryMemory(ImageMemory);
+		return(0);
+	}
+
+	// NOTE(georgy): Shelf packing, tallest first. Whatever doesn't fit with its padding gets a layer of its own.
+	qsort(Images.Entries, Images.EntriesCount, sizeof(atlas_image), CompareAtlasImageHeights);
+	uint32_t LayerSize = Array->LayerSize;
+	uint32_t ShelfX = 0, ShelfY = 0, ShelfHeight = 0;
+	int32_t SharedLayer = -1;
+	uint32_t LayerCount = 0;
+	for (uint32_t ImageIndex = 0; ImageIndex < Images.EntriesCount; ImageIndex++)
+	{
+		atlas_image* Image = &Images[ImageIndex];
+		uint32_t FootprintWidth = AlignUp(Image->Width + 2 * ATLAS_PADDING, ATLAS_PADDING);
+		uint32_t FootprintHeight = AlignUp(Image->Height + 2 * ATLAS_PADDING, ATLAS_PADDING);
+		if ((FootprintWidth > LayerSize) || (FootprintHeight > LayerSize))
+		{
+			Image->OwnLayer = true;
+			Image->X = Image->Y = 0;
+			Image->Layer = LayerCount++;
+			continue;
+		}
+
+		if ((SharedLayer >= 0) && (ShelfX + FootprintWidth > LayerSize))
+		{
+			ShelfX = 0;
+			ShelfY += ShelfHeight;
+			ShelfHeight = 0;
+		}
+		if ((SharedLayer < 0) || (ShelfY + FootprintHeight > LayerSize))
+		{
+			SharedLayer = LayerCount++;
+			ShelfX = ShelfY = ShelfHeight = 0;
+		}
+
+		Image->X = ShelfX + ATLAS_PADDING;
+		Image->Y = ShelfY + ATLAS_PADDING;
+		Image->Layer = SharedLayer;
+		ShelfX += FootprintWidth;
+		ShelfHeight = Max(ShelfHeight, FootprintHeight);
+	}
+	Array->LayerCount = LayerCount;
+
+	uint32_t MipCount = 1;
+	while ((LayerSize >> MipCount) > 0)
+	{
+		MipCount++;
+	}
+
+	uint32_t LayerTexelCount = LayerSize * LayerSize;
+	ReserveDynamicArray(&Array->Texels, LayerCount * LayerTexelCount);
+	Array->Texels.EntriesCount = LayerCount * LayerTexelCount;
+	for (uint32_t LayerIndex = 0; LayerIndex < LayerCount; LayerIndex++)
+	{
+		uint8_t* Layer = (uint8_t*)(Array->Texels.Entries + (size_t)LayerIndex * LayerTexelCount);
+		memset(Layer, 0, 4 * (size_t)LayerTexelCount);
+		for (uint32_t ImageIndex = 0; ImageIndex < Images.EntriesCount; ImageIndex++)
+		{
+			atlas_image* Image = &Images[ImageIndex];
+			if (Image->Layer != LayerIndex)
+			{
+				continue;
+			}
+
+			WriteAtlasImage(Array, Image);
+
+			texture_slot* Slot = &Array->Slots[Image->MaterialIndex];
+			Slot->X = Image->X;
+			Slot->Y = Image->Y;
+			Slot->Layer = Image->Layer;
+			Slot->Width = Image->Width;
+			Slot->Height = Image->Height;
+			Slot->OwnLayer = Image->OwnLayer;
+
+			material_texture* Material = &Materials[Image->MaterialIndex];
+			Material->UVTransform = vec4((float)Image->Width / (float)LayerSize, (float)Image->Height / (float)LayerSize,
+										 (float)Image->X / (float)LayerSize, (float)Image->Y / (float)LayerSize);
+			Material->Layer = (float)Image->Layer;
+			Material->MaxLod = (Image->OwnLayer && (Image->Width == LayerSize) && (Image->Height == LayerSize)) ?
+				(float)(MipCount - 1) : (float)ATLAS_PADDING_LOG2;
+		}
+	}
+
+	for (uint32_t MaterialIndex = 0; MaterialIndex < MaterialCount; MaterialIndex++)
+	{
+		uint32_t First = FirstWithPath[MaterialIndex];
+		Materials[MaterialIndex] = Materials[First];
+		Array->Slots[MaterialIndex] = Array->Slots[First];
+	}
+
+	for (uint32_t ImageIndex = 0; ImageIndex < Images.EntriesCount; ImageIndex++)
+	{
+		stbi_image_free(Images[ImageIndex].Pixels);
+	}
+	uint32_t Result = Images.EntriesCount;
+	FreeDynamicArray(&FirstWithPath);
+	FreeDynamicArray(&Images);
+	EndTemporaryMemory(ImageMemory);
+
+	return(Result);
+}
+
+// NOTE(georgy): The CPU half of replacing one changed texture, writes it into its old slot in Texels.
+// Only works if it decodes to the same size as before, otherwise returns false and the whole array has to be packed again.
+static bool
+RepackTextureArrayImage(texture_array* Array, uint32_t MaterialIndex, const char* Path, uint32_t MaxLayerSize)
+{
+	PROFILE_ZONE("RepackTextureArrayImage");
+
+	texture_slot* Slot = &Array->Slots[MaterialIndex];
+	if (Slot->Width == 0)
+	{
+		return(false);
+	}
+
+	atlas_image Image;
+	if (!LoadAtlasImage(Path, MaterialIndex, MaxLayerSize, &Image))
+	{
+		return(false);
+	}
+
+	bool Result = (Image.Width == Slot->Width) && (Image.Height == Slot->Height);
+	if (Result)
+	{
+		Image.X = Slot->X;
+		Image.Y = Slot->Y;
+		Image.Layer = Slot->Layer;
+		Image.OwnLayer = Slot->OwnLayer;
+		WriteAtlasImage(Array, &Image);
+	}
+	stbi_image_free(Image.Pixels);
+
+	return(Result);
+}
+
+// NOTE(georgy): Largest layer the GL side takes
+static uint32_t
+TextureArrayMaxLayerSize(void)
+{
+	GLint MaxTextureSize;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &MaxTextureSize);
+	uint32_t Result = Min((uint32_t)MaxTextureSize, (uint32_t)TEXTURE_ARRAY_MAX_LAYER_SIZE);
+
+	return(Result);
+}
+
+// NOTE(georgy): The GL half, replaces the texture with what PackTextureArray left in Texels. TextureCount is what it returned.
+// Returns false if there is nothing to sample.
+static bool
+UploadTextureArray(texture_array* Array, uint32_t TextureCount)
+{
+	PROFILE_ZONE("UploadTextureArray");
+
+	if (Array->Texture)
+	{
+		TrackGPUObject(MemoryTag_GPUTextures, Array->Texture, 0);
+		glDeleteTextures(1, &Array->Texture);
+		Array->Texture = 0;
+	}
+
+	if (TextureCount == 0)
+	{
+		return(false);
+	}
+
+	uint32_t LayerSize = Array->LayerSize;
+	uint32_t LayerTexelCount = LayerSize * LayerSize;
+	glGenTextures(1, &Array->Texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, Array->Texture);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, LayerSize, LayerSize, Array->LayerCount, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	for (uint32_t LayerIndex = 0; LayerIndex < Array->LayerCount; LayerIndex++)
+	{
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, LayerIndex, LayerSize, LayerSize, 1, GL_RGBA, GL_UNSIGNED_BYTE,
+			Array->Texels.Entries + (size_t)LayerIndex * LayerTexelCount);
+	}
+
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	// NOTE(georgy): The mip chain adds a third
+	TrackGPUObject(MemoryTag_GPUTextures, Array->Texture, 4 * (uint64_t)LayerTexelCount * Array->LayerCount * 4 / 3);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	PROFILE_COUNTER("Texture array textures", TextureCount);
+	PROFILE_COUNTER("Texture array layers", Array->LayerCount);
+
+	return(true);
+}
+
+// NOTE(georgy): The GL half of RepackTextureArrayImage, uploads just the slot (with its padding) and rebuilds the mips.
+// glGenerateMipmap has no way to take a single layer, so the mips of the other layers are rebuilt as well.
+static void
+UploadTextureArrayImage(texture_array* Array, uint32_t MaterialIndex)
+{
+	PROFILE_ZONE("UploadTextureArrayImage");
+
+	texture_slot* Slot = &Array->Slots[MaterialIndex];
+	uint32_t LayerSize = Array->LayerSize;
+	uint32_t X = 0, Y = 0, Width = LayerSize, Height = LayerSize;
+	if (!Slot->OwnLayer)
+	{
+		X = Slot->X - ATLAS_PADDING;
+		Y = Slot->Y - ATLAS_PADDING;
+		Width = Slot->Width + 2 * ATLAS_PADDING;
+		Height = Slot->Height + 2 * ATLAS_PADDING;
+	}
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, Array->Texture);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, LayerSize);
+	glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, X, Y, Slot->Layer, Width, Height, 1, GL_RGBA, GL_UNSIGNED_BYTE,
+		Array->Texels.Entries + ((size_t)Slot->Layer * LayerSize + Y) * LayerSize + X);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
@@ -0,0 +1,85 @@
+#version 330 core
+layout (location = 0) in vec3 aP;
+layout (location = 1) in vec3 aN;
+#ifdef HAS_UV
+layout (location = 2) in vec2 aUV;
+#endif
+#ifdef SKINNED
+layout (location = 3) in uvec4 aBoneIndices;
+layout (location = 4) in vec4 aBoneWeights;
+#endif
+layout (location = 5) in vec4 aInstancePositionTimeOffset;
+layout (location = 6) in uint aInstanceClip;
+#ifdef HAS_TEXTURE
+layout (location = 7) in vec4 aMaterialUVTransform;
+layout (location = 8) in vec2 aMaterialLayer;
+#endif
+
+#define MAX_BAKED_CLIPS 32
+
+layout (std140) uniform FrameConstants
+{
+    mat4 Projection;
+    mat4 View;
+};
+uniform mat4 Model = mat4(1.0);
+
+#ifdef SKINNED
+uniform sampler2D BoneTexture;
+uniform float Time;
+uniform float FramesPerSecond;
+uniform int ClipFirstFrame[MAX_BAKED_CLIPS];
+uniform int ClipFrameCount[MAX_BAKED_CLIPS];
+#endif
+
+#ifdef HAS_UV
+out vec2 TexCoords;
+#endif
+#ifdef HAS_TEXTURE
+flat out vec4 MaterialUVTransform;
+flat out vec2 MaterialLayer;
+#endif
+
+#ifdef SKINNED
+mat4 FetchBone(uint Bone, int Frame)
+{
+    int X = 3 * int(Bone);
+    vec4 Row0 = texelFetch(BoneTexture, ivec2(X + 0, Frame), 0);
+    vec4 Row1 = texelFetch(BoneTexture, ivec2(X + 1, Frame), 0);
+    vec4 Row2 = texelFetch(BoneTexture, ivec2(X + 2, Frame), 0);
+    return transpose(mat4(Row0, Row1, Row2, vec4(0.0, 0.0, 0.0, 1.0)));
+}
+#endif
+
+void main()
+{
+    vec4 P = vec4(aP, 1.0);
+#ifdef SKINNED
+    // NOTE(georgy): The last baked frame equals the first one of a looping clip, so the period is FrameCount - 1
+    int Period = max(ClipFrameCount[aInstanceClip] - 1, 1);
+    float Frame = mod((Time + aInstancePositionTimeOffset.w) * FramesPerSecond, float(Period));
+    int Frame0 = ClipFirstFrame[aInstanceClip] + int(Frame);
+    int Frame1 = min(Frame0 + 1, ClipFirstFrame[aInstanceClip] + ClipFrameCount[aInstanceClip] - 1);
+    float t = fract(Frame);
+
+    float WeightSum = dot(aBoneWeights, vec4(1.0));
+    if (WeightSum > 0.0)
+    {
+        mat4 Skin = mat4(0.0);
+        for (int I = 0; I < 4; I++)
+        {
+            Skin += aBoneWeights[I] * mix(FetchBone(aBoneIndices[I], Frame0), FetchBone(aBoneIndices[I], Frame1), t);
+        }
+        P = Skin * P;
+    }
+#endif
+
+#ifdef HAS_UV
+    TexCoords = aUV;
+#endif
+#ifdef HAS_TEXTURE
+    MaterialUVTransform = aMaterialUVTransform;
+    MaterialLayer = aMaterialLayer;
+#endif
+    gl_Position = Projection * View * (Model * P + vec4(aInstancePositionTimeOffset.xyz, 0.0));
+}
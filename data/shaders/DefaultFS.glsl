@@ -1,11 +1,29 @@
 #version 330 core
 out vec4 FragCoord;
 
-uniform sampler2D Albedo;
+#ifdef HAS_TEXTURE
+// NOTE(georgy): All material textures of the model. A material is a rectangle of one layer:
+// MaterialUVTransform is the scale and offset into it, MaterialLayer is the layer and the highest mip it may use.
+uniform sampler2DArray Albedo;
 
 in vec2 TexCoords;
+flat in vec4 MaterialUVTransform;
+flat in vec2 MaterialLayer;
+#endif
 
 void main()
 {
-    FragCoord = vec4(texture(Albedo, TexCoords).rgb, 1.0);
+#ifdef HAS_TEXTURE
+    // NOTE(georgy): Wrapping with fract breaks the derivatives at the seams, so the mip is chosen from the unwrapped UVs
+    vec2 LayerSize = vec2(textureSize(Albedo, 0).xy);
+    vec2 dUVdx = dFdx(TexCoords) * MaterialUVTransform.xy * LayerSize;
+    vec2 dUVdy = dFdy(TexCoords) * MaterialUVTransform.xy * LayerSize;
+    float Lod = 0.5 * log2(max(max(dot(dUVdx, dUVdx), dot(dUVdy, dUVdy)), 1e-8));
+    Lod = clamp(Lod, 0.0, MaterialLayer.y);
+
+    vec2 UV = fract(TexCoords) * MaterialUVTransform.xy + MaterialUVTransform.zw;
+    FragCoord = vec4(textureLod(Albedo, vec3(UV, MaterialLayer.x), Lod).rgb, 1.0);
+#else
+    FragCoord = vec4(0.8, 0.8, 0.8, 1.0);
+#endif
 }
@@ -1,16 +1,47 @@
 #version 330 core
 layout (location = 0) in vec3 aP;
 layout (location = 1) in vec3 aN;
+#ifdef HAS_UV
 layout (location = 2) in vec2 aUV;
+#endif
+#ifdef HAS_TEXTURE
+layout (location = 7) in vec4 aMaterialUVTransform;
+layout (location = 8) in vec2 aMaterialLayer;
+#endif
 
-uniform mat4 Projection = mat4(1.0);
-uniform mat4 View = mat4(1.0);
+layout (std140) uniform FrameConstants
+{
+    mat4 Projection;
+    mat4 View;
+};
 uniform mat4 Model = mat4(1.0);
 
+#ifdef MORPH
+uniform sampler2D MorphDeltas;
+uniform int MorphTextureWidth = 1;
+#endif
+
+#ifdef HAS_UV
 out vec2 TexCoords;
+#endif
+#ifdef HAS_TEXTURE
+flat out vec4 MaterialUVTransform;
+flat out vec2 MaterialLayer;
+#endif
 
 void main()
 {
+    vec3 P = aP;
+#ifdef MORPH
+    P += texelFetch(MorphDeltas, ivec2(gl_VertexID % MorphTextureWidth, gl_VertexID / MorphTextureWidth), 0).xyz;
+#endif
+
+#ifdef HAS_UV
     TexCoords = aUV;
-    gl_Position = Projection * View * Model * vec4(aP, 1.0);
+#endif
+#ifdef HAS_TEXTURE
+    MaterialUVTransform = aMaterialUVTransform;
+    MaterialLayer = aMaterialLayer;
+#endif
+    gl_Position = Projection * View * Model * vec4(P, 1.0);
 }
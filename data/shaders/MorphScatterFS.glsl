@@ -0,0 +1,9 @@
+#version 330 core
+out vec4 FragCoord;
+
+in vec3 Delta;
+
+void main()
+{
+    FragCoord = vec4(Delta, 0.0);
+}
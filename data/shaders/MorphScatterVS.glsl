@@ -0,0 +1,18 @@
+#version 330 core
+layout (location = 0) in uint aVertexIndex;
+layout (location = 1) in vec3 aDelta;
+
+uniform vec2 TargetSize;
+uniform float Weight;
+
+out vec3 Delta;
+
+void main()
+{
+    // NOTE(georgy): One point per moved vertex, landing on that vertex's texel
+    int Width = int(TargetSize.x);
+    vec2 Texel = vec2(int(aVertexIndex) % Width, int(aVertexIndex) / Width) + 0.5;
+
+    Delta = Weight * aDelta;
+    gl_Position = vec4(2.0 * Texel / TargetSize - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,11 @@
+#version 330 core
+out vec4 FragCoord;
+
+in vec2 TexCoords;
+
+uniform sampler2D Frame;
+
+void main()
+{
+    FragCoord = texture(Frame, TexCoords);
+}
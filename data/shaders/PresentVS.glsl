@@ -0,0 +1,11 @@
+#version 330 core
+
+out vec2 TexCoords;
+
+void main()
+{
+    // NOTE(georgy): One triangle over the whole screen. The frame's first row is its top, so v is flipped.
+    vec2 P = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    TexCoords = vec2(P.x, 1.0 - P.y);
+    gl_Position = vec4(2.0 * P - 1.0, 0.0, 1.0);
+}